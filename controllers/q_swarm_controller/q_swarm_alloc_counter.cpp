@@ -0,0 +1,88 @@
+/*
+ * Q-Swarm Allocation Counter Implementation
+ *
+ * Replacing operator new affects the whole process (ARGoS included),
+ * so this is only compiled in with Q_SWARM_COUNT_ALLOCATIONS.
+ */
+
+#include "q_swarm_alloc_counter.h"
+
+#ifdef Q_SWARM_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+   /* Per thread: ARGoS may step controllers on several threads */
+   thread_local uint64_t s_unAllocations = 0;
+
+   void* CountedAllocate(std::size_t size) {
+      ++s_unAllocations;
+      return std::malloc(size == 0 ? 1 : size);
+   }
+
+}
+
+/****************************************/
+/****************************************/
+
+void* operator new(std::size_t size) {
+   void* ptr = CountedAllocate(size);
+   if (ptr == NULL) {
+      throw std::bad_alloc();
+   }
+   return ptr;
+}
+
+void* operator new[](std::size_t size) {
+   return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+   return CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+   return CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+   std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+   std::free(ptr);
+}
+
+#endif
+
+namespace argos {
+
+   namespace QSwarmAllocCounter {
+
+      /****************************************/
+      /****************************************/
+
+      bool IsEnabled() {
+#ifdef Q_SWARM_COUNT_ALLOCATIONS
+         return true;
+#else
+         return false;
+#endif
+      }
+
+      /****************************************/
+      /****************************************/
+
+      uint64_t GetCount() {
+#ifdef Q_SWARM_COUNT_ALLOCATIONS
+         return s_unAllocations;
+#else
+         return 0;
+#endif
+      }
+
+   }
+
+}
@@ -0,0 +1,31 @@
+#ifndef Q_SWARM_ALLOC_COUNTER_H
+#define Q_SWARM_ALLOC_COUNTER_H
+
+/*
+ * Q-Swarm Allocation Counter (debug)
+ *
+ * Built with -DQ_SWARM_COUNT_ALLOCATIONS=ON, q_swarm_alloc_counter.cpp
+ * replaces the global operator new and counts the heap allocations of
+ * each thread. QSwarmController uses it to check that ControlStep does
+ * not allocate in steady state. Without the option the count is always 0.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stdint.h>
+
+namespace argos {
+
+   namespace QSwarmAllocCounter {
+
+      /* True if the global operator new is instrumented */
+      bool IsEnabled();
+
+      /* Heap allocations made by the calling thread so far */
+      uint64_t GetCount();
+
+   }
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Q-Swarm Reconnect Backoff Implementation
+ */
+
+#include "q_swarm_backoff.h"
+
+namespace argos {
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmBackoff::CQSwarmBackoff(int n_initial_ms, int n_max_ms) :
+      m_nInitialMs(n_initial_ms),
+      m_nMaxMs(n_max_ms),
+      m_nDelayMs(n_initial_ms),
+      m_cNextAttempt(std::chrono::steady_clock::now()) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmBackoff::IsDue() const {
+      return std::chrono::steady_clock::now() >= m_cNextAttempt;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmBackoff::Failed() {
+      m_cNextAttempt = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_nDelayMs);
+      m_nDelayMs = (m_nDelayMs * 2 < m_nMaxMs) ? m_nDelayMs * 2 : m_nMaxMs;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmBackoff::Reset() {
+      m_nDelayMs = m_nInitialMs;
+      m_cNextAttempt = std::chrono::steady_clock::now();
+   }
+
+}
@@ -0,0 +1,45 @@
+#ifndef Q_SWARM_BACKOFF_H
+#define Q_SWARM_BACKOFF_H
+
+/*
+ * Q-Swarm Reconnect Backoff
+ *
+ * Schedules connection attempts without sleeping: the first retry comes
+ * after the initial delay, each failure doubles it up to the maximum, and
+ * a successful connection starts over. Callers check IsDue() from the
+ * control loop, so robots keep stepping while the server is down.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <chrono>
+
+namespace argos {
+
+   class CQSwarmBackoff {
+
+   public:
+
+      CQSwarmBackoff(int n_initial_ms = 100, int n_max_ms = 5000);
+
+      /* True when the next attempt may start */
+      bool IsDue() const;
+
+      /* An attempt failed: wait for the current delay, then double it */
+      void Failed();
+
+      /* Connected: the next attempt is due at once, with the initial delay */
+      void Reset();
+
+   private:
+
+      int m_nInitialMs;
+      int m_nMaxMs;
+      int m_nDelayMs;
+      std::chrono::steady_clock::time_point m_cNextAttempt;
+
+   };
+
+}
+
+#endif
@@ -0,0 +1,897 @@
+/*
+ * Q-Swarm Microbenchmarks
+ *
+ * Times the hot path of a control step piece by piece, with synthetic
+ * inputs and without ARGoS or a Q-Network server:
+ *    protocol/...   text and binary (and compact) encoding of a STEP, and
+ *                   the parsing of both on the receiving side
+ *    state/...      sensor snapshot processing (SIMD and scalar), and
+ *                   GetState + reward on synthetic readings (the same
+ *                   QSwarmSensors calls as QSwarmController)
+ *    socket/...     STEP round trip of CQSwarmSocketTransport (text,
+ *                   binary, compact) against an echo server thread on
+ *                   the loopback interface
+ *    mlp/...        CQSwarmPolicy::SelectActions for every kernel this CPU
+ *                   supports, float32 and int8 weights, batches of 1 to
+ *                   --max-batch states (layers of python/q_network.py)
+ *
+ * Usage:
+ *    q_swarm_bench [--filter TEXT] [--min-time 0.2] [--repetitions 5]
+ *       [--max-batch 1024] [--json FILE] [--csv FILE]
+ *       [--compare BASELINE.csv] [--max-regression 10] [--list]
+ *
+ * Each benchmark runs enough iterations to last --min-time seconds, then
+ * that many iterations --repetitions times; the median, fastest and
+ * slowest time per operation are reported (an operation is one message,
+ * one step, one round trip or one batch; items are states).
+ *
+ * --csv writes one row per benchmark:
+ *    name,iterations,repetitions,ns_per_op,ns_min,ns_max,items_per_op,items_per_s
+ * and --json the same fields with the build and CPU context. --compare
+ * reads an earlier --csv file and exits with status 2 if a benchmark's
+ * median got slower by more than --max-regression percent, so that a CI
+ * job or a sweep script can refuse a slower build.
+ */
+
+#include "q_swarm_protocol.h"
+#include "q_swarm_sensors.h"
+#include "q_swarm_policy.h"
+#include "q_swarm_random.h"
+#include "q_swarm_latency.h"
+#include "q_swarm_socket_transport.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace argos;
+
+namespace {
+
+   struct SOptions {
+      std::string Filter;
+      double MinTime;
+      int Repetitions;
+      size_t MaxBatch;
+      std::string Json;
+      std::string Csv;
+      std::string Compare;
+      double MaxRegression;
+      bool List;
+
+      SOptions() :
+         MinTime(0.2),
+         Repetitions(5),
+         MaxBatch(1024),
+         MaxRegression(10.0),
+         List(false) {
+      }
+   };
+
+   struct SResult {
+      std::string Name;
+      uint64_t Iterations;
+      int Repetitions;
+      double NsPerOp;                      /* median of the repetitions */
+      double NsMin;
+      double NsMax;
+      size_t ItemsPerOp;
+   };
+
+   /* Runs un_iterations operations */
+   typedef std::function<void(uint64_t un_iterations)> TBody;
+
+   /* Results the compiler must not drop */
+   volatile uint64_t g_unSink = 0;
+
+   /* Layers of python/q_network.py (DQN) */
+   const size_t HIDDEN_SIZE = 128;
+   const size_t HIDDEN_LAYERS = 3;
+   const size_t ACTIONS = 4;
+
+   /* Synthetic inputs, cycled through so that no call sees the same data twice in a row */
+   const size_t SAMPLES = 256;
+
+   const int CONNECT_TIMEOUT_MS = 5000;
+
+   /****************************************/
+   /****************************************/
+
+   void PrintUsage() {
+      fprintf(stderr,
+              "Usage: q_swarm_bench [--filter TEXT] [--min-time 0.2] [--repetitions 5]\n"
+              "          [--max-batch 1024] [--json FILE] [--csv FILE]\n"
+              "          [--compare BASELINE.csv] [--max-regression 10] [--list]\n");
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool ParseOptions(int argc, char** argv, SOptions& s_options) {
+      for (int i = 1; i < argc; ++i) {
+         std::string strArg = argv[i];
+         bool bValue = (i + 1 < argc);
+         if (strArg == "--filter" && bValue) {
+            s_options.Filter = argv[++i];
+         }
+         else if (strArg == "--min-time" && bValue) {
+            s_options.MinTime = atof(argv[++i]);
+         }
+         else if (strArg == "--repetitions" && bValue) {
+            s_options.Repetitions = atoi(argv[++i]);
+         }
+         else if (strArg == "--max-batch" && bValue) {
+            s_options.MaxBatch = strtoul(argv[++i], NULL, 10);
+         }
+         else if (strArg == "--json" && bValue) {
+            s_options.Json = argv[++i];
+         }
+         else if (strArg == "--csv" && bValue) {
+            s_options.Csv = argv[++i];
+         }
+         else if (strArg == "--compare" && bValue) {
+            s_options.Compare = argv[++i];
+         }
+         else if (strArg == "--max-regression" && bValue) {
+            s_options.MaxRegression = atof(argv[++i]);
+         }
+         else if (strArg == "--list") {
+            s_options.List = true;
+         }
+         else {
+            return false;
+         }
+      }
+      return s_options.MinTime > 0.0 && s_options.Repetitions > 0 && s_options.MaxBatch > 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /*
+    * Registered benchmarks, run in registration order
+    */
+   class CBenchmarks {
+
+   public:
+
+      explicit CBenchmarks(const SOptions& s_options) : m_sOptions(s_options) {}
+
+      /* Set up by the caller, so that only the timed part is in c_body */
+      void Add(const std::string& str_name, size_t un_items_per_op, const TBody& c_body) {
+         if (!m_sOptions.Filter.empty() && str_name.find(m_sOptions.Filter) == std::string::npos) {
+            return;
+         }
+         if (m_sOptions.List) {
+            printf("%s\n", str_name.c_str());
+            return;
+         }
+         SResult sResult;
+         sResult.Name = str_name;
+         sResult.ItemsPerOp = un_items_per_op;
+         Run(c_body, sResult);
+         printf("%-40s %12.1f ns/op %12.1f min %14.0f items/s\n", sResult.Name.c_str(),
+                sResult.NsPerOp, sResult.NsMin, ItemsPerSecond(sResult));
+         fflush(stdout);
+         m_vecResults.push_back(sResult);
+      }
+
+      bool Wants(const std::string& str_prefix) const {
+         return m_sOptions.Filter.empty() || m_sOptions.List ||
+            str_prefix.find(m_sOptions.Filter) != std::string::npos ||
+            m_sOptions.Filter.find(str_prefix) == 0;
+      }
+
+      const std::vector<SResult>& GetResults() const {
+         return m_vecResults;
+      }
+
+      static double ItemsPerSecond(const SResult& s_result) {
+         return s_result.NsPerOp > 0.0 ? s_result.ItemsPerOp * 1e9 / s_result.NsPerOp : 0.0;
+      }
+
+   private:
+
+      void Run(const TBody& c_body, SResult& s_result) {
+         // Warm up, then grow the iterations until one run lasts MinTime
+         c_body(1);
+         uint64_t unIterations = 1;
+         uint64_t unMinNs = static_cast<uint64_t>(m_sOptions.MinTime * 1e9);
+         while (true) {
+            uint64_t unTime = Time(c_body, unIterations);
+            if (unTime >= unMinNs || unIterations >= (1ULL << 40)) {
+               break;
+            }
+            // Aim a bit past the target to finish in one or two more runs
+            double fScale = unTime > 0 ? 1.4 * unMinNs / unTime : 10.0;
+            unIterations = std::max<uint64_t>(unIterations + 1,
+               static_cast<uint64_t>(unIterations * std::min(fScale, 10.0)));
+         }
+
+         std::vector<double> vecNs(m_sOptions.Repetitions);
+         for (int i = 0; i < m_sOptions.Repetitions; ++i) {
+            vecNs[i] = static_cast<double>(Time(c_body, unIterations)) / unIterations;
+         }
+         std::sort(vecNs.begin(), vecNs.end());
+         s_result.Iterations = unIterations;
+         s_result.Repetitions = m_sOptions.Repetitions;
+         s_result.NsPerOp = vecNs[vecNs.size() / 2];
+         s_result.NsMin = vecNs.front();
+         s_result.NsMax = vecNs.back();
+      }
+
+      static uint64_t Time(const TBody& c_body, uint64_t un_iterations) {
+         uint64_t unStart = CQSwarmLatencyStats::Now();
+         c_body(un_iterations);
+         return CQSwarmLatencyStats::Now() - unStart;
+      }
+
+      const SOptions& m_sOptions;
+      std::vector<SResult> m_vecResults;
+
+   };
+
+   /****************************************/
+   /****************************************/
+
+   /* SAMPLES states that look like a robot's: arena coordinates, readings in [0, 1] */
+   std::vector<float> MakeStates(CQSwarmRandom& c_random, size_t un_count) {
+      std::vector<float> vecStates(un_count * QSwarmProtocol::STATE_SIZE);
+      for (size_t i = 0; i < un_count; ++i) {
+         float* pfState = &vecStates[i * QSwarmProtocol::STATE_SIZE];
+         for (size_t j = 0; j < 4; ++j) {
+            pfState[j] = 20.0f * c_random.Uniform();
+         }
+         for (size_t j = 4; j < QSwarmProtocol::STATE_SIZE; ++j) {
+            // Mostly nothing in range, as in open space
+            pfState[j] = c_random.Uniform() < 0.7f ? 0.0f : c_random.Uniform();
+         }
+      }
+      return vecStates;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /*
+    * Receiving side of the text STEP: split at '|' and convert every field,
+    * as the server does
+    */
+   size_t ParseTextStep(const char* buf, size_t length, float* values, size_t un_max) {
+      const char* p = static_cast<const char*>(memchr(buf, '|', length));
+      const char* pEnd = buf + length;
+      size_t unValues = 0;
+      while (p != NULL && p < pEnd && unValues < un_max) {
+         char* pNext = NULL;
+         values[unValues++] = strtof(p + 1, &pNext);
+         p = static_cast<const char*>(memchr(pNext, '|', pEnd - pNext));
+      }
+      return unValues;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void AddProtocol(CBenchmarks& c_benchmarks) {
+      CQSwarmRandom cRandom;
+      cRandom.Seed(1, 0);
+      std::vector<float> vecStates = MakeStates(cRandom, SAMPLES);
+      const float* pfStates = &vecStates[0];
+      const size_t unStateSize = QSwarmProtocol::STATE_SIZE;
+
+      c_benchmarks.Add("protocol/encode_text", 1, [pfStates, unStateSize](uint64_t un_iterations) {
+         char buf[4096];
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            unSum += QSwarmProtocol::EncodeTextStep(buf, sizeof(buf), 7,
+                                                    pfStates + (i % SAMPLES) * unStateSize,
+                                                    -0.1f, QSwarmProtocol::STEP_HAS_PREV, true);
+         }
+         g_unSink += unSum;
+      });
+
+      c_benchmarks.Add("protocol/encode_binary", 1, [pfStates, unStateSize](uint64_t un_iterations) {
+         uint8_t frame[QSwarmProtocol::STEP_FRAME_SIZE];
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            unSum += QSwarmProtocol::EncodeStep(frame, 7, pfStates + (i % SAMPLES) * unStateSize,
+                                                -0.1f, QSwarmProtocol::STEP_HAS_PREV);
+            unSum += frame[QSwarmProtocol::HEADER_SIZE];
+         }
+         g_unSink += unSum;
+      });
+
+      c_benchmarks.Add("protocol/encode_compact", 1, [pfStates, unStateSize](uint64_t un_iterations) {
+         uint8_t frame[QSwarmProtocol::STEP_FRAME_SIZE];
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            unSum += QSwarmProtocol::EncodeCompactStep(frame, 7, pfStates + (i % SAMPLES) * unStateSize,
+                                                       -0.1f, QSwarmProtocol::STEP_HAS_PREV);
+            unSum += frame[QSwarmProtocol::HEADER_SIZE];
+         }
+         g_unSink += unSum;
+      });
+
+      // Messages to parse, encoded once
+      std::vector<std::string> vecText(SAMPLES);
+      std::vector<uint8_t> vecFrames(SAMPLES * QSwarmProtocol::STEP_FRAME_SIZE);
+      for (size_t i = 0; i < SAMPLES; ++i) {
+         char buf[4096];
+         size_t unLength = QSwarmProtocol::EncodeTextStep(buf, sizeof(buf), 7, pfStates + i * unStateSize,
+                                                          -0.1f, QSwarmProtocol::STEP_HAS_PREV, true);
+         vecText[i].assign(buf, unLength);
+         QSwarmProtocol::EncodeStep(&vecFrames[i * QSwarmProtocol::STEP_FRAME_SIZE], 7,
+                                    pfStates + i * unStateSize, -0.1f, QSwarmProtocol::STEP_HAS_PREV);
+      }
+      const std::vector<std::string>* pvecText = &vecText;
+      const uint8_t* pFrames = &vecFrames[0];
+
+      c_benchmarks.Add("protocol/parse_text", 1, [pvecText](uint64_t un_iterations) {
+         float values[QSwarmProtocol::STATE_SIZE + 4];
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            const std::string& strMessage = (*pvecText)[i % SAMPLES];
+            unSum += ParseTextStep(strMessage.data(), strMessage.size(), values,
+                                   QSwarmProtocol::STATE_SIZE + 4);
+            unSum += static_cast<uint64_t>(values[4]);
+         }
+         g_unSink += unSum;
+      });
+
+      c_benchmarks.Add("protocol/parse_binary", 1, [pFrames](uint64_t un_iterations) {
+         float values[QSwarmProtocol::STATE_SIZE + 1];
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            const uint8_t* pFrame = pFrames + (i % SAMPLES) * QSwarmProtocol::STEP_FRAME_SIZE;
+            QSwarmProtocol::SFrameHeader sHeader;
+            if (!QSwarmProtocol::DecodeHeader(pFrame, sHeader)) {
+               continue;
+            }
+            const uint8_t* pPayload = pFrame + QSwarmProtocol::HEADER_SIZE;
+            for (size_t j = 0; j < QSwarmProtocol::STATE_SIZE; ++j) {
+               values[j] = QSwarmProtocol::ReadFloat(pPayload + 4 * j);
+            }
+            values[QSwarmProtocol::STATE_SIZE] = QSwarmProtocol::ReadFloat(pPayload + QSwarmProtocol::STATE_PAYLOAD_SIZE);
+            unSum += sHeader.PayloadSize + static_cast<uint64_t>(values[4]);
+         }
+         g_unSink += unSum;
+      });
+
+      c_benchmarks.Add("protocol/parse_text_action", 1, [](uint64_t un_iterations) {
+         static const char* REPLIES[4] = { "ACTION|0", "ACTION|1", "ACTION|2", "ACTION|3" };
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            unSum += QSwarmProtocol::ParseTextAction(REPLIES[i & 3], 8);
+         }
+         g_unSink += unSum;
+      });
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void AddState(CBenchmarks& c_benchmarks) {
+      // Synthetic readings: mostly open space, some obstacles, a few touching
+      CQSwarmRandom cRandom;
+      cRandom.Seed(2, 0);
+      std::vector<QSwarmSensors::SSnapshot> vecSnapshots(SAMPLES);
+      for (size_t i = 0; i < SAMPLES; ++i) {
+         QSwarmSensors::SSnapshot& sSnapshot = vecSnapshots[i];
+         QSwarmSensors::Clear(sSnapshot);
+         float fLevel = cRandom.Uniform() < 0.6f ? 0.0f : (cRandom.Uniform() < 0.9f ? 0.7f : 1.0f);
+         for (size_t j = 0; j < QSwarmSensors::READINGS; ++j) {
+            sSnapshot.Proximity[j] = fLevel * cRandom.Uniform();
+         }
+         sSnapshot.X = 20.0f * cRandom.Uniform();
+         sSnapshot.Y = 20.0f * cRandom.Uniform();
+      }
+      QSwarmSensors::SSnapshot* psSnapshots = &vecSnapshots[0];
+
+      c_benchmarks.Add("state/snapshot_simd", 1, [psSnapshots](uint64_t un_iterations) {
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            QSwarmSensors::SSnapshot& sSnapshot = psSnapshots[i % SAMPLES];
+            QSwarmSensors::Process(sSnapshot);
+            unSum += sSnapshot.CloseMask;
+         }
+         g_unSink += unSum;
+      });
+
+      c_benchmarks.Add("state/snapshot_scalar", 1, [psSnapshots](uint64_t un_iterations) {
+         uint64_t unSum = 0;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            QSwarmSensors::SSnapshot& sSnapshot = psSnapshots[i % SAMPLES];
+            QSwarmSensors::ProcessScalar(sSnapshot);
+            unSum += sSnapshot.CloseMask;
+         }
+         g_unSink += unSum;
+      });
+
+      // What ControlStep does between reading the sensors and asking for
+      // an action, then after the action (rewards of CalculateReward)
+      c_benchmarks.Add("state/get_state_reward", 1, [psSnapshots](uint64_t un_iterations) {
+         float state[QSwarmProtocol::STATE_SIZE] = { 0.0f };
+         float fPreviousX = 0.0f;
+         float fPreviousY = 0.0f;
+         float fRewards = 0.0f;
+         for (uint64_t i = 0; i < un_iterations; ++i) {
+            QSwarmSensors::SSnapshot& sSnapshot = psSnapshots[i % SAMPLES];
+            QSwarmSensors::Process(sSnapshot);
+            QSwarmSensors::FillState(sSnapshot, 0.0f, 0.0f, 18.0f, 18.0f, state);
+            float fReward = -0.1f;
+            if (QSwarmSensors::IsAtGoal(sSnapshot, 18.0f, 18.0f, 0.5f)) {
+               fReward = 10.0f;
+            }
+            else if (QSwarmSensors::IsColliding(sSnapshot, fPreviousX, fPreviousY, 0.01f)) {
+               fReward = -5.0f;
+            }
+            fPreviousX = sSnapshot.X;
+            fPreviousY = sSnapshot.Y;
+            fRewards += fReward + state[4];
+         }
+         g_unSink += static_cast<uint64_t>(fRewards);
+      });
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /*
+    * Echo server on 127.0.0.1: answers every text line with "ACTION|1"
+    * and every binary frame with one action byte (ACK for REWARD)
+    */
+   class CEchoServer {
+
+   public:
+
+      CEchoServer() : m_nListen(-1), m_nPort(0), m_bStop(false) {}
+
+      ~CEchoServer() {
+         Stop();
+      }
+
+      bool Start(std::string& str_error) {
+         m_nListen = socket(AF_INET, SOCK_STREAM, 0);
+         if (m_nListen < 0) {
+            str_error = "socket() failed";
+            return false;
+         }
+         int nYes = 1;
+         setsockopt(m_nListen, SOL_SOCKET, SO_REUSEADDR, &nYes, sizeof(nYes));
+         sockaddr_in sAddress;
+         memset(&sAddress, 0, sizeof(sAddress));
+         sAddress.sin_family = AF_INET;
+         sAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+         sAddress.sin_port = 0;
+         socklen_t unLength = sizeof(sAddress);
+         if (bind(m_nListen, reinterpret_cast<sockaddr*>(&sAddress), sizeof(sAddress)) != 0 ||
+             listen(m_nListen, 4) != 0 ||
+             getsockname(m_nListen, reinterpret_cast<sockaddr*>(&sAddress), &unLength) != 0) {
+            str_error = "cannot listen on 127.0.0.1";
+            close(m_nListen);
+            m_nListen = -1;
+            return false;
+         }
+         m_nPort = ntohs(sAddress.sin_port);
+         m_cThread = std::thread(&CEchoServer::Run, this);
+         return true;
+      }
+
+      void Stop() {
+         if (!m_cThread.joinable()) {
+            return;
+         }
+         m_bStop = true;
+         shutdown(m_nListen, SHUT_RDWR);
+         close(m_nListen);
+         m_cThread.join();
+      }
+
+      int GetPort() const {
+         return m_nPort;
+      }
+
+   private:
+
+      /* One client at a time, until it disconnects */
+      void Run() {
+         while (!m_bStop) {
+            int nClient = accept(m_nListen, NULL, NULL);
+            if (nClient < 0) {
+               return;
+            }
+            int nYes = 1;
+            setsockopt(nClient, IPPROTO_TCP, TCP_NODELAY, &nYes, sizeof(nYes));
+            Serve(nClient);
+            close(nClient);
+         }
+      }
+
+      void Serve(int n_client) {
+         std::vector<uint8_t> vecBuffer;
+         uint8_t chunk[8192];
+         while (true) {
+            ssize_t nReceived = recv(n_client, chunk, sizeof(chunk), 0);
+            if (nReceived <= 0) {
+               return;
+            }
+            vecBuffer.insert(vecBuffer.end(), chunk, chunk + nReceived);
+            size_t unUsed = 0;
+            while (unUsed < vecBuffer.size()) {
+               const uint8_t* pData = &vecBuffer[unUsed];
+               size_t unLeft = vecBuffer.size() - unUsed;
+               if (pData[0] == QSwarmProtocol::MAGIC_0) {
+                  QSwarmProtocol::SFrameHeader sHeader;
+                  if (unLeft < QSwarmProtocol::HEADER_SIZE) {
+                     break;
+                  }
+                  if (!QSwarmProtocol::DecodeHeader(pData, sHeader)) {
+                     return;
+                  }
+                  size_t unFrame = QSwarmProtocol::HEADER_SIZE + sHeader.PayloadSize;
+                  if (unLeft < unFrame) {
+                     break;
+                  }
+                  uint8_t reply = 1;
+                  if (send(n_client, &reply, 1, 0) != 1) {
+                     return;
+                  }
+                  unUsed += unFrame;
+               }
+               else {
+                  const uint8_t* pNewline = static_cast<const uint8_t*>(memchr(pData, '\n', unLeft));
+                  if (pNewline == NULL) {
+                     break;
+                  }
+                  static const char REPLY[] = "ACTION|1\n";
+                  if (send(n_client, REPLY, sizeof(REPLY) - 1, 0) != static_cast<ssize_t>(sizeof(REPLY) - 1)) {
+                     return;
+                  }
+                  unUsed += (pNewline - pData) + 1;
+               }
+            }
+            vecBuffer.erase(vecBuffer.begin(), vecBuffer.begin() + unUsed);
+         }
+      }
+
+      int m_nListen;
+      int m_nPort;
+      volatile bool m_bStop;
+      std::thread m_cThread;
+
+   };
+
+   /****************************************/
+   /****************************************/
+
+   bool WaitConnected(CQSwarmTransport& c_transport) {
+      if (!c_transport.Connect()) {
+         return false;
+      }
+      std::chrono::steady_clock::time_point cDeadline =
+         std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+      while (!c_transport.Maintain()) {
+         if (!c_transport.GetFatalError().empty() || std::chrono::steady_clock::now() > cDeadline) {
+            return false;
+         }
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void AddSocket(CBenchmarks& c_benchmarks) {
+      CEchoServer cServer;
+      std::string strError;
+      if (!cServer.Start(strError)) {
+         fprintf(stderr, "socket benchmarks skipped: %s\n", strError.c_str());
+         return;
+      }
+      CQSwarmRandom cRandom;
+      cRandom.Seed(3, 0);
+      std::vector<float> vecStates = MakeStates(cRandom, SAMPLES);
+
+      static const char* MODES[] = { "text", "binary", "compact" };
+      for (size_t m = 0; m < 3; ++m) {
+         std::string strMode = MODES[m];
+         if (!c_benchmarks.Wants("socket/" + strMode)) {
+            continue;
+         }
+         CQSwarmSocketTransport cTransport("127.0.0.1", cServer.GetPort(), strMode != "text", true,
+                                           strMode == "compact");
+         if (!WaitConnected(cTransport)) {
+            fprintf(stderr, "socket/%s skipped: no connection to the echo server\n", strMode.c_str());
+            continue;
+         }
+         CQSwarmSocketTransport* pcTransport = &cTransport;
+         const float* pfStates = &vecStates[0];
+         c_benchmarks.Add("socket/" + strMode + "_round_trip", 1, [pcTransport, pfStates](uint64_t un_iterations) {
+            uint64_t unSum = 0;
+            for (uint64_t i = 0; i < un_iterations; ++i) {
+               int action = 0;
+               if (pcTransport->RequestAction(7, pfStates + (i % SAMPLES) * QSwarmProtocol::STATE_SIZE,
+                                              -0.1f, QSwarmProtocol::STEP_HAS_PREV, action)) {
+                  unSum += action;
+               }
+            }
+            g_unSink += unSum;
+         });
+         cTransport.Close();
+      }
+      cServer.Stop();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void WriteUInt32(std::ofstream& c_file, uint32_t un_value) {
+      uint8_t buf[4];
+      QSwarmProtocol::WriteUInt32(buf, un_value);
+      c_file.write(reinterpret_cast<const char*>(buf), 4);
+   }
+
+   void WriteFloats(std::ofstream& c_file, const std::vector<float>& vec_values) {
+      for (size_t i = 0; i < vec_values.size(); ++i) {
+         uint8_t buf[4];
+         QSwarmProtocol::WriteFloat(buf, vec_values[i]);
+         c_file.write(reinterpret_cast<const char*>(buf), 4);
+      }
+   }
+
+   /*
+    * Random weights with the layers of the DQN, in the export_policy.py
+    * format: version 1 (float32) or 2 (int8, one scale per output)
+    */
+   bool WritePolicy(const std::string& str_path, bool b_int8) {
+      std::ofstream cFile(str_path.c_str(), std::ios::binary | std::ios::trunc);
+      if (!cFile) {
+         return false;
+      }
+      std::vector<size_t> vecWidths;
+      vecWidths.push_back(QSwarmProtocol::STATE_SIZE);
+      for (size_t i = 0; i < HIDDEN_LAYERS; ++i) {
+         vecWidths.push_back(HIDDEN_SIZE);
+      }
+      vecWidths.push_back(ACTIONS);
+
+      CQSwarmRandom cRandom;
+      cRandom.Seed(4, 0);
+      cFile.write("QSNN", 4);
+      WriteUInt32(cFile, b_int8 ? 2 : 1);
+      WriteUInt32(cFile, static_cast<uint32_t>(vecWidths.size() - 1));
+      for (size_t l = 0; l + 1 < vecWidths.size(); ++l) {
+         size_t unInputs = vecWidths[l];
+         size_t unOutputs = vecWidths[l + 1];
+         WriteUInt32(cFile, static_cast<uint32_t>(unInputs));
+         WriteUInt32(cFile, static_cast<uint32_t>(unOutputs));
+         float fRange = 1.0f / std::sqrt(static_cast<float>(unInputs));
+         std::vector<float> vecBiases(unOutputs);
+         for (size_t j = 0; j < unOutputs; ++j) {
+            vecBiases[j] = fRange * (2.0f * cRandom.Uniform() - 1.0f);
+         }
+         if (b_int8) {
+            std::vector<float> vecScales(unOutputs, fRange / 127.0f);
+            WriteFloats(cFile, vecScales);
+            std::vector<char> vecWeights(unOutputs * unInputs);
+            for (size_t k = 0; k < vecWeights.size(); ++k) {
+               vecWeights[k] = static_cast<char>(static_cast<int>(cRandom.Below(255)) - 127);
+            }
+            cFile.write(&vecWeights[0], vecWeights.size());
+         }
+         else {
+            std::vector<float> vecWeights(unOutputs * unInputs);
+            for (size_t k = 0; k < vecWeights.size(); ++k) {
+               vecWeights[k] = fRange * (2.0f * cRandom.Uniform() - 1.0f);
+            }
+            WriteFloats(cFile, vecWeights);
+         }
+         WriteFloats(cFile, vecBiases);
+      }
+      return static_cast<bool>(cFile);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void AddMlp(CBenchmarks& c_benchmarks, const SOptions& s_options) {
+      if (!c_benchmarks.Wants("mlp/")) {
+         return;
+      }
+      char szDirectory[] = "/tmp/q_swarm_bench.XXXXXX";
+      if (mkdtemp(szDirectory) == NULL) {
+         fprintf(stderr, "mlp benchmarks skipped: no temporary directory\n");
+         return;
+      }
+      std::string strDirectory = szDirectory;
+
+      CQSwarmRandom cRandom;
+      cRandom.Seed(5, 0);
+      std::vector<float> vecStates = MakeStates(cRandom, s_options.MaxBatch);
+      std::vector<int> vecActions(s_options.MaxBatch);
+
+      static const char* KERNELS[] = { "scalar", "sse", "avx2", "neon" };
+      for (int nInt8 = 0; nInt8 < 2; ++nInt8) {
+         std::string strWeights = nInt8 ? "int8" : "float";
+         std::string strPath = strDirectory + "/policy_" + strWeights + ".bin";
+         CQSwarmPolicy cPolicy;
+         std::string strError;
+         if (!WritePolicy(strPath, nInt8 != 0) || !cPolicy.Load(strPath, strError)) {
+            fprintf(stderr, "mlp/%s skipped: %s\n", strWeights.c_str(), strError.c_str());
+            remove(strPath.c_str());
+            continue;
+         }
+         for (size_t k = 0; k < 4; ++k) {
+            if (QSwarmKernels::FindKernel(KERNELS[k]) == NULL || !cPolicy.SetKernel(KERNELS[k])) {
+               continue;
+            }
+            for (size_t unBatch = 1; unBatch <= s_options.MaxBatch; unBatch *= 2) {
+               std::ostringstream cName;
+               cName << "mlp/" << KERNELS[k] << "/" << strWeights << "/batch_" << unBatch;
+               const CQSwarmPolicy* pcPolicy = &cPolicy;
+               const float* pfStates = &vecStates[0];
+               int* pnActions = &vecActions[0];
+               c_benchmarks.Add(cName.str(), unBatch, [pcPolicy, pfStates, pnActions, unBatch](uint64_t un_iterations) {
+                  uint64_t unSum = 0;
+                  for (uint64_t i = 0; i < un_iterations; ++i) {
+                     pcPolicy->SelectActions(pfStates, unBatch, pnActions);
+                     unSum += pnActions[i % unBatch];
+                  }
+                  g_unSink += unSum;
+               });
+            }
+         }
+         remove(strPath.c_str());
+      }
+      rmdir(strDirectory.c_str());
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool WriteCsv(const std::string& str_path, const std::vector<SResult>& vec_results) {
+      std::ofstream cFile(str_path.c_str(), std::ios::trunc);
+      if (!cFile) {
+         return false;
+      }
+      cFile << "name,iterations,repetitions,ns_per_op,ns_min,ns_max,items_per_op,items_per_s\n";
+      for (size_t i = 0; i < vec_results.size(); ++i) {
+         const SResult& sResult = vec_results[i];
+         cFile << sResult.Name << "," << sResult.Iterations << "," << sResult.Repetitions << ","
+               << sResult.NsPerOp << "," << sResult.NsMin << "," << sResult.NsMax << ","
+               << sResult.ItemsPerOp << "," << CBenchmarks::ItemsPerSecond(sResult) << "\n";
+      }
+      return static_cast<bool>(cFile);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool WriteJson(const std::string& str_path, const std::vector<SResult>& vec_results) {
+      std::ofstream cFile(str_path.c_str(), std::ios::trunc);
+      if (!cFile) {
+         return false;
+      }
+      const QSwarmKernels::SKernel* psAuto = QSwarmKernels::FindKernel("auto");
+      cFile << "{\n  \"context\": {\"state_size\": " << QSwarmProtocol::STATE_SIZE
+            << ", \"proximity_size\": " << QSwarmProtocol::PROXIMITY_SIZE
+            << ", \"neighbours\": " << QSwarmProtocol::NEIGHBOURS
+            << ", \"auto_kernel\": \"" << (psAuto != NULL ? psAuto->Name : "none") << "\""
+            << ", \"threads\": " << std::thread::hardware_concurrency() << "},\n"
+            << "  \"benchmarks\": [";
+      for (size_t i = 0; i < vec_results.size(); ++i) {
+         const SResult& sResult = vec_results[i];
+         cFile << (i > 0 ? "," : "") << "\n    {\"name\": \"" << sResult.Name << "\""
+               << ", \"iterations\": " << sResult.Iterations
+               << ", \"repetitions\": " << sResult.Repetitions
+               << ", \"ns_per_op\": " << sResult.NsPerOp
+               << ", \"ns_min\": " << sResult.NsMin
+               << ", \"ns_max\": " << sResult.NsMax
+               << ", \"items_per_op\": " << sResult.ItemsPerOp
+               << ", \"items_per_s\": " << CBenchmarks::ItemsPerSecond(sResult) << "}";
+      }
+      cFile << "\n  ]\n}\n";
+      return static_cast<bool>(cFile);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /*
+    * Compare with a --csv file of an earlier run
+    * Returns the number of regressions, or -1 if the file cannot be read
+    */
+   int Compare(const std::string& str_path, const std::vector<SResult>& vec_results, double f_max_regression) {
+      std::ifstream cFile(str_path.c_str());
+      if (!cFile) {
+         return -1;
+      }
+      std::map<std::string, double> mapBaseline;
+      std::string strLine;
+      std::getline(cFile, strLine);
+      while (std::getline(cFile, strLine)) {
+         std::istringstream cLine(strLine);
+         std::string strName, strIterations, strRepetitions, strNs;
+         if (std::getline(cLine, strName, ',') && std::getline(cLine, strIterations, ',') &&
+             std::getline(cLine, strRepetitions, ',') && std::getline(cLine, strNs, ',')) {
+            mapBaseline[strName] = atof(strNs.c_str());
+         }
+      }
+
+      int nRegressions = 0;
+      for (size_t i = 0; i < vec_results.size(); ++i) {
+         std::map<std::string, double>::const_iterator it = mapBaseline.find(vec_results[i].Name);
+         if (it == mapBaseline.end() || it->second <= 0.0) {
+            continue;
+         }
+         double fChange = 100.0 * (vec_results[i].NsPerOp - it->second) / it->second;
+         if (fChange > f_max_regression) {
+            printf("REGRESSION %-40s %10.1f -> %10.1f ns/op (%+.1f%%)\n", vec_results[i].Name.c_str(),
+                   it->second, vec_results[i].NsPerOp, fChange);
+            ++nRegressions;
+         }
+      }
+      return nRegressions;
+   }
+
+}
+
+/****************************************/
+/****************************************/
+
+int main(int argc, char** argv) {
+   SOptions sOptions;
+   if (!ParseOptions(argc, argv, sOptions)) {
+      PrintUsage();
+      return 1;
+   }
+
+   CBenchmarks cBenchmarks(sOptions);
+   AddProtocol(cBenchmarks);
+   AddState(cBenchmarks);
+   AddSocket(cBenchmarks);
+   AddMlp(cBenchmarks, sOptions);
+   if (sOptions.List) {
+      return 0;
+   }
+
+   const std::vector<SResult>& vecResults = cBenchmarks.GetResults();
+   if (!sOptions.Csv.empty() && !WriteCsv(sOptions.Csv, vecResults)) {
+      fprintf(stderr, "Cannot write %s\n", sOptions.Csv.c_str());
+      return 1;
+   }
+   if (!sOptions.Json.empty() && !WriteJson(sOptions.Json, vecResults)) {
+      fprintf(stderr, "Cannot write %s\n", sOptions.Json.c_str());
+      return 1;
+   }
+   if (!sOptions.Compare.empty()) {
+      int nRegressions = Compare(sOptions.Compare, vecResults, sOptions.MaxRegression);
+      if (nRegressions < 0) {
+         fprintf(stderr, "Cannot read %s\n", sOptions.Compare.c_str());
+         return 1;
+      }
+      printf("%d regressions over %.1f%% against %s\n", nRegressions, sOptions.MaxRegression,
+             sOptions.Compare.c_str());
+      if (nRegressions > 0) {
+         return 2;
+      }
+   }
+   return 0;
+}
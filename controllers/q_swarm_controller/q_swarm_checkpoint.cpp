@@ -0,0 +1,302 @@
+/*
+ * Q-Swarm Controller Checkpoints Implementation
+ */
+
+#include "q_swarm_checkpoint.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#ifndef _WIN32
+   #include <unistd.h>
+#endif
+
+namespace argos {
+
+   static_assert(sizeof(QSwarmCheckpoint::SHeader) == QSwarmCheckpoint::HEADER_SIZE,
+                 "checkpoint header layout");
+   static_assert(QSwarmCheckpoint::RECORD_SIZE == 64,
+                 "checkpoint records must not be padded");
+
+   /****************************************/
+   /****************************************/
+
+   bool QSwarmCheckpoint::Read(const std::string& str_path,
+                               std::vector<SRecord>& vec_records,
+                               std::string& str_error) {
+      vec_records.clear();
+      FILE* pFile = fopen(str_path.c_str(), "rb");
+      if (pFile == NULL) {
+         str_error = "cannot open " + str_path;
+         return false;
+      }
+      SHeader sHeader;
+      if (fread(&sHeader, sizeof(sHeader), 1, pFile) != 1 ||
+          sHeader.Magic != MAGIC || sHeader.Version != VERSION ||
+          sHeader.RecordSize != RECORD_SIZE) {
+         str_error = str_path + " is not a checkpoint";
+         fclose(pFile);
+         return false;
+      }
+      vec_records.resize(sHeader.Count);
+      size_t unRead = sHeader.Count == 0 ? 0 :
+         fread(&vec_records[0], RECORD_SIZE, sHeader.Count, pFile);
+      fclose(pFile);
+      if (unRead != sHeader.Count) {
+         str_error = str_path + " is truncated";
+         vec_records.clear();
+         return false;
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmCheckpointWriter& CQSwarmCheckpointWriter::GetInstance() {
+      static CQSwarmCheckpointWriter cInstance;
+      return cInstance;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmCheckpointWriter::CQSwarmCheckpointWriter() :
+      m_unIntervalMs(0),
+      m_unUsers(0),
+      m_bStop(false),
+      m_nLoaded(0),
+      m_bDirty(false),
+      m_unWrites(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmCheckpointWriter::~CQSwarmCheckpointWriter() {
+      // Robots that were never destroyed (the process is exiting)
+      if (m_cThread.joinable()) {
+         {
+            std::lock_guard<std::mutex> cLock(m_cMutex);
+            m_bStop = true;
+         }
+         m_cWakeUp.notify_one();
+         m_cThread.join();
+         Flush();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmCheckpointWriter::Register(const std::string& str_path,
+                                          uint64_t un_interval_ms,
+                                          uint32_t un_robot_id,
+                                          std::string& str_error) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      if (m_unUsers > 0 && str_path != m_strPath) {
+         str_error = "already checkpointing to " + m_strPath;
+         return false;
+      }
+      if (m_unUsers == 0) {
+         m_strPath = str_path;
+         m_unIntervalMs = un_interval_ms;
+         m_bStop = false;
+         m_bDirty = false;
+         m_nLoaded = 0;
+         m_vecRecords.clear();
+         m_vecValid.clear();
+         m_mapSlots.clear();
+         m_cThread = std::thread(&CQSwarmCheckpointWriter::Run, this);
+      }
+      ++m_unUsers;
+
+      // The robot's slot, so that Save() never allocates
+      if (m_mapSlots.count(un_robot_id) == 0) {
+         QSwarmCheckpoint::SRecord sRecord;
+         memset(&sRecord, 0, sizeof(sRecord));
+         sRecord.RobotId = un_robot_id;
+         m_mapSlots[un_robot_id] = m_vecRecords.size();
+         m_vecRecords.push_back(sRecord);
+         m_vecValid.push_back(false);
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmCheckpointWriter::Load(std::string& str_error) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      if (m_nLoaded == 0) {
+         std::vector<QSwarmCheckpoint::SRecord> vecRecords;
+         if (!QSwarmCheckpoint::Read(m_strPath, vecRecords, m_strLoadError)) {
+            m_nLoaded = -1;
+         }
+         else {
+            m_nLoaded = 1;
+            // Robots that do not register keep their record in the next writes
+            for (size_t i = 0; i < vecRecords.size(); ++i) {
+               std::map<uint32_t, size_t>::iterator it = m_mapSlots.find(vecRecords[i].RobotId);
+               if (it == m_mapSlots.end()) {
+                  m_mapSlots[vecRecords[i].RobotId] = m_vecRecords.size();
+                  m_vecRecords.push_back(vecRecords[i]);
+                  m_vecValid.push_back(true);
+               }
+               else {
+                  m_vecRecords[it->second] = vecRecords[i];
+                  m_vecValid[it->second] = true;
+               }
+            }
+         }
+      }
+      str_error = m_strLoadError;
+      return m_nLoaded > 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmCheckpointWriter::Unregister() {
+      {
+         std::lock_guard<std::mutex> cLock(m_cMutex);
+         if (m_unUsers == 0 || --m_unUsers > 0) {
+            return;
+         }
+         m_bStop = true;
+      }
+      m_cWakeUp.notify_one();
+      m_cThread.join();
+      Flush();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmCheckpointWriter::Find(uint32_t un_robot_id, QSwarmCheckpoint::SRecord& s_record) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      std::map<uint32_t, size_t>::iterator it = m_mapSlots.find(un_robot_id);
+      if (it == m_mapSlots.end() || !m_vecValid[it->second]) {
+         return false;
+      }
+      s_record = m_vecRecords[it->second];
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmCheckpointWriter::Save(const QSwarmCheckpoint::SRecord& s_record) {
+      {
+         std::lock_guard<std::mutex> cLock(m_cMutex);
+         std::map<uint32_t, size_t>::iterator it = m_mapSlots.find(s_record.RobotId);
+         if (it == m_mapSlots.end()) {
+            return;
+         }
+         m_vecRecords[it->second] = s_record;
+         m_vecValid[it->second] = true;
+         m_bDirty = true;
+      }
+      m_cWakeUp.notify_one();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmCheckpointWriter::Flush() {
+      // Copy under the write lock, so that an older table never replaces a newer one
+      std::lock_guard<std::mutex> cWriteLock(m_cWriteMutex);
+      std::vector<QSwarmCheckpoint::SRecord> vecRecords;
+      {
+         std::lock_guard<std::mutex> cLock(m_cMutex);
+         if (m_strPath.empty() || m_vecRecords.empty()) {
+            return true;
+         }
+         for (size_t i = 0; i < m_vecRecords.size(); ++i) {
+            if (m_vecValid[i]) {
+               vecRecords.push_back(m_vecRecords[i]);
+            }
+         }
+         m_bDirty = false;
+      }
+      return WriteTable(vecRecords);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint64_t CQSwarmCheckpointWriter::GetWriteCount() {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      return m_unWrites;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmCheckpointWriter::Run() {
+      std::chrono::steady_clock::time_point cLastWrite =
+         std::chrono::steady_clock::now() - std::chrono::milliseconds(m_unIntervalMs);
+      std::unique_lock<std::mutex> cLock(m_cMutex);
+      while (!m_bStop) {
+         m_cWakeUp.wait(cLock, [this] { return m_bStop || m_bDirty; });
+         if (m_bStop) {
+            break;
+         }
+         // Checkpoints taken until the interval has passed go into the same write
+         std::chrono::steady_clock::time_point cDue =
+            cLastWrite + std::chrono::milliseconds(m_unIntervalMs);
+         m_cWakeUp.wait_until(cLock, cDue, [this] { return m_bStop; });
+         if (m_bStop) {
+            break;
+         }
+         cLock.unlock();
+         Flush();
+         cLastWrite = std::chrono::steady_clock::now();
+         cLock.lock();
+      }
+      // Unregister() writes the last table
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmCheckpointWriter::WriteTable(const std::vector<QSwarmCheckpoint::SRecord>& vec_records) {
+      // Written next to the checkpoint and renamed over it: never a partial file
+      std::string strTemporary = m_strPath + ".tmp";
+      FILE* pFile = fopen(strTemporary.c_str(), "wb");
+      if (pFile == NULL) {
+         return false;
+      }
+      QSwarmCheckpoint::SHeader sHeader;
+      memset(&sHeader, 0, sizeof(sHeader));
+      sHeader.Magic = QSwarmCheckpoint::MAGIC;
+      sHeader.Version = QSwarmCheckpoint::VERSION;
+      sHeader.RecordSize = QSwarmCheckpoint::RECORD_SIZE;
+      sHeader.Count = static_cast<uint32_t>(vec_records.size());
+      bool bWritten = fwrite(&sHeader, sizeof(sHeader), 1, pFile) == 1 &&
+         (vec_records.empty() ||
+          fwrite(&vec_records[0], QSwarmCheckpoint::RECORD_SIZE, vec_records.size(), pFile) == vec_records.size()) &&
+         fflush(pFile) == 0;
+#ifndef _WIN32
+      bWritten = bWritten && fsync(fileno(pFile)) == 0;
+#endif
+      bWritten = (fclose(pFile) == 0) && bWritten;
+      if (!bWritten) {
+         remove(strTemporary.c_str());
+         return false;
+      }
+#ifdef _WIN32
+      // rename() does not replace an existing file on Windows
+      remove(m_strPath.c_str());
+#endif
+      if (rename(strTemporary.c_str(), m_strPath.c_str()) != 0) {
+         remove(strTemporary.c_str());
+         return false;
+      }
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      ++m_unWrites;
+      return true;
+   }
+
+}
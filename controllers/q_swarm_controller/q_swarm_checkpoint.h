@@ -0,0 +1,175 @@
+#ifndef Q_SWARM_CHECKPOINT_H
+#define Q_SWARM_CHECKPOINT_H
+
+/*
+ * Q-Swarm Controller Checkpoints
+ *
+ * With checkpoint_file set, every controller stores a fixed-size record
+ * of its state (episode counter, random stream position, pose, which is
+ * also the collision check's previous position, the last action and the
+ * reward still to be delivered to the server) each time it starts an
+ * episode. A run restarted with resume="true" picks every robot up at the
+ * episode it had reached instead of episode 0. Requests in flight are not
+ * saved: they are lost with the connection anyway.
+ *
+ * File layout (host byte order, little-endian on all supported targets):
+ *    SHeader                64 bytes ("QSCK", version, record size, count)
+ *    SRecord[count]         the latest record of every robot
+ *
+ * The records of all robots of the ARGoS process live in one table.
+ * Taking a checkpoint only copies the robot's record into the table; a
+ * background thread writes the table at most every interval to a
+ * temporary file and renames it over the checkpoint, so a control step
+ * never waits for the disk and a crash leaves either the previous or the
+ * new file, never a partial one. The last robot to unregister writes the
+ * final table before the thread stops.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace argos {
+
+   namespace QSwarmCheckpoint {
+
+      const uint32_t MAGIC = 0x4b435351;  /* "QSCK" little-endian */
+      const uint32_t VERSION = 1;
+      const size_t HEADER_SIZE = 64;
+
+      /* SRecord::Flags */
+      const uint8_t RECORD_PENDING_REWARD = 0x01;  /* PendingReward not delivered yet */
+      const uint8_t RECORD_PENDING_DONE = 0x02;    /* ... and it ended its episode */
+
+      struct SHeader {
+         uint32_t Magic;
+         uint32_t Version;
+         uint32_t RecordSize;
+         uint32_t Count;
+         uint8_t Reserved[HEADER_SIZE - 4 * sizeof(uint32_t)];
+      };
+
+      struct SRecord {
+         uint64_t Time;                    /* when it was taken, ms since the Unix epoch */
+         uint64_t RandomDraws;             /* counter of the robot's CQSwarmRandom stream */
+         uint32_t RobotId;
+         uint32_t Episode;                 /* episode the robot was starting */
+         float PreviousX;                  /* position at the start of the episode, */
+         float PreviousY;                  /* also the collision check's previous one */
+         float Yaw;                        /* heading there, radians */
+         float PendingReward;              /* last reward of the previous episode */
+         int32_t LastAction;               /* repeated by pipelined fallbacks */
+         float LastReward;                 /* outcome of the previous episode */
+         uint32_t LastSteps;
+         uint8_t LastOutcome;              /* QSwarmEpisodeLog::OUTCOME_* */
+         uint8_t Flags;                    /* RECORD_* */
+         uint8_t Reserved[10];
+      };
+
+      const size_t RECORD_SIZE = sizeof(SRecord);
+
+      /*
+       * Read the records of the checkpoint at str_path
+       * Returns false if it is missing or not a checkpoint
+       */
+      bool Read(const std::string& str_path,
+                std::vector<SRecord>& vec_records,
+                std::string& str_error);
+
+   }
+
+   /*
+    * Process-wide table of the robots' checkpoints and its writer thread
+    */
+   class CQSwarmCheckpointWriter {
+
+   public:
+
+      static CQSwarmCheckpointWriter& GetInstance();
+
+      /*
+       * Add robot un_robot_id; the first robot sets the file and the
+       * shortest time between two writes (un_interval_ms) and starts the
+       * writer thread
+       * Returns false if another checkpoint file is already in use
+       */
+      bool Register(const std::string& str_path,
+                    uint64_t un_interval_ms,
+                    uint32_t un_robot_id,
+                    std::string& str_error);
+
+      /*
+       * Load the records of the existing file into the table (resume);
+       * only the first call reads the file, later ones return its result
+       * Returns false if there is no valid checkpoint
+       */
+      bool Load(std::string& str_error);
+
+      /*
+       * Remove a robot; the last one writes the table and stops the thread
+       */
+      void Unregister();
+
+      /*
+       * The loaded record of un_robot_id (resume), if there is one
+       */
+      bool Find(uint32_t un_robot_id, QSwarmCheckpoint::SRecord& s_record);
+
+      /* Replace the robot's record (written by the thread, never blocks on I/O) */
+      void Save(const QSwarmCheckpoint::SRecord& s_record);
+
+      /* Write the table now (from the calling thread) */
+      bool Flush();
+
+      uint64_t GetWriteCount();
+
+   private:
+
+      CQSwarmCheckpointWriter();
+
+      ~CQSwarmCheckpointWriter();
+
+      /* Writer thread: write the table when it changed, at most every interval */
+      void Run();
+
+      /* Write a copy of the table (m_cWriteMutex held) */
+      bool WriteTable(const std::vector<QSwarmCheckpoint::SRecord>& vec_records);
+
+      /* Guards everything below except the file writes */
+      std::mutex m_cMutex;
+      std::condition_variable m_cWakeUp;
+
+      std::string m_strPath;
+      uint64_t m_unIntervalMs;
+      size_t m_unUsers;
+      bool m_bStop;
+
+      /* Load(): 0 not tried, 1 loaded, -1 failed (m_strLoadError) */
+      int m_nLoaded;
+      std::string m_strLoadError;
+
+      /* Records in use (m_vecValid), and the slot of each robot */
+      std::vector<QSwarmCheckpoint::SRecord> m_vecRecords;
+      std::vector<bool> m_vecValid;
+      std::map<uint32_t, size_t> m_mapSlots;
+
+      /* The table changed since the last write */
+      bool m_bDirty;
+      uint64_t m_unWrites;
+
+      /* One write at a time (thread and Flush) */
+      std::mutex m_cWriteMutex;
+      std::thread m_cThread;
+
+   };
+
+}
+
+#endif
@@ -7,9 +7,19 @@
  */
 
 #include "q_swarm_controller.h"
+#include "q_swarm_socket_transport.h"
+#include "q_swarm_shm_transport.h"
+#include "q_swarm_pool_transport.h"
+#include "q_swarm_alloc_counter.h"
+#include "q_swarm_trajectory.h"
+#include "q_swarm_episode_log.h"
+#include "q_swarm_checkpoint.h"
+#include <argos3/core/simulator/simulator.h>
 #include <argos3/core/utility/configuration/argos_configuration.h>
 #include <argos3/core/utility/logging/argos_log.h>
-#include <sstream>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <algorithm>
 
@@ -22,18 +32,66 @@ namespace argos {
       m_pcWheels(NULL),
       m_pcProximity(NULL),
       m_pcPositioning(NULL),
+      m_nRobotIdNum(0),
+      m_pcNeighbours(NULL),
+      m_unNeighbourSlot(0),
       m_nEpisode(0),
       m_nSteps(0),
       m_nMaxSteps(500),
       m_nMaxEpisodes(1000),
-      m_nSocket(-1),
+      m_pcTransport(NULL),
+      m_strTransport("tcp"),
+      m_strShmName("/q_swarm"),
+      m_strHost("127.0.0.1"),
+      m_nPort(5555),
+      m_nPoolSize(4),
       m_bConnected(false),
+      m_bConnectionChanged(false),
+      m_eInference(INFERENCE_SOCKET),
+      m_strPolicyFile("models/q_network_latest.bin"),
+      m_strKernel("auto"),
+      m_bAwaitingAction(false),
+      m_bBinaryProtocol(false),
+      m_bCombinedStep(true),
+      m_bCompactState(false),
+      m_fPendingReward(0.0f),
+      m_bPendingDone(false),
+      m_bHasPendingReward(false),
+      m_bPipelined(false),
+      m_nFallbackAction(-1),
+      m_nLastAction(0),
+      m_unRequestsInFlight(0),
+      m_unStaleReplies(0),
+      m_unFreshActions(0),
+      m_unStaleActions(0),
+      m_unLateActions(0),
       m_fVelocity(0.1f),
       m_fCollisionThreshold(0.01f),
       m_fGoalThreshold(0.5f),
       m_bEpisodeDone(false),
+      m_bWaiting(false),
       m_fEpisodeReward(0.0f),
-      m_nRobotIdNum(0) {
+      m_unEpisodeOutcome(QSwarmEpisodeLog::OUTCOME_NONE),
+      m_bRecording(false),
+      m_bCheckpoint(false),
+      m_bResumed(false),
+      m_fEpsilonStart(0.0f),
+      m_fEpsilonEnd(0.0f),
+      m_fEpsilonDecay(1.0f),
+      m_fEpsilon(0.0f),
+      m_nActionRepeat(1),
+      m_bAdaptiveRepeat(false),
+      m_fRepeatThreshold(0.1f),
+      m_nRepeatLeft(0),
+      m_nHeldAction(0),
+      m_bRepeatedStep(false),
+      m_fDecisionMax(0.0f),
+      m_fRepeatReward(0.0f),
+      m_bRepeatRewardDeferred(false),
+      m_unDecisions(0) {
+      m_cState.fill(0.0f);
+      m_cDecisionState.fill(0.0f);
+      QSwarmSensors::Clear(m_sSensors);
    }
 
    /****************************************/
@@ -60,14 +118,140 @@ namespace argos {
       }
 
       // Read goal position from configuration (default to 18, 18)
-      GetNodeAttributeOrDefault(t_node, "goal_x", m_cGoalPosition.SetX(18.0f), m_cGoalPosition.GetX());
-      GetNodeAttributeOrDefault(t_node, "goal_y", m_cGoalPosition.SetY(18.0f), m_cGoalPosition.GetY());
+      Real fGoalX = 18.0f;
+      Real fGoalY = 18.0f;
+      GetNodeAttributeOrDefault(t_node, "goal_x", fGoalX, fGoalX);
+      GetNodeAttributeOrDefault(t_node, "goal_y", fGoalY, fGoalY);
+      m_cGoalPosition.Set(fGoalX, fGoalY);
 
       // Read other parameters
       GetNodeAttributeOrDefault(t_node, "velocity", m_fVelocity, m_fVelocity);
       GetNodeAttributeOrDefault(t_node, "max_steps", m_nMaxSteps, m_nMaxSteps);
       GetNodeAttributeOrDefault(t_node, "max_episodes", m_nMaxEpisodes, m_nMaxEpisodes);
 
+      // Wire protocol: "text" (default, works with any server) or "binary"
+      std::string strProtocol = "text";
+      GetNodeAttributeOrDefault(t_node, "protocol", strProtocol, strProtocol);
+      if (strProtocol == "binary") {
+         m_bBinaryProtocol = true;
+      }
+      else if (strProtocol != "text") {
+         LOGERR << "[Robot " << m_strRobotId << "] Unknown protocol '" << strProtocol
+                << "', using text" << std::endl;
+      }
+
+      // Send the reward with the next state (true) or as a separate REWARD (false)
+      GetNodeAttributeOrDefault(t_node, "combined_step", m_bCombinedStep, m_bCombinedStep);
+
+      // Quantized states, goal only when it changes (binary STEP frames)
+      GetNodeAttributeOrDefault(t_node, "compact_state", m_bCompactState, m_bCompactState);
+
+      // Inference: "socket" (default, one request per robot), "batched"
+      // (one request per tick for the swarm, needs q_swarm_loop_functions)
+      // or "native" (in-process forward pass of policy_file, no learning)
+      std::string strInference = "socket";
+      GetNodeAttributeOrDefault(t_node, "inference", strInference, strInference);
+      GetNodeAttributeOrDefault(t_node, "policy_file", m_strPolicyFile, m_strPolicyFile);
+      GetNodeAttributeOrDefault(t_node, "simd", m_strKernel, m_strKernel);
+      // Native inference explores on its own (default: greedy)
+      GetNodeAttributeOrDefault(t_node, "epsilon_start", m_fEpsilonStart, m_fEpsilonStart);
+      GetNodeAttributeOrDefault(t_node, "epsilon_end", m_fEpsilonEnd, m_fEpsilonEnd);
+      GetNodeAttributeOrDefault(t_node, "epsilon_decay", m_fEpsilonDecay, m_fEpsilonDecay);
+      if (strInference == "batched") {
+         m_eInference = INFERENCE_BATCHED;
+         // Batches always carry the reward with the next state
+         m_bCombinedStep = true;
+      }
+      else if (strInference == "native") {
+         m_eInference = INFERENCE_NATIVE;
+      }
+      else if (strInference != "socket") {
+         LOGERR << "[Robot " << m_strRobotId << "] Unknown inference mode '" << strInference
+                << "', using socket" << std::endl;
+      }
+
+      // Pipelined requests: never wait for the server, execute the action
+      // received for the previous tick (or fallback_action if none arrived)
+      GetNodeAttributeOrDefault(t_node, "pipelined", m_bPipelined, m_bPipelined);
+      GetNodeAttributeOrDefault(t_node, "fallback_action", m_nFallbackAction, m_nFallbackAction);
+
+      // Action repeat: hold each action for up to action_repeat ticks;
+      // "adaptive" asks earlier when the surroundings change
+      GetNodeAttributeOrDefault(t_node, "action_repeat", m_nActionRepeat, m_nActionRepeat);
+      std::string strRepeatMode = "fixed";
+      GetNodeAttributeOrDefault(t_node, "repeat_mode", strRepeatMode, strRepeatMode);
+      GetNodeAttributeOrDefault(t_node, "repeat_threshold", m_fRepeatThreshold, m_fRepeatThreshold);
+      if (m_nActionRepeat < 1) {
+         LOGERR << "[Robot " << m_strRobotId << "] Invalid action_repeat " << m_nActionRepeat
+                << ", using 1" << std::endl;
+         m_nActionRepeat = 1;
+      }
+      if (strRepeatMode == "adaptive") {
+         m_bAdaptiveRepeat = true;
+      }
+      else if (strRepeatMode != "fixed") {
+         LOGERR << "[Robot " << m_strRobotId << "] Unknown repeat_mode '" << strRepeatMode
+                << "', using fixed" << std::endl;
+      }
+
+      // Transport: "tcp" (default), "pool" (pool_size connections shared by
+      // all robots of the process) or "shm" (shared memory segment created by the server)
+      GetNodeAttributeOrDefault(t_node, "transport", m_strTransport, m_strTransport);
+      GetNodeAttributeOrDefault(t_node, "shm_name", m_strShmName, m_strShmName);
+      GetNodeAttributeOrDefault(t_node, "host", m_strHost, m_strHost);
+      GetNodeAttributeOrDefault(t_node, "port", m_nPort, m_nPort);
+      GetNodeAttributeOrDefault(t_node, "pool_size", m_nPoolSize, m_nPoolSize);
+
+      // Several servers: robots are sharded across them by a hash of their id
+      std::string strServers;
+      GetNodeAttributeOrDefault(t_node, "servers", strServers, strServers);
+      std::string strError;
+      if (!strServers.empty() && !ParseEndpoints(strServers, m_nPort, m_tServers, strError)) {
+         LOGERR << "[Robot " << m_strRobotId << "] Invalid servers: " << strError
+                << ". Using " << m_strHost << ":" << m_nPort << std::endl;
+         m_tServers.clear();
+      }
+      if (m_tServers.empty()) {
+         SQSwarmEndpoint sServer = { m_strHost, m_nPort };
+         m_tServers.push_back(sServer);
+      }
+      const SQSwarmEndpoint& sShard = m_tServers[ShardOf(m_nRobotIdNum, m_tServers.size())];
+      m_strHost = sShard.Host;
+      m_nPort = sShard.Port;
+      if (m_strTransport == "shm") {
+         // Shared memory slots always carry the reward with the next state
+         m_bCombinedStep = true;
+      }
+      else if (m_strTransport == "pool") {
+         // Answers are routed by the robot id of binary STEP frames
+         m_bBinaryProtocol = true;
+         m_bCombinedStep = true;
+      }
+      else if (m_strTransport != "tcp") {
+         LOGERR << "[Robot " << m_strRobotId << "] Unknown transport '" << m_strTransport
+                << "', using tcp" << std::endl;
+         m_strTransport = "tcp";
+      }
+      // Batched inference: the loop functions' compact_state applies instead
+      if (m_bCompactState && m_eInference == INFERENCE_SOCKET &&
+          (m_strTransport == "shm" || !m_bBinaryProtocol || !m_bCombinedStep)) {
+         LOGERR << "[Robot " << m_strRobotId << "] compact_state needs protocol=\"binary\","
+                << " combined_step=\"true\" and transport=\"tcp\" or \"pool\"."
+                << " Sending full states" << std::endl;
+         m_bCompactState = false;
+      }
+
+      // Trajectory log of every step, shared by the robots of the process
+      std::string strRecordFile;
+      GetNodeAttributeOrDefault(t_node, "record_file", strRecordFile, strRecordFile);
+      if (!strRecordFile.empty()) {
+         std::string strRecordError;
+         m_bRecording = CQSwarmTrajectoryWriter::GetInstance().Register(strRecordFile, strRecordError);
+         if (!m_bRecording) {
+            LOGERR << "[Robot " << m_strRobotId << "] Not recording: " << strRecordError << std::endl;
+         }
+      }
+
       LOG << "[Robot " << m_strRobotId << "] Initialized. Goal: (" 
           << m_cGoalPosition.GetX() << ", " << m_cGoalPosition.GetY() << ")" << std::endl;
 
@@ -75,8 +259,34 @@ namespace argos {
       const CCI_PositioningSensor::SReading& sReading = m_pcPositioning->GetReading();
       m_cPreviousPosition.Set(sReading.Position.GetX(), sReading.Position.GetY());
 
-      // Connect to Q-Network server
-      ConnectToQNetwork();
+      // Own random stream: same numbers for the same random_seed, whatever
+      // the simulator threads do
+      m_cRandom.Seed(CSimulator::GetInstance().GetRandomSeed(), static_cast<uint32_t>(m_nRobotIdNum));
+
+      // Episode counters and the state that goes with them, from a previous run
+      InitCheckpoint(t_node);
+      UpdateEpsilon();
+
+      // Native inference falls back to the socket path if the policy cannot be loaded
+      if (m_eInference == INFERENCE_NATIVE && !LoadPolicy()) {
+         m_eInference = INFERENCE_SOCKET;
+      }
+
+      // Connect to Q-Network server (batched mode uses the loop functions' connection)
+      if (m_eInference == INFERENCE_SOCKET) {
+         ConnectToQNetwork();
+      }
+      else {
+         m_bPipelined = false;
+      }
+
+      if (m_bPipelined && (m_pcTransport == NULL || !m_pcTransport->SupportsPipelining())) {
+         LOGERR << "[Robot " << m_strRobotId << "] Pipelined requests need protocol=\"binary\","
+                << " combined_step=\"true\" and transport=\"tcp\" or \"pool\"."
+                << " Waiting for each action"
+                << std::endl;
+         m_bPipelined = false;
+      }
    }
 
    /****************************************/
@@ -89,39 +299,217 @@ namespace argos {
          return;
       }
 
+      // The other robots of the arena have not ended their episode yet
+      if (m_bWaiting) {
+         m_pcWheels->SetLinearVelocity(0.0f, 0.0f);
+         return;
+      }
+
       // If episode is done, reset
       if (m_bEpisodeDone) {
          ResetEpisode();
          return;
       }
 
+      // Steady state from here on: no heap allocation (checked in
+      // Q_SWARM_COUNT_ALLOCATIONS builds)
+      uint64_t unAllocations = QSwarmAllocCounter::GetCount();
+      m_bConnectionChanged = false;
+      CQSwarmLatencyTimer cTimer(m_pcLatency.get());
+
       // Increment step counter
       m_nSteps++;
 
-      // Get current state from sensors
-      std::vector<float> state = GetState();
+      // Read the sensors once, then get the current state from them
+      ReadSensors();
+      GetState(m_cState);
+      cTimer.Lap(CQSwarmLatencyStats::STATE);
+
+      m_bRepeatedStep = !IsDecisionDue();
+      if (m_bRepeatedStep) {
+         // Keep the held action; no request this tick
+         --m_nRepeatLeft;
+         FinishStep(m_nHeldAction, true);
+      }
+      else if (m_eInference == INFERENCE_BATCHED) {
+         StartDecision();
+         // CQSwarmLoopFunctions::PostStep() sends the batch and calls ApplyAction()
+         m_bAwaitingAction = true;
+      }
+      else {
+         StartDecision();
+
+         // Get action from the local policy or the Q-Network server
+         int action;
+         if (m_eInference == INFERENCE_NATIVE) {
+            action = GetActionFromPolicy(m_cState);
+         }
+         else if (m_bPipelined) {
+            action = GetActionPipelined(m_cState);
+         }
+         else {
+            action = GetActionFromQNetwork(m_cState);
+         }
+         cTimer.Lap(CQSwarmLatencyStats::ACTION);
+
+         FinishStep(action);
+      }
+      cTimer.Total(CQSwarmLatencyStats::STEP);
+
+      CheckAllocations(unAllocations);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void QSwarmController::CheckAllocations(uint64_t un_before) {
+      // The first step after a reset may warm up lazily allocated state,
+      // the last one logs the end of the episode, and so do (re)connections
+      if (!QSwarmAllocCounter::IsEnabled() || m_nSteps <= 1 || m_bEpisodeDone ||
+          m_bConnectionChanged) {
+         return;
+      }
+      uint64_t unAllocations = QSwarmAllocCounter::GetCount() - un_before;
+      if (unAllocations != 0) {
+         LOGERR << "[Robot " << m_strRobotId << "] ControlStep made " << unAllocations
+                << " heap allocations at step " << m_nSteps << std::endl;
+         assert(unAllocations == 0);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void QSwarmController::ApplyAction(int action) {
+      // The pending reward went out with the batch
+      m_bAwaitingAction = false;
+      m_bHasPendingReward = false;
 
-      // Get action from Q-Network
-      int action = GetActionFromQNetwork(state);
+      FinishStep(action);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool QSwarmController::IsDecisionDue() const {
+      if (m_nRepeatLeft <= 0) {
+         return true;
+      }
+      if (!m_bAdaptiveRepeat) {
+         return false;
+      }
+      // An obstacle came into range
+      if (m_sSensors.Max > 0.0f && m_fDecisionMax <= 0.0f) {
+         return true;
+      }
+      // Proximity and neighbour features moved away from the decision's;
+      // position and goal change with every move and are not compared
+      for (size_t i = 4; i < m_cState.size(); ++i) {
+         if (std::fabs(m_cState[i] - m_cDecisionState[i]) > m_fRepeatThreshold) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void QSwarmController::StartDecision() {
+      // Adaptive repeat ended the previous hold early: its reward is still here
+      if (m_bRepeatRewardDeferred) {
+         SendReward(m_fRepeatReward, false);
+         m_bRepeatRewardDeferred = false;
+      }
+      m_nRepeatLeft = m_nActionRepeat - 1;
+      if (m_bAdaptiveRepeat) {
+         m_cDecisionState = m_cState;
+         m_fDecisionMax = m_sSensors.Max;
+      }
+      ++m_unDecisions;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void QSwarmController::FinishStep(int action, bool b_repeated) {
+      CQSwarmLatencyTimer cTimer(m_pcLatency.get());
 
       // Execute the action
+      m_nHeldAction = action;
       ExecuteAction(action);
+      cTimer.Lap(CQSwarmLatencyStats::EXECUTE);
 
       // Calculate reward and check if done
       bool done = false;
       float reward = CalculateReward(done);
       m_fEpisodeReward += reward;
+      cTimer.Lap(CQSwarmLatencyStats::REWARD);
+
+      if (m_bRecording) {
+         RecordStep(action, reward, done);
+      }
 
-      // Send reward to Q-Network for learning
-      SendReward(reward, done);
+      // Send reward to Q-Network for learning; held ticks add theirs to
+      // the reward of the tick that chose the action
+      if (m_bCombinedStep) {
+         // Delivered with the next state, which completes the transition
+         m_fPendingReward = b_repeated ? m_fPendingReward + reward : reward;
+         m_bPendingDone = done;
+         m_bHasPendingReward = true;
+      }
+      else {
+         m_fRepeatReward = b_repeated ? m_fRepeatReward + reward : reward;
+         m_bRepeatRewardDeferred = true;
+         // Sent once the hold is over (known here unless adaptive ends it early)
+         if (done || m_nRepeatLeft <= 0 || m_nSteps >= m_nMaxSteps) {
+            SendReward(m_fRepeatReward, done);
+            m_bRepeatRewardDeferred = false;
+            cTimer.Lap(CQSwarmLatencyStats::REWARD_SEND);
+         }
+      }
 
       // Check if episode should end
       if (done || m_nSteps >= m_nMaxSteps) {
          m_bEpisodeDone = true;
+         if (!done) {
+            m_unEpisodeOutcome = QSwarmEpisodeLog::OUTCOME_TIMEOUT;
+         }
          LOG << "[Robot " << m_strRobotId << "] Episode " << m_nEpisode 
              << " ended. Steps: " << m_nSteps 
              << ", Reward: " << m_fEpisodeReward << std::endl;
+         if (m_nActionRepeat > 1) {
+            LOG << "[Robot " << m_strRobotId << "] Action repeat: " << m_unDecisions
+                << " decisions in " << m_nSteps << " steps" << std::endl;
+         }
+         if (m_bPipelined) {
+            LOG << "[Robot " << m_strRobotId << "] Pipelined actions: " << m_unFreshActions
+                << " fresh, " << m_unStaleActions << " stale, " << m_unLateActions
+                << " late" << std::endl;
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void QSwarmController::RecordStep(int action, float reward, bool done) {
+      QSwarmTrajectory::SRecord sRecord;
+      sRecord.RobotId = m_nRobotIdNum;
+      sRecord.Episode = m_nEpisode;
+      sRecord.Step = m_nSteps;
+      sRecord.Action = static_cast<uint8_t>(action);
+      sRecord.Flags = 0;
+      if (done) {
+         sRecord.Flags |= QSwarmTrajectory::RECORD_DONE;
+      }
+      else if (m_nSteps >= m_nMaxSteps) {
+         sRecord.Flags |= QSwarmTrajectory::RECORD_TIMEOUT;
       }
+      sRecord.Reserved[0] = sRecord.Reserved[1] = 0;
+      sRecord.Reward = reward;
+      std::copy(m_cState.begin(), m_cState.end(), sRecord.State);
+      CQSwarmTrajectoryWriter::GetInstance().Append(sRecord);
    }
 
    /****************************************/
@@ -132,7 +520,28 @@ namespace argos {
       m_nEpisode = 0;
       m_nSteps = 0;
       m_bEpisodeDone = false;
+      m_bWaiting = false;
       m_fEpisodeReward = 0.0f;
+      m_unEpisodeOutcome = QSwarmEpisodeLog::OUTCOME_NONE;
+      m_bHasPendingReward = false;
+      m_bAwaitingAction = false;
+      // Answers to the requests in flight come before those of the new
+      // run (request order): skip them instead of acting on them
+      m_unStaleReplies += m_unRequestsInFlight;
+      m_unRequestsInFlight = 0;
+      m_nLastAction = 0;
+      m_unFreshActions = 0;
+      m_unStaleActions = 0;
+      m_unLateActions = 0;
+      m_nRepeatLeft = 0;
+      m_bRepeatedStep = false;
+      m_bRepeatRewardDeferred = false;
+      m_unDecisions = 0;
+      m_cRandom.SetCounter(0);
+      UpdateEpsilon();
+      if (m_pcLatency) {
+         m_pcLatency->Clear();
+      }
 
       // Stop the robot
       m_pcWheels->SetLinearVelocity(0.0f, 0.0f);
@@ -147,123 +556,400 @@ namespace argos {
 
    void QSwarmController::Destroy() {
       CloseConnection();
+      if (m_bRecording) {
+         CQSwarmTrajectoryWriter::GetInstance().Unregister();
+         m_bRecording = false;
+      }
+      if (m_bCheckpoint) {
+         CQSwarmCheckpointWriter::GetInstance().Unregister();
+         m_bCheckpoint = false;
+      }
    }
 
    /****************************************/
    /****************************************/
 
-   bool QSwarmController::ConnectToQNetwork() {
-      #ifdef _WIN32
-         WSADATA wsaData;
-         if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-            LOGERR << "[Robot " << m_strRobotId << "] WSAStartup failed" << std::endl;
-            return false;
+   void QSwarmController::InitCheckpoint(TConfigurationNode& t_node) {
+      std::string strFile;
+      Real fInterval = 1.0f;
+      bool bResume = false;
+      GetNodeAttributeOrDefault(t_node, "checkpoint_file", strFile, strFile);
+      GetNodeAttributeOrDefault(t_node, "checkpoint_interval", fInterval, fInterval);
+      GetNodeAttributeOrDefault(t_node, "resume", bResume, bResume);
+      if (strFile.empty()) {
+         if (bResume) {
+            LOGERR << "[Robot " << m_strRobotId << "] resume needs a checkpoint_file."
+                   << " Starting from episode 0" << std::endl;
+         }
+         return;
+      }
+
+      CQSwarmCheckpointWriter& cWriter = CQSwarmCheckpointWriter::GetInstance();
+      std::string strError;
+      uint64_t unIntervalMs = static_cast<uint64_t>(std::max<Real>(fInterval, 0.0) * 1000.0);
+      m_bCheckpoint = cWriter.Register(strFile, unIntervalMs, m_nRobotIdNum, strError);
+      if (!m_bCheckpoint) {
+         LOGERR << "[Robot " << m_strRobotId << "] No checkpoints: " << strError << std::endl;
+         return;
+      }
+      if (!bResume) {
+         return;
+      }
+
+      QSwarmCheckpoint::SRecord sRecord;
+      if (!cWriter.Load(strError)) {
+         LOGERR << "[Robot " << m_strRobotId << "] Cannot resume: " << strError
+                << ". Starting from episode 0" << std::endl;
+         return;
+      }
+      if (!cWriter.Find(m_nRobotIdNum, sRecord)) {
+         LOG << "[Robot " << m_strRobotId << "] Not in " << strFile
+             << ", starting from episode 0" << std::endl;
+         return;
+      }
+
+      // The robot starts the episode it was starting when the checkpoint was taken
+      m_nEpisode = sRecord.Episode;
+      m_cRandom.SetCounter(sRecord.RandomDraws);
+      m_nLastAction = sRecord.LastAction;
+      m_cPreviousPosition.Set(sRecord.PreviousX, sRecord.PreviousY);
+      m_fPendingReward = sRecord.PendingReward;
+      m_bHasPendingReward = (sRecord.Flags & QSwarmCheckpoint::RECORD_PENDING_REWARD) != 0;
+      m_bPendingDone = (sRecord.Flags & QSwarmCheckpoint::RECORD_PENDING_DONE) != 0;
+      m_bResumed = true;
+      m_cResumePosition = m_cPreviousPosition;
+      m_cResumeYaw.SetValue(sRecord.Yaw);
+      LOG << "[Robot " << m_strRobotId << "] Resuming at episode " << m_nEpisode
+          << " (last episode: " << sRecord.LastSteps << " steps, reward "
+          << sRecord.LastReward << ")" << std::endl;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void QSwarmController::SaveCheckpoint(float f_last_reward, int n_last_steps, uint8_t un_last_outcome) {
+      const CCI_PositioningSensor::SReading& sReading = m_pcPositioning->GetReading();
+      CRadians cYaw, cPitch, cRoll;
+      sReading.Orientation.ToEulerAngles(cYaw, cPitch, cRoll);
+
+      QSwarmCheckpoint::SRecord sRecord;
+      memset(&sRecord, 0, sizeof(sRecord));
+      sRecord.Time = CQSwarmEpisodeLog::WallTime();
+      sRecord.RandomDraws = m_cRandom.GetCounter();
+      sRecord.RobotId = m_nRobotIdNum;
+      sRecord.Episode = m_nEpisode;
+      sRecord.PreviousX = m_cPreviousPosition.GetX();
+      sRecord.PreviousY = m_cPreviousPosition.GetY();
+      sRecord.Yaw = cYaw.GetValue();
+      sRecord.PendingReward = m_fPendingReward;
+      sRecord.LastAction = m_nLastAction;
+      sRecord.LastReward = f_last_reward;
+      sRecord.LastSteps = static_cast<uint32_t>(n_last_steps);
+      sRecord.LastOutcome = un_last_outcome;
+      if (m_bHasPendingReward) {
+         sRecord.Flags |= QSwarmCheckpoint::RECORD_PENDING_REWARD;
+         if (m_bPendingDone) {
+            sRecord.Flags |= QSwarmCheckpoint::RECORD_PENDING_DONE;
          }
-      #endif
+      }
+      CQSwarmCheckpointWriter::GetInstance().Save(sRecord);
+   }
 
-      // Create socket
-      m_nSocket = socket(AF_INET, SOCK_STREAM, 0);
-      if (m_nSocket < 0) {
-         LOGERR << "[Robot " << m_strRobotId << "] Socket creation failed" << std::endl;
+   /****************************************/
+   /****************************************/
+
+   bool QSwarmController::GetResumePose(CVector2& c_position, CRadians& c_yaw) const {
+      if (!m_bResumed) {
          return false;
       }
+      c_position = m_cResumePosition;
+      c_yaw = m_cResumeYaw;
+      return true;
+   }
 
-      // Setup server address
-      struct sockaddr_in serverAddr;
-      serverAddr.sin_family = AF_INET;
-      serverAddr.sin_port = htons(5555);  // Port 5555
-      
-      #ifdef _WIN32
-         serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
-      #else
-         inet_pton(AF_INET, "127.0.0.1", &serverAddr.sin_addr);
-      #endif
-
-      // Connect to server (with retry logic)
-      int maxRetries = 10;
-      for (int i = 0; i < maxRetries; i++) {
-         if (connect(m_nSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == 0) {
-            m_bConnected = true;
-            LOG << "[Robot " << m_strRobotId << "] Connected to Q-Network server" << std::endl;
-            return true;
+   /****************************************/
+   /****************************************/
+
+   bool QSwarmController::ConnectToQNetwork() {
+      if (m_strTransport == "shm") {
+         m_pcTransport = new CQSwarmShmTransport(m_strShmName, m_nRobotIdNum);
+         LOG << "[Robot " << m_strRobotId << "] Connecting to Q-Network server (shm "
+             << m_strShmName << ")" << std::endl;
+      }
+      else if (m_strTransport == "pool") {
+         CQSwarmConnectionPool& cPool = CQSwarmConnectionPool::GetInstance();
+         if (!cPool.Configure(m_tServers, std::max(m_nPoolSize, 1))) {
+            LOGERR << "[Robot " << m_strRobotId << "] The connection pool is already"
+                   << " configured with other servers or pool_size. Using those"
+                   << std::endl;
          }
-         
-         // Wait before retry
-         #ifdef _WIN32
-            Sleep(1000);  // 1 second
-         #else
-            sleep(1);
-         #endif
+         m_pcTransport = new CQSwarmPoolTransport(m_nRobotIdNum, m_bCompactState);
+         LOG << "[Robot " << m_strRobotId << "] Connecting to Q-Network server (pool "
+             << m_strHost << ":" << m_nPort << ")" << std::endl;
+      }
+      else {
+         m_pcTransport = new CQSwarmSocketTransport(m_strHost, m_nPort,
+                                                    m_bBinaryProtocol, m_bCombinedStep,
+                                                    m_bCompactState);
+         LOG << "[Robot " << m_strRobotId << "] Connecting to Q-Network server (tcp "
+             << m_strHost << ":" << m_nPort << ")" << std::endl;
       }
 
-      LOGERR << "[Robot " << m_strRobotId << "] Failed to connect to Q-Network server after " 
-             << maxRetries << " attempts" << std::endl;
-      return false;
+      // Returns at once; MaintainConnection() completes the connection
+      // and keeps reconnecting while the server is down
+      if (!m_pcTransport->Connect()) {
+         LOGERR << "[Robot " << m_strRobotId << "] Invalid Q-Network server address "
+                << m_strHost << ". Using fallback actions" << std::endl;
+         return false;
+      }
+      MaintainConnection();
+      return true;
    }
 
    /****************************************/
    /****************************************/
 
-   std::vector<float> QSwarmController::GetState() {
-      std::vector<float> state;
+   bool QSwarmController::MaintainConnection() {
+      if (m_pcTransport == NULL) {
+         return false;
+      }
 
-      // Get current position
-      const CCI_PositioningSensor::SReading& sReading = m_pcPositioning->GetReading();
-      float x = sReading.Position.GetX();
-      float y = sReading.Position.GetY();
+      bool bConnected = m_pcTransport->Maintain();
+      if (!bConnected && !m_pcTransport->GetFatalError().empty()) {
+         // Permanent failure: stop retrying, as for an invalid address
+         LOGERR << "[Robot " << m_strRobotId << "] Cannot use the Q-Network server ("
+                << m_strTransport << "): " << m_pcTransport->GetFatalError()
+                << ". Using fallback actions" << std::endl;
+         CloseConnection();
+         return false;
+      }
+      if (bConnected != m_bConnected) {
+         m_bConnected = bConnected;
+         m_bConnectionChanged = true;
+         m_unRequestsInFlight = 0;
+         m_unStaleReplies = 0;
+         if (bConnected) {
+            LOG << "[Robot " << m_strRobotId << "] Connected to Q-Network server ("
+                << m_strTransport << ")" << std::endl;
+         }
+         else {
+            LOGERR << "[Robot " << m_strRobotId << "] Lost connection to Q-Network server,"
+                   << " reconnecting in the background" << std::endl;
+         }
+      }
+      return bConnected;
+   }
+
+   /****************************************/
+   /****************************************/
 
-      // Add position and goal to state
-      state.push_back(x);
-      state.push_back(y);
-      state.push_back(m_cGoalPosition.GetX());
-      state.push_back(m_cGoalPosition.GetY());
+   void QSwarmController::ReadSensors() {
+      const CCI_PositioningSensor::SReading& sReading = m_pcPositioning->GetReading();
+      m_sSensors.X = sReading.Position.GetX();
+      m_sSensors.Y = sReading.Position.GetY();
 
-      // Add proximity sensor readings (24 sensors on FootBot)
+      // Proximity sensor readings (24 sensors on FootBot), zero if missing
       const CCI_FootBotProximitySensor::TReadings& tReadings = m_pcProximity->GetReadings();
-      for (size_t i = 0; i < tReadings.size(); ++i) {
-         state.push_back(tReadings[i].Value);
+      size_t unReadings = std::min(tReadings.size(), QSwarmSensors::READINGS);
+      for (size_t i = 0; i < unReadings; ++i) {
+         m_sSensors.Proximity[i] = tReadings[i].Value;
       }
+      std::fill(m_sSensors.Proximity + unReadings,
+                m_sSensors.Proximity + QSwarmSensors::READINGS, 0.0f);
+      QSwarmSensors::Process(m_sSensors);
+   }
+
+   /****************************************/
+   /****************************************/
 
-      return state;
+   void QSwarmController::GetState(TState& state) {
+      // Position and goal relative to the robot's arena, proximity
+      // readings or their sector maxima
+      QSwarmSensors::FillState(m_sSensors, m_cArenaOrigin.GetX(), m_cArenaOrigin.GetY(),
+                               m_cGoalPosition.GetX(), m_cGoalPosition.GetY(), &state[0]);
+
+      GetNeighbourFeatures(&state[0] + QSwarmProtocol::NEIGHBOUR_OFFSET);
    }
 
    /****************************************/
    /****************************************/
 
-   int QSwarmController::GetActionFromQNetwork(const std::vector<float>& state) {
-      if (!m_bConnected) {
-         // Fallback: random action
-         return rand() % 4;
+   void QSwarmController::GetNeighbourFeatures(float* features) {
+      const size_t unFeatures = QSwarmProtocol::NEIGHBOUR_FEATURES * QSwarmProtocol::NEIGHBOURS;
+      if (unFeatures == 0) {
+         return;
       }
+      size_t unFound = 0;
+      CQSwarmNeighbourIndex::SNeighbour sNeighbours[QSwarmProtocol::NEIGHBOURS + 1];
+      if (m_pcNeighbours != NULL && m_unNeighbourSlot < m_pcNeighbours->GetSize()) {
+         unFound = m_pcNeighbours->Query(m_unNeighbourSlot, QSwarmProtocol::NEIGHBOURS, sNeighbours);
+      }
+      float fScale = m_pcNeighbours != NULL ? 1.0f / m_pcNeighbours->GetRadius() : 0.0f;
+      for (size_t i = 0; i < unFound; ++i) {
+         features[3 * i] = sNeighbours[i].Dx * fScale;
+         features[3 * i + 1] = sNeighbours[i].Dy * fScale;
+         features[3 * i + 2] = 1.0f;
+      }
+      std::fill(features + QSwarmProtocol::NEIGHBOUR_FEATURES * unFound, features + unFeatures, 0.0f);
+   }
 
-      // Build state message: "STATE|robot_id|x|y|goal_x|goal_y|prox0|...|prox23"
-      std::ostringstream oss;
-      oss << "STATE|" << m_nRobotIdNum;
-      for (float val : state) {
-         oss << "|" << val;
+   /****************************************/
+   /****************************************/
+
+   int QSwarmController::GetActionFromQNetwork(const TState& state) {
+      if (!MaintainConnection()) {
+         // Fallback (not connected yet, or reconnecting): random action
+         return GetFallbackAction();
       }
 
-      // Send state
-      if (!SendMessage(oss.str())) {
-         LOGERR << "[Robot " << m_strRobotId << "] Failed to send state" << std::endl;
+      // Send state (with the pending reward in combined step mode), receive action
+      int action = 0;
+      bool ok = m_pcTransport->RequestAction(m_nRobotIdNum, &state[0],
+                                             m_fPendingReward, GetPendingFlags(), action);
+      m_bHasPendingReward = false;
+      if (!ok) {
+         // A failed connection is dropped by the transport and reported here
+         if (MaintainConnection()) {
+            LOGERR << "[Robot " << m_strRobotId << "] No response from Q-Network" << std::endl;
+         }
          return 0;  // Default action: move forward
       }
 
-      // Receive action: "ACTION|action_id"
-      std::string response = ReceiveMessage();
-      if (response.empty()) {
-         LOGERR << "[Robot " << m_strRobotId << "] No response from Q-Network" << std::endl;
-         return 0;
+      return action;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int QSwarmController::GetActionPipelined(const TState& state) {
+      if (!MaintainConnection()) {
+         // Fallback (not connected yet, or reconnecting): random action
+         return GetFallbackAction();
+      }
+
+      // Answers that arrived since the last tick, in request order
+      int received = 0;
+      int nCount = m_pcTransport->PollActions(received);
+      if (nCount < 0) {
+         // Reports the lost connection; the requests in flight are gone
+         MaintainConnection();
+         return GetFallbackAction();
+      }
+      if (m_unStaleReplies > 0) {
+         // Answers to requests sent before Reset(); received is the most
+         // recent answer, from this run if any is left
+         uint32_t unSkipped = std::min(static_cast<uint32_t>(nCount), m_unStaleReplies);
+         m_unStaleReplies -= unSkipped;
+         nCount -= static_cast<int>(unSkipped);
       }
 
-      // Parse action
-      size_t pos = response.find('|');
-      if (pos != std::string::npos) {
-         std::string actionStr = response.substr(pos + 1);
-         return std::stoi(actionStr);
+      int action;
+      if (nCount > 0) {
+         m_unRequestsInFlight -= std::min(static_cast<uint32_t>(nCount), m_unRequestsInFlight);
+         action = received;
+         if (m_unRequestsInFlight == 0) {
+            ++m_unFreshActions;
+         }
+         else {
+            ++m_unStaleActions;
+         }
+      }
+      else {
+         // Nothing yet (first tick, or the server is busy training)
+         action = (m_nFallbackAction >= 0) ? m_nFallbackAction : m_nLastAction;
+         ++m_unLateActions;
+      }
+      m_nLastAction = action;
+
+      // Request for this tick (with the pending reward); answered later
+      if (m_pcTransport->SendRequest(m_nRobotIdNum, state.data(),
+                                     m_fPendingReward, GetPendingFlags())) {
+         ++m_unRequestsInFlight;
+      }
+      else {
+         MaintainConnection();
+      }
+      m_bHasPendingReward = false;
+
+      return action;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool QSwarmController::LoadPolicy() {
+      if (!m_cPolicy.SetKernel(m_strKernel)) {
+         LOGERR << "[Robot " << m_strRobotId << "] SIMD kernel '" << m_strKernel
+                << "' not available, using " << m_cPolicy.GetKernelName() << std::endl;
+      }
+
+      std::string strError;
+      if (!m_cPolicy.Load(m_strPolicyFile, strError)) {
+         LOGERR << "[Robot " << m_strRobotId << "] Cannot load policy " << m_strPolicyFile
+                << ": " << strError << ". Using the Q-Network server" << std::endl;
+         return false;
+      }
+      if (m_cPolicy.GetInputSize() != QSwarmProtocol::STATE_SIZE || m_cPolicy.GetOutputSize() != 4) {
+         LOGERR << "[Robot " << m_strRobotId << "] Policy " << m_strPolicyFile << " has "
+                << m_cPolicy.GetInputSize() << " inputs and " << m_cPolicy.GetOutputSize()
+                << " outputs (expected " << QSwarmProtocol::STATE_SIZE << " and 4)."
+                << " Using the Q-Network server" << std::endl;
+         return false;
       }
 
-      return 0;  // Default action
+      LOG << "[Robot " << m_strRobotId << "] Native inference with " << m_strPolicyFile
+          << " (" << (m_cPolicy.IsQuantized() ? "int8" : "float32") << ", "
+          << m_cPolicy.GetWeightBytes() / 1024 << " KB"
+          << (m_cPolicy.IsMapped() ? " mapped, " : ", ")
+          << m_cPolicy.GetKernelName() << " kernel)" << std::endl;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int QSwarmController::GetActionFromPolicy(const TState& state) {
+      // LoadPolicy() checked that the policy takes STATE_SIZE inputs
+      return Explore(m_cPolicy.SelectAction(state.data()));
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int QSwarmController::Explore(int n_greedy) {
+      if (m_fEpsilon <= 0.0f || m_cRandom.Uniform() >= m_fEpsilon) {
+         return n_greedy;
+      }
+      return static_cast<int>(m_cRandom.Below(4));
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void QSwarmController::UpdateEpsilon() {
+      float fEpsilon = m_fEpsilonStart * std::pow(m_fEpsilonDecay, static_cast<float>(m_nEpisode));
+      m_fEpsilon = std::max(fEpsilon, m_fEpsilonEnd);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int QSwarmController::GetFallbackAction() {
+      return static_cast<int>(m_cRandom.Below(4));
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint8_t QSwarmController::GetPendingFlags() const {
+      uint8_t flags = 0;
+      if (m_bHasPendingReward) {
+         flags |= QSwarmProtocol::STEP_HAS_PREV;
+         if (m_bPendingDone) {
+            flags |= QSwarmProtocol::STEP_PREV_DONE;
+         }
+      }
+      return flags;
    }
 
    /****************************************/
@@ -309,12 +995,14 @@ namespace argos {
       if (ReachedGoal()) {
          reward = 10.0f;
          done = true;
+         m_unEpisodeOutcome = QSwarmEpisodeLog::OUTCOME_GOAL;
          LOG << "[Robot " << m_strRobotId << "] GOAL REACHED!" << std::endl;
       }
       // Check for collision
       else if (DetectCollision()) {
          reward = -5.0f;
          done = true;
+         m_unEpisodeOutcome = QSwarmEpisodeLog::OUTCOME_COLLISION;
          LOG << "[Robot " << m_strRobotId << "] COLLISION DETECTED!" << std::endl;
       }
 
@@ -325,128 +1013,130 @@ namespace argos {
    /****************************************/
 
    bool QSwarmController::ReachedGoal() {
-      const CCI_PositioningSensor::SReading& sReading = m_pcPositioning->GetReading();
-      CVector2 currentPos(sReading.Position.GetX(), sReading.Position.GetY());
-      
-      float distance = (currentPos - m_cGoalPosition).Length();
-      return distance < m_fGoalThreshold;
+      return QSwarmSensors::IsAtGoal(m_sSensors, m_cGoalPosition.GetX(), m_cGoalPosition.GetY(),
+                                     m_fGoalThreshold);
    }
 
    /****************************************/
    /****************************************/
 
    bool QSwarmController::DetectCollision() {
-      // Get current position
-      const CCI_PositioningSensor::SReading& sReading = m_pcPositioning->GetReading();
-      CVector2 currentPos(sReading.Position.GetX(), sReading.Position.GetY());
-
-      // Check if robot moved very little (stuck/collision)
-      float distanceMoved = (currentPos - m_cPreviousPosition).Length();
-      
-      // Update previous position
-      m_cPreviousPosition = currentPos;
+      // Moved very little since the previous tick (stuck), or proximity
+      // readings above QSwarmSensors::COLLISION_READING
+      bool bColliding = QSwarmSensors::IsColliding(m_sSensors, m_cPreviousPosition.GetX(),
+                                                   m_cPreviousPosition.GetY(), m_fCollisionThreshold);
+
+      // Update previous position, from this tick's snapshot
+      m_cPreviousPosition.Set(m_sSensors.X, m_sSensors.Y);
+      return bColliding;
+   }
 
-      // If moved less than threshold, likely collision
-      if (distanceMoved < m_fCollisionThreshold) {
-         return true;
-      }
+   /****************************************/
+   /****************************************/
 
-      // Also check proximity sensors for very close obstacles
-      const CCI_FootBotProximitySensor::TReadings& tReadings = m_pcProximity->GetReadings();
-      for (size_t i = 0; i < tReadings.size(); ++i) {
-         if (tReadings[i].Value > 0.9f) {  // Very close obstacle
-            return true;
-         }
-      }
+   void QSwarmController::SendReward(float reward, bool done) {
+      if (m_pcTransport == NULL || !m_pcTransport->IsConnected()) return;
 
-      return false;
+      // Separate REWARD message, waits for the acknowledgment
+      m_pcTransport->SendReward(m_nRobotIdNum, reward, done);
    }
 
    /****************************************/
    /****************************************/
 
-   void QSwarmController::SendReward(float reward, bool done) {
-      if (!m_bConnected) return;
+   void QSwarmController::SetArena(const CVector2& c_origin, const CVector2& c_goal) {
+      m_cArenaOrigin = c_origin;
+      m_cGoalPosition = c_goal;
+   }
+
+   /****************************************/
+   /****************************************/
 
-      // Build reward message: "REWARD|robot_id|reward|done"
-      std::ostringstream oss;
-      oss << "REWARD|" << m_nRobotIdNum << "|" << reward << "|" << (done ? "1" : "0");
+   void QSwarmController::StopWheels() {
+      m_pcWheels->SetLinearVelocity(0.0f, 0.0f);
+   }
 
-      SendMessage(oss.str());
+   /****************************************/
+   /****************************************/
 
-      // Wait for acknowledgment
-      ReceiveMessage();
+   void QSwarmController::EnableLatency() {
+      if (!m_pcLatency) {
+         m_pcLatency.reset(new CQSwarmLatencyStats);
+      }
+      if (m_pcTransport != NULL) {
+         m_pcTransport->SetLatencyStats(m_pcLatency.get());
+      }
    }
 
    /****************************************/
    /****************************************/
 
    void QSwarmController::ResetEpisode() {
+      float fLastReward = m_fEpisodeReward;
+      int nLastSteps = m_nSteps;
+      uint8_t unLastOutcome = m_unEpisodeOutcome;
+
       // Increment episode counter
       m_nEpisode++;
       m_nSteps = 0;
       m_bEpisodeDone = false;
       m_fEpisodeReward = 0.0f;
+      m_unEpisodeOutcome = QSwarmEpisodeLog::OUTCOME_NONE;
+      m_unFreshActions = 0;
+      m_unStaleActions = 0;
+      m_unLateActions = 0;
+      m_nRepeatLeft = 0;
+      m_bRepeatedStep = false;
+      m_unDecisions = 0;
 
       // Stop the robot
       m_pcWheels->SetLinearVelocity(0.0f, 0.0f);
 
-      // Note: ARGoS will reset robot positions via the experiment file
+      // CQSwarmLoopFunctions has moved the robot back to its start position
+      // (robots stay where they are without the loop functions)
       // Update previous position
       const CCI_PositioningSensor::SReading& sReading = m_pcPositioning->GetReading();
       m_cPreviousPosition.Set(sReading.Position.GetX(), sReading.Position.GetY());
 
-      LOG << "[Robot " << m_strRobotId << "] Starting episode " << m_nEpisode << std::endl;
-   }
+      // Episode boundary: counters, position and pending reward go to the
+      // checkpoint (the writer thread does the I/O)
+      if (m_bCheckpoint) {
+         SaveCheckpoint(fLastReward, nLastSteps, unLastOutcome);
+      }
 
-   /****************************************/
-   /****************************************/
+      UpdateEpsilon();
 
-   bool QSwarmController::SendMessage(const std::string& message) {
-      if (m_nSocket < 0 || !m_bConnected) return false;
+      // Pick up a policy file replaced by the trainer since the last episode
+      if (m_eInference == INFERENCE_NATIVE) {
+         ReloadPolicy();
+      }
 
-      std::string msg = message + "\n";  // Add newline delimiter
-      int sent = send(m_nSocket, msg.c_str(), msg.length(), 0);
-      
-      return sent > 0;
+      LOG << "[Robot " << m_strRobotId << "] Starting episode " << m_nEpisode << std::endl;
    }
 
    /****************************************/
    /****************************************/
 
-   std::string QSwarmController::ReceiveMessage() {
-      if (m_nSocket < 0 || !m_bConnected) return "";
-
-      char buffer[4096];
-      int received = recv(m_nSocket, buffer, sizeof(buffer) - 1, 0);
-      
-      if (received > 0) {
-         buffer[received] = '\0';
-         std::string msg(buffer);
-         
-         // Remove newline if present
-         if (!msg.empty() && msg.back() == '\n') {
-            msg.pop_back();
-         }
-         
-         return msg;
+   void QSwarmController::ReloadPolicy() {
+      bool bChanged = false;
+      std::string strError;
+      if (!m_cPolicy.Reload(bChanged, strError)) {
+         LOGERR << "[Robot " << m_strRobotId << "] Cannot reload policy " << m_strPolicyFile
+                << ": " << strError << ". Keeping the current weights" << std::endl;
+      }
+      else if (bChanged) {
+         LOG << "[Robot " << m_strRobotId << "] Reloaded policy " << m_strPolicyFile << std::endl;
       }
-
-      return "";
    }
 
    /****************************************/
    /****************************************/
 
    void QSwarmController::CloseConnection() {
-      if (m_nSocket >= 0) {
-         #ifdef _WIN32
-            closesocket(m_nSocket);
-            WSACleanup();
-         #else
-            close(m_nSocket);
-         #endif
-         m_nSocket = -1;
+      if (m_pcTransport != NULL) {
+         m_pcTransport->Close();
+         delete m_pcTransport;
+         m_pcTransport = NULL;
          m_bConnected = false;
       }
    }
@@ -14,30 +14,42 @@
 #include <argos3/plugins/robots/generic/control_interface/ci_positioning_sensor.h>
 #include <argos3/plugins/robots/foot-bot/control_interface/ci_footbot_proximity_sensor.h>
 #include <argos3/core/utility/math/vector2.h>
+#include <argos3/core/utility/math/angles.h>
 #include <argos3/core/utility/logging/argos_log.h>
 
+#include "q_swarm_protocol.h"
+#include "q_swarm_transport.h"
+#include "q_swarm_policy.h"
+#include "q_swarm_endpoints.h"
+#include "q_swarm_neighbours.h"
+#include "q_swarm_latency.h"
+#include "q_swarm_sensors.h"
+#include "q_swarm_random.h"
+
+#include <array>
 #include <string>
 #include <vector>
 #include <memory>
 
-// For socket communication
-#ifdef _WIN32
-    #include <winsock2.h>
-    #include <ws2tcpip.h>
-    #pragma comment(lib, "ws2_32.lib")
-#else
-    #include <sys/socket.h>
-    #include <arpa/inet.h>
-    #include <unistd.h>
-    #include <netinet/in.h>
-#endif
-
 namespace argos {
 
    class QSwarmController : public CCI_Controller {
 
    public:
 
+      /* State vector: x, y, goal_x, goal_y, prox_0, ..., prox_23 */
+      typedef std::array<float, QSwarmProtocol::STATE_SIZE> TState;
+
+      /* How the action for each tick is obtained */
+      enum EInferenceMode {
+         INFERENCE_SOCKET,   /* per-robot request to the Q-Network server */
+         INFERENCE_BATCHED,  /* one request per tick for the whole swarm,
+                                sent by CQSwarmLoopFunctions */
+         INFERENCE_NATIVE    /* in-process forward pass (CQSwarmPolicy),
+                                epsilon-greedy with a local schedule,
+                                no learning */
+      };
+
       /* Constructor */
       QSwarmController();
 
@@ -67,6 +79,147 @@ namespace argos {
        */
       virtual void Destroy();
 
+      /*
+       * Batched inference interface (used by CQSwarmLoopFunctions)
+       *
+       * In batched mode ControlStep only collects the state and waits.
+       * The loop functions gather the states of all waiting robots,
+       * send them in a single request and hand each robot its action
+       * through ApplyAction(), which finishes the step.
+       */
+      bool IsBatched() const {
+         return m_eInference == INFERENCE_BATCHED;
+      }
+
+      bool IsAwaitingAction() const {
+         return m_bAwaitingAction;
+      }
+
+      int GetRobotIdNum() const {
+         return m_nRobotIdNum;
+      }
+
+      const TState& GetCurrentState() const {
+         return m_cState;
+      }
+
+      float GetPendingReward() const {
+         return m_fPendingReward;
+      }
+
+      /*
+       * STEP flags describing the pending reward
+       */
+      uint8_t GetPendingFlags() const;
+
+      /*
+       * Execute the action for the current tick and compute its reward
+       */
+      void ApplyAction(int action);
+
+      /*
+       * Action used when no answer from the Q-Network is available
+       */
+      int GetFallbackAction();
+
+      /*
+       * Native inference: n_greedy, or a random action with the episode's
+       * epsilon (epsilon_start * epsilon_decay^episode, at least
+       * epsilon_end), drawn from this robot's stream
+       */
+      int Explore(int n_greedy);
+
+      /*
+       * Sub-arena interface (used by CQSwarmLoopFunctions)
+       *
+       * With several arenas tiled in one simulation each robot gets the
+       * origin and goal of its arena; its state then holds positions
+       * relative to the origin, so every arena looks like the first one.
+       */
+      void SetArena(const CVector2& c_origin, const CVector2& c_goal);
+
+      /*
+       * Scenarios: a robot whose episode ended waits (wheels stopped, next
+       * episode not started) until the loop functions have laid out the
+       * next scenario of its arena
+       */
+      void SetWaiting(bool b_waiting) {
+         m_bWaiting = b_waiting;
+      }
+
+      bool IsWaiting() const {
+         return m_bWaiting;
+      }
+
+      /*
+       * Neighbour index rebuilt by the loop functions every tick, and this
+       * robot's index in it (without one the neighbour features are zero)
+       */
+      void SetNeighbourIndex(const CQSwarmNeighbourIndex* pc_index, size_t un_slot) {
+         m_pcNeighbours = pc_index;
+         m_unNeighbourSlot = un_slot;
+      }
+
+      const CVector2& GetGoal() const {
+         return m_cGoalPosition;
+      }
+
+      /* The last step ended the episode (reset at the next ControlStep) */
+      bool IsEpisodeDone() const {
+         return m_bEpisodeDone;
+      }
+
+      int GetEpisode() const {
+         return m_nEpisode;
+      }
+
+      /* All max_episodes episodes are done: the robot stands still */
+      bool IsFinished() const {
+         return m_nEpisode >= m_nMaxEpisodes;
+      }
+
+      float GetEpisodeReward() const {
+         return m_fEpisodeReward;
+      }
+
+      /* Steps of the current episode */
+      int GetSteps() const {
+         return m_nSteps;
+      }
+
+      /* How the last episode ended (QSwarmEpisodeLog::OUTCOME_*) */
+      uint8_t GetEpisodeOutcome() const {
+         return m_unEpisodeOutcome;
+      }
+
+      bool IsAtGoal() {
+         return ReachedGoal();
+      }
+
+      /*
+       * The loop functions moved the robot back to its start position:
+       * stop the wheels before the next physics step
+       */
+      void StopWheels();
+
+      /*
+       * Latency instrumentation (turned on by CQSwarmLoopFunctions when
+       * it has a latency_file): every step records its phases into this
+       * robot's histograms. NULL while disabled
+       */
+      void EnableLatency();
+
+      CQSwarmLatencyStats* GetLatency() {
+         return m_pcLatency.get();
+      }
+
+      /*
+       * Continued from a checkpoint (resume attribute): where the robot
+       * was when the checkpoint was taken, for the loop functions to put
+       * it back there
+       */
+      bool GetResumePose(CVector2& c_position, CRadians& c_yaw) const;
+
    private:
 
       /* Pointer to the differential steering actuator */
@@ -85,6 +238,16 @@ namespace argos {
       /* Goal position (target to reach) */
       CVector2 m_cGoalPosition;
 
+      /* Origin of the robot's sub-arena (subtracted from state positions) */
+      CVector2 m_cArenaOrigin;
+
+      /* Sensor readings of the current tick (see ReadSensors()) */
+      QSwarmSensors::SSnapshot m_sSensors;
+
+      /* Neighbour index of the swarm (NULL without the loop functions) */
+      const CQSwarmNeighbourIndex* m_pcNeighbours;
+      size_t m_unNeighbourSlot;
+
       /* Current episode number */
       int m_nEpisode;
 
@@ -97,10 +260,101 @@ namespace argos {
       /* Maximum number of episodes */
       int m_nMaxEpisodes;
 
-      /* Socket for communication with Python Q-Network */
-      int m_nSocket;
+      /* Transport for communication with Python Q-Network (owned) */
+      CQSwarmTransport* m_pcTransport;
+
+      /*
+       * Transport selection: "tcp" (socket), "pool" (sockets shared by the
+       * robots of the process) or "shm" (shared memory)
+       */
+      std::string m_strTransport;
+
+      /* Shared memory segment name (shm transport) */
+      std::string m_strShmName;
+
+      /* Q-Network server address (tcp and pool transports) */
+      std::string m_strHost;
+      int m_nPort;
+
+      /*
+       * All servers of the swarm (servers="host:port,..." or host/port);
+       * m_strHost/m_nPort is this robot's shard
+       */
+      TQSwarmEndpoints m_tServers;
+
+      /* Connections shared by all robots (pool transport) */
+      int m_nPoolSize;
+
+      /* Connection state seen by the last MaintainConnection() */
       bool m_bConnected;
 
+      /* The connection went up or down during the current step */
+      bool m_bConnectionChanged;
+
+      /* How actions are obtained (see EInferenceMode) */
+      EInferenceMode m_eInference;
+
+      /* Weights file and policy for native inference */
+      std::string m_strPolicyFile;
+      CQSwarmPolicy m_cPolicy;
+
+      /* SIMD kernel for native inference ("auto" = best for this CPU) */
+      std::string m_strKernel;
+
+      /* State collected in the current tick (reused, no allocation per tick) */
+      TState m_cState;
+
+      /* Batched mode: state collected, waiting for ApplyAction() */
+      bool m_bAwaitingAction;
+
+      /* Wire protocol: true = binary frames, false = text messages */
+      bool m_bBinaryProtocol;
+
+      /*
+       * Combined step: the reward of the previous tick travels with the
+       * next state (one round trip per tick) instead of a separate REWARD
+       */
+      bool m_bCombinedStep;
+
+      /*
+       * Compact state encoding (COMPACT_STEP frames, binary STEP over tcp
+       * or pool only)
+       */
+      bool m_bCompactState;
+
+      /* Reward of the previous tick, not yet sent (combined step mode) */
+      float m_fPendingReward;
+      bool m_bPendingDone;
+      bool m_bHasPendingReward;
+
+      /*
+       * Pipelined requests (socket inference): each tick sends its state
+       * without waiting and executes the newest action that already
+       * arrived (normally the answer for the previous tick)
+       */
+      bool m_bPipelined;
+
+      /* Action when none arrived in time (-1 = repeat the last action) */
+      int m_nFallbackAction;
+      int m_nLastAction;
+
+      /* Requests sent and not answered yet */
+      uint32_t m_unRequestsInFlight;
+
+      /*
+       * Answers still due for requests sent before Reset(): they belong to
+       * the previous run and are dropped when they arrive
+       */
+      uint32_t m_unStaleReplies;
+
+      /*
+       * Actions of the current episode: answer to the previous tick
+       * (fresh), to an older one (stale) or none yet (late, fallback used)
+       */
+      uint32_t m_unFreshActions;
+      uint32_t m_unStaleActions;
+      uint32_t m_unLateActions;
+
       /* Previous position (for collision detection) */
       CVector2 m_cPreviousPosition;
 
@@ -116,32 +370,164 @@ namespace argos {
       /* Episode done flag */
       bool m_bEpisodeDone;
 
+      /* Held by the loop functions between two scenarios */
+      bool m_bWaiting;
+
       /* Accumulated reward for current episode */
       float m_fEpisodeReward;
 
+      /* Outcome of the episode once it is done (QSwarmEpisodeLog::OUTCOME_*) */
+      uint8_t m_unEpisodeOutcome;
+
+      /* Phase timings of this robot's steps (NULL unless enabled) */
+      std::unique_ptr<CQSwarmLatencyStats> m_pcLatency;
+
+      /* Steps are appended to the trajectory log (record_file) */
+      bool m_bRecording;
+
+      /* A checkpoint is taken at every episode start (checkpoint_file) */
+      bool m_bCheckpoint;
+
+      /* Restored from a checkpoint, and the pose it was taken at */
+      bool m_bResumed;
+      CVector2 m_cResumePosition;
+      CRadians m_cResumeYaw;
+
+      /*
+       * This robot's random stream (experiment random_seed, robot id) for
+       * fallback actions and exploration
+       */
+      CQSwarmRandom m_cRandom;
+
+      /* Exploration of native inference, and its value for the current episode */
+      float m_fEpsilonStart;
+      float m_fEpsilonEnd;
+      float m_fEpsilonDecay;
+      float m_fEpsilon;
+
+      /*
+       * Action repeat: an action is held for up to action_repeat ticks
+       * without asking for a new one; adaptive mode asks earlier when an
+       * obstacle appears or the sensed part of the state (proximity,
+       * neighbours) moves more than m_fRepeatThreshold from the state the
+       * action was chosen for. The rewards of the held ticks add up to the
+       * reward of one transition.
+       */
+      int m_nActionRepeat;
+      bool m_bAdaptiveRepeat;
+      float m_fRepeatThreshold;
+
+      /* Ticks the held action still runs, the action and its state */
+      int m_nRepeatLeft;
+      int m_nHeldAction;
+      bool m_bRepeatedStep;
+      TState m_cDecisionState;
+      float m_fDecisionMax;
+
+      /* Summed reward of the held ticks not sent yet (separate REWARD messages) */
+      float m_fRepeatReward;
+      bool m_bRepeatRewardDeferred;
+
+      /* Actions chosen in the current episode */
+      uint32_t m_unDecisions;
+
       /*
        * Connect to the Python Q-Network server
        * Returns true if successful
        */
       bool ConnectToQNetwork();
 
+      /*
+       * Advance the background connection (never blocks) and log when it
+       * goes up or down; requests in flight are lost with the connection
+       * Returns true while the connection is usable
+       */
+      bool MaintainConnection();
+
       /*
        * Send state to Q-Network and receive action
        * State includes: robot position, goal position, proximity readings
+       * In combined step mode the pending reward is sent along with it
        * Returns action ID (0=forward, 1=left, 2=right, 3=stop)
        */
-      int GetActionFromQNetwork(const std::vector<float>& state);
+      int GetActionFromQNetwork(const TState& state);
+
+      /*
+       * Pipelined variant of GetActionFromQNetwork: sends the state and
+       * returns the newest action received so far (never blocks)
+       */
+      int GetActionPipelined(const TState& state);
 
       /*
-       * Send reward feedback to Q-Network
+       * Greedy action from the in-process policy (native inference)
+       */
+      int GetActionFromPolicy(const TState& state);
+
+      /*
+       * Load m_strPolicyFile for native inference
+       * Returns true if successful
+       */
+      bool LoadPolicy();
+
+      /*
+       * Switch to a newer policy file if the trainer replaced it
+       * (called at episode boundaries)
+       */
+      void ReloadPolicy();
+
+      /*
+       * Send reward feedback to Q-Network (separate round trip)
        */
       void SendReward(float reward, bool done);
 
       /*
-       * Collect current state from sensors
-       * Returns: [x, y, goal_x, goal_y, prox_0, ..., prox_23]
+       * Second half of ControlStep: execute the action, compute the
+       * reward and check for the end of the episode
+       */
+      void FinishStep(int action, bool b_repeated = false);
+
+      /*
+       * A new action is needed this tick (the held one ran out, or
+       * adaptive repeat saw the surroundings change)
+       */
+      bool IsDecisionDue() const;
+
+      /*
+       * Start holding the action chosen this tick; sends the reward of the
+       * previous hold if it is still pending
+       */
+      void StartDecision();
+
+      /*
+       * Append the step (state, action, reward, episode end) to the
+       * trajectory log
+       */
+      void RecordStep(int action, float reward, bool done);
+
+      /*
+       * Report heap allocations made by a steady state step since
+       * un_before (Q_SWARM_COUNT_ALLOCATIONS builds only)
        */
-      std::vector<float> GetState();
+      void CheckAllocations(uint64_t un_before);
+
+      /*
+       * Read the proximity and positioning sensors into m_sSensors, once
+       * per tick: the state, the reward and the collision check use it
+       */
+      void ReadSensors();
+
+      /*
+       * Collect current state from the sensor snapshot into state:
+       * [x, y, goal_x, goal_y, prox_0, ..., prox_23] (8 sector maxima
+       * instead of the 24 readings in Q_SWARM_PROXIMITY_SECTORS builds)
+       */
+      void GetState(TState& state);
+
+      /*
+       * Write the QSwarmProtocol::NEIGHBOURS neighbour features of the
+       * state (dx, dy divided by the radius, present flag)
+       */
+      void GetNeighbourFeatures(float* features);
 
       /*
        * Execute the selected action
@@ -166,7 +552,8 @@ namespace argos {
       bool ReachedGoal();
 
       /*
-       * Check if robot collided (stuck or didn't move)
+       * Check if robot collided (stuck or didn't move, or an obstacle
+       * touching it)
        */
       bool DetectCollision();
 
@@ -176,17 +563,24 @@ namespace argos {
       void ResetEpisode();
 
       /*
-       * Send message through socket
+       * Exploration rate of the current episode (m_fEpsilon)
+       */
+      void UpdateEpsilon();
+
+      /*
+       * Set up checkpoint_file (and resume from it) after the other
+       * parameters have been read
        */
-      bool SendMessage(const std::string& message);
+      void InitCheckpoint(TConfigurationNode& t_node);
 
       /*
-       * Receive message from socket
+       * Hand the state at the start of the episode, and how the previous
+       * one ended, to the checkpoint writer (written in the background)
        */
-      std::string ReceiveMessage();
+      void SaveCheckpoint(float f_last_reward, int n_last_steps, uint8_t un_last_outcome);
 
       /*
-       * Close socket connection
+       * Close and release the transport
        */
       void CloseConnection();
 
@@ -0,0 +1,80 @@
+/*
+ * Q-Swarm Server Endpoints Implementation
+ */
+
+#include "q_swarm_endpoints.h"
+
+#include <stdlib.h>
+
+namespace argos {
+
+   /****************************************/
+   /****************************************/
+
+   bool ParseEndpoints(const std::string& str_list,
+                       int n_default_port,
+                       TQSwarmEndpoints& t_endpoints,
+                       std::string& str_error) {
+      t_endpoints.clear();
+      size_t start = 0;
+      while (start <= str_list.size()) {
+         size_t end = str_list.find(',', start);
+         if (end == std::string::npos) {
+            end = str_list.size();
+         }
+
+         // Trim spaces around the entry
+         size_t first = str_list.find_first_not_of(" \t", start);
+         size_t last = str_list.find_last_not_of(" \t", end - 1);
+         if (first == std::string::npos || first >= end || last < first) {
+            str_error = "empty entry in '" + str_list + "'";
+            return false;
+         }
+         std::string strEntry = str_list.substr(first, last - first + 1);
+
+         SQSwarmEndpoint sEndpoint;
+         sEndpoint.Port = n_default_port;
+         size_t colon = strEntry.rfind(':');
+         if (colon == std::string::npos) {
+            sEndpoint.Host = strEntry;
+         }
+         else {
+            sEndpoint.Host = strEntry.substr(0, colon);
+            std::string strPort = strEntry.substr(colon + 1);
+            char* pcEnd = NULL;
+            long port = strtol(strPort.c_str(), &pcEnd, 10);
+            if (strPort.empty() || *pcEnd != '\0' || port <= 0 || port > 65535) {
+               str_error = "invalid port in '" + strEntry + "'";
+               return false;
+            }
+            sEndpoint.Port = static_cast<int>(port);
+         }
+         if (sEndpoint.Host.empty()) {
+            str_error = "missing host in '" + strEntry + "'";
+            return false;
+         }
+         t_endpoints.push_back(sEndpoint);
+
+         start = end + 1;
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t ShardOf(uint32_t robot_id, size_t un_shards) {
+      if (un_shards <= 1) {
+         return 0;
+      }
+      // MurmurHash3 fmix32: neighbouring ids land on unrelated servers
+      uint32_t h = robot_id;
+      h ^= h >> 16;
+      h *= 0x85ebca6bU;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35U;
+      h ^= h >> 16;
+      return h % un_shards;
+   }
+
+}
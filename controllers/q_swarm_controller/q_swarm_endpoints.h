@@ -0,0 +1,47 @@
+#ifndef Q_SWARM_ENDPOINTS_H
+#define Q_SWARM_ENDPOINTS_H
+
+/*
+ * Q-Swarm Server Endpoints
+ *
+ * Several Q-Network servers can serve one swarm: the servers="..."
+ * parameter lists them ("host:port,host:port,...") and every robot is
+ * assigned to one of them by a hash of its id. The hash is fixed (the
+ * 32-bit MurmurHash3 finalizer), so the assignment does not depend on
+ * the process, the order robots are created in or the transport, and
+ * python/q_protocol.py (shard_of) computes the same one.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   struct SQSwarmEndpoint {
+      std::string Host;
+      int Port;
+   };
+
+   typedef std::vector<SQSwarmEndpoint> TQSwarmEndpoints;
+
+   /*
+    * Parse "host:port,host:port,..." (a missing port means n_default_port)
+    * Returns false (and sets str_error) if an entry is malformed
+    */
+   bool ParseEndpoints(const std::string& str_list,
+                       int n_default_port,
+                       TQSwarmEndpoints& t_endpoints,
+                       std::string& str_error);
+
+   /*
+    * Index of the server (0 to un_shards - 1) serving robot_id
+    */
+   size_t ShardOf(uint32_t robot_id, size_t un_shards);
+
+}
+
+#endif
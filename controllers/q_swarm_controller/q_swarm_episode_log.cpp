@@ -0,0 +1,259 @@
+/*
+ * Q-Swarm Episode Log Implementation
+ */
+
+#include "q_swarm_episode_log.h"
+
+#include <string.h>
+#include <chrono>
+#include <sstream>
+
+namespace argos {
+
+   static_assert(sizeof(QSwarmEpisodeLog::SHeader) == QSwarmEpisodeLog::HEADER_SIZE,
+                 "episode log header layout");
+   static_assert(QSwarmEpisodeLog::RECORD_SIZE == 32,
+                 "episode log records must not be padded");
+
+   namespace {
+
+      /* Monotonic milliseconds, for the flush interval */
+      uint64_t SteadyMs() {
+         return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+      }
+
+      std::string RotatedPath(const std::string& str_path, size_t un_index) {
+         std::ostringstream cPath;
+         cPath << str_path << "." << un_index;
+         return cPath.str();
+      }
+
+      /* Append the complete records of one file */
+      bool ReadFile(const std::string& str_path,
+                    std::vector<QSwarmEpisodeLog::SRecord>& vec_records,
+                    std::string& str_error) {
+         FILE* pFile = fopen(str_path.c_str(), "rb");
+         if (pFile == NULL) {
+            str_error = "cannot open " + str_path;
+            return false;
+         }
+         QSwarmEpisodeLog::SHeader sHeader;
+         if (fread(&sHeader, sizeof(sHeader), 1, pFile) != 1 ||
+             sHeader.Magic != QSwarmEpisodeLog::MAGIC ||
+             sHeader.Version != QSwarmEpisodeLog::VERSION ||
+             sHeader.RecordSize != QSwarmEpisodeLog::RECORD_SIZE) {
+            str_error = str_path + " is not an episode log";
+            fclose(pFile);
+            return false;
+         }
+         QSwarmEpisodeLog::SRecord sRecord;
+         while (fread(&sRecord, sizeof(sRecord), 1, pFile) == 1) {
+            vec_records.push_back(sRecord);
+         }
+         fclose(pFile);
+         return true;
+      }
+
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmEpisodeLog::CQSwarmEpisodeLog() :
+      m_pFile(NULL),
+      m_unRotateBytes(0),
+      m_unKeep(0),
+      m_unFlushMs(0),
+      m_unFileBytes(0),
+      m_unRecords(0),
+      m_unLastFlush(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmEpisodeLog::~CQSwarmEpisodeLog() {
+      Close();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint64_t CQSwarmEpisodeLog::WallTime() {
+      return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+         std::chrono::system_clock::now().time_since_epoch()).count());
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmEpisodeLog::Read(const std::string& str_path,
+                                std::vector<QSwarmEpisodeLog::SRecord>& vec_records,
+                                std::string& str_error) {
+      vec_records.clear();
+      size_t unRotated = 0;
+      while (true) {
+         FILE* pFile = fopen(RotatedPath(str_path, unRotated + 1).c_str(), "rb");
+         if (pFile == NULL) {
+            break;
+         }
+         fclose(pFile);
+         ++unRotated;
+      }
+      for (size_t i = unRotated; i > 0; --i) {
+         if (!ReadFile(RotatedPath(str_path, i), vec_records, str_error)) {
+            return false;
+         }
+      }
+      return ReadFile(str_path, vec_records, str_error);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmEpisodeLog::Open(const std::string& str_path,
+                                uint64_t un_rotate_bytes,
+                                size_t un_keep,
+                                uint64_t un_flush_ms,
+                                std::string& str_error) {
+      Close();
+      m_strPath = str_path;
+      m_unRotateBytes = un_rotate_bytes;
+      m_unKeep = un_keep;
+      m_unFlushMs = un_flush_ms;
+      m_unRecords = 0;
+
+      // The previous run's log becomes path.1
+      FILE* pExisting = fopen(str_path.c_str(), "rb");
+      if (pExisting != NULL) {
+         fclose(pExisting);
+         Rotate();
+      }
+
+      if (!StartFile(str_error)) {
+         return false;
+      }
+      m_vecBuffer.reserve(QSwarmEpisodeLog::BUFFER_RECORDS);
+      m_unLastFlush = SteadyMs();
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmEpisodeLog::StartFile(std::string& str_error) {
+      m_pFile = fopen(m_strPath.c_str(), "wb");
+      if (m_pFile == NULL) {
+         str_error = "cannot create " + m_strPath;
+         return false;
+      }
+      // Records are buffered here; what was flushed must reach the file
+      setvbuf(m_pFile, NULL, _IONBF, 0);
+
+      QSwarmEpisodeLog::SHeader sHeader;
+      memset(&sHeader, 0, sizeof(sHeader));
+      sHeader.Magic = QSwarmEpisodeLog::MAGIC;
+      sHeader.Version = QSwarmEpisodeLog::VERSION;
+      sHeader.RecordSize = QSwarmEpisodeLog::RECORD_SIZE;
+      if (fwrite(&sHeader, sizeof(sHeader), 1, m_pFile) != 1) {
+         str_error = "cannot write " + m_strPath;
+         fclose(m_pFile);
+         m_pFile = NULL;
+         return false;
+      }
+      m_unFileBytes = sizeof(sHeader);
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmEpisodeLog::Rotate() {
+      if (m_unKeep == 0) {
+         remove(m_strPath.c_str());
+         return;
+      }
+      remove(RotatedPath(m_strPath, m_unKeep).c_str());
+      for (size_t i = m_unKeep; i > 1; --i) {
+         rename(RotatedPath(m_strPath, i - 1).c_str(), RotatedPath(m_strPath, i).c_str());
+      }
+      rename(m_strPath.c_str(), RotatedPath(m_strPath, 1).c_str());
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmEpisodeLog::Append(QSwarmEpisodeLog::SRecord s_record) {
+      if (m_pFile == NULL) {
+         return;
+      }
+      s_record.Time = WallTime();
+      s_record.Reserved = 0;
+      s_record.Reserved2 = 0;
+      m_vecBuffer.push_back(s_record);
+      ++m_unRecords;
+      if (m_vecBuffer.size() >= QSwarmEpisodeLog::BUFFER_RECORDS) {
+         Flush();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmEpisodeLog::Poll() {
+      if (m_pFile == NULL || m_vecBuffer.empty()) {
+         return;
+      }
+      if (SteadyMs() - m_unLastFlush >= m_unFlushMs) {
+         Flush();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmEpisodeLog::Flush() {
+      m_unLastFlush = SteadyMs();
+      if (m_pFile == NULL || m_vecBuffer.empty()) {
+         return true;
+      }
+
+      uint64_t unBytes = m_vecBuffer.size() * QSwarmEpisodeLog::RECORD_SIZE;
+      if (m_unRotateBytes > 0 && m_unFileBytes > QSwarmEpisodeLog::HEADER_SIZE &&
+          m_unFileBytes + unBytes > m_unRotateBytes) {
+         fclose(m_pFile);
+         m_pFile = NULL;
+         Rotate();
+         std::string strError;
+         if (!StartFile(strError)) {
+            // Nowhere to write to: the log stops
+            m_vecBuffer.clear();
+            return false;
+         }
+      }
+
+      size_t unWritten = fwrite(&m_vecBuffer[0], QSwarmEpisodeLog::RECORD_SIZE,
+                                m_vecBuffer.size(), m_pFile);
+      m_unFileBytes += unWritten * QSwarmEpisodeLog::RECORD_SIZE;
+      bool bOk = (unWritten == m_vecBuffer.size());
+      m_vecBuffer.clear();
+      return bOk;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmEpisodeLog::Close() {
+      if (m_pFile == NULL) {
+         return;
+      }
+      Flush();
+      if (m_pFile != NULL) {
+         fclose(m_pFile);
+         m_pFile = NULL;
+      }
+      m_vecBuffer.clear();
+   }
+
+}
@@ -0,0 +1,161 @@
+#ifndef Q_SWARM_EPISODE_LOG_H
+#define Q_SWARM_EPISODE_LOG_H
+
+/*
+ * Q-Swarm Episode Log
+ *
+ * One fixed-size record per finished episode (robot, arena, episode,
+ * steps, reward, outcome, wall clock time), written by the loop functions
+ * (episode_log attribute) while the run goes on. Dashboards tail the file
+ * (python/q_episode_log.py) and only read what was appended since their
+ * last look.
+ *
+ * File layout (host byte order, little-endian on all supported targets):
+ *    SHeader                64 bytes ("QSEP", version, record size)
+ *    SRecord[...]           RECORD_SIZE bytes each, in the order the episodes ended
+ *
+ * The file is append-only with no trailer: after a crash it holds every
+ * record up to the last flush (a partly written last record is ignored).
+ * Records are buffered and written every flush interval, and when the
+ * file reaches its size limit it is rotated like a system log: path
+ * becomes path.1, path.1 becomes path.2 and so on up to the number of
+ * kept files, and a new path is started. Opening the log rotates an
+ * existing file too, so each run starts a new segment.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   namespace QSwarmEpisodeLog {
+
+      const uint32_t MAGIC = 0x50455351;  /* "QSEP" little-endian */
+      const uint32_t VERSION = 1;
+      const size_t HEADER_SIZE = 64;
+
+      /* SRecord::Outcome */
+      const uint8_t OUTCOME_NONE = 0;
+      const uint8_t OUTCOME_GOAL = 1;
+      const uint8_t OUTCOME_COLLISION = 2;
+      const uint8_t OUTCOME_TIMEOUT = 3;   /* max_steps reached */
+
+      struct SHeader {
+         uint32_t Magic;
+         uint32_t Version;
+         uint32_t RecordSize;
+         uint8_t Reserved[HEADER_SIZE - 3 * sizeof(uint32_t)];
+      };
+
+      struct SRecord {
+         uint64_t Time;                    /* end of the episode, ms since the Unix epoch */
+         uint32_t RobotId;
+         uint32_t Episode;
+         uint32_t Steps;
+         float Reward;
+         uint8_t Outcome;                  /* OUTCOME_* */
+         uint8_t Reserved;
+         uint16_t Arena;
+         uint32_t Reserved2;
+      };
+
+      const size_t RECORD_SIZE = sizeof(SRecord);
+
+      /* Records written at once at most (more are written in several blocks) */
+      const size_t BUFFER_RECORDS = 1024;
+
+   }
+
+   class CQSwarmEpisodeLog {
+
+   public:
+
+      CQSwarmEpisodeLog();
+
+      ~CQSwarmEpisodeLog();
+
+      /*
+       * Start a new log at str_path (an existing one is rotated away)
+       * un_rotate_bytes: size at which the file is rotated (0: never)
+       * un_keep:         rotated files kept (path.1 .. path.N)
+       * un_flush_ms:     longest time a record stays buffered
+       * Returns false if the file cannot be created
+       */
+      bool Open(const std::string& str_path,
+                uint64_t un_rotate_bytes,
+                size_t un_keep,
+                uint64_t un_flush_ms,
+                std::string& str_error);
+
+      bool IsOpen() const {
+         return m_pFile != NULL;
+      }
+
+      /* Add one record (written at the next flush), stamped with the current time */
+      void Append(QSwarmEpisodeLog::SRecord s_record);
+
+      /* Write the buffered records if the flush interval has expired */
+      void Poll();
+
+      /*
+       * Write the buffered records, rotating the file first if they
+       * would make it exceed its size limit
+       * Returns false if they could not be written
+       */
+      bool Flush();
+
+      /* Flush and close */
+      void Close();
+
+      uint64_t GetRecordCount() const {
+         return m_unRecords;
+      }
+
+      /* Milliseconds since the Unix epoch */
+      static uint64_t WallTime();
+
+      /*
+       * Read the records of the log at str_path and of its rotated files,
+       * oldest first (like read_log() in python/q_episode_log.py)
+       * Returns false if str_path is missing or not an episode log
+       */
+      static bool Read(const std::string& str_path,
+                       std::vector<QSwarmEpisodeLog::SRecord>& vec_records,
+                       std::string& str_error);
+
+   private:
+
+      CQSwarmEpisodeLog(const CQSwarmEpisodeLog&);
+      CQSwarmEpisodeLog& operator=(const CQSwarmEpisodeLog&);
+
+      /* Shift path.N-1 .. path to path.N .. path.1 (file closed) */
+      void Rotate();
+
+      /* Create path and write the header */
+      bool StartFile(std::string& str_error);
+
+      std::string m_strPath;
+      FILE* m_pFile;
+      uint64_t m_unRotateBytes;
+      size_t m_unKeep;
+      uint64_t m_unFlushMs;
+
+      /* Bytes in the current file, records in all files */
+      uint64_t m_unFileBytes;
+      uint64_t m_unRecords;
+
+      /* Monotonic time of the last flush (ms) */
+      uint64_t m_unLastFlush;
+
+      std::vector<QSwarmEpisodeLog::SRecord> m_vecBuffer;
+
+   };
+
+}
+
+#endif
@@ -0,0 +1,411 @@
+/*
+ * Q-Swarm Dense Layer Kernels Implementation
+ *
+ * Scalar, SSE and NEON kernels and the runtime dispatch.
+ * The AVX2/FMA kernel is in q_swarm_kernels_avx2.cpp.
+ */
+
+#include "q_swarm_kernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+   #include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+   #include <arm_neon.h>
+#endif
+
+namespace argos {
+
+   namespace QSwarmKernels {
+
+      /****************************************/
+      /****************************************/
+
+      namespace {
+
+         template <typename T>
+         void DenseScalarImpl(const T* weights, const float* scales, const float* biases,
+                              size_t inputs, size_t blocks, bool relu,
+                              const float* in, size_t in_stride,
+                              float* out, size_t out_stride, size_t rows) {
+            for (size_t r = 0; r < rows; ++r) {
+               const float* x = in + r * in_stride;
+               float* y = out + r * out_stride;
+
+               for (size_t b = 0; b < blocks; ++b) {
+                  const T* w = weights + b * inputs * BLOCK_WIDTH;
+                  float acc[BLOCK_WIDTH] = { 0.0f };
+                  for (size_t i = 0; i < inputs; ++i, w += BLOCK_WIDTH) {
+                     for (size_t k = 0; k < BLOCK_WIDTH; ++k) {
+                        acc[k] += w[k] * x[i];
+                     }
+                  }
+                  for (size_t k = 0; k < BLOCK_WIDTH; ++k) {
+                     size_t j = b * BLOCK_WIDTH + k;
+                     float v = (scales != NULL ? acc[k] * scales[j] : acc[k]) + biases[j];
+                     y[j] = (relu && v < 0.0f) ? 0.0f : v;
+                  }
+               }
+            }
+         }
+
+      }
+
+      void DenseScalar(const float* weights, const float* biases,
+                       size_t inputs, size_t blocks, bool relu,
+                       const float* in, size_t in_stride,
+                       float* out, size_t out_stride, size_t rows) {
+         DenseScalarImpl<float>(weights, NULL, biases, inputs, blocks, relu,
+                                in, in_stride, out, out_stride, rows);
+      }
+
+      void DenseScalarInt8(const int8_t* weights, const float* scales, const float* biases,
+                           size_t inputs, size_t blocks, bool relu,
+                           const float* in, size_t in_stride,
+                           float* out, size_t out_stride, size_t rows) {
+         DenseScalarImpl<int8_t>(weights, scales, biases, inputs, blocks, relu,
+                                 in, in_stride, out, out_stride, rows);
+      }
+
+      /****************************************/
+      /****************************************/
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+      namespace {
+
+         /* float weights: out = acc + bias */
+         struct SSseFloatWeights {
+            typedef float TValue;
+            static void Load(const float* w, __m128& lo, __m128& hi) {
+               lo = _mm_loadu_ps(w);
+               hi = _mm_loadu_ps(w + 4);
+            }
+            static __m128 Finish(__m128 acc, const float*, const float* bias) {
+               return _mm_add_ps(acc, _mm_loadu_ps(bias));
+            }
+         };
+
+         /* int8 weights: sign-extended on load (SSE2 only), out = acc * scale + bias */
+         struct SSseInt8Weights {
+            typedef int8_t TValue;
+            static void Load(const int8_t* w, __m128& lo, __m128& hi) {
+               __m128i q8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(w));
+               __m128i q16 = _mm_srai_epi16(_mm_unpacklo_epi8(q8, q8), 8);
+               lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(q16, q16), 16));
+               hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(q16, q16), 16));
+            }
+            static __m128 Finish(__m128 acc, const float* scale, const float* bias) {
+               return _mm_add_ps(_mm_mul_ps(acc, _mm_loadu_ps(scale)), _mm_loadu_ps(bias));
+            }
+         };
+
+         /*
+          * ROWS inputs x BLOCKS blocks (two registers each): each weight
+          * vector is loaded once and used for every row
+          */
+         template <typename TWeights, size_t ROWS, size_t BLOCKS>
+         inline void DenseSseTile(const typename TWeights::TValue* weights,
+                                  const float* scale, const float* bias,
+                                  size_t inputs, bool relu,
+                                  const float* in, size_t in_stride,
+                                  float* out, size_t out_stride) {
+            __m128 acc[ROWS][2 * BLOCKS];
+            for (size_t r = 0; r < ROWS; ++r) {
+               for (size_t v = 0; v < 2 * BLOCKS; ++v) {
+                  acc[r][v] = _mm_setzero_ps();
+               }
+            }
+
+            const size_t blockStride = inputs * BLOCK_WIDTH;
+            for (size_t i = 0; i < inputs; ++i) {
+               __m128 w[2 * BLOCKS];
+               for (size_t b = 0; b < BLOCKS; ++b) {
+                  TWeights::Load(weights + b * blockStride + i * BLOCK_WIDTH, w[2 * b], w[2 * b + 1]);
+               }
+               for (size_t r = 0; r < ROWS; ++r) {
+                  __m128 x = _mm_set1_ps(in[r * in_stride + i]);
+                  for (size_t v = 0; v < 2 * BLOCKS; ++v) {
+                     acc[r][v] = _mm_add_ps(acc[r][v], _mm_mul_ps(w[v], x));
+                  }
+               }
+            }
+
+            // Scale/bias and fused ReLU epilogue
+            __m128 zero = _mm_setzero_ps();
+            for (size_t r = 0; r < ROWS; ++r) {
+               for (size_t v = 0; v < 2 * BLOCKS; ++v) {
+                  __m128 y = TWeights::Finish(acc[r][v], scale + v * 4, bias + v * 4);
+                  if (relu) {
+                     y = _mm_max_ps(y, zero);
+                  }
+                  _mm_storeu_ps(out + r * out_stride + v * 4, y);
+               }
+            }
+         }
+
+         template <typename TWeights>
+         void DenseSseImpl(const typename TWeights::TValue* weights,
+                           const float* scales, const float* biases,
+                           size_t inputs, size_t blocks, bool relu,
+                           const float* in, size_t in_stride,
+                           float* out, size_t out_stride, size_t rows) {
+            for (size_t r = 0; r < rows; r += 4) {
+               const float* x = in + r * in_stride;
+               float* y = out + r * out_stride;
+               size_t left = rows - r;
+
+               size_t b = 0;
+               if (left == 1) {
+                  // A single row needs more independent accumulators: 2 blocks at a time
+                  for (; b + 2 <= blocks; b += 2) {
+                     DenseSseTile<TWeights, 1, 2>(weights + b * inputs * BLOCK_WIDTH,
+                                                  scales + b * BLOCK_WIDTH, biases + b * BLOCK_WIDTH,
+                                                  inputs, relu, x, in_stride, y + b * BLOCK_WIDTH, out_stride);
+                  }
+               }
+               for (; b < blocks; ++b) {
+                  const typename TWeights::TValue* w = weights + b * inputs * BLOCK_WIDTH;
+                  const float* scale = scales + b * BLOCK_WIDTH;
+                  const float* bias = biases + b * BLOCK_WIDTH;
+                  float* yb = y + b * BLOCK_WIDTH;
+                  switch (left) {
+                     case 1:  DenseSseTile<TWeights, 1, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                     case 2:  DenseSseTile<TWeights, 2, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                     case 3:  DenseSseTile<TWeights, 3, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                     default: DenseSseTile<TWeights, 4, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                  }
+               }
+            }
+         }
+
+      }
+
+      void DenseSse(const float* weights, const float* biases,
+                    size_t inputs, size_t blocks, bool relu,
+                    const float* in, size_t in_stride,
+                    float* out, size_t out_stride, size_t rows) {
+         // The scales are not read for float weights
+         DenseSseImpl<SSseFloatWeights>(weights, biases, biases, inputs, blocks, relu,
+                                        in, in_stride, out, out_stride, rows);
+      }
+
+      void DenseSseInt8(const int8_t* weights, const float* scales, const float* biases,
+                        size_t inputs, size_t blocks, bool relu,
+                        const float* in, size_t in_stride,
+                        float* out, size_t out_stride, size_t rows) {
+         DenseSseImpl<SSseInt8Weights>(weights, scales, biases, inputs, blocks, relu,
+                                       in, in_stride, out, out_stride, rows);
+      }
+
+#endif
+
+      /****************************************/
+      /****************************************/
+
+#if defined(__ARM_NEON)
+
+      namespace {
+
+         inline float32x4_t MultiplyAdd(float32x4_t acc, float32x4_t w, float32x4_t x) {
+#if defined(__aarch64__)
+            return vfmaq_f32(acc, w, x);
+#else
+            return vmlaq_f32(acc, w, x);
+#endif
+         }
+
+         /* float weights: out = acc + bias */
+         struct SNeonFloatWeights {
+            typedef float TValue;
+            static void Load(const float* w, float32x4_t& lo, float32x4_t& hi) {
+               lo = vld1q_f32(w);
+               hi = vld1q_f32(w + 4);
+            }
+            static float32x4_t Finish(float32x4_t acc, const float*, const float* bias) {
+               return vaddq_f32(acc, vld1q_f32(bias));
+            }
+         };
+
+         /* int8 weights: widened on load, out = acc * scale + bias */
+         struct SNeonInt8Weights {
+            typedef int8_t TValue;
+            static void Load(const int8_t* w, float32x4_t& lo, float32x4_t& hi) {
+               int16x8_t q16 = vmovl_s8(vld1_s8(w));
+               lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(q16)));
+               hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(q16)));
+            }
+            static float32x4_t Finish(float32x4_t acc, const float* scale, const float* bias) {
+               return MultiplyAdd(vld1q_f32(bias), acc, vld1q_f32(scale));
+            }
+         };
+
+         /*
+          * ROWS inputs x BLOCKS blocks (two registers each): each weight
+          * vector is loaded once and used for every row
+          */
+         template <typename TWeights, size_t ROWS, size_t BLOCKS>
+         inline void DenseNeonTile(const typename TWeights::TValue* weights,
+                                   const float* scale, const float* bias,
+                                   size_t inputs, bool relu,
+                                   const float* in, size_t in_stride,
+                                   float* out, size_t out_stride) {
+            float32x4_t acc[ROWS][2 * BLOCKS];
+            for (size_t r = 0; r < ROWS; ++r) {
+               for (size_t v = 0; v < 2 * BLOCKS; ++v) {
+                  acc[r][v] = vdupq_n_f32(0.0f);
+               }
+            }
+
+            const size_t blockStride = inputs * BLOCK_WIDTH;
+            for (size_t i = 0; i < inputs; ++i) {
+               float32x4_t w[2 * BLOCKS];
+               for (size_t b = 0; b < BLOCKS; ++b) {
+                  TWeights::Load(weights + b * blockStride + i * BLOCK_WIDTH, w[2 * b], w[2 * b + 1]);
+               }
+               for (size_t r = 0; r < ROWS; ++r) {
+                  float32x4_t x = vdupq_n_f32(in[r * in_stride + i]);
+                  for (size_t v = 0; v < 2 * BLOCKS; ++v) {
+                     acc[r][v] = MultiplyAdd(acc[r][v], w[v], x);
+                  }
+               }
+            }
+
+            // Scale/bias and fused ReLU epilogue
+            float32x4_t zero = vdupq_n_f32(0.0f);
+            for (size_t r = 0; r < ROWS; ++r) {
+               for (size_t v = 0; v < 2 * BLOCKS; ++v) {
+                  float32x4_t y = TWeights::Finish(acc[r][v], scale + v * 4, bias + v * 4);
+                  if (relu) {
+                     y = vmaxq_f32(y, zero);
+                  }
+                  vst1q_f32(out + r * out_stride + v * 4, y);
+               }
+            }
+         }
+
+         template <typename TWeights>
+         void DenseNeonImpl(const typename TWeights::TValue* weights,
+                            const float* scales, const float* biases,
+                            size_t inputs, size_t blocks, bool relu,
+                            const float* in, size_t in_stride,
+                            float* out, size_t out_stride, size_t rows) {
+            for (size_t r = 0; r < rows; r += 4) {
+               const float* x = in + r * in_stride;
+               float* y = out + r * out_stride;
+               size_t left = rows - r;
+
+               size_t b = 0;
+               if (left == 1) {
+                  // A single row needs more independent accumulators: 2 blocks at a time
+                  for (; b + 2 <= blocks; b += 2) {
+                     DenseNeonTile<TWeights, 1, 2>(weights + b * inputs * BLOCK_WIDTH,
+                                                   scales + b * BLOCK_WIDTH, biases + b * BLOCK_WIDTH,
+                                                   inputs, relu, x, in_stride, y + b * BLOCK_WIDTH, out_stride);
+                  }
+               }
+               for (; b < blocks; ++b) {
+                  const typename TWeights::TValue* w = weights + b * inputs * BLOCK_WIDTH;
+                  const float* scale = scales + b * BLOCK_WIDTH;
+                  const float* bias = biases + b * BLOCK_WIDTH;
+                  float* yb = y + b * BLOCK_WIDTH;
+                  switch (left) {
+                     case 1:  DenseNeonTile<TWeights, 1, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                     case 2:  DenseNeonTile<TWeights, 2, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                     case 3:  DenseNeonTile<TWeights, 3, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                     default: DenseNeonTile<TWeights, 4, 1>(w, scale, bias, inputs, relu, x, in_stride, yb, out_stride); break;
+                  }
+               }
+            }
+         }
+
+      }
+
+      void DenseNeon(const float* weights, const float* biases,
+                     size_t inputs, size_t blocks, bool relu,
+                     const float* in, size_t in_stride,
+                     float* out, size_t out_stride, size_t rows) {
+         // The scales are not read for float weights
+         DenseNeonImpl<SNeonFloatWeights>(weights, biases, biases, inputs, blocks, relu,
+                                          in, in_stride, out, out_stride, rows);
+      }
+
+      void DenseNeonInt8(const int8_t* weights, const float* scales, const float* biases,
+                         size_t inputs, size_t blocks, bool relu,
+                         const float* in, size_t in_stride,
+                         float* out, size_t out_stride, size_t rows) {
+         DenseNeonImpl<SNeonInt8Weights>(weights, scales, biases, inputs, blocks, relu,
+                                         in, in_stride, out, out_stride, rows);
+      }
+
+#endif
+
+      /****************************************/
+      /****************************************/
+
+      namespace {
+
+         const SKernel SCALAR_KERNEL = { "scalar", DenseScalar, DenseScalarInt8 };
+#if defined(__SSE2__) || defined(_M_X64)
+         const SKernel SSE_KERNEL = { "sse", DenseSse, DenseSseInt8 };
+#endif
+#if defined(__ARM_NEON)
+         const SKernel NEON_KERNEL = { "neon", DenseNeon, DenseNeonInt8 };
+#endif
+#if defined(Q_SWARM_HAVE_AVX2)
+         const SKernel AVX2_KERNEL = { "avx2", DenseAvx2, DenseAvx2Int8 };
+
+         bool CpuHasAvx2() {
+            // Also checks that the OS saves the AVX registers
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+         }
+#endif
+
+         const SKernel* BestKernel() {
+#if defined(Q_SWARM_HAVE_AVX2)
+            if (CpuHasAvx2()) {
+               return &AVX2_KERNEL;
+            }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+            return &SSE_KERNEL;
+#elif defined(__ARM_NEON)
+            return &NEON_KERNEL;
+#else
+            return &SCALAR_KERNEL;
+#endif
+         }
+
+      }
+
+      const SKernel* FindKernel(const std::string& str_name) {
+         if (str_name == "auto") {
+            // Detected once; safe to call from several controller threads
+            static const SKernel* psBest = BestKernel();
+            return psBest;
+         }
+         if (str_name == "scalar") {
+            return &SCALAR_KERNEL;
+         }
+#if defined(__SSE2__) || defined(_M_X64)
+         if (str_name == "sse") {
+            return &SSE_KERNEL;
+         }
+#endif
+#if defined(__ARM_NEON)
+         if (str_name == "neon") {
+            return &NEON_KERNEL;
+         }
+#endif
+#if defined(Q_SWARM_HAVE_AVX2)
+         if (str_name == "avx2") {
+            return CpuHasAvx2() ? &AVX2_KERNEL : NULL;
+         }
+#endif
+         return NULL;
+      }
+
+   }
+
+}
@@ -0,0 +1,138 @@
+#ifndef Q_SWARM_KERNELS_H
+#define Q_SWARM_KERNELS_H
+
+/*
+ * Q-Swarm Dense Layer Kernels
+ *
+ * SIMD implementations of one fully connected layer (with optional fused
+ * ReLU) used by CQSwarmPolicy, and the runtime CPU dispatch between them.
+ *
+ * Weights are packed in blocks of BLOCK_WIDTH outputs:
+ *    packed[block][input][lane] = W[block * BLOCK_WIDTH + lane][input]
+ * so every input contributes one contiguous vector per block. Outputs are
+ * padded to a multiple of BLOCK_WIDTH with zero weights and biases.
+ *
+ * Quantized layers use the same layout with int8 weights and one float
+ * scale per output (W[j][i] ~ scale[j] * q[j][i]); activations stay float
+ * and the scale is applied once per output in the epilogue.
+ *
+ * One binary carries every kernel the compiler can build (the AVX2/FMA
+ * one lives in q_swarm_kernels_avx2.cpp, compiled with its own flags);
+ * FindKernel("auto") picks the best one the running CPU supports.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace argos {
+
+   namespace QSwarmKernels {
+
+      /* Outputs per packed block (one AVX register, two SSE/NEON registers) */
+      const size_t BLOCK_WIDTH = 8;
+
+      /* Alignment of packed weights (one cache line) */
+      const size_t ALIGNMENT = 64;
+
+      /*
+       * out[r][0 .. blocks * BLOCK_WIDTH) = act(in[r][0 .. inputs) * W^T + b)
+       * for r in [0, rows), act = ReLU if relu, identity otherwise
+       *
+       * weights : packed [blocks][inputs][BLOCK_WIDTH]
+       * biases  : [blocks * BLOCK_WIDTH]
+       * in/out  : row-major with strides in floats
+       */
+      typedef void (*TDenseFunc)(const float* weights,
+                                 const float* biases,
+                                 size_t inputs,
+                                 size_t blocks,
+                                 bool relu,
+                                 const float* in,
+                                 size_t in_stride,
+                                 float* out,
+                                 size_t out_stride,
+                                 size_t rows);
+
+      /*
+       * Same as TDenseFunc with int8 weights
+       * out[r][j] = act(scales[j] * (in[r] . q[j]) + biases[j])
+       *
+       * weights : packed [blocks][inputs][BLOCK_WIDTH]
+       * scales  : [blocks * BLOCK_WIDTH]
+       */
+      typedef void (*TDenseInt8Func)(const int8_t* weights,
+                                     const float* scales,
+                                     const float* biases,
+                                     size_t inputs,
+                                     size_t blocks,
+                                     bool relu,
+                                     const float* in,
+                                     size_t in_stride,
+                                     float* out,
+                                     size_t out_stride,
+                                     size_t rows);
+
+      struct SKernel {
+         const char* Name;
+         TDenseFunc Dense;
+         TDenseInt8Func DenseInt8;
+      };
+
+      /*
+       * Kernel by name: "auto" (best supported), "avx2", "sse", "neon"
+       * or "scalar"
+       * Returns NULL if unknown, not built or not supported by this CPU
+       */
+      const SKernel* FindKernel(const std::string& str_name);
+
+      /* Kernel implementations */
+      void DenseScalar(const float* weights, const float* biases,
+                       size_t inputs, size_t blocks, bool relu,
+                       const float* in, size_t in_stride,
+                       float* out, size_t out_stride, size_t rows);
+      void DenseScalarInt8(const int8_t* weights, const float* scales, const float* biases,
+                           size_t inputs, size_t blocks, bool relu,
+                           const float* in, size_t in_stride,
+                           float* out, size_t out_stride, size_t rows);
+
+#if defined(__SSE2__) || defined(_M_X64)
+      void DenseSse(const float* weights, const float* biases,
+                    size_t inputs, size_t blocks, bool relu,
+                    const float* in, size_t in_stride,
+                    float* out, size_t out_stride, size_t rows);
+      void DenseSseInt8(const int8_t* weights, const float* scales, const float* biases,
+                        size_t inputs, size_t blocks, bool relu,
+                        const float* in, size_t in_stride,
+                        float* out, size_t out_stride, size_t rows);
+#endif
+
+#if defined(__ARM_NEON)
+      void DenseNeon(const float* weights, const float* biases,
+                     size_t inputs, size_t blocks, bool relu,
+                     const float* in, size_t in_stride,
+                     float* out, size_t out_stride, size_t rows);
+      void DenseNeonInt8(const int8_t* weights, const float* scales, const float* biases,
+                         size_t inputs, size_t blocks, bool relu,
+                         const float* in, size_t in_stride,
+                         float* out, size_t out_stride, size_t rows);
+#endif
+
+#if defined(Q_SWARM_HAVE_AVX2)
+      void DenseAvx2(const float* weights, const float* biases,
+                     size_t inputs, size_t blocks, bool relu,
+                     const float* in, size_t in_stride,
+                     float* out, size_t out_stride, size_t rows);
+      void DenseAvx2Int8(const int8_t* weights, const float* scales, const float* biases,
+                         size_t inputs, size_t blocks, bool relu,
+                         const float* in, size_t in_stride,
+                         float* out, size_t out_stride, size_t rows);
+#endif
+
+   }
+
+}
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Q-Swarm Dense Layer Kernel (AVX2/FMA)
+ *
+ * Compiled with -mavx2 -mfma (see CMakeLists.txt) and only called after
+ * FindKernel() checked the CPU, so nothing else may live in this file:
+ * any inline function shared with other translation units could end up
+ * using AVX instructions on CPUs without them.
+ */
+
+#include "q_swarm_kernels.h"
+
+#include <immintrin.h>
+
+namespace argos {
+
+   namespace QSwarmKernels {
+
+      namespace {
+
+         /* float weights: out = acc + bias */
+         struct SFloatWeights {
+            typedef float TValue;
+            static __m256 Load(const float* w) {
+               return _mm256_loadu_ps(w);
+            }
+            static __m256 Finish(__m256 acc, const float*, const float* bias) {
+               return _mm256_add_ps(acc, _mm256_loadu_ps(bias));
+            }
+         };
+
+         /* int8 weights: widened on load, out = acc * scale + bias */
+         struct SInt8Weights {
+            typedef int8_t TValue;
+            static __m256 Load(const int8_t* w) {
+               __m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(w));
+               return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q));
+            }
+            static __m256 Finish(__m256 acc, const float* scale, const float* bias) {
+               return _mm256_fmadd_ps(acc, _mm256_loadu_ps(scale), _mm256_loadu_ps(bias));
+            }
+         };
+
+         /*
+          * ROWS inputs x BLOCKS blocks of 8 outputs:
+          * each weight vector is loaded once and used for every row,
+          * and the ROWS * BLOCKS independent accumulators hide the FMA latency
+          */
+         template <typename TWeights, size_t ROWS, size_t BLOCKS>
+         inline void DenseAvx2Tile(const typename TWeights::TValue* weights,
+                                   const float* scale, const float* bias,
+                                   size_t inputs, bool relu,
+                                   const float* in, size_t in_stride,
+                                   float* out, size_t out_stride) {
+            __m256 acc[ROWS][BLOCKS];
+            for (size_t r = 0; r < ROWS; ++r) {
+               for (size_t b = 0; b < BLOCKS; ++b) {
+                  acc[r][b] = _mm256_setzero_ps();
+               }
+            }
+
+            const size_t blockStride = inputs * BLOCK_WIDTH;
+            for (size_t i = 0; i < inputs; ++i) {
+               __m256 w[BLOCKS];
+               for (size_t b = 0; b < BLOCKS; ++b) {
+                  w[b] = TWeights::Load(weights + b * blockStride + i * BLOCK_WIDTH);
+               }
+               for (size_t r = 0; r < ROWS; ++r) {
+                  __m256 x = _mm256_broadcast_ss(in + r * in_stride + i);
+                  for (size_t b = 0; b < BLOCKS; ++b) {
+                     acc[r][b] = _mm256_fmadd_ps(w[b], x, acc[r][b]);
+                  }
+               }
+            }
+
+            // Scale/bias and fused ReLU epilogue
+            __m256 zero = _mm256_setzero_ps();
+            for (size_t r = 0; r < ROWS; ++r) {
+               for (size_t b = 0; b < BLOCKS; ++b) {
+                  __m256 y = TWeights::Finish(acc[r][b], scale + b * BLOCK_WIDTH, bias + b * BLOCK_WIDTH);
+                  if (relu) {
+                     y = _mm256_max_ps(y, zero);
+                  }
+                  _mm256_storeu_ps(out + r * out_stride + b * BLOCK_WIDTH, y);
+               }
+            }
+         }
+
+         template <typename TWeights, size_t BLOCKS>
+         inline void DenseAvx2Rows(const typename TWeights::TValue* weights,
+                                   const float* scale, const float* bias,
+                                   size_t inputs, bool relu,
+                                   const float* in, size_t in_stride,
+                                   float* out, size_t out_stride, size_t rows) {
+            switch (rows) {
+               case 1:  DenseAvx2Tile<TWeights, 1, BLOCKS>(weights, scale, bias, inputs, relu, in, in_stride, out, out_stride); break;
+               case 2:  DenseAvx2Tile<TWeights, 2, BLOCKS>(weights, scale, bias, inputs, relu, in, in_stride, out, out_stride); break;
+               case 3:  DenseAvx2Tile<TWeights, 3, BLOCKS>(weights, scale, bias, inputs, relu, in, in_stride, out, out_stride); break;
+               default: DenseAvx2Tile<TWeights, 4, BLOCKS>(weights, scale, bias, inputs, relu, in, in_stride, out, out_stride); break;
+            }
+         }
+
+         template <typename TWeights>
+         void DenseAvx2Impl(const typename TWeights::TValue* weights,
+                            const float* scales, const float* biases,
+                            size_t inputs, size_t blocks, bool relu,
+                            const float* in, size_t in_stride,
+                            float* out, size_t out_stride, size_t rows) {
+            for (size_t r = 0; r < rows; r += 4) {
+               const float* x = in + r * in_stride;
+               float* y = out + r * out_stride;
+               size_t left = rows - r;
+
+               size_t b = 0;
+               if (left == 1) {
+                  // A single row needs more independent accumulators: 4 blocks at a time
+                  for (; b + 4 <= blocks; b += 4) {
+                     DenseAvx2Tile<TWeights, 1, 4>(weights + b * inputs * BLOCK_WIDTH,
+                                                   scales + b * BLOCK_WIDTH, biases + b * BLOCK_WIDTH,
+                                                   inputs, relu, x, in_stride, y + b * BLOCK_WIDTH, out_stride);
+                  }
+               }
+               // Two blocks (16 outputs) at a time, then the odd one
+               for (; b + 2 <= blocks; b += 2) {
+                  DenseAvx2Rows<TWeights, 2>(weights + b * inputs * BLOCK_WIDTH,
+                                             scales + b * BLOCK_WIDTH, biases + b * BLOCK_WIDTH,
+                                             inputs, relu, x, in_stride, y + b * BLOCK_WIDTH, out_stride, left);
+               }
+               if (b < blocks) {
+                  DenseAvx2Rows<TWeights, 1>(weights + b * inputs * BLOCK_WIDTH,
+                                             scales + b * BLOCK_WIDTH, biases + b * BLOCK_WIDTH,
+                                             inputs, relu, x, in_stride, y + b * BLOCK_WIDTH, out_stride, left);
+               }
+            }
+         }
+
+      }
+
+      /****************************************/
+      /****************************************/
+
+      void DenseAvx2(const float* weights, const float* biases,
+                     size_t inputs, size_t blocks, bool relu,
+                     const float* in, size_t in_stride,
+                     float* out, size_t out_stride, size_t rows) {
+         // The scales are not read for float weights
+         DenseAvx2Impl<SFloatWeights>(weights, biases, biases, inputs, blocks, relu,
+                                      in, in_stride, out, out_stride, rows);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      void DenseAvx2Int8(const int8_t* weights, const float* scales, const float* biases,
+                         size_t inputs, size_t blocks, bool relu,
+                         const float* in, size_t in_stride,
+                         float* out, size_t out_stride, size_t rows) {
+         DenseAvx2Impl<SInt8Weights>(weights, scales, biases, inputs, blocks, relu,
+                                     in, in_stride, out, out_stride, rows);
+      }
+
+   }
+
+}
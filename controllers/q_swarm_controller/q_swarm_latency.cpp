@@ -0,0 +1,217 @@
+/*
+ * Q-Swarm Latency Histograms Implementation
+ */
+
+#include "q_swarm_latency.h"
+
+#include <string.h>
+#include <chrono>
+#include <fstream>
+
+namespace argos {
+
+   namespace {
+
+      const char* PHASE_NAMES[CQSwarmLatencyStats::PHASES] = {
+         "state", "encode", "send", "wait", "action", "execute",
+         "reward", "reward_send", "step", "batch", "tick", "simulator"
+      };
+
+      /* Histograms are in nanoseconds, the output in microseconds */
+      double Microseconds(uint64_t un_ns) {
+         return static_cast<double>(un_ns) / 1000.0;
+      }
+
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmLatencyHistogram::CQSwarmLatencyHistogram() {
+      Clear();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmLatencyHistogram::BucketOf(uint64_t un_ns) {
+      if (un_ns < SUB_BUCKETS) {
+         return static_cast<size_t>(un_ns);
+      }
+      // Highest set bit m >= 4: values [2^m, 2^(m+1)) in 16 linear buckets
+      size_t unMagnitude = 4;
+      while (unMagnitude + 1 < 64 && (un_ns >> (unMagnitude + 1)) != 0) {
+         ++unMagnitude;
+      }
+      if (unMagnitude >= MAX_MAGNITUDE) {
+         return BUCKETS - 1;
+      }
+      size_t unSub = static_cast<size_t>(un_ns >> (unMagnitude - 4)) - SUB_BUCKETS;
+      return SUB_BUCKETS * (unMagnitude - 3) + unSub;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint64_t CQSwarmLatencyHistogram::UpperBound(size_t un_bucket) {
+      if (un_bucket < SUB_BUCKETS) {
+         return un_bucket;
+      }
+      size_t unMagnitude = un_bucket / SUB_BUCKETS + 3;
+      uint64_t unSub = un_bucket % SUB_BUCKETS;
+      return ((SUB_BUCKETS + unSub + 1) << (unMagnitude - 4)) - 1;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLatencyHistogram::Record(uint64_t un_ns) {
+      ++m_unCounts[BucketOf(un_ns)];
+      ++m_unCount;
+      m_unSum += un_ns;
+      if (un_ns > m_unMax) {
+         m_unMax = un_ns;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLatencyHistogram::Merge(const CQSwarmLatencyHistogram& c_other) {
+      if (c_other.m_unCount == 0) {
+         return;
+      }
+      for (size_t i = 0; i < BUCKETS; ++i) {
+         m_unCounts[i] += c_other.m_unCounts[i];
+      }
+      m_unCount += c_other.m_unCount;
+      m_unSum += c_other.m_unSum;
+      if (c_other.m_unMax > m_unMax) {
+         m_unMax = c_other.m_unMax;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLatencyHistogram::Clear() {
+      memset(m_unCounts, 0, sizeof(m_unCounts));
+      m_unCount = 0;
+      m_unSum = 0;
+      m_unMax = 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint64_t CQSwarmLatencyHistogram::GetPercentile(double f_quantile) const {
+      if (m_unCount == 0) {
+         return 0;
+      }
+      // Rank of the value, 1-based: at least one value is below any quantile
+      double fRank = f_quantile * static_cast<double>(m_unCount);
+      uint64_t unRank = static_cast<uint64_t>(fRank);
+      if (static_cast<double>(unRank) < fRank || unRank == 0) {
+         ++unRank;
+      }
+      uint64_t unSeen = 0;
+      for (size_t i = 0; i < BUCKETS; ++i) {
+         unSeen += m_unCounts[i];
+         if (unSeen >= unRank) {
+            uint64_t unBound = UpperBound(i);
+            return unBound < m_unMax ? unBound : m_unMax;
+         }
+      }
+      return m_unMax;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   const char* CQSwarmLatencyStats::GetPhaseName(EPhase e_phase) {
+      return (e_phase >= 0 && e_phase < PHASES) ? PHASE_NAMES[e_phase] : "unknown";
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint64_t CQSwarmLatencyStats::Now() {
+      return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch()).count());
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLatencyStats::Merge(const CQSwarmLatencyStats& c_other) {
+      for (size_t i = 0; i < PHASES; ++i) {
+         m_cHistograms[i].Merge(c_other.m_cHistograms[i]);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLatencyStats::Clear() {
+      for (size_t i = 0; i < PHASES; ++i) {
+         m_cHistograms[i].Clear();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmLatencyStats::Write(const std::string& str_path,
+                                   uint64_t un_episodes,
+                                   bool b_truncate,
+                                   std::string& str_error) const {
+      std::ofstream cFile(str_path.c_str(), b_truncate ? std::ios::trunc : std::ios::app);
+      if (!cFile) {
+         str_error = "cannot open " + str_path;
+         return false;
+      }
+
+      bool bJson = str_path.size() >= 5 && str_path.compare(str_path.size() - 5, 5, ".json") == 0;
+      if (bJson) {
+         cFile << "{\"episodes\": " << un_episodes << ", \"phases\": {";
+      }
+      else if (b_truncate) {
+         cFile << "episodes,phase,count,mean_us,p50_us,p99_us,p999_us,max_us\n";
+      }
+
+      bool bFirst = true;
+      for (size_t i = 0; i < PHASES; ++i) {
+         const CQSwarmLatencyHistogram& cHistogram = m_cHistograms[i];
+         if (cHistogram.GetCount() == 0) {
+            continue;
+         }
+         const char* strName = PHASE_NAMES[i];
+         double fMean = cHistogram.GetMean() / 1000.0;
+         double fP50 = Microseconds(cHistogram.GetPercentile(0.5));
+         double fP99 = Microseconds(cHistogram.GetPercentile(0.99));
+         double fP999 = Microseconds(cHistogram.GetPercentile(0.999));
+         double fMax = Microseconds(cHistogram.GetMax());
+         if (bJson) {
+            cFile << (bFirst ? "" : ", ") << "\"" << strName << "\": {\"count\": " << cHistogram.GetCount()
+                  << ", \"mean_us\": " << fMean << ", \"p50_us\": " << fP50
+                  << ", \"p99_us\": " << fP99 << ", \"p999_us\": " << fP999
+                  << ", \"max_us\": " << fMax << "}";
+         }
+         else {
+            cFile << un_episodes << "," << strName << "," << cHistogram.GetCount() << ","
+                  << fMean << "," << fP50 << "," << fP99 << "," << fP999 << "," << fMax << "\n";
+         }
+         bFirst = false;
+      }
+      if (bJson) {
+         cFile << "}}\n";
+      }
+
+      if (!cFile) {
+         str_error = "cannot write " + str_path;
+         return false;
+      }
+      return true;
+   }
+
+}
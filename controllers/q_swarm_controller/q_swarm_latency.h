@@ -0,0 +1,190 @@
+#ifndef Q_SWARM_LATENCY_H
+#define Q_SWARM_LATENCY_H
+
+/*
+ * Q-Swarm Latency Histograms
+ *
+ * Where the time of a tick goes: every controller times the phases of its
+ * step with a monotonic clock (std::chrono::steady_clock) into its own
+ * CQSwarmLatencyStats, so recording never takes a lock or touches memory
+ * shared with other robots, even when ARGoS steps controllers in several
+ * threads. CQSwarmLoopFunctions merges the robots' histograms at episode
+ * boundaries and appends p50/p99/p99.9 per phase to a CSV or JSON file
+ * (see Write()).
+ *
+ * CQSwarmLatencyHistogram is HDR-style: values below 16 ns have a bucket
+ * each, larger ones 16 linear buckets per power of two, so every bucket is
+ * within 1/16 (6.25%) of the values it holds, from nanoseconds to minutes,
+ * in a fixed array (no allocation when recording).
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace argos {
+
+   class CQSwarmLatencyHistogram {
+
+   public:
+
+      /* Linear buckets per power of two */
+      static const size_t SUB_BUCKETS = 16;
+
+      /* Values from 2^MAX_MAGNITUDE ns (about 18 minutes) on share the last bucket */
+      static const size_t MAX_MAGNITUDE = 40;
+
+      static const size_t BUCKETS = SUB_BUCKETS * (MAX_MAGNITUDE - 3);
+
+      CQSwarmLatencyHistogram();
+
+      /* Add one duration in nanoseconds */
+      void Record(uint64_t un_ns);
+
+      /* Add the values of another histogram */
+      void Merge(const CQSwarmLatencyHistogram& c_other);
+
+      void Clear();
+
+      uint64_t GetCount() const {
+         return m_unCount;
+      }
+
+      /* Sum of all recorded values (ns) */
+      uint64_t GetSum() const {
+         return m_unSum;
+      }
+
+      uint64_t GetMax() const {
+         return m_unMax;
+      }
+
+      double GetMean() const {
+         return m_unCount > 0 ? static_cast<double>(m_unSum) / m_unCount : 0.0;
+      }
+
+      /*
+       * Smallest value (upper bound of its bucket, at most the maximum)
+       * that f_quantile of the recorded values do not exceed; 0 if empty
+       */
+      uint64_t GetPercentile(double f_quantile) const;
+
+   private:
+
+      static size_t BucketOf(uint64_t un_ns);
+
+      /* Largest value that falls in a bucket */
+      static uint64_t UpperBound(size_t un_bucket);
+
+      uint32_t m_unCounts[BUCKETS];
+      uint64_t m_unCount;
+      uint64_t m_unSum;
+      uint64_t m_unMax;
+
+   };
+
+   /****************************************/
+   /****************************************/
+
+   class CQSwarmLatencyStats {
+
+   public:
+
+      /* Timed phases (controller step, then loop functions) */
+      enum EPhase {
+         STATE,        /* GetState: sensors to state vector */
+         ENCODE,       /* request serialisation (tcp transport) */
+         SEND,         /* request written to the socket (tcp transport) */
+         WAIT,         /* send to answer received (tcp transport) */
+         ACTION,       /* whole action lookup: transport round trip, pipelined poll or policy */
+         EXECUTE,      /* ExecuteAction */
+         REWARD,       /* CalculateReward */
+         REWARD_SEND,  /* separate REWARD round trip (combined_step="false") */
+         STEP,         /* whole ControlStep of a robot */
+         BATCH,        /* batched inference in PostStep (loop functions) */
+         TICK,         /* PreStep to PostStep: actuators, physics, sensors, controllers */
+         SIMULATOR,    /* TICK minus the robots' STEP time: ARGoS itself */
+         PHASES
+      };
+
+      static const char* GetPhaseName(EPhase e_phase);
+
+      /* Monotonic time in nanoseconds */
+      static uint64_t Now();
+
+      void Record(EPhase e_phase, uint64_t un_ns) {
+         m_cHistograms[e_phase].Record(un_ns);
+      }
+
+      const CQSwarmLatencyHistogram& Get(EPhase e_phase) const {
+         return m_cHistograms[e_phase];
+      }
+
+      void Merge(const CQSwarmLatencyStats& c_other);
+
+      void Clear();
+
+      /*
+       * Append one row per recorded phase to str_path: CSV
+       *    episodes,phase,count,mean_us,p50_us,p99_us,p999_us,max_us
+       * or, for a .json path, one JSON object per call (JSON lines):
+       *    {"episodes": N, "phases": {"state": {"count": ..., "p50_us": ...}, ...}}
+       * b_truncate starts a new file (CSV with its header line)
+       * Returns false if the file cannot be written
+       */
+      bool Write(const std::string& str_path,
+                 uint64_t un_episodes,
+                 bool b_truncate,
+                 std::string& str_error) const;
+
+   private:
+
+      CQSwarmLatencyHistogram m_cHistograms[PHASES];
+
+   };
+
+   /****************************************/
+   /****************************************/
+
+   /*
+    * Times consecutive phases: each Lap() records the time since the
+    * previous one (or the construction). Does nothing without stats
+    */
+   class CQSwarmLatencyTimer {
+
+   public:
+
+      explicit CQSwarmLatencyTimer(CQSwarmLatencyStats* pc_stats) :
+         m_pcStats(pc_stats),
+         m_unStart(pc_stats != NULL ? CQSwarmLatencyStats::Now() : 0),
+         m_unLast(m_unStart) {
+      }
+
+      void Lap(CQSwarmLatencyStats::EPhase e_phase) {
+         if (m_pcStats != NULL) {
+            uint64_t unNow = CQSwarmLatencyStats::Now();
+            m_pcStats->Record(e_phase, unNow - m_unLast);
+            m_unLast = unNow;
+         }
+      }
+
+      /* Record the time since the construction */
+      void Total(CQSwarmLatencyStats::EPhase e_phase) {
+         if (m_pcStats != NULL) {
+            m_pcStats->Record(e_phase, CQSwarmLatencyStats::Now() - m_unStart);
+         }
+      }
+
+   private:
+
+      CQSwarmLatencyStats* m_pcStats;
+      uint64_t m_unStart;
+      uint64_t m_unLast;
+
+   };
+
+}
+
+#endif
@@ -0,0 +1,944 @@
+/*
+ * Q-Learning Swarm Loop Functions Implementation
+ */
+
+#include "q_swarm_loop_functions.h"
+#include "q_swarm_pool_transport.h"
+#include <argos3/core/simulator/simulator.h>
+#include <argos3/core/utility/configuration/argos_configuration.h>
+#include <argos3/core/utility/logging/argos_log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+namespace argos {
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmLoopFunctions::CQSwarmLoopFunctions() :
+      m_bResetPositions(true),
+      m_bScenarios(false),
+      m_fPromoteRate(0.8f),
+      m_pcRNG(NULL),
+      m_unTickStart(0),
+      m_unRobotStepTime(0),
+      m_unLatencyEpisodes(0),
+      m_unEpisodes(0),
+      m_bLatencyTruncate(true),
+      m_bCompactState(false),
+      m_bNative(false) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::Init(TConfigurationNode& t_tree) {
+      InitArenas(t_tree);
+      InitEpisodeLog(t_tree);
+
+      // Neighbour features of the state (built with Q_SWARM_NEIGHBOURS > 0)
+      if (QSwarmProtocol::NEIGHBOURS > 0) {
+         Real fRadius = 1.0f;
+         GetNodeAttributeOrDefault(t_tree, "neighbour_radius", fRadius, fRadius);
+         m_cNeighbours.SetRadius(fRadius);
+         m_vecPositions.resize(2 * m_vecRobots.size());
+         m_vecGroups.resize(m_vecRobots.size());
+         for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+            m_vecGroups[i] = static_cast<uint32_t>(m_vecRobots[i].Arena);
+            m_vecRobots[i].Controller->SetNeighbourIndex(&m_cNeighbours, i);
+         }
+         UpdateNeighbours();
+         LOG << "[LoopFunctions] " << QSwarmProtocol::NEIGHBOURS << " neighbours within "
+             << m_cNeighbours.GetRadius() << " m in the state" << std::endl;
+      }
+
+      // Phase timings of every robot, written at episode boundaries
+      GetNodeAttributeOrDefault(t_tree, "latency_file", m_strLatencyFile, m_strLatencyFile);
+      if (!m_strLatencyFile.empty()) {
+         for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+            m_vecRobots[i].Controller->EnableLatency();
+         }
+         LOG << "[LoopFunctions] Latency histograms of " << m_vecRobots.size()
+             << " robots go to " << m_strLatencyFile << std::endl;
+      }
+
+      // Collect the controllers that want batched inference
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         if (m_vecRobots[i].Controller->IsBatched()) {
+            m_vecControllers.push_back(m_vecRobots[i].Controller);
+         }
+      }
+
+      if (m_vecControllers.empty()) {
+         return;
+      }
+
+      // Size the batch buffers once for the whole swarm
+      size_t unRobots = m_vecControllers.size();
+      m_vecBatch.reserve(unRobots);
+      m_vecRobotIds.reserve(unRobots);
+      m_vecStates.reserve(unRobots * QSwarmProtocol::STATE_SIZE);
+      m_vecPrevRewards.reserve(unRobots);
+      m_vecFlags.reserve(unRobots);
+      m_vecActions.reserve(unRobots);
+      m_vecPolicyActions.reserve(unRobots);
+      m_cEpisodeBoundaries.Resize(unRobots);
+
+      LOG << "[LoopFunctions] Batched inference for " << unRobots << " robots" << std::endl;
+
+      // Evaluate the batch in-process if a policy is given, else ask the server
+      std::string strPolicyFile;
+      std::string strKernel = "auto";
+      GetNodeAttributeOrDefault(t_tree, "policy_file", strPolicyFile, strPolicyFile);
+      GetNodeAttributeOrDefault(t_tree, "simd", strKernel, strKernel);
+      if (!strPolicyFile.empty() && LoadPolicy(strPolicyFile, strKernel)) {
+         m_bNative = true;
+         return;
+      }
+
+      // One server (host/port) or several (servers="host:port,...")
+      SQSwarmEndpoint sServer = { "127.0.0.1", 5555 };
+      std::string strServers;
+      GetNodeAttributeOrDefault(t_tree, "host", sServer.Host, sServer.Host);
+      GetNodeAttributeOrDefault(t_tree, "port", sServer.Port, sServer.Port);
+      GetNodeAttributeOrDefault(t_tree, "servers", strServers, strServers);
+      TQSwarmEndpoints tServers;
+      std::string strError;
+      if (!strServers.empty() && !ParseEndpoints(strServers, sServer.Port, tServers, strError)) {
+         LOGERR << "[LoopFunctions] Invalid servers: " << strError << ". Using "
+                << sServer.Host << ":" << sServer.Port << std::endl;
+         tServers.clear();
+      }
+      if (tServers.empty()) {
+         tServers.push_back(sServer);
+      }
+
+      // Quantized states, goals only when they change
+      GetNodeAttributeOrDefault(t_tree, "compact_state", m_bCompactState, m_bCompactState);
+      if (m_bCompactState) {
+         uint32_t unMaxId = 0;
+         for (size_t i = 0; i < m_vecControllers.size(); ++i) {
+            unMaxId = std::max<uint32_t>(unMaxId, m_vecControllers[i]->GetRobotIdNum());
+         }
+         QSwarmProtocol::SCompactGoal sNone;
+         memset(&sNone, 0, sizeof(sNone));
+         m_vecGoals.assign(unMaxId + 1, sNone);
+      }
+      ConnectToQNetwork(tServers);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::InitArenas(TConfigurationNode& t_tree) {
+      int nArenas = 1;
+      Real fArenaSize = 20.0f;
+      bool bRandomGoals = false;
+      std::string strController = "qsc";
+      GetNodeAttributeOrDefault(t_tree, "arenas", nArenas, nArenas);
+      GetNodeAttributeOrDefault(t_tree, "arena_size", fArenaSize, fArenaSize);
+      GetNodeAttributeOrDefault(t_tree, "random_goals", bRandomGoals, bRandomGoals);
+      GetNodeAttributeOrDefault(t_tree, "reset_positions", m_bResetPositions, m_bResetPositions);
+      GetNodeAttributeOrDefault(t_tree, "controller", strController, strController);
+
+      // The robots of the experiment file make up arena 0
+      std::vector<SRobot> vecOriginals;
+      int nNextId = 0;
+      CSpace::TMapPerType& tFootBots = GetSpace().GetEntitiesByType("foot-bot");
+      for (CSpace::TMapPerType::iterator it = tFootBots.begin(); it != tFootBots.end(); ++it) {
+         CFootBotEntity& cFootBot = *any_cast<CFootBotEntity*>(it->second);
+         QSwarmController* pcController =
+            dynamic_cast<QSwarmController*>(&cFootBot.GetControllableEntity().GetController());
+         if (pcController == NULL) {
+            continue;
+         }
+         const CEmbodiedEntity& cBody = cFootBot.GetEmbodiedEntity();
+         SRobot sRobot = { &cFootBot, pcController, 0, vecOriginals.size(),
+                           cBody.GetOriginAnchor().Position,
+                           cBody.GetOriginAnchor().Orientation, -1 };
+         vecOriginals.push_back(sRobot);
+         nNextId = std::max(nNextId, pcController->GetRobotIdNum() + 1);
+      }
+      if (vecOriginals.empty()) {
+         return;
+      }
+
+      // Grid of tiles, limited to what the arena of the experiment file covers
+      CVector3 cLimits = GetSpace().GetArenaCenter() + GetSpace().GetArenaSize() * 0.5f;
+      int nColumns = static_cast<int>(std::ceil(std::sqrt(static_cast<Real>(std::max(nArenas, 1)))));
+      int nFitX = std::max(1, static_cast<int>(cLimits.GetX() / fArenaSize + 1e-3f));
+      int nFitY = std::max(1, static_cast<int>(cLimits.GetY() / fArenaSize + 1e-3f));
+      nColumns = std::min(nColumns, nFitX);
+      int nFit = nColumns * nFitY;
+      if (nArenas > nFit) {
+         LOGERR << "[LoopFunctions] " << nArenas << " arenas of " << fArenaSize << " m do not fit in the "
+                << GetSpace().GetArenaSize().GetX() << " x " << GetSpace().GetArenaSize().GetY()
+                << " m arena, using " << nFit << std::endl;
+         nArenas = nFit;
+      }
+      nArenas = std::max(nArenas, 1);
+
+      if (m_pcRNG == NULL) {
+         m_pcRNG = CRandom::CreateRNG("argos");
+      }
+      CVector2 cLocalGoal = vecOriginals[0].Controller->GetGoal();
+
+      m_vecArenas.resize(nArenas);
+      for (int k = 0; k < nArenas; ++k) {
+         int nColumn = k % nColumns;
+         int nRow = k / nColumns;
+         SArena& sArena = m_vecArenas[k];
+         sArena.Origin.Set(nColumn * fArenaSize, nRow * fArenaSize);
+         if (bRandomGoals) {
+            CRange<Real> cRange(2.0f, fArenaSize - 2.0f);
+            sArena.Goal = sArena.Origin + CVector2(m_pcRNG->Uniform(cRange), m_pcRNG->Uniform(cRange));
+         }
+         else {
+            sArena.Goal = sArena.Origin + cLocalGoal;
+         }
+
+         if (k > 0) {
+            // Walls shared with a neighbour exist already (west, south)
+            Real fX = sArena.Origin.GetX();
+            Real fY = sArena.Origin.GetY();
+            Real fHalf = fArenaSize * 0.5f;
+            CVector3 cHorizontal(fArenaSize, 0.1f, 0.5f);
+            CVector3 cVertical(0.1f, fArenaSize, 0.5f);
+            std::ostringstream cId;
+            cId << "arena" << k << "_wall_";
+            AddEntity(*new CBoxEntity(cId.str() + "north", CVector3(fX + fHalf, fY + fArenaSize, 0),
+                                      CQuaternion(), false, cHorizontal));
+            AddEntity(*new CBoxEntity(cId.str() + "east", CVector3(fX + fArenaSize, fY + fHalf, 0),
+                                      CQuaternion(), false, cVertical));
+            if (nRow == 0) {
+               AddEntity(*new CBoxEntity(cId.str() + "south", CVector3(fX + fHalf, fY, 0),
+                                         CQuaternion(), false, cHorizontal));
+            }
+            if (nColumn == 0) {
+               AddEntity(*new CBoxEntity(cId.str() + "west", CVector3(fX, fY + fHalf, 0),
+                                         CQuaternion(), false, cVertical));
+            }
+         }
+
+         // The robots of arena 0, or their clones
+         sArena.FirstRobot = m_vecRobots.size();
+         for (size_t j = 0; j < vecOriginals.size(); ++j) {
+            SRobot sRobot = vecOriginals[j];
+            sRobot.Arena = k;
+            if (k > 0) {
+               sRobot.StartPosition += CVector3(sArena.Origin.GetX(), sArena.Origin.GetY(), 0);
+               std::ostringstream cId;
+               cId << "fb" << nNextId++;
+               sRobot.Entity = new CFootBotEntity(cId.str(), strController,
+                                                  sRobot.StartPosition, sRobot.StartOrientation);
+               AddEntity(*sRobot.Entity);
+               sRobot.Controller = dynamic_cast<QSwarmController*>(
+                  &sRobot.Entity->GetControllableEntity().GetController());
+               if (sRobot.Controller == NULL) {
+                  LOGERR << "[LoopFunctions] Controller '" << strController
+                         << "' is not a Q-Swarm controller, no robots cloned" << std::endl;
+                  RemoveEntity(*sRobot.Entity);
+                  m_vecArenas.resize(1);
+                  return;
+               }
+            }
+            sRobot.Controller->SetArena(sArena.Origin, sArena.Goal);
+            m_vecRobots.push_back(sRobot);
+            ++sArena.Robots;
+         }
+      }
+
+      if (nArenas > 1) {
+         LOG << "[LoopFunctions] " << nArenas << " arenas of " << fArenaSize << " m, "
+             << vecOriginals.size() << " robots each" << std::endl;
+      }
+
+      InitScenarios(t_tree, fArenaSize, vecOriginals.size());
+
+      // Robots resumed from a checkpoint continue where they were (with
+      // reset_positions that is their start position anyway, with
+      // scenarios the one of their episode)
+      if (!m_bResetPositions && !m_bScenarios) {
+         ResumePoses();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::InitScenarios(TConfigurationNode& t_tree, Real f_arena_size, size_t un_robots) {
+      GetNodeAttributeOrDefault(t_tree, "scenarios", m_bScenarios, m_bScenarios);
+      if (!m_bScenarios || m_vecArenas.empty()) {
+         m_bScenarios = false;
+         return;
+      }
+      int nCache = 256;
+      int nObstacles = 0;
+      int nLevels = 1;
+      Real fObstacleSize = 1.0f;
+      int nSeed = 0;
+      GetNodeAttributeOrDefault(t_tree, "scenario_cache", nCache, nCache);
+      GetNodeAttributeOrDefault(t_tree, "scenario_seed", nSeed, nSeed);
+      GetNodeAttributeOrDefault(t_tree, "obstacles", nObstacles, nObstacles);
+      GetNodeAttributeOrDefault(t_tree, "obstacle_size", fObstacleSize, fObstacleSize);
+      GetNodeAttributeOrDefault(t_tree, "curriculum_levels", nLevels, nLevels);
+      GetNodeAttributeOrDefault(t_tree, "curriculum_promote", m_fPromoteRate, m_fPromoteRate);
+
+      CQSwarmScenarioCache::SConfig sConfig;
+      sConfig.ArenaSize = static_cast<float>(f_arena_size);
+      sConfig.Robots = static_cast<uint32_t>(un_robots);
+      sConfig.Obstacles = static_cast<uint32_t>(std::max(nObstacles, 0));
+      sConfig.ObstacleSize = static_cast<float>(fObstacleSize);
+      sConfig.Levels = static_cast<uint32_t>(std::max(nLevels, 1));
+      uint64_t unSeed = nSeed != 0 ? static_cast<uint64_t>(nSeed) : CSimulator::GetInstance().GetRandomSeed();
+      std::string strError;
+      uint64_t unStart = CQSwarmLatencyStats::Now();
+      if (!m_cScenarios.Build(sConfig, unSeed, static_cast<size_t>(std::max(nCache, 1)), strError)) {
+         LOGERR << "[LoopFunctions] No scenarios: " << strError << std::endl;
+         m_bScenarios = false;
+         return;
+      }
+      uint64_t unBuildTime = CQSwarmLatencyStats::Now() - unStart;
+
+      // Robots first: the obstacles of the first layout are created
+      // where the robots no longer are
+      for (size_t k = 0; k < m_vecArenas.size(); ++k) {
+         SArena& sArena = m_vecArenas[k];
+         sArena.Level = 0;
+         sArena.Round = static_cast<uint64_t>(std::max(m_vecRobots[sArena.FirstRobot].Controller->GetEpisode(), 0));
+         ApplyScenario(k);
+      }
+      CVector3 cSize(fObstacleSize, fObstacleSize, 0.5f);
+      for (size_t k = 0; k < m_vecArenas.size(); ++k) {
+         const SArena& sArena = m_vecArenas[k];
+         CQSwarmScenarioCache::SScenario sScenario =
+            m_cScenarios.Get(sArena.Level, sArena.Round * m_vecArenas.size() + k);
+         for (uint32_t j = 0; j < sConfig.Obstacles; ++j) {
+            std::ostringstream cId;
+            cId << "arena" << k << "_obstacle_" << j;
+            CVector3 cPosition(sArena.Origin.GetX() + sScenario.Obstacles[j].X,
+                               sArena.Origin.GetY() + sScenario.Obstacles[j].Y, 0);
+            m_vecObstacles.push_back(new CBoxEntity(cId.str(), cPosition, CQuaternion(), false, cSize));
+            AddEntity(*m_vecObstacles.back());
+         }
+      }
+      m_vecMoves.reserve(un_robots + sConfig.Obstacles);
+
+      LOG << "[LoopFunctions] " << m_cScenarios.GetPerLevel() * sConfig.Levels << " scenarios ("
+          << sConfig.Levels << " levels, " << sConfig.Obstacles << " obstacles) cached in "
+          << unBuildTime / 1000000.0 << " ms" << std::endl;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::ApplyScenario(size_t un_arena) {
+      SArena& sArena = m_vecArenas[un_arena];
+      CQSwarmScenarioCache::SScenario sScenario =
+         m_cScenarios.Get(sArena.Level, sArena.Round * m_vecArenas.size() + un_arena);
+      sArena.Goal = sArena.Origin + CVector2(sScenario.GoalX, sScenario.GoalY);
+
+      m_vecMoves.clear();
+      for (size_t i = sArena.FirstRobot; i < sArena.FirstRobot + sArena.Robots; ++i) {
+         SRobot& sRobot = m_vecRobots[i];
+         const CQSwarmScenarioCache::SPose& sPose = sScenario.Starts[sRobot.Slot];
+         sRobot.StartPosition.Set(sArena.Origin.GetX() + sPose.X, sArena.Origin.GetY() + sPose.Y,
+                                  sRobot.StartPosition.GetZ());
+         sRobot.StartOrientation.FromEulerAngles(CRadians(sPose.Yaw), CRadians(), CRadians());
+         sRobot.Controller->SetArena(sArena.Origin, sArena.Goal);
+         SMove sMove = { &sRobot.Entity->GetEmbodiedEntity(), sRobot.StartPosition,
+                         sRobot.StartOrientation, false };
+         m_vecMoves.push_back(sMove);
+      }
+      uint32_t unObstacles = m_cScenarios.GetConfig().Obstacles;
+      if (m_vecObstacles.size() >= (un_arena + 1) * unObstacles) {
+         for (uint32_t j = 0; j < unObstacles; ++j) {
+            CVector3 cPosition(sArena.Origin.GetX() + sScenario.Obstacles[j].X,
+                               sArena.Origin.GetY() + sScenario.Obstacles[j].Y, 0);
+            SMove sMove = { &m_vecObstacles[un_arena * unObstacles + j]->GetEmbodiedEntity(),
+                            cPosition, CQuaternion(), false };
+            m_vecMoves.push_back(sMove);
+         }
+      }
+
+      // The new places are free in the new layout, but may still be taken
+      // by something of the old one that has not moved yet: a few passes
+      size_t unLeft = m_vecMoves.size();
+      for (int nPass = 0; nPass < 4 && unLeft > 0; ++nPass) {
+         for (size_t i = 0; i < m_vecMoves.size(); ++i) {
+            SMove& sMove = m_vecMoves[i];
+            if (!sMove.Done && MoveEntity(*sMove.Body, sMove.Position, sMove.Orientation)) {
+               sMove.Done = true;
+               --unLeft;
+            }
+         }
+      }
+      if (unLeft > 0) {
+         LOGERR << "[Arena " << un_arena << "] " << unLeft << " robots or obstacles could not be"
+                << " moved to scenario " << sArena.Round << ", they stay where they are" << std::endl;
+      }
+      for (size_t i = sArena.FirstRobot; i < sArena.FirstRobot + sArena.Robots; ++i) {
+         m_vecRobots[i].Controller->StopWheels();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::NextRound(size_t un_arena) {
+      SArena& sArena = m_vecArenas[un_arena];
+      for (size_t i = sArena.FirstRobot; i < sArena.FirstRobot + sArena.Robots; ++i) {
+         QSwarmController* pcController = m_vecRobots[i].Controller;
+         if (!pcController->IsWaiting() && !pcController->IsFinished()) {
+            return;
+         }
+      }
+
+      // Curriculum: next level once enough robots reached the goal
+      if (sArena.Level + 1 < m_cScenarios.GetConfig().Levels && sArena.RoundEpisodes > 0 &&
+          sArena.RoundGoals >= m_fPromoteRate * sArena.RoundEpisodes) {
+         ++sArena.Level;
+         LOG << "[Arena " << un_arena << "] Curriculum level " << sArena.Level
+             << " from episode " << sArena.Round + 1 << std::endl;
+      }
+      sArena.RoundEpisodes = 0;
+      sArena.RoundGoals = 0;
+      ++sArena.Round;
+      ApplyScenario(un_arena);
+
+      // They all start the next episode in their next ControlStep
+      for (size_t i = sArena.FirstRobot; i < sArena.FirstRobot + sArena.Robots; ++i) {
+         m_vecRobots[i].Controller->SetWaiting(false);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::ResumePoses() {
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         SRobot& sRobot = m_vecRobots[i];
+         CVector2 cPosition;
+         CRadians cYaw;
+         if (!sRobot.Controller->GetResumePose(cPosition, cYaw)) {
+            continue;
+         }
+         CVector3 cPosition3(cPosition.GetX(), cPosition.GetY(), sRobot.StartPosition.GetZ());
+         CQuaternion cOrientation;
+         cOrientation.FromEulerAngles(cYaw, CRadians(), CRadians());
+         if (!MoveEntity(sRobot.Entity->GetEmbodiedEntity(), cPosition3, cOrientation)) {
+            LOGERR << "[LoopFunctions] Checkpoint position of " << sRobot.Entity->GetId()
+                   << " is occupied, resuming from the start position" << std::endl;
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::InitEpisodeLog(TConfigurationNode& t_tree) {
+      std::string strPath;
+      Real fRotateMb = 64.0f;
+      int nKeep = 4;
+      Real fFlush = 1.0f;
+      GetNodeAttributeOrDefault(t_tree, "episode_log", strPath, strPath);
+      GetNodeAttributeOrDefault(t_tree, "episode_log_rotate_mb", fRotateMb, fRotateMb);
+      GetNodeAttributeOrDefault(t_tree, "episode_log_keep", nKeep, nKeep);
+      GetNodeAttributeOrDefault(t_tree, "episode_log_flush", fFlush, fFlush);
+      if (strPath.empty()) {
+         return;
+      }
+
+      std::string strError;
+      uint64_t unRotateBytes = fRotateMb > 0 ? static_cast<uint64_t>(fRotateMb * 1024 * 1024) : 0;
+      uint64_t unFlushMs = fFlush > 0 ? static_cast<uint64_t>(fFlush * 1000) : 0;
+      if (!m_cEpisodeLog.Open(strPath, unRotateBytes, nKeep > 0 ? nKeep : 0, unFlushMs, strError)) {
+         LOGERR << "[LoopFunctions] No episode log: " << strError << std::endl;
+         return;
+      }
+      LOG << "[LoopFunctions] Episodes of " << m_vecRobots.size() << " robots go to "
+          << strPath << std::endl;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::Reset() {
+      m_vecBatch.clear();
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         m_vecRobots[i].HandledEpisode = -1;
+      }
+      for (size_t k = 0; k < m_vecArenas.size(); ++k) {
+         SArena& sArena = m_vecArenas[k];
+         sArena.Episodes = 0;
+         sArena.Goals = 0;
+         sArena.Reward = 0.0f;
+         sArena.Reported = 0;
+         sArena.Level = 0;
+         sArena.Round = 0;
+         sArena.RoundEpisodes = 0;
+         sArena.RoundGoals = 0;
+         // The layouts are cached: the run starts again from scenario 0
+         if (m_bScenarios) {
+            ApplyScenario(k);
+         }
+      }
+      m_cLatency.Clear();
+      m_unRobotStepTime = 0;
+      m_unLatencyEpisodes = 0;
+      m_unEpisodes = 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::Destroy() {
+      m_vecShards.clear();
+      m_cEpisodeLog.Close();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::PreStep() {
+      if (!m_strLatencyFile.empty()) {
+         m_unTickStart = CQSwarmLatencyStats::Now();
+      }
+      if (QSwarmProtocol::NEIGHBOURS > 0) {
+         UpdateNeighbours();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::UpdateNeighbours() {
+      // Where the physics engine left the robots, as their sensors see it
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         const CVector3& cPosition = m_vecRobots[i].Entity->GetEmbodiedEntity().GetOriginAnchor().Position;
+         m_vecPositions[2 * i] = static_cast<float>(cPosition.GetX());
+         m_vecPositions[2 * i + 1] = static_cast<float>(cPosition.GetY());
+      }
+      m_cNeighbours.Rebuild(m_vecPositions.empty() ? NULL : &m_vecPositions[0],
+                            m_vecGroups.empty() ? NULL : &m_vecGroups[0], m_vecRobots.size());
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::PostStep() {
+      bool bLatency = !m_strLatencyFile.empty();
+      if (bLatency) {
+         RecordTick();
+      }
+
+      // End of the tick: write what pooled robots queued and not sent yet
+      CQSwarmConnectionPool::GetInstance().Flush();
+
+      if (!m_vecControllers.empty()) {
+         CQSwarmLatencyTimer cTimer(bLatency ? &m_cLatency : NULL);
+         StepBatch();
+         cTimer.Lap(CQSwarmLatencyStats::BATCH);
+      }
+
+      // Episodes that ended in this tick (batched ones in StepBatch)
+      UpdateArenas();
+      m_cEpisodeLog.Poll();
+
+      // One dump per round of episodes (as many as there are robots)
+      if (bLatency && !m_vecRobots.empty() && m_unLatencyEpisodes >= m_vecRobots.size()) {
+         WriteLatency();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmLoopFunctions::IsExperimentFinished() {
+      if (m_vecRobots.empty()) {
+         return false;
+      }
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         if (!m_vecRobots[i].Controller->IsFinished()) {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::RecordTick() {
+      uint64_t unTick = CQSwarmLatencyStats::Now() - m_unTickStart;
+
+      // Time the robots spent in ControlStep during this tick
+      uint64_t unRobotStepTime = 0;
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         CQSwarmLatencyStats* pcLatency = m_vecRobots[i].Controller->GetLatency();
+         if (pcLatency != NULL) {
+            unRobotStepTime += pcLatency->Get(CQSwarmLatencyStats::STEP).GetSum();
+         }
+      }
+      uint64_t unControllers = unRobotStepTime - m_unRobotStepTime;
+      m_unRobotStepTime = unRobotStepTime;
+
+      // With threaded controllers the sum can exceed the tick
+      m_cLatency.Record(CQSwarmLatencyStats::TICK, unTick);
+      m_cLatency.Record(CQSwarmLatencyStats::SIMULATOR,
+                        unTick > unControllers ? unTick - unControllers : 0);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::WriteLatency() {
+      m_cLatencyMerged = m_cLatency;
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         CQSwarmLatencyStats* pcLatency = m_vecRobots[i].Controller->GetLatency();
+         if (pcLatency != NULL) {
+            m_cLatencyMerged.Merge(*pcLatency);
+            pcLatency->Clear();
+         }
+      }
+      m_cLatency.Clear();
+      m_unRobotStepTime = 0;
+      m_unLatencyEpisodes = 0;
+
+      std::string strError;
+      if (!m_cLatencyMerged.Write(m_strLatencyFile, m_unEpisodes, m_bLatencyTruncate, strError)) {
+         LOGERR << "[LoopFunctions] Latency histograms not written: " << strError << std::endl;
+         return;
+      }
+      m_bLatencyTruncate = false;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::UpdateArenas() {
+      for (size_t i = 0; i < m_vecRobots.size(); ++i) {
+         SRobot& sRobot = m_vecRobots[i];
+         QSwarmController* pcController = sRobot.Controller;
+         if (!pcController->IsEpisodeDone() || pcController->GetEpisode() == sRobot.HandledEpisode) {
+            continue;
+         }
+         sRobot.HandledEpisode = pcController->GetEpisode();
+         ++m_unEpisodes;
+         ++m_unLatencyEpisodes;
+
+         if (m_cEpisodeLog.IsOpen()) {
+            QSwarmEpisodeLog::SRecord sRecord;
+            sRecord.RobotId = pcController->GetRobotIdNum();
+            sRecord.Episode = pcController->GetEpisode();
+            sRecord.Steps = pcController->GetSteps();
+            sRecord.Reward = pcController->GetEpisodeReward();
+            sRecord.Outcome = pcController->GetEpisodeOutcome();
+            sRecord.Arena = static_cast<uint16_t>(sRobot.Arena);
+            m_cEpisodeLog.Append(sRecord);
+         }
+
+         SArena& sArena = m_vecArenas[sRobot.Arena];
+         bool bGoal = pcController->IsAtGoal();
+         ++sArena.Episodes;
+         sArena.Reward += pcController->GetEpisodeReward();
+         if (bGoal) {
+            ++sArena.Goals;
+         }
+
+         // The controller starts the next episode in its next ControlStep,
+         // with scenarios once the whole arena is done
+         if (m_bScenarios) {
+            pcController->SetWaiting(true);
+            ++sArena.RoundEpisodes;
+            sArena.RoundGoals += bGoal ? 1 : 0;
+         }
+         else if (m_bResetPositions) {
+            if (MoveEntity(sRobot.Entity->GetEmbodiedEntity(),
+                           sRobot.StartPosition, sRobot.StartOrientation)) {
+               pcController->StopWheels();
+            }
+            else {
+               LOGERR << "[LoopFunctions] Start position of " << sRobot.Entity->GetId()
+                      << " is occupied, next episode starts where the robot is" << std::endl;
+            }
+         }
+
+         // One report per episode of every robot of the arena
+         if (sArena.Episodes >= sArena.Robots) {
+            if (m_vecArenas.size() > 1) {
+               LOG << "[Arena " << sRobot.Arena << "] Episodes " << sArena.Reported + 1 << "-"
+                   << sArena.Reported + sArena.Episodes << ": mean reward "
+                   << sArena.Reward / sArena.Episodes << ", goals "
+                   << sArena.Goals << "/" << sArena.Episodes << std::endl;
+            }
+            sArena.Reported += sArena.Episodes;
+            sArena.Episodes = 0;
+            sArena.Goals = 0;
+            sArena.Reward = 0.0f;
+         }
+
+         if (m_bScenarios) {
+            NextRound(sRobot.Arena);
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::StepBatch() {
+      // Gather the robots that collected a state this tick
+      m_vecBatch.clear();
+      m_vecRobotIds.clear();
+      m_vecStates.clear();
+      m_vecPrevRewards.clear();
+      m_vecFlags.clear();
+
+      for (size_t i = 0; i < m_vecControllers.size(); ++i) {
+         QSwarmController* pcController = m_vecControllers[i];
+         // Finished and waiting robots keep their counter
+         m_cEpisodeBoundaries.Update(i, pcController->GetEpisode());
+         if (!pcController->IsAwaitingAction()) {
+            // Holding its action (action_repeat), reset this tick, finished or waiting
+            continue;
+         }
+
+         const QSwarmController::TState& cState = pcController->GetCurrentState();
+         m_vecBatch.push_back(pcController);
+         m_vecRobotIds.push_back(pcController->GetRobotIdNum());
+         m_vecStates.insert(m_vecStates.end(), cState.begin(), cState.end());
+         m_vecPrevRewards.push_back(pcController->GetPendingReward());
+         m_vecFlags.push_back(pcController->GetPendingFlags());
+      }
+
+      // Robots that reset this tick are not in the batch: a boundary
+      // stays pending until a tick that evaluates the policy
+      if (m_vecBatch.empty()) {
+         return;
+      }
+
+      if (m_bNative) {
+         // Some robot started a new episode: pick up a policy file
+         // replaced by the trainer
+         if (m_cEpisodeBoundaries.IsReloadDue()) {
+            ReloadPolicy();
+            m_cEpisodeBoundaries.Reloaded();
+         }
+
+         // One forward pass over the whole swarm
+         m_vecPolicyActions.resize(m_vecBatch.size());
+         m_cPolicy.SelectActions(&m_vecStates[0], m_vecBatch.size(), &m_vecPolicyActions[0]);
+         for (size_t i = 0; i < m_vecBatch.size(); ++i) {
+            m_vecBatch[i]->ApplyAction(m_vecBatch[i]->Explore(m_vecPolicyActions[i]));
+         }
+         return;
+      }
+
+      // One request per server for the whole swarm
+      ExchangeBatch();
+
+      // Hand each controller its action
+      for (size_t i = 0; i < m_vecBatch.size(); ++i) {
+         m_vecBatch[i]->ApplyAction(m_vecActions[i]);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmLoopFunctions::ConnectToQNetwork(const TQSwarmEndpoints& t_servers) {
+      // Size each shard's buffers for the robots it serves
+      std::vector<size_t> vecRobots(t_servers.size(), 0);
+      for (size_t i = 0; i < m_vecControllers.size(); ++i) {
+         ++vecRobots[ShardOf(m_vecControllers[i]->GetRobotIdNum(), t_servers.size())];
+      }
+
+      bool bOk = true;
+      for (size_t i = 0; i < t_servers.size(); ++i) {
+         std::unique_ptr<SShard> pcShard(new SShard);
+         pcShard->Endpoint = t_servers[i];
+         size_t unRobots = vecRobots[i];
+         pcShard->Members.reserve(unRobots);
+         pcShard->RobotIds.reserve(unRobots);
+         pcShard->States.reserve(unRobots * QSwarmProtocol::STATE_SIZE);
+         pcShard->PrevRewards.reserve(unRobots);
+         pcShard->Flags.reserve(unRobots);
+         pcShard->Frame.reserve(QSwarmProtocol::BatchStepFrameSize(unRobots));
+         pcShard->Actions.reserve(unRobots);
+
+         LOG << "[LoopFunctions] Connecting to Q-Network server (tcp "
+             << pcShard->Endpoint.Host << ":" << pcShard->Endpoint.Port << ", "
+             << unRobots << " robots)" << std::endl;
+
+         // Returns at once; MaintainConnection() completes the connection
+         if (!pcShard->Socket.Connect(pcShard->Endpoint.Host, pcShard->Endpoint.Port)) {
+            LOGERR << "[LoopFunctions] Invalid Q-Network server address "
+                   << pcShard->Endpoint.Host << ". Using fallback actions for its robots"
+                   << std::endl;
+            bOk = false;
+         }
+         else {
+            MaintainConnection(*pcShard);
+         }
+         m_vecShards.push_back(std::move(pcShard));
+      }
+      return bOk;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmLoopFunctions::MaintainConnection(SShard& s_shard) {
+      bool bConnected = s_shard.Socket.Maintain();
+      if (bConnected != s_shard.Connected) {
+         s_shard.Connected = bConnected;
+         if (bConnected) {
+            LOG << "[LoopFunctions] Connected to Q-Network server "
+                << s_shard.Endpoint.Host << ":" << s_shard.Endpoint.Port << std::endl;
+         }
+         else {
+            LOGERR << "[LoopFunctions] Lost connection to Q-Network server "
+                   << s_shard.Endpoint.Host << ":" << s_shard.Endpoint.Port
+                   << ", reconnecting in the background" << std::endl;
+         }
+      }
+      return bConnected;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmLoopFunctions::LoadPolicy(const std::string& str_path,
+                                         const std::string& str_kernel) {
+      if (!m_cPolicy.SetKernel(str_kernel)) {
+         LOGERR << "[LoopFunctions] SIMD kernel '" << str_kernel
+                << "' not available, using " << m_cPolicy.GetKernelName() << std::endl;
+      }
+
+      std::string strError;
+      if (!m_cPolicy.Load(str_path, strError)) {
+         LOGERR << "[LoopFunctions] Cannot load policy " << str_path << ": " << strError
+                << ". Using the Q-Network server" << std::endl;
+         return false;
+      }
+      if (m_cPolicy.GetInputSize() != QSwarmProtocol::STATE_SIZE || m_cPolicy.GetOutputSize() != 4) {
+         LOGERR << "[LoopFunctions] Policy " << str_path << " has " << m_cPolicy.GetInputSize()
+                << " inputs and " << m_cPolicy.GetOutputSize() << " outputs (expected "
+                << QSwarmProtocol::STATE_SIZE << " and 4)."
+                << " Using the Q-Network server" << std::endl;
+         return false;
+      }
+
+      LOG << "[LoopFunctions] Native batched inference with " << str_path
+          << " (" << (m_cPolicy.IsQuantized() ? "int8" : "float32") << ", "
+          << m_cPolicy.GetWeightBytes() / 1024 << " KB"
+          << (m_cPolicy.IsMapped() ? " mapped, " : ", ")
+          << m_cPolicy.GetKernelName() << " kernel)" << std::endl;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::ReloadPolicy() {
+      bool bChanged = false;
+      std::string strError;
+      if (!m_cPolicy.Reload(bChanged, strError)) {
+         LOGERR << "[LoopFunctions] Cannot reload policy: " << strError
+                << ". Keeping the current weights" << std::endl;
+      }
+      else if (bChanged) {
+         LOG << "[LoopFunctions] Reloaded policy" << std::endl;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmLoopFunctions::ExchangeBatch() {
+      // Split the batch by server
+      for (size_t s = 0; s < m_vecShards.size(); ++s) {
+         SShard& sShard = *m_vecShards[s];
+         sShard.Members.clear();
+         sShard.RobotIds.clear();
+         sShard.States.clear();
+         sShard.PrevRewards.clear();
+         sShard.Flags.clear();
+      }
+      for (size_t i = 0; i < m_vecBatch.size(); ++i) {
+         SShard& sShard = *m_vecShards[ShardOf(m_vecRobotIds[i], m_vecShards.size())];
+         const float* pfState = &m_vecStates[i * QSwarmProtocol::STATE_SIZE];
+         sShard.Members.push_back(i);
+         sShard.RobotIds.push_back(m_vecRobotIds[i]);
+         sShard.States.insert(sShard.States.end(), pfState, pfState + QSwarmProtocol::STATE_SIZE);
+         sShard.PrevRewards.push_back(m_vecPrevRewards[i]);
+         sShard.Flags.push_back(m_vecFlags[i]);
+      }
+
+      // Send every batch first, so the servers work in parallel
+      for (size_t s = 0; s < m_vecShards.size(); ++s) {
+         SShard& sShard = *m_vecShards[s];
+         sShard.Sent = false;
+         if (sShard.Members.empty() || !MaintainConnection(sShard)) {
+            continue;
+         }
+
+         uint32_t unCount = sShard.Members.size();
+         sShard.Frame.resize(QSwarmProtocol::BatchStepFrameSize(unCount));
+         size_t frameSize;
+         if (m_bCompactState) {
+            // The goals this connection has not seen yet go along
+            uint32_t unGeneration = sShard.Socket.GetGeneration();
+            for (size_t k = 0; k < unCount; ++k) {
+               sShard.Flags[k] |= QSwarmProtocol::CompactGoalFlag(m_vecGoals[sShard.RobotIds[k]],
+                                                                 &sShard.States[k * QSwarmProtocol::STATE_SIZE],
+                                                                 unGeneration);
+            }
+            frameSize = QSwarmProtocol::EncodeCompactBatchStep(&sShard.Frame[0],
+                                                               unCount,
+                                                               &sShard.RobotIds[0],
+                                                               &sShard.States[0],
+                                                               &sShard.PrevRewards[0],
+                                                               &sShard.Flags[0]);
+         }
+         else {
+            frameSize = QSwarmProtocol::EncodeBatchStep(&sShard.Frame[0],
+                                                        unCount,
+                                                        &sShard.RobotIds[0],
+                                                        &sShard.States[0],
+                                                        &sShard.PrevRewards[0],
+                                                        &sShard.Flags[0]);
+         }
+         sShard.Sent = sShard.Socket.SendBytes(&sShard.Frame[0], frameSize);
+         if (!sShard.Sent) {
+            MaintainConnection(sShard);
+         }
+      }
+
+      // One action byte per robot, in batch order; fallback if the server failed
+      m_vecActions.resize(m_vecBatch.size());
+      for (size_t s = 0; s < m_vecShards.size(); ++s) {
+         SShard& sShard = *m_vecShards[s];
+         size_t unCount = sShard.Members.size();
+         sShard.Actions.resize(unCount);
+         bool bOk = sShard.Sent && sShard.Socket.ReceiveBytes(&sShard.Actions[0], unCount);
+         if (sShard.Sent && !bOk) {
+            MaintainConnection(sShard);
+         }
+         for (size_t k = 0; k < unCount; ++k) {
+            size_t i = sShard.Members[k];
+            m_vecActions[i] = bOk ? sShard.Actions[k] : m_vecBatch[i]->GetFallbackAction();
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   REGISTER_LOOP_FUNCTIONS(CQSwarmLoopFunctions, "q_swarm_loop_functions")
+
+}
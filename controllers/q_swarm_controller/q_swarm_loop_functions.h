@@ -0,0 +1,384 @@
+#ifndef Q_SWARM_LOOP_FUNCTIONS_H
+#define Q_SWARM_LOOP_FUNCTIONS_H
+
+/*
+ * Q-Learning Swarm Loop Functions Header
+ *
+ * Swarm-wide batched inference. Controllers running with
+ * inference="batched" only collect their state in ControlStep.
+ * After all controllers have stepped, these loop functions gather the
+ * states into one contiguous [N x 28] buffer, send a single BATCH_STEP
+ * request to the Q-Network server and hand each controller its action.
+ *
+ * With a policy_file attribute the batch is evaluated in-process instead
+ * (CQSwarmPolicy::SelectActions, greedy actions, no learning):
+ *    <loop_functions ... policy_file="models/q_network_latest.bin" simd="auto" />
+ *
+ * The server address is set with host="127.0.0.1" port="5555", or
+ * servers="host:port,host:port,..." to shard the swarm across several
+ * servers (robot to server by ShardOf(), as in the controllers). Each
+ * server then gets the BATCH_STEP of its robots; all batches are sent
+ * before any answer is read, so the servers work in parallel.
+ * Connections are made in the background: ticks before a server is up
+ * (or while it is being re-established) use the controllers' fallback
+ * actions for its robots.
+ *
+ * PostStep also ends the tick of controllers using transport="pool":
+ * frames they queued and did not send yet go out in one write per
+ * connection (see q_swarm_pool_transport.h).
+ *
+ * Sub-arenas: arenas="K" tiles K independent copies of the experiment's
+ * arena (arena_size x arena_size, the one of the .argos file at the
+ * origin) in a grid of ceil(sqrt(K)) columns. Each copy gets walls and a
+ * clone of every foot-bot of the file (controller config "qsc", or the
+ * controller attribute), at the same place relative to its origin. The
+ * goal is the controllers' goal relative to each origin, or a random
+ * point per arena with random_goals="true". The arena in the .argos file
+ * and its physics boundaries must cover all tiles; arenas that do not
+ * fit are dropped. Controllers see positions relative to their arena, so
+ * every arena produces the same kind of experience.
+ *
+ * Every robot whose episode ends is moved back to its start position
+ * (reset_positions="false" keeps it where it is), and each arena logs
+ * the mean reward and goals of its robots' episodes.
+ *
+ * Scenarios: scenarios="true" lays out every arena anew for each round
+ * of episodes, in-process, from a cache of seeded layouts
+ * (q_swarm_scenarios.h): goal, start pose of every robot and obstacles
+ * (obstacles="N" boxes of obstacle_size meters, created once per arena
+ * and moved). scenario_cache layouts are drawn per curriculum level at
+ * Init from scenario_seed (default: the experiment's random_seed), so
+ * the sequence is the same in every run and round k of episode k picks
+ * the same layout after a resume. Robots whose episode ends wait until
+ * all robots of their arena are done, then the next layout is applied
+ * and they start together. With curriculum_levels="L" an arena moves up
+ * a level after a round in which at least curriculum_promote of its
+ * robots reached the goal (the level restarts at 0 with the process).
+ * Scenarios replace random_goals, reset_positions and checkpoint poses.
+ *
+ * Latency: latency_file="latency.csv" (or .json) turns on the phase
+ * timers of every robot (see q_swarm_latency.h). The loop functions add
+ * their own phases (batched inference, whole tick, and the tick minus the
+ * controllers' time, i.e. ARGoS physics and sensors; meaningful with one
+ * ARGoS thread) and, after every round of episodes (as many episodes as
+ * robots), append the swarm's p50/p99/p99.9 per phase to the file.
+ *
+ * Neighbour features (builds with Q_SWARM_NEIGHBOURS > 0): PreStep
+ * indexes the positions of all robots in a uniform grid
+ * (q_swarm_neighbours.h, cells of neighbour_radius meters, default 1)
+ * that every controller queries for its nearest robots in the same arena.
+ *
+ * Episode log: episode_log="models/episodes.qse" appends one record per
+ * finished episode of every robot (see q_swarm_episode_log.h), written
+ * at least every episode_log_flush seconds. The file is rotated at
+ * episode_log_rotate_mb megabytes, keeping episode_log_keep old files.
+ *
+ * Experiments with length="0" end once every robot has run its
+ * max_episodes (q_swarm_sweep relies on this to end its runs).
+ */
+
+#include <argos3/core/simulator/loop_functions.h>
+#include <argos3/core/utility/math/rng.h>
+#include <argos3/plugins/robots/foot-bot/simulator/footbot_entity.h>
+#include <argos3/plugins/simulator/entities/box_entity.h>
+
+#include "q_swarm_controller.h"
+#include "q_swarm_policy.h"
+#include "q_swarm_socket.h"
+#include "q_swarm_endpoints.h"
+#include "q_swarm_latency.h"
+#include "q_swarm_episode_log.h"
+#include "q_swarm_neighbours.h"
+#include "q_swarm_scenarios.h"
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   class CQSwarmLoopFunctions : public CLoopFunctions {
+
+   public:
+
+      /* Constructor */
+      CQSwarmLoopFunctions();
+
+      /* Destructor */
+      virtual ~CQSwarmLoopFunctions() {}
+
+      /*
+       * Collects the controllers and connects to the server
+       * if any of them runs in batched mode
+       */
+      virtual void Init(TConfigurationNode& t_tree);
+
+      virtual void Reset();
+
+      virtual void Destroy();
+
+      /*
+       * Starts the tick timer (latency_file only) and rebuilds the
+       * neighbour index
+       */
+      virtual void PreStep();
+
+      /*
+       * Called after every controller's ControlStep:
+       * sends the batch, distributes the actions and resets the robots
+       * whose episode ended
+       */
+      virtual void PostStep();
+
+      /*
+       * True once every robot has run its max_episodes, so that
+       * experiments with length="0" end by themselves
+       */
+      virtual bool IsExperimentFinished();
+
+   private:
+
+      /* One tile of the simulation */
+      struct SArena {
+         CVector2 Origin;
+         CVector2 Goal;
+         size_t Robots;
+
+         /* Episodes of the arena's robots since the last report */
+         uint32_t Episodes;
+         uint32_t Goals;
+         float Reward;
+
+         /* Episodes reported so far */
+         uint32_t Reported;
+
+         /* Scenarios: first robot in m_vecRobots, level and round (episode) */
+         size_t FirstRobot;
+         uint32_t Level;
+         uint64_t Round;
+
+         /* Episodes of the current round, and how many reached the goal */
+         uint32_t RoundEpisodes;
+         uint32_t RoundGoals;
+
+         SArena() : Robots(0), Episodes(0), Goals(0), Reward(0.0f), Reported(0),
+                    FirstRobot(0), Level(0), Round(0), RoundEpisodes(0), RoundGoals(0) {}
+      };
+
+      /* A Q-Swarm robot, its arena and start pose */
+      struct SRobot {
+         CFootBotEntity* Entity;
+         QSwarmController* Controller;
+         size_t Arena;
+         size_t Slot;                      /* index among the arena's robots */
+         CVector3 StartPosition;
+         CQuaternion StartOrientation;
+
+         /* Last episode whose end was handled */
+         int HandledEpisode;
+      };
+
+      std::vector<SArena> m_vecArenas;
+      std::vector<SRobot> m_vecRobots;
+
+      /* Move robots back to their start position after an episode */
+      bool m_bResetPositions;
+
+      /* Layouts of the arenas for each round (scenarios attribute) */
+      bool m_bScenarios;
+      CQSwarmScenarioCache m_cScenarios;
+      Real m_fPromoteRate;
+
+      /* Obstacles of arena k: [k x obstacles, (k + 1) x obstacles) */
+      std::vector<CBoxEntity*> m_vecObstacles;
+
+      /* A move of ApplyScenario() (reused) */
+      struct SMove {
+         CEmbodiedEntity* Body;
+         CVector3 Position;
+         CQuaternion Orientation;
+         bool Done;
+      };
+
+      std::vector<SMove> m_vecMoves;
+
+      CRandom::CRNG* m_pcRNG;
+
+      /* Positions of the robots for the controllers' neighbour features */
+      CQSwarmNeighbourIndex m_cNeighbours;
+      std::vector<float> m_vecPositions;    /* [N x 2] */
+      std::vector<uint32_t> m_vecGroups;    /* arena of each robot */
+
+      /* Latency histograms output (latency_file attribute, empty: off) */
+      std::string m_strLatencyFile;
+
+      /* Phases timed here (BATCH, TICK, SIMULATOR), and the merge of all robots */
+      CQSwarmLatencyStats m_cLatency;
+      CQSwarmLatencyStats m_cLatencyMerged;
+
+      /* Start of the current tick, robots' STEP time up to the previous one */
+      uint64_t m_unTickStart;
+      uint64_t m_unRobotStepTime;
+
+      /* Episodes ended since the last dump, and in total */
+      uint64_t m_unLatencyEpisodes;
+      uint64_t m_unEpisodes;
+
+      /* The next dump starts a new file */
+      bool m_bLatencyTruncate;
+
+      /* Finished episodes of all robots (episode_log attribute, closed: off) */
+      CQSwarmEpisodeLog m_cEpisodeLog;
+
+      /* Controllers running in batched mode */
+      std::vector<QSwarmController*> m_vecControllers;
+
+      /* Controllers waiting for an action in the current tick */
+      std::vector<QSwarmController*> m_vecBatch;
+
+      /* Batch buffers (struct-of-arrays, reused every tick) */
+      std::vector<uint32_t> m_vecRobotIds;
+      std::vector<float> m_vecStates;       /* [N x STATE_SIZE] */
+      std::vector<float> m_vecPrevRewards;
+      std::vector<uint8_t> m_vecFlags;
+
+      /* One action per batch entry */
+      std::vector<uint8_t> m_vecActions;
+
+      /*
+       * COMPACT_BATCH_STEP frames (compact_state attribute), and the
+       * goal each server has for each robot (indexed by robot id)
+       */
+      bool m_bCompactState;
+      std::vector<QSwarmProtocol::SCompactGoal> m_vecGoals;
+
+      /* One Q-Network server and the part of the batch it serves */
+      struct SShard {
+         SQSwarmEndpoint Endpoint;
+         CQSwarmSocket Socket;
+
+         /* Connection state seen by the last MaintainConnection() */
+         bool Connected;
+
+         /* Batch entries of this server's robots, and their SoA copy */
+         std::vector<size_t> Members;
+         std::vector<uint32_t> RobotIds;
+         std::vector<float> States;
+         std::vector<float> PrevRewards;
+         std::vector<uint8_t> Flags;
+
+         /* Encoded request and reply */
+         std::vector<uint8_t> Frame;
+         std::vector<uint8_t> Actions;
+         bool Sent;
+
+         SShard() : Connected(false), Sent(false) {}
+      };
+
+      std::vector<std::unique_ptr<SShard> > m_vecShards;
+
+      /* In-process evaluation of the batch (policy_file given and loaded) */
+      bool m_bNative;
+      CQSwarmPolicy m_cPolicy;
+      std::vector<int> m_vecPolicyActions;
+
+      /* Episode counters of m_vecControllers, to reload only at an episode boundary */
+      CQSwarmEpisodeBoundaries m_cEpisodeBoundaries;
+
+      /*
+       * Tile the sub-arenas (walls, robot clones, goals) and collect
+       * the robots
+       */
+      void InitArenas(TConfigurationNode& t_tree);
+
+      /*
+       * Move the robots resumed from a checkpoint to where it was taken
+       */
+      void ResumePoses();
+
+      /*
+       * Build the scenario cache, lay out every arena and create its
+       * obstacles (scenarios attribute)
+       */
+      void InitScenarios(TConfigurationNode& t_tree, Real f_arena_size, size_t un_robots);
+
+      /*
+       * Lay out the current scenario of arena un_arena: goal, start poses
+       * and obstacles
+       */
+      void ApplyScenario(size_t un_arena);
+
+      /*
+       * Next round of arena un_arena once all its robots are done (or
+       * finished): curriculum level, next scenario, robots released
+       */
+      void NextRound(size_t un_arena);
+
+      /*
+       * Open the episode log if the episode_log attribute is set
+       */
+      void InitEpisodeLog(TConfigurationNode& t_tree);
+
+      /*
+       * Index the robots' positions for their neighbour features
+       */
+      void UpdateNeighbours();
+
+      /*
+       * Episode bookkeeping and position resets for the robots whose
+       * episode ended in this tick
+       */
+      void UpdateArenas();
+
+      /*
+       * Record the TICK and SIMULATOR phases of the current tick
+       */
+      void RecordTick();
+
+      /*
+       * Merge the histograms of all robots, append them to the latency
+       * file and start new ones
+       */
+      void WriteLatency();
+
+      /*
+       * Batched inference for the current tick
+       */
+      void StepBatch();
+
+      /*
+       * Create the shards and start connecting to their servers
+       * Returns false if an address is invalid
+       */
+      bool ConnectToQNetwork(const TQSwarmEndpoints& t_servers);
+
+      /*
+       * Advance a shard's background connection and log when it goes
+       * up or down
+       * Returns true while the connection is usable
+       */
+      bool MaintainConnection(SShard& s_shard);
+
+      /*
+       * Load the policy for in-process batch evaluation
+       * Returns true if successful
+       */
+      bool LoadPolicy(const std::string& str_path, const std::string& str_kernel);
+
+      /*
+       * Switch to a newer policy file if the trainer replaced it
+       */
+      void ReloadPolicy();
+
+      /*
+       * Send each server its part of the current batch and fill
+       * m_vecActions (fallback actions for servers that failed)
+       */
+      void ExchangeBatch();
+
+   };
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * Q-Swarm Neighbour Index Implementation
+ */
+
+#include "q_swarm_neighbours.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace argos {
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmNeighbourIndex::CQSwarmNeighbourIndex() :
+      m_fRadius(1.0f),
+      m_fCell(1.0f),
+      m_fMinX(0.0f),
+      m_fMinY(0.0f),
+      m_unColumns(0),
+      m_unRows(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmNeighbourIndex::SetRadius(float f_radius) {
+      m_fRadius = f_radius > 0.0f ? f_radius : 1.0f;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmNeighbourIndex::Rebuild(const float* positions, const uint32_t* groups, size_t un_count) {
+      m_vecCells.resize(un_count);
+      m_vecSlots.resize(un_count);
+      m_vecX.resize(un_count);
+      m_vecY.resize(un_count);
+      m_vecGroups.resize(un_count);
+      m_vecIndices.resize(un_count);
+      if (un_count == 0) {
+         m_unColumns = m_unRows = 0;
+         m_vecCellStart.assign(1, 0);
+         return;
+      }
+
+      // Bounds of the swarm (all sub-arenas)
+      float fMinX = positions[0], fMaxX = positions[0];
+      float fMinY = positions[1], fMaxY = positions[1];
+      for (size_t i = 1; i < un_count; ++i) {
+         fMinX = std::min(fMinX, positions[2 * i]);
+         fMaxX = std::max(fMaxX, positions[2 * i]);
+         fMinY = std::min(fMinY, positions[2 * i + 1]);
+         fMaxY = std::max(fMaxY, positions[2 * i + 1]);
+      }
+
+      // Cells of the radius, larger if that would make too many
+      double fMaxCells = static_cast<double>(MAX_CELLS_PER_ROBOT * un_count + 16);
+      float fCell = m_fRadius;
+      while ((std::floor((fMaxX - fMinX) / fCell) + 1.0) * (std::floor((fMaxY - fMinY) / fCell) + 1.0) > fMaxCells) {
+         fCell *= 2.0f;
+      }
+      m_fCell = fCell;
+      m_fMinX = fMinX;
+      m_fMinY = fMinY;
+      m_unColumns = static_cast<size_t>((fMaxX - fMinX) / fCell) + 1;
+      m_unRows = static_cast<size_t>((fMaxY - fMinY) / fCell) + 1;
+
+      // Counting sort by cell
+      m_vecCellStart.assign(m_unColumns * m_unRows + 1, 0);
+      for (size_t i = 0; i < un_count; ++i) {
+         size_t unColumn = std::min(static_cast<size_t>((positions[2 * i] - fMinX) / fCell), m_unColumns - 1);
+         size_t unRow = std::min(static_cast<size_t>((positions[2 * i + 1] - fMinY) / fCell), m_unRows - 1);
+         m_vecCells[i] = static_cast<uint32_t>(unRow * m_unColumns + unColumn);
+         ++m_vecCellStart[m_vecCells[i] + 1];
+      }
+      for (size_t c = 1; c < m_vecCellStart.size(); ++c) {
+         m_vecCellStart[c] += m_vecCellStart[c - 1];
+      }
+      // Place the robots, advancing each cell's start past its robots
+      for (size_t i = 0; i < un_count; ++i) {
+         uint32_t unSlot = m_vecCellStart[m_vecCells[i]]++;
+         m_vecSlots[i] = unSlot;
+         m_vecX[unSlot] = positions[2 * i];
+         m_vecY[unSlot] = positions[2 * i + 1];
+         m_vecGroups[unSlot] = groups[i];
+         m_vecIndices[unSlot] = static_cast<uint32_t>(i);
+      }
+      // Every start is now the next cell's start
+      for (size_t c = m_vecCellStart.size() - 1; c > 0; --c) {
+         m_vecCellStart[c] = m_vecCellStart[c - 1];
+      }
+      m_vecCellStart[0] = 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmNeighbourIndex::Query(size_t un_index, size_t un_k, SNeighbour* neighbours) const {
+      if (un_index >= m_vecSlots.size() || un_k == 0) {
+         return 0;
+      }
+      uint32_t unSelf = m_vecSlots[un_index];
+      float fX = m_vecX[unSelf];
+      float fY = m_vecY[unSelf];
+      uint32_t unGroup = m_vecGroups[unSelf];
+      float fRadius2 = m_fRadius * m_fRadius;
+
+      size_t unCell = m_vecCells[un_index];
+      size_t unColumn = unCell % m_unColumns;
+      size_t unRow = unCell / m_unColumns;
+      size_t unFirstColumn = unColumn > 0 ? unColumn - 1 : 0;
+      size_t unLastColumn = std::min(unColumn + 1, m_unColumns - 1);
+      size_t unFirstRow = unRow > 0 ? unRow - 1 : 0;
+      size_t unLastRow = std::min(unRow + 1, m_unRows - 1);
+
+      // Insertion into the sorted k best (k is small)
+      size_t unFound = 0;
+      for (size_t r = unFirstRow; r <= unLastRow; ++r) {
+         size_t unBegin = m_vecCellStart[r * m_unColumns + unFirstColumn];
+         size_t unEnd = m_vecCellStart[r * m_unColumns + unLastColumn + 1];
+         for (size_t j = unBegin; j < unEnd; ++j) {
+            if (j == unSelf || m_vecGroups[j] != unGroup) {
+               continue;
+            }
+            float fDx = m_vecX[j] - fX;
+            float fDy = m_vecY[j] - fY;
+            float fDistance2 = fDx * fDx + fDy * fDy;
+            if (fDistance2 > fRadius2 || (unFound == un_k && fDistance2 >= neighbours[un_k - 1].Distance2)) {
+               continue;
+            }
+            size_t p = unFound < un_k ? unFound++ : un_k - 1;
+            while (p > 0 && neighbours[p - 1].Distance2 > fDistance2) {
+               neighbours[p] = neighbours[p - 1];
+               --p;
+            }
+            neighbours[p].Index = m_vecIndices[j];
+            neighbours[p].Dx = fDx;
+            neighbours[p].Dy = fDy;
+            neighbours[p].Distance2 = fDistance2;
+         }
+      }
+      return unFound;
+   }
+
+}
@@ -0,0 +1,104 @@
+#ifndef Q_SWARM_NEIGHBOURS_H
+#define Q_SWARM_NEIGHBOURS_H
+
+/*
+ * Q-Swarm Neighbour Index
+ *
+ * Uniform grid over the robots' positions, rebuilt once per tick by the
+ * loop functions, for the neighbour features of the state (see
+ * QSwarmProtocol::NEIGHBOURS). The cells are at least the query radius
+ * wide, so the neighbours of a robot are in its own cell and the eight
+ * around it: a query looks at a handful of robots whatever the swarm
+ * size, and a rebuild is linear in the number of robots.
+ *
+ * Rebuild() sorts the robots by cell with a counting sort into flat
+ * arrays (positions in cell order, one offset per cell), so neither
+ * rebuilding nor querying allocates once the arrays have grown to the
+ * swarm size. Query() is const and may run in several simulator threads
+ * at once between two rebuilds.
+ *
+ * Each robot has a group (its sub-arena): robots only see neighbours of
+ * their own group, as the arenas are separated by walls.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace argos {
+
+   class CQSwarmNeighbourIndex {
+
+   public:
+
+      /* A neighbour of the queried robot, relative to it */
+      struct SNeighbour {
+         uint32_t Index;                   /* index given to Rebuild() */
+         float Dx;
+         float Dy;
+         float Distance2;                  /* squared distance */
+      };
+
+      /* Cells per robot at most: the cells grow beyond the radius for sparse swarms */
+      static const size_t MAX_CELLS_PER_ROBOT = 4;
+
+      CQSwarmNeighbourIndex();
+
+      /* Robots further away than f_radius are not neighbours */
+      void SetRadius(float f_radius);
+
+      float GetRadius() const {
+         return m_fRadius;
+      }
+
+      /*
+       * Index un_count robots
+       * positions: [un_count x 2] x, y
+       * groups:    un_count group ids
+       */
+      void Rebuild(const float* positions, const uint32_t* groups, size_t un_count);
+
+      /* Robots of the last Rebuild() */
+      size_t GetSize() const {
+         return m_vecSlots.size();
+      }
+
+      /*
+       * Up to un_k nearest robots of the same group within the radius
+       * of robot un_index, nearest first, into neighbours (room for
+       * un_k entries)
+       * Returns how many were found
+       */
+      size_t Query(size_t un_index, size_t un_k, SNeighbour* neighbours) const;
+
+   private:
+
+      float m_fRadius;
+
+      /* Grid of the last rebuild */
+      float m_fCell;
+      float m_fMinX;
+      float m_fMinY;
+      size_t m_unColumns;
+      size_t m_unRows;
+
+      /* First robot of each cell (in cell order), plus the end */
+      std::vector<uint32_t> m_vecCellStart;
+
+      /* Robots in cell order */
+      std::vector<float> m_vecX;
+      std::vector<float> m_vecY;
+      std::vector<uint32_t> m_vecGroups;
+      std::vector<uint32_t> m_vecIndices;
+
+      /* Cell of each robot (Rebuild() order), and its place in cell order */
+      std::vector<uint32_t> m_vecCells;
+      std::vector<uint32_t> m_vecSlots;
+
+   };
+
+}
+
+#endif
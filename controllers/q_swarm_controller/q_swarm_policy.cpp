@@ -0,0 +1,197 @@
+/*
+ * Q-Swarm Native Policy Implementation
+ */
+
+#include "q_swarm_policy.h"
+#include <string.h>
+
+namespace argos {
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmPolicy::CQSwarmPolicy() :
+      m_psKernel(QSwarmKernels::FindKernel("auto")) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPolicy::Load(const std::string& str_path, std::string& str_error) {
+      m_pcImage.reset();
+      m_strPath = str_path;
+
+      std::shared_ptr<const CQSwarmPolicyImage> pcImage =
+         CQSwarmPolicyRegistry::GetInstance().Acquire(str_path, str_error);
+      if (!pcImage || !Validate(*pcImage, str_error)) {
+         return false;
+      }
+
+      m_pcImage = pcImage;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPolicy::Reload(bool& b_changed, std::string& str_error) {
+      b_changed = false;
+
+      std::shared_ptr<const CQSwarmPolicyImage> pcImage =
+         CQSwarmPolicyRegistry::GetInstance().Acquire(m_strPath, str_error);
+      if (!pcImage || !Validate(*pcImage, str_error)) {
+         return false;
+      }
+
+      // The new network must be a drop-in replacement
+      if (m_pcImage && (pcImage->GetLayers().front().Inputs != GetInputSize() ||
+                        pcImage->GetLayers().back().Outputs != GetOutputSize())) {
+         str_error = "input or output size changed";
+         return false;
+      }
+
+      b_changed = (pcImage != m_pcImage);
+      m_pcImage = pcImage;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPolicy::Validate(const CQSwarmPolicyImage& c_image, std::string& str_error) {
+      const std::vector<SLayer>& vecLayers = c_image.GetLayers();
+      for (size_t l = 0; l < vecLayers.size(); ++l) {
+         if (vecLayers[l].Blocks * QSwarmKernels::BLOCK_WIDTH > MAX_LAYER_WIDTH ||
+             vecLayers[l].Inputs > MAX_LAYER_WIDTH) {
+            str_error = "layer wider than MAX_LAYER_WIDTH";
+            return false;
+         }
+      }
+      return !vecLayers.empty();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmPolicy::GetInputSize() const {
+      return m_pcImage ? m_pcImage->GetLayers().front().Inputs : 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmPolicy::GetOutputSize() const {
+      return m_pcImage ? m_pcImage->GetLayers().back().Outputs : 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPolicy::IsQuantized() const {
+      return m_pcImage && m_pcImage->GetLayers().front().Quantized;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmPolicy::GetWeightBytes() const {
+      return m_pcImage ? m_pcImage->GetWeightBytes() : 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmPolicy::Forward(const float* input, float* output) const {
+      ForwardBatch(input, 1, output);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmPolicy::ForwardBatch(const float* inputs, size_t count, float* outputs) const {
+      float activations[2][BATCH_CHUNK * MAX_LAYER_WIDTH];
+      const std::vector<SLayer>& vecLayers = m_pcImage->GetLayers();
+      const size_t inputSize = GetInputSize();
+      const size_t outputSize = GetOutputSize();
+
+      for (size_t first = 0; first < count; first += BATCH_CHUNK) {
+         size_t rows = (count - first < BATCH_CHUNK) ? count - first : BATCH_CHUNK;
+         const float* in = inputs + first * inputSize;
+         size_t inStride = inputSize;
+
+         for (size_t l = 0; l < vecLayers.size(); ++l) {
+            const SLayer& sLayer = vecLayers[l];
+            float* out = activations[l % 2];
+            // Padded layer width (the next layer only reads the real outputs)
+            size_t outStride = sLayer.Blocks * QSwarmKernels::BLOCK_WIDTH;
+
+            // ReLU on hidden layers, fused into the kernel
+            bool last = (l + 1 == vecLayers.size());
+            if (sLayer.Quantized) {
+               m_psKernel->DenseInt8(sLayer.QWeights, sLayer.Scales, sLayer.Biases,
+                                     sLayer.Inputs, sLayer.Blocks, !last,
+                                     in, inStride, out, outStride, rows);
+            }
+            else {
+               m_psKernel->Dense(sLayer.Weights, sLayer.Biases,
+                                 sLayer.Inputs, sLayer.Blocks, !last,
+                                 in, inStride, out, outStride, rows);
+            }
+            in = out;
+            inStride = outStride;
+         }
+
+         // Drop the padding of the output layer
+         for (size_t r = 0; r < rows; ++r) {
+            memcpy(outputs + (first + r) * outputSize, in + r * inStride, outputSize * sizeof(float));
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int CQSwarmPolicy::SelectAction(const float* input) const {
+      int action;
+      SelectActions(input, 1, &action);
+      return action;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmPolicy::SelectActions(const float* inputs, size_t count, int* actions) const {
+      float qValues[BATCH_CHUNK * MAX_LAYER_WIDTH];
+      const size_t inputSize = GetInputSize();
+      const size_t outputSize = GetOutputSize();
+
+      for (size_t first = 0; first < count; first += BATCH_CHUNK) {
+         size_t rows = (count - first < BATCH_CHUNK) ? count - first : BATCH_CHUNK;
+         ForwardBatch(inputs + first * inputSize, rows, qValues);
+
+         for (size_t r = 0; r < rows; ++r) {
+            const float* q = qValues + r * outputSize;
+            int best = 0;
+            for (size_t a = 1; a < outputSize; ++a) {
+               if (q[a] > q[best]) {
+                  best = a;
+               }
+            }
+            actions[first + r] = best;
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPolicy::SetKernel(const std::string& str_name) {
+      const QSwarmKernels::SKernel* psKernel = QSwarmKernels::FindKernel(str_name);
+      if (psKernel == NULL) {
+         return false;
+      }
+      m_psKernel = psKernel;
+      return true;
+   }
+
+}
@@ -0,0 +1,201 @@
+#ifndef Q_SWARM_POLICY_H
+#define Q_SWARM_POLICY_H
+
+/*
+ * Q-Swarm Native Policy
+ *
+ * In-process forward pass of the DQN exported by python/export_policy.py,
+ * used by inference="native" to pick greedy actions without a server.
+ *
+ * Weights file (little-endian):
+ *    char[4]   magic "QSNN"
+ *    u32       version (1 = float32 weights, 2 = int8 weights,
+ *              3 = packed, see q_swarm_policy_registry.h)
+ *    u32       number of layers
+ *    per layer, version 1:
+ *       u32        inputs
+ *       u32        outputs
+ *       float32    weights[outputs][inputs]
+ *       float32    biases[outputs]
+ *    per layer, version 2 (per-output symmetric quantization,
+ *    W[j][i] ~ scales[j] * weights[j][i]):
+ *       u32        inputs
+ *       u32        outputs
+ *       float32    scales[outputs]
+ *       int8       weights[outputs][inputs]
+ *       float32    biases[outputs]
+ *
+ * Every layer but the last is followed by a ReLU.
+ *
+ * The weights are shared: policies loading the same file use the same
+ * read-only image from CQSwarmPolicyRegistry (memory-mapped for version 3
+ * files, so shared across processes too). Reload() switches to a newer
+ * file at a point chosen by the caller (e.g. an episode boundary).
+ *
+ * Layers are stored in the blocked, cache-aligned layout of
+ * q_swarm_kernels.h and evaluated by the SIMD kernel chosen
+ * for the running CPU (SetKernel() overrides the choice).
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "q_swarm_kernels.h"
+#include "q_swarm_policy_registry.h"
+
+namespace argos {
+
+   class CQSwarmPolicy {
+
+   public:
+
+      /* Widest layer supported (activations live on the stack) */
+      static const size_t MAX_LAYER_WIDTH = 512;
+
+      /* Inputs evaluated together by ForwardBatch() (stack activations) */
+      static const size_t BATCH_CHUNK = 8;
+
+      CQSwarmPolicy();
+
+      /*
+       * Load a weights file (shared with every policy using the same file)
+       * Returns false (and sets str_error) if the file is missing or invalid
+       */
+      bool Load(const std::string& str_path, std::string& str_error);
+
+      /*
+       * Switch to the current content of the loaded file if it was replaced
+       * Keeps the current weights (and returns false) if the new file
+       * cannot be loaded; b_changed tells whether the weights changed
+       */
+      bool Reload(bool& b_changed, std::string& str_error);
+
+      bool IsLoaded() const {
+         return m_pcImage.get() != NULL;
+      }
+
+      size_t GetInputSize() const;
+      size_t GetOutputSize() const;
+
+      /* True if the weights are int8 */
+      bool IsQuantized() const;
+
+      /* True if the weights are mapped from the file (shared between processes) */
+      bool IsMapped() const {
+         return m_pcImage.get() != NULL && m_pcImage->IsMapped();
+      }
+
+      /* Memory used by the packed weights, scales and biases */
+      size_t GetWeightBytes() const;
+
+      /*
+       * Compute the Q-values for one input
+       * input has GetInputSize() floats, output GetOutputSize() floats
+       */
+      void Forward(const float* input, float* output) const;
+
+      /*
+       * Compute the Q-values for count inputs
+       * inputs is [count][GetInputSize()], outputs [count][GetOutputSize()]
+       */
+      void ForwardBatch(const float* inputs, size_t count, float* outputs) const;
+
+      /*
+       * Greedy action: argmax of the Q-values
+       */
+      int SelectAction(const float* input) const;
+
+      /*
+       * Greedy actions for count inputs ([count][GetInputSize()])
+       */
+      void SelectActions(const float* inputs, size_t count, int* actions) const;
+
+      /*
+       * Select the kernel by name (see QSwarmKernels::FindKernel)
+       * Returns false and keeps the current one if it is not available
+       */
+      bool SetKernel(const std::string& str_name);
+
+      const char* GetKernelName() const {
+         return m_psKernel->Name;
+      }
+
+   private:
+
+      typedef CQSwarmPolicyImage::SLayer SLayer;
+
+      /*
+       * Check that an image is usable (widths within MAX_LAYER_WIDTH)
+       */
+      static bool Validate(const CQSwarmPolicyImage& c_image, std::string& str_error);
+
+      /* Path given to Load() */
+      std::string m_strPath;
+
+      /* Shared, read-only weights */
+      std::shared_ptr<const CQSwarmPolicyImage> m_pcImage;
+
+      /* Kernel used by Forward() */
+      const QSwarmKernels::SKernel* m_psKernel;
+
+   };
+
+   /****************************************/
+   /****************************************/
+
+   /*
+    * Episode boundaries of a swarm sharing one policy (inference="native"
+    * batches in the loop functions): the policy may be reloaded only after
+    * at least one robot started a new episode. Robots that have finished
+    * their episodes, or wait for their arena, keep the same counter and
+    * never open a boundary. A boundary stays pending until Reloaded(), so
+    * one seen on a tick with no batch (every robot reset at once) is not
+    * lost.
+    */
+   class CQSwarmEpisodeBoundaries {
+
+   public:
+
+      CQSwarmEpisodeBoundaries() : m_bPending(false) {}
+
+      void Resize(size_t un_robots) {
+         m_vecEpisodes.assign(un_robots, -1);
+         m_bPending = false;
+      }
+
+      /*
+       * Record the episode counter of robot un_robot for this tick
+       * A change since the last call (the first call counts as the start
+       * of its first episode) makes a reload pending
+       */
+      void Update(size_t un_robot, int n_episode) {
+         if (m_vecEpisodes[un_robot] != n_episode) {
+            m_vecEpisodes[un_robot] = n_episode;
+            m_bPending = true;
+         }
+      }
+
+      /* Some robot started an episode since the last Reloaded() */
+      bool IsReloadDue() const {
+         return m_bPending;
+      }
+
+      void Reloaded() {
+         m_bPending = false;
+      }
+
+   private:
+
+      std::vector<int> m_vecEpisodes;
+      bool m_bPending;
+
+   };
+
+}
+
+#endif
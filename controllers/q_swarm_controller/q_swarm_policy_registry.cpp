@@ -0,0 +1,387 @@
+/*
+ * Q-Swarm Policy Registry Implementation
+ */
+
+#include "q_swarm_policy_registry.h"
+#include "q_swarm_kernels.h"
+#include "q_swarm_protocol.h"
+
+#include <fstream>
+#include <iterator>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <unistd.h>
+#endif
+
+namespace argos {
+
+   namespace {
+
+      const uint32_t VERSION_FLOAT = 1;
+      const uint32_t VERSION_INT8 = 2;
+      const uint32_t VERSION_PACKED = 3;
+
+      const size_t PACKED_HEADER_SIZE = 64;
+      const size_t PACKED_LAYER_SIZE = 32;
+
+      const uint32_t LAYER_FLOAT = 0;
+      const uint32_t LAYER_INT8 = 1;
+
+      size_t AlignUp(size_t value) {
+         return (value + QSwarmKernels::ALIGNMENT - 1) / QSwarmKernels::ALIGNMENT * QSwarmKernels::ALIGNMENT;
+      }
+
+      /* Bytes of each section of a packed layer */
+      size_t WeightsBytes(size_t inputs, size_t blocks, bool quantized) {
+         return blocks * QSwarmKernels::BLOCK_WIDTH * inputs * (quantized ? sizeof(int8_t) : sizeof(float));
+      }
+
+      size_t VectorBytes(size_t blocks) {
+         return blocks * QSwarmKernels::BLOCK_WIDTH * sizeof(float);
+      }
+
+      CQSwarmPolicyImage::SFileId MakeFileId(const struct stat& s_stat) {
+         CQSwarmPolicyImage::SFileId sId;
+         sId.Device = s_stat.st_dev;
+         sId.Inode = s_stat.st_ino;
+         sId.Size = s_stat.st_size;
+         sId.ModificationTime = s_stat.st_mtime;
+         return sId;
+      }
+
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmPolicyImage::CQSwarmPolicyImage() :
+      m_pMapping(NULL),
+      m_unMappingSize(0) {
+      memset(&m_sFileId, 0, sizeof(m_sFileId));
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmPolicyImage::~CQSwarmPolicyImage() {
+#ifndef _WIN32
+      if (m_pMapping != NULL) {
+         munmap(m_pMapping, m_unMappingSize);
+      }
+#endif
+   }
+
+   /****************************************/
+   /****************************************/
+
+   std::shared_ptr<CQSwarmPolicyImage> CQSwarmPolicyImage::Open(const std::string& str_path,
+                                                                std::string& str_error) {
+      std::shared_ptr<CQSwarmPolicyImage> pcImage(new CQSwarmPolicyImage());
+
+#ifndef _WIN32
+      int nFd = open(str_path.c_str(), O_RDONLY);
+      if (nFd < 0) {
+         str_error = "cannot open " + str_path;
+         return std::shared_ptr<CQSwarmPolicyImage>();
+      }
+
+      // Identify the file actually opened (it may be replaced at any time)
+      struct stat sStat;
+      if (fstat(nFd, &sStat) != 0 || sStat.st_size < 12) {
+         close(nFd);
+         str_error = "not a policy weights file";
+         return std::shared_ptr<CQSwarmPolicyImage>();
+      }
+      pcImage->m_sFileId = MakeFileId(sStat);
+
+      size_t unSize = sStat.st_size;
+      void* pMapping = mmap(NULL, unSize, PROT_READ, MAP_SHARED, nFd, 0);
+      close(nFd);
+      if (pMapping == MAP_FAILED) {
+         str_error = "cannot map " + str_path;
+         return std::shared_ptr<CQSwarmPolicyImage>();
+      }
+      const uint8_t* data = static_cast<const uint8_t*>(pMapping);
+
+      if (memcmp(data, "QSNN", 4) == 0 && QSwarmProtocol::ReadUInt32(data + 4) == VERSION_PACKED) {
+         // Used in place: the weights live in the (shared) page cache
+         pcImage->m_pMapping = pMapping;
+         pcImage->m_unMappingSize = unSize;
+         if (!pcImage->ParsePacked(data, unSize, str_error)) {
+            return std::shared_ptr<CQSwarmPolicyImage>();
+         }
+         return pcImage;
+      }
+
+      bool bOk = pcImage->ParseLegacy(data, unSize, str_error);
+      munmap(pMapping, unSize);
+      if (!bOk) {
+         return std::shared_ptr<CQSwarmPolicyImage>();
+      }
+      return pcImage;
+#else
+      // No mmap: read the file and keep a private copy
+      std::ifstream cFile(str_path.c_str(), std::ios::binary);
+      struct stat sStat;
+      if (!cFile || stat(str_path.c_str(), &sStat) != 0) {
+         str_error = "cannot open " + str_path;
+         return std::shared_ptr<CQSwarmPolicyImage>();
+      }
+      pcImage->m_sFileId = MakeFileId(sStat);
+      std::vector<uint8_t> vecData((std::istreambuf_iterator<char>(cFile)),
+                                   std::istreambuf_iterator<char>());
+      if (vecData.size() < 12 || memcmp(&vecData[0], "QSNN", 4) != 0) {
+         str_error = "not a policy weights file";
+         return std::shared_ptr<CQSwarmPolicyImage>();
+      }
+
+      if (QSwarmProtocol::ReadUInt32(&vecData[4]) == VERSION_PACKED) {
+         // Copy to an aligned buffer so the sections keep their alignment
+         pcImage->m_vecOwned.resize(vecData.size() + QSwarmKernels::ALIGNMENT);
+         uint8_t* base = &pcImage->m_vecOwned[0];
+         base += (QSwarmKernels::ALIGNMENT - reinterpret_cast<uintptr_t>(base) % QSwarmKernels::ALIGNMENT) %
+                 QSwarmKernels::ALIGNMENT;
+         memcpy(base, &vecData[0], vecData.size());
+         if (!pcImage->ParsePacked(base, vecData.size(), str_error)) {
+            return std::shared_ptr<CQSwarmPolicyImage>();
+         }
+         return pcImage;
+      }
+
+      if (!pcImage->ParseLegacy(&vecData[0], vecData.size(), str_error)) {
+         return std::shared_ptr<CQSwarmPolicyImage>();
+      }
+      return pcImage;
+#endif
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPolicyImage::ParsePacked(const uint8_t* data, size_t size, std::string& str_error) {
+      if (size < PACKED_HEADER_SIZE || memcmp(data, "QSNN", 4) != 0 ||
+          QSwarmProtocol::ReadUInt32(data + 4) != VERSION_PACKED) {
+         str_error = "not a packed policy weights file";
+         return false;
+      }
+      if (QSwarmProtocol::ReadUInt32(data + 12) != QSwarmKernels::BLOCK_WIDTH) {
+         str_error = "unsupported block width";
+         return false;
+      }
+
+      uint32_t numLayers = QSwarmProtocol::ReadUInt32(data + 8);
+      if (numLayers == 0 || PACKED_HEADER_SIZE + numLayers * PACKED_LAYER_SIZE > size) {
+         str_error = "invalid layer table";
+         return false;
+      }
+
+      std::vector<SLayer> vecLayers(numLayers);
+      for (uint32_t l = 0; l < numLayers; ++l) {
+         const uint8_t* entry = data + PACKED_HEADER_SIZE + l * PACKED_LAYER_SIZE;
+         SLayer& sLayer = vecLayers[l];
+         sLayer.Inputs = QSwarmProtocol::ReadUInt32(entry);
+         sLayer.Outputs = QSwarmProtocol::ReadUInt32(entry + 4);
+         sLayer.Blocks = QSwarmProtocol::ReadUInt32(entry + 8);
+         uint32_t unType = QSwarmProtocol::ReadUInt32(entry + 12);
+         uint32_t unWeights = QSwarmProtocol::ReadUInt32(entry + 16);
+         uint32_t unScales = QSwarmProtocol::ReadUInt32(entry + 20);
+         uint32_t unBiases = QSwarmProtocol::ReadUInt32(entry + 24);
+
+         if (sLayer.Inputs == 0 || sLayer.Outputs == 0 ||
+             sLayer.Blocks != (sLayer.Outputs + QSwarmKernels::BLOCK_WIDTH - 1) / QSwarmKernels::BLOCK_WIDTH ||
+             (unType != LAYER_FLOAT && unType != LAYER_INT8) ||
+             (l > 0 && sLayer.Inputs != vecLayers[l - 1].Outputs)) {
+            str_error = "invalid layer dimensions";
+            return false;
+         }
+         sLayer.Quantized = (unType == LAYER_INT8);
+
+         // Every section inside the file and aligned for float access
+         size_t weightsBytes = WeightsBytes(sLayer.Inputs, sLayer.Blocks, sLayer.Quantized);
+         size_t vectorBytes = VectorBytes(sLayer.Blocks);
+         if (unWeights % sizeof(float) != 0 || unWeights + weightsBytes > size ||
+             unBiases % sizeof(float) != 0 || unBiases + vectorBytes > size ||
+             (sLayer.Quantized && (unScales % sizeof(float) != 0 || unScales + vectorBytes > size))) {
+            str_error = "truncated layer data";
+            return false;
+         }
+
+         sLayer.Weights = sLayer.Quantized ? NULL : reinterpret_cast<const float*>(data + unWeights);
+         sLayer.QWeights = sLayer.Quantized ? reinterpret_cast<const int8_t*>(data + unWeights) : NULL;
+         sLayer.Scales = sLayer.Quantized ? reinterpret_cast<const float*>(data + unScales) : NULL;
+         sLayer.Biases = reinterpret_cast<const float*>(data + unBiases);
+      }
+
+      m_vecLayers.swap(vecLayers);
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPolicyImage::ParseLegacy(const uint8_t* data, size_t size, std::string& str_error) {
+      uint32_t unVersion = QSwarmProtocol::ReadUInt32(data + 4);
+      if (memcmp(data, "QSNN", 4) != 0) {
+         str_error = "not a policy weights file";
+         return false;
+      }
+      if (unVersion != VERSION_FLOAT && unVersion != VERSION_INT8) {
+         str_error = "unsupported weights file version";
+         return false;
+      }
+      bool bQuantized = (unVersion == VERSION_INT8);
+      uint32_t numLayers = QSwarmProtocol::ReadUInt32(data + 8);
+      // Every layer has at least its 8-byte header: reject an absurd count
+      // before sizing the tables from it
+      if (12 + static_cast<size_t>(numLayers) * 8 > size) {
+         str_error = "truncated layer header";
+         return false;
+      }
+
+      // First pass: dimensions and the size of the packed image
+      const size_t width = QSwarmKernels::BLOCK_WIDTH;
+      std::vector<SLayer> vecLayers(numLayers);
+      std::vector<size_t> vecSource(numLayers);
+      size_t offset = 12;
+      size_t packedSize = 0;
+      for (uint32_t l = 0; l < numLayers; ++l) {
+         SLayer& sLayer = vecLayers[l];
+         if (offset + 8 > size) {
+            str_error = "truncated layer header";
+            return false;
+         }
+         sLayer.Inputs = QSwarmProtocol::ReadUInt32(data + offset);
+         sLayer.Outputs = QSwarmProtocol::ReadUInt32(data + offset + 4);
+         sLayer.Quantized = bQuantized;
+         offset += 8;
+
+         if (sLayer.Inputs == 0 || sLayer.Outputs == 0 ||
+             (l > 0 && sLayer.Inputs != vecLayers[l - 1].Outputs)) {
+            str_error = "invalid layer dimensions";
+            return false;
+         }
+
+         size_t numWeights = sLayer.Inputs * sLayer.Outputs;
+         size_t layerSize = bQuantized ?
+            numWeights + 2 * sLayer.Outputs * sizeof(float) :
+            (numWeights + sLayer.Outputs) * sizeof(float);
+         if (offset + layerSize > size) {
+            str_error = "truncated layer data";
+            return false;
+         }
+         vecSource[l] = offset;
+         offset += layerSize;
+
+         sLayer.Blocks = (sLayer.Outputs + width - 1) / width;
+         packedSize += AlignUp(WeightsBytes(sLayer.Inputs, sLayer.Blocks, bQuantized)) +
+                       AlignUp(VectorBytes(sLayer.Blocks)) * (bQuantized ? 2 : 1);
+      }
+
+      if (vecLayers.empty()) {
+         str_error = "no layers";
+         return false;
+      }
+
+      // Second pass: pack W[out][in] into [block][in][lane], padding with zeros
+      m_vecOwned.assign(packedSize + QSwarmKernels::ALIGNMENT, 0);
+      uint8_t* base = &m_vecOwned[0];
+      base += (QSwarmKernels::ALIGNMENT - reinterpret_cast<uintptr_t>(base) % QSwarmKernels::ALIGNMENT) %
+              QSwarmKernels::ALIGNMENT;
+
+      for (uint32_t l = 0; l < numLayers; ++l) {
+         SLayer& sLayer = vecLayers[l];
+         const uint8_t* source = data + vecSource[l];
+         const size_t inputs = sLayer.Inputs;
+
+         if (bQuantized) {
+            float* scales = reinterpret_cast<float*>(base);
+            base += AlignUp(VectorBytes(sLayer.Blocks));
+            for (size_t j = 0; j < sLayer.Outputs; ++j, source += sizeof(float)) {
+               scales[j] = QSwarmProtocol::ReadFloat(source);
+            }
+            int8_t* packed = reinterpret_cast<int8_t*>(base);
+            base += AlignUp(WeightsBytes(inputs, sLayer.Blocks, true));
+            for (size_t j = 0; j < sLayer.Outputs; ++j) {
+               int8_t* lane = packed + (j / width) * inputs * width + j % width;
+               for (size_t i = 0; i < inputs; ++i, ++source) {
+                  lane[i * width] = static_cast<int8_t>(*source);
+               }
+            }
+            sLayer.Weights = NULL;
+            sLayer.QWeights = packed;
+            sLayer.Scales = scales;
+         }
+         else {
+            float* packed = reinterpret_cast<float*>(base);
+            base += AlignUp(WeightsBytes(inputs, sLayer.Blocks, false));
+            for (size_t j = 0; j < sLayer.Outputs; ++j) {
+               float* lane = packed + (j / width) * inputs * width + j % width;
+               for (size_t i = 0; i < inputs; ++i, source += sizeof(float)) {
+                  lane[i * width] = QSwarmProtocol::ReadFloat(source);
+               }
+            }
+            sLayer.Weights = packed;
+            sLayer.QWeights = NULL;
+            sLayer.Scales = NULL;
+         }
+
+         float* biases = reinterpret_cast<float*>(base);
+         base += AlignUp(VectorBytes(sLayer.Blocks));
+         for (size_t j = 0; j < sLayer.Outputs; ++j, source += sizeof(float)) {
+            biases[j] = QSwarmProtocol::ReadFloat(source);
+         }
+         sLayer.Biases = biases;
+      }
+
+      m_vecLayers.swap(vecLayers);
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmPolicyImage::GetWeightBytes() const {
+      size_t bytes = 0;
+      for (size_t l = 0; l < m_vecLayers.size(); ++l) {
+         const SLayer& sLayer = m_vecLayers[l];
+         bytes += WeightsBytes(sLayer.Inputs, sLayer.Blocks, sLayer.Quantized) +
+                  VectorBytes(sLayer.Blocks) * (sLayer.Quantized ? 2 : 1);
+      }
+      return bytes;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmPolicyRegistry& CQSwarmPolicyRegistry::GetInstance() {
+      static CQSwarmPolicyRegistry cInstance;
+      return cInstance;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   std::shared_ptr<const CQSwarmPolicyImage> CQSwarmPolicyRegistry::Acquire(const std::string& str_path,
+                                                                            std::string& str_error) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+
+      // Reuse the cached image while the file on disk is the same one
+      std::shared_ptr<const CQSwarmPolicyImage> pcImage = m_mapImages[str_path].lock();
+      struct stat sStat;
+      if (pcImage && stat(str_path.c_str(), &sStat) == 0 &&
+          pcImage->GetFileId() == MakeFileId(sStat)) {
+         return pcImage;
+      }
+
+      pcImage = CQSwarmPolicyImage::Open(str_path, str_error);
+      if (pcImage) {
+         m_mapImages[str_path] = pcImage;
+      }
+      return pcImage;
+   }
+
+}
@@ -0,0 +1,162 @@
+#ifndef Q_SWARM_POLICY_REGISTRY_H
+#define Q_SWARM_POLICY_REGISTRY_H
+
+/*
+ * Q-Swarm Policy Registry
+ *
+ * Process-wide cache of read-only policy weights, shared by every
+ * CQSwarmPolicy (one per controller) that loads the same file.
+ *
+ * Version 3 weights files are already packed in the kernel layout, so
+ * they are mapped read-only with mmap and used in place: all controllers
+ * of a process, and all ARGoS processes on the node, share the same
+ * page cache pages. Version 1/2 files are repacked once per process.
+ *
+ * Version 3 layout (little-endian, sections aligned to 64 bytes):
+ *    header (64 bytes):
+ *       char[4]   magic "QSNN"
+ *       u32       version (3)
+ *       u32       number of layers
+ *       u32       block width (8)
+ *    per layer (32 bytes):
+ *       u32       inputs
+ *       u32       outputs
+ *       u32       blocks = ceil(outputs / block width)
+ *       u32       type (0 = float32, 1 = int8)
+ *       u32       weights offset: packed [blocks][inputs][block width]
+ *       u32       scales offset (int8): float32 [blocks * block width]
+ *       u32       biases offset: float32 [blocks * block width]
+ *       u32       reserved
+ *
+ * Hot reload: writers replace the file atomically (write a temporary
+ * file, then rename it). Acquire() notices the new file and maps it;
+ * images still in use by other controllers stay valid until released.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   /*
+    * One loaded weights file (immutable)
+    */
+   class CQSwarmPolicyImage {
+
+   public:
+
+      /* Layer view into the image */
+      struct SLayer {
+         size_t Inputs;
+         size_t Outputs;
+         size_t Blocks;                /* ceil(Outputs / BLOCK_WIDTH) */
+         bool Quantized;
+         const float* Weights;         /* float layers [Blocks][Inputs][BLOCK_WIDTH] */
+         const int8_t* QWeights;       /* int8 layers [Blocks][Inputs][BLOCK_WIDTH] */
+         const float* Scales;          /* int8 layers [Blocks * BLOCK_WIDTH] */
+         const float* Biases;          /* [Blocks * BLOCK_WIDTH] */
+      };
+
+      /* Identifies the file the image was loaded from */
+      struct SFileId {
+         uint64_t Device;
+         uint64_t Inode;
+         uint64_t Size;
+         int64_t ModificationTime;
+
+         bool operator==(const SFileId& s_other) const {
+            return Device == s_other.Device && Inode == s_other.Inode &&
+                   Size == s_other.Size && ModificationTime == s_other.ModificationTime;
+         }
+      };
+
+      ~CQSwarmPolicyImage();
+
+      /*
+       * Load a weights file (any version)
+       * Returns NULL (and sets str_error) if the file is missing or invalid
+       */
+      static std::shared_ptr<CQSwarmPolicyImage> Open(const std::string& str_path,
+                                                      std::string& str_error);
+
+      const std::vector<SLayer>& GetLayers() const {
+         return m_vecLayers;
+      }
+
+      const SFileId& GetFileId() const {
+         return m_sFileId;
+      }
+
+      /* True if the file is mapped (shared between processes) */
+      bool IsMapped() const {
+         return m_pMapping != NULL;
+      }
+
+      /* Bytes of weights, scales and biases */
+      size_t GetWeightBytes() const;
+
+   private:
+
+      CQSwarmPolicyImage();
+      CQSwarmPolicyImage(const CQSwarmPolicyImage&);
+      CQSwarmPolicyImage& operator=(const CQSwarmPolicyImage&);
+
+      /* Point the layers into a version 3 image */
+      bool ParsePacked(const uint8_t* data, size_t size, std::string& str_error);
+
+      /* Repack a version 1/2 file into m_vecOwned */
+      bool ParseLegacy(const uint8_t* data, size_t size, std::string& str_error);
+
+      std::vector<SLayer> m_vecLayers;
+      SFileId m_sFileId;
+
+      /* Read-only mapping of a version 3 file */
+      void* m_pMapping;
+      size_t m_unMappingSize;
+
+      /* Repacked version 1/2 data (64 bytes of slack for alignment) */
+      std::vector<uint8_t> m_vecOwned;
+
+   };
+
+   /*
+    * Process-wide, reference-counted cache of policy images by path
+    */
+   class CQSwarmPolicyRegistry {
+
+   public:
+
+      static CQSwarmPolicyRegistry& GetInstance();
+
+      /*
+       * Image of the current content of str_path
+       * Returns the cached image if the file did not change since it was
+       * loaded, loads it again otherwise (thread safe)
+       * Returns NULL (and sets str_error) on failure
+       */
+      std::shared_ptr<const CQSwarmPolicyImage> Acquire(const std::string& str_path,
+                                                        std::string& str_error);
+
+   private:
+
+      CQSwarmPolicyRegistry() {}
+      CQSwarmPolicyRegistry(const CQSwarmPolicyRegistry&);
+      CQSwarmPolicyRegistry& operator=(const CQSwarmPolicyRegistry&);
+
+      std::mutex m_cMutex;
+
+      /* Images stay alive only as long as some policy holds them */
+      std::map<std::string, std::weak_ptr<const CQSwarmPolicyImage> > m_mapImages;
+
+   };
+
+}
+
+#endif
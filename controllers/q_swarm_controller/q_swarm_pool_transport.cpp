@@ -0,0 +1,437 @@
+/*
+ * Q-Swarm Pooled TCP Transport Implementation
+ */
+
+#include "q_swarm_pool_transport.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace argos {
+
+   namespace {
+
+      /* Initial capacity of the ring of unanswered frames */
+      const size_t PENDING_CAPACITY = 64;
+
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmConnectionPool& CQSwarmConnectionPool::GetInstance() {
+      static CQSwarmConnectionPool cInstance;
+      return cInstance;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmConnectionPool::CQSwarmConnectionPool() :
+      m_unSize(4),
+      m_bConfigured(false),
+      m_unRobots(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::Configure(const TQSwarmEndpoints& t_servers,
+                                         size_t un_connections) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      un_connections = std::max<size_t>(un_connections, 1);
+      if (m_bConfigured) {
+         if (t_servers.size() != m_tServers.size() || un_connections != m_unSize) {
+            return false;
+         }
+         for (size_t i = 0; i < t_servers.size(); ++i) {
+            if (t_servers[i].Host != m_tServers[i].Host || t_servers[i].Port != m_tServers[i].Port) {
+               return false;
+            }
+         }
+         return true;
+      }
+      m_tServers = t_servers;
+      m_unSize = un_connections;
+      m_bConfigured = true;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::Register(uint32_t robot_id, bool b_compact) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+
+      // The first robot opens the connections, m_unSize per server
+      if (m_vecConnections.empty()) {
+         if (m_tServers.empty()) {
+            SQSwarmEndpoint sDefault = { "127.0.0.1", 5555 };
+            m_tServers.push_back(sDefault);
+         }
+         for (size_t i = 0; i < m_tServers.size() * m_unSize; ++i) {
+            const SQSwarmEndpoint& sServer = m_tServers[i / m_unSize];
+            std::unique_ptr<SConnection> pcConnection(new SConnection);
+            if (!pcConnection->Socket.Connect(sServer.Host, sServer.Port)) {
+               m_vecConnections.clear();
+               return false;
+            }
+            pcConnection->Pending.resize(PENDING_CAPACITY);
+            m_vecConnections.push_back(std::move(pcConnection));
+         }
+      }
+
+      if (robot_id >= m_vecMailboxes.size()) {
+         SMailbox sEmpty;
+         memset(&sEmpty, 0, sizeof(sEmpty));
+         m_vecMailboxes.resize(robot_id + 1, sEmpty);
+      }
+
+      // Room for two ticks of frames (robots resetting an episode skip a
+      // tick and their connection writes with the next one), so queueing
+      // does not allocate
+      SConnection& sConnection = GetConnection(robot_id);
+      std::lock_guard<std::mutex> cConnectionLock(sConnection.Mutex);
+      m_vecMailboxes[robot_id].Compact = b_compact;
+      m_vecMailboxes[robot_id].Goal.Sent = false;
+      ++sConnection.Robots;
+      sConnection.Outgoing.reserve(2 * sConnection.Robots * QSwarmProtocol::STEP_FRAME_SIZE);
+      ++m_unRobots;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmConnectionPool::Unregister(uint32_t robot_id) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      if (m_unRobots == 0 || m_vecConnections.empty()) {
+         return;
+      }
+
+      {
+         SConnection& sConnection = GetConnection(robot_id);
+         std::lock_guard<std::mutex> cConnectionLock(sConnection.Mutex);
+         if (sConnection.Robots > 0) {
+            --sConnection.Robots;
+         }
+      }
+
+      // The last robot closes the connections; the next run may configure again
+      if (--m_unRobots == 0) {
+         m_vecConnections.clear();
+         m_vecMailboxes.clear();
+         m_tServers.clear();
+         m_bConfigured = false;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::Maintain(uint32_t robot_id) {
+      if (m_vecConnections.empty()) {
+         return false;
+      }
+      SConnection& sConnection = GetConnection(robot_id);
+      std::lock_guard<std::mutex> cLock(sConnection.Mutex);
+      return MaintainLocked(sConnection);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::IsConnected(uint32_t robot_id) {
+      if (m_vecConnections.empty()) {
+         return false;
+      }
+      SConnection& sConnection = GetConnection(robot_id);
+      std::lock_guard<std::mutex> cLock(sConnection.Mutex);
+      return sConnection.Connected;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::Request(uint32_t robot_id,
+                                       const float* state,
+                                       float prev_reward,
+                                       uint8_t flags,
+                                       int& action) {
+      if (m_vecConnections.empty()) {
+         return false;
+      }
+      SConnection& sConnection = GetConnection(robot_id);
+      std::lock_guard<std::mutex> cLock(sConnection.Mutex);
+      if (!sConnection.Connected) {
+         return false;
+      }
+
+      // Sends the frames other robots queued along with this one
+      AppendFrame(sConnection, robot_id, state, prev_reward, flags);
+      if (!Send(sConnection)) {
+         return false;
+      }
+
+      // This frame is answered last: read every outstanding answer
+      SMailbox& sMailbox = m_vecMailboxes[robot_id];
+      uint8_t replies[64];
+      while (sConnection.PendingCount > 0) {
+         size_t count = std::min(sConnection.PendingCount, sizeof(replies));
+         if (!sConnection.Socket.ReceiveBytes(replies, count)) {
+            Reset(sConnection);
+            return false;
+         }
+         Dispatch(sConnection, replies, count);
+      }
+      action = sMailbox.Action;
+      sMailbox.Count = 0;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::Queue(uint32_t robot_id,
+                                     const float* state,
+                                     float prev_reward,
+                                     uint8_t flags) {
+      if (m_vecConnections.empty()) {
+         return false;
+      }
+      SConnection& sConnection = GetConnection(robot_id);
+      std::lock_guard<std::mutex> cLock(sConnection.Mutex);
+      if (!sConnection.Connected) {
+         return false;
+      }
+
+      AppendFrame(sConnection, robot_id, state, prev_reward, flags);
+
+      // The last robot of the connection to step writes the whole tick
+      if (sConnection.QueuedFrames >= sConnection.Robots) {
+         return Send(sConnection);
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int CQSwarmConnectionPool::Poll(uint32_t robot_id, int& action) {
+      if (m_vecConnections.empty()) {
+         return -1;
+      }
+      SConnection& sConnection = GetConnection(robot_id);
+      std::lock_guard<std::mutex> cLock(sConnection.Mutex);
+      if (!sConnection.Connected) {
+         return -1;
+      }
+
+      // One byte per answer: drain everything that arrived
+      uint8_t replies[64];
+      while (sConnection.PendingCount > 0) {
+         int received = sConnection.Socket.ReceiveAvailable(
+            replies, std::min(sConnection.PendingCount, sizeof(replies)));
+         if (received < 0) {
+            Reset(sConnection);
+            return -1;
+         }
+         if (received == 0) {
+            break;
+         }
+         Dispatch(sConnection, replies, received);
+      }
+
+      SMailbox& sMailbox = m_vecMailboxes[robot_id];
+      int count = sMailbox.Count;
+      if (count > 0) {
+         action = sMailbox.Action;
+         sMailbox.Count = 0;
+      }
+      return count;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmConnectionPool::Flush() {
+      for (size_t i = 0; i < m_vecConnections.size(); ++i) {
+         SConnection& sConnection = *m_vecConnections[i];
+         std::lock_guard<std::mutex> cLock(sConnection.Mutex);
+         if (sConnection.Connected && !sConnection.Outgoing.empty()) {
+            Send(sConnection);
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::MaintainLocked(SConnection& s_connection) {
+      bool bConnected = s_connection.Socket.Maintain();
+      if (bConnected != s_connection.Connected) {
+         // Frames queued or sent on the previous connection are lost
+         Reset(s_connection);
+         s_connection.Connected = bConnected;
+      }
+      return bConnected;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmConnectionPool::AppendFrame(SConnection& s_connection,
+                                           uint32_t robot_id,
+                                           const float* state,
+                                           float prev_reward,
+                                           uint8_t flags) {
+      size_t offset = s_connection.Outgoing.size();
+      s_connection.Outgoing.resize(offset + QSwarmProtocol::STEP_FRAME_SIZE);
+      SMailbox& sMailbox = m_vecMailboxes[robot_id];
+      size_t frameSize;
+      if (sMailbox.Compact) {
+         flags |= QSwarmProtocol::CompactGoalFlag(sMailbox.Goal, state, s_connection.Socket.GetGeneration());
+         frameSize = QSwarmProtocol::EncodeCompactStep(&s_connection.Outgoing[offset], robot_id, state, prev_reward, flags);
+      }
+      else {
+         frameSize = QSwarmProtocol::EncodeStep(&s_connection.Outgoing[offset], robot_id, state, prev_reward, flags);
+      }
+      s_connection.Outgoing.resize(offset + frameSize);
+      ++s_connection.QueuedFrames;
+
+      // Grow the ring when full (only while the pipeline deepens)
+      std::vector<uint32_t>& vecPending = s_connection.Pending;
+      if (s_connection.PendingCount == vecPending.size()) {
+         std::rotate(vecPending.begin(), vecPending.begin() + s_connection.PendingHead, vecPending.end());
+         s_connection.PendingHead = 0;
+         vecPending.resize(vecPending.size() * 2);
+      }
+      size_t tail = (s_connection.PendingHead + s_connection.PendingCount) % vecPending.size();
+      vecPending[tail] = robot_id;
+      ++s_connection.PendingCount;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmConnectionPool::Send(SConnection& s_connection) {
+      bool bOk = s_connection.Socket.SendBytes(&s_connection.Outgoing[0],
+                                               s_connection.Outgoing.size());
+      s_connection.Outgoing.clear();
+      s_connection.QueuedFrames = 0;
+      if (!bOk) {
+         Reset(s_connection);
+      }
+      return bOk;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmConnectionPool::Dispatch(SConnection& s_connection,
+                                        const uint8_t* actions,
+                                        size_t count) {
+      const std::vector<uint32_t>& vecPending = s_connection.Pending;
+      for (size_t i = 0; i < count && s_connection.PendingCount > 0; ++i) {
+         SMailbox& sMailbox = m_vecMailboxes[vecPending[s_connection.PendingHead]];
+         sMailbox.Action = actions[i];
+         ++sMailbox.Count;
+         s_connection.PendingHead = (s_connection.PendingHead + 1) % vecPending.size();
+         --s_connection.PendingCount;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmConnectionPool::Reset(SConnection& s_connection) {
+      s_connection.Outgoing.clear();
+      s_connection.QueuedFrames = 0;
+      s_connection.PendingHead = 0;
+      s_connection.PendingCount = 0;
+      s_connection.Connected = s_connection.Socket.IsConnected();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmPoolTransport::CQSwarmPoolTransport(uint32_t robot_id, bool b_compact) :
+      m_unRobotId(robot_id),
+      m_bCompact(b_compact),
+      m_bRegistered(false) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmPoolTransport::~CQSwarmPoolTransport() {
+      Close();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPoolTransport::Connect() {
+      Close();
+      m_bRegistered = CQSwarmConnectionPool::GetInstance().Register(m_unRobotId, m_bCompact);
+      return m_bRegistered;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPoolTransport::Maintain() {
+      return m_bRegistered && CQSwarmConnectionPool::GetInstance().Maintain(m_unRobotId);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPoolTransport::IsConnected() const {
+      return m_bRegistered && CQSwarmConnectionPool::GetInstance().IsConnected(m_unRobotId);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPoolTransport::RequestAction(uint32_t /* robot_id */,
+                                            const float* state,
+                                            float prev_reward,
+                                            uint8_t flags,
+                                            int& action) {
+      return m_bRegistered &&
+             CQSwarmConnectionPool::GetInstance().Request(m_unRobotId, state, prev_reward, flags, action);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmPoolTransport::SendRequest(uint32_t /* robot_id */,
+                                          const float* state,
+                                          float prev_reward,
+                                          uint8_t flags) {
+      return m_bRegistered &&
+             CQSwarmConnectionPool::GetInstance().Queue(m_unRobotId, state, prev_reward, flags);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int CQSwarmPoolTransport::PollActions(int& action) {
+      if (!m_bRegistered) {
+         return -1;
+      }
+      return CQSwarmConnectionPool::GetInstance().Poll(m_unRobotId, action);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmPoolTransport::Close() {
+      if (m_bRegistered) {
+         CQSwarmConnectionPool::GetInstance().Unregister(m_unRobotId);
+         m_bRegistered = false;
+      }
+   }
+
+}
@@ -0,0 +1,253 @@
+#ifndef Q_SWARM_POOL_TRANSPORT_H
+#define Q_SWARM_POOL_TRANSPORT_H
+
+/*
+ * Q-Swarm Pooled TCP Transport
+ *
+ * All controllers of an ARGoS process share a few connections to the
+ * Q-Network server instead of opening one socket per robot. Robot r
+ * uses connection r % pool_size to its server (with several servers,
+ * ShardOf() in q_swarm_endpoints.h picks it and each server gets
+ * pool_size connections). Requests are binary STEP frames, which
+ * carry the robot id, and the server answers the frames of a connection
+ * in order with one action byte each, so the answers are routed back
+ * by matching them against the robot ids of the frames sent.
+ *
+ * In pipelined mode a request is only appended to the connection's
+ * outgoing buffer, which is written with a single send() once every
+ * robot of the connection has queued its frame (or at the latest by
+ * CQSwarmLoopFunctions::PostStep at the end of the tick). The server
+ * answers such a block of frames with one forward pass.
+ *
+ * Blocking requests (pipelined="false") flush at once and wait for the
+ * answer; robots sharing a connection are then served one at a time.
+ *
+ * Robots register in Init (serially), so the per-robot tables are sized
+ * before the worker threads start; each connection has its own mutex.
+ */
+
+#include "q_swarm_transport.h"
+#include "q_swarm_protocol.h"
+#include "q_swarm_socket.h"
+#include "q_swarm_endpoints.h"
+
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   /*
+    * Process-wide pool of connections to the Q-Network server
+    */
+   class CQSwarmConnectionPool {
+
+   public:
+
+      static CQSwarmConnectionPool& GetInstance();
+
+      /*
+       * Servers and number of connections per server (used when the
+       * first robot registers)
+       * Returns false if the pool is already configured differently; the
+       * existing configuration is kept
+       */
+      bool Configure(const TQSwarmEndpoints& t_servers, size_t un_connections);
+
+      /*
+       * Add a robot; the first one starts connecting (in the background)
+       * b_compact: the robot's frames are COMPACT_STEP instead of STEP
+       * Returns false if the server address is invalid
+       */
+      bool Register(uint32_t robot_id, bool b_compact = false);
+
+      /*
+       * Remove a robot; the last one closes the connections
+       */
+      void Unregister(uint32_t robot_id);
+
+      /*
+       * Advance the robot's connection (see CQSwarmSocket::Maintain())
+       * Returns true while it is usable
+       */
+      bool Maintain(uint32_t robot_id);
+
+      bool IsConnected(uint32_t robot_id);
+
+      /*
+       * Send a STEP frame and wait for the robot's action
+       */
+      bool Request(uint32_t robot_id,
+                   const float* state,
+                   float prev_reward,
+                   uint8_t flags,
+                   int& action);
+
+      /*
+       * Queue a STEP frame without waiting (pipelined mode)
+       */
+      bool Queue(uint32_t robot_id,
+                 const float* state,
+                 float prev_reward,
+                 uint8_t flags);
+
+      /*
+       * Collect the answers that arrived on the robot's connection
+       * without blocking; action is set to the robot's most recent one
+       * Returns the number of the robot's answers, -1 on error
+       */
+      int Poll(uint32_t robot_id, int& action);
+
+      /*
+       * Write every queued frame (one send() per connection)
+       */
+      void Flush();
+
+      size_t GetConnectionCount() const {
+         return m_vecConnections.size();
+      }
+
+   private:
+
+      /* One shared connection */
+      struct SConnection {
+         std::mutex Mutex;
+         CQSwarmSocket Socket;
+         bool Connected;
+
+         /* Robots routed to this connection */
+         size_t Robots;
+
+         /* Frames not written yet */
+         std::vector<uint8_t> Outgoing;
+         size_t QueuedFrames;
+
+         /* Robot ids of the frames not answered yet (ring buffer) */
+         std::vector<uint32_t> Pending;
+         size_t PendingHead;
+         size_t PendingCount;
+
+         SConnection() :
+            Connected(false),
+            Robots(0),
+            QueuedFrames(0),
+            PendingHead(0),
+            PendingCount(0) {}
+      };
+
+      /*
+       * Answers received for one robot since its last Poll(), and how
+       * its frames are encoded
+       */
+      struct SMailbox {
+         int Action;
+         uint32_t Count;
+         bool Compact;
+         QSwarmProtocol::SCompactGoal Goal;
+      };
+
+      CQSwarmConnectionPool();
+      CQSwarmConnectionPool(const CQSwarmConnectionPool&);
+      CQSwarmConnectionPool& operator=(const CQSwarmConnectionPool&);
+
+      SConnection& GetConnection(uint32_t robot_id) {
+         size_t shard = ShardOf(robot_id, m_tServers.size());
+         return *m_vecConnections[shard * m_unSize + robot_id % m_unSize];
+      }
+
+      /* The following expect the connection's mutex to be held */
+
+      /* Check the socket and forget the queues when it went up or down */
+      bool MaintainLocked(SConnection& s_connection);
+
+      /* Append a STEP (or COMPACT_STEP) frame and remember who sent it */
+      void AppendFrame(SConnection& s_connection,
+                       uint32_t robot_id,
+                       const float* state,
+                       float prev_reward,
+                       uint8_t flags);
+
+      /* Write the outgoing buffer */
+      bool Send(SConnection& s_connection);
+
+      /* Hand count received action bytes to the robots that asked */
+      void Dispatch(SConnection& s_connection, const uint8_t* actions, size_t count);
+
+      /* The connection failed: drop the queues */
+      void Reset(SConnection& s_connection);
+
+      std::mutex m_cMutex;
+
+      TQSwarmEndpoints m_tServers;
+      size_t m_unSize;
+      bool m_bConfigured;
+
+      /* Registered robots, all connections */
+      size_t m_unRobots;
+
+      std::vector<std::unique_ptr<SConnection> > m_vecConnections;
+
+      /* Indexed by robot id, guarded by the robot's connection mutex */
+      std::vector<SMailbox> m_vecMailboxes;
+
+   };
+
+   /*
+    * Transport of one robot over the pool
+    */
+   class CQSwarmPoolTransport : public CQSwarmTransport {
+
+   public:
+
+      /* b_compact: COMPACT_STEP frames instead of STEP */
+      CQSwarmPoolTransport(uint32_t robot_id, bool b_compact = false);
+
+      virtual ~CQSwarmPoolTransport();
+
+      virtual bool Connect();
+
+      virtual bool Maintain();
+
+      virtual bool IsConnected() const;
+
+      virtual bool RequestAction(uint32_t robot_id,
+                                 const float* state,
+                                 float prev_reward,
+                                 uint8_t flags,
+                                 int& action);
+
+      /*
+       * Not supported: STEP frames always carry the previous reward
+       */
+      virtual bool SendReward(uint32_t /* robot_id */,
+                              float /* reward */,
+                              bool /* done */) {
+         return false;
+      }
+
+      virtual bool SupportsPipelining() const {
+         return true;
+      }
+
+      virtual bool SendRequest(uint32_t robot_id,
+                               const float* state,
+                               float prev_reward,
+                               uint8_t flags);
+
+      virtual int PollActions(int& action);
+
+      virtual void Close();
+
+   private:
+
+      uint32_t m_unRobotId;
+      bool m_bCompact;
+      bool m_bRegistered;
+
+   };
+
+}
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ * Q-Swarm Binary Wire Protocol Implementation
+ *
+ * All multi-byte fields are written byte by byte in little-endian order,
+ * so the encoding is the same on every host.
+ */
+
+#include "q_swarm_protocol.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace argos {
+
+   namespace QSwarmProtocol {
+
+      static_assert(COMPACT_STEP_FRAME_SIZE <= STEP_FRAME_SIZE,
+                    "compact frames are encoded into STEP frame buffers");
+
+      namespace {
+
+         /* Round value * scale to the nearest integer in [min, max] */
+         int Quantize(float value, float scale, int min, int max) {
+            float scaled = value * scale;
+            if (!(scaled > min)) {
+               return min;          /* also NaN */
+            }
+            if (scaled >= max) {
+               return max;
+            }
+            return static_cast<int>(lrintf(scaled));
+         }
+
+         void WritePosition(uint8_t* buf, float value) {
+            int16_t fixed = static_cast<int16_t>(Quantize(value, COMPACT_POSITION_SCALE, -32768, 32767));
+            WriteUInt16(buf, static_cast<uint16_t>(fixed));
+         }
+
+         /*
+          * Append "|value" at buf[pos] (same formatting as std::ostream)
+          * Returns the new end, or size if the message does not fit
+          */
+         size_t AppendFloat(char* buf, size_t size, size_t pos, float value) {
+            if (pos >= size) {
+               return size;
+            }
+            int written = snprintf(buf + pos, size - pos, "|%g", value);
+            return (written < 0 || pos + written >= size) ? size : pos + written;
+         }
+
+         size_t AppendUInt(char* buf, size_t size, size_t pos, uint32_t value) {
+            if (pos >= size) {
+               return size;
+            }
+            int written = snprintf(buf + pos, size - pos, "|%u", value);
+            return (written < 0 || pos + written >= size) ? size : pos + written;
+         }
+
+         /* Copy the message type (without its NUL), or size if it does not fit */
+         size_t AppendType(char* buf, size_t size, const char* type) {
+            size_t length = strlen(type);
+            if (length >= size) {
+               return size;
+            }
+            memcpy(buf, type, length);
+            return length;
+         }
+
+         /*
+          * Parse a decimal integer in [first, last) (std::from_chars style)
+          * Returns the end of the number, or first if there is none
+          */
+         const char* ParseInt(const char* first, const char* last, int& value) {
+            const char* p = first;
+            bool negative = (p < last && *p == '-');
+            if (negative) {
+               ++p;
+            }
+            const char* digits = p;
+            int result = 0;
+            for (; p < last && *p >= '0' && *p <= '9'; ++p) {
+               result = result * 10 + (*p - '0');
+            }
+            if (p == digits) {
+               return first;
+            }
+            value = negative ? -result : result;
+            return p;
+         }
+
+         /* Proximity readings as u8, then neighbour features as int8 */
+         void WriteFeatures(uint8_t* proximity, uint8_t* neighbours, const float* state) {
+            for (size_t i = 0; i < PROXIMITY_SIZE; ++i) {
+               proximity[i] = static_cast<uint8_t>(Quantize(state[4 + i], COMPACT_PROXIMITY_SCALE, 0, 255));
+            }
+            for (size_t i = 0; i < NEIGHBOUR_FEATURES * NEIGHBOURS; ++i) {
+               int8_t feature = static_cast<int8_t>(
+                  Quantize(state[NEIGHBOUR_OFFSET + i], COMPACT_NEIGHBOUR_SCALE, -127, 127));
+               neighbours[i] = static_cast<uint8_t>(feature);
+            }
+         }
+
+      }
+
+      /****************************************/
+      /****************************************/
+
+      void WriteUInt16(uint8_t* buf, uint16_t value) {
+         buf[0] = static_cast<uint8_t>(value);
+         buf[1] = static_cast<uint8_t>(value >> 8);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      uint16_t ReadUInt16(const uint8_t* buf) {
+         return static_cast<uint16_t>(buf[0] | (buf[1] << 8));
+      }
+
+      /****************************************/
+      /****************************************/
+
+      void WriteUInt32(uint8_t* buf, uint32_t value) {
+         buf[0] = static_cast<uint8_t>(value);
+         buf[1] = static_cast<uint8_t>(value >> 8);
+         buf[2] = static_cast<uint8_t>(value >> 16);
+         buf[3] = static_cast<uint8_t>(value >> 24);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      uint32_t ReadUInt32(const uint8_t* buf) {
+         return static_cast<uint32_t>(buf[0]) |
+                (static_cast<uint32_t>(buf[1]) << 8) |
+                (static_cast<uint32_t>(buf[2]) << 16) |
+                (static_cast<uint32_t>(buf[3]) << 24);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      void WriteFloat(uint8_t* buf, float value) {
+         uint32_t bits;
+         memcpy(&bits, &value, sizeof(bits));
+         WriteUInt32(buf, bits);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      float ReadFloat(const uint8_t* buf) {
+         uint32_t bits = ReadUInt32(buf);
+         float value;
+         memcpy(&value, &bits, sizeof(value));
+         return value;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      void EncodeHeader(uint8_t* buf,
+                        uint8_t type,
+                        uint32_t robot_id,
+                        uint32_t payload_size) {
+         buf[0] = MAGIC_0;
+         buf[1] = MAGIC_1;
+         buf[2] = VERSION;
+         buf[3] = type;
+         WriteUInt32(buf + 4, robot_id);
+         WriteUInt32(buf + 8, payload_size);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      bool DecodeHeader(const uint8_t* buf, SFrameHeader& header) {
+         if (buf[0] != MAGIC_0 || buf[1] != MAGIC_1) {
+            return false;
+         }
+         header.Version = buf[2];
+         header.Type = buf[3];
+         header.RobotId = ReadUInt32(buf + 4);
+         header.PayloadSize = ReadUInt32(buf + 8);
+         return header.Version == VERSION;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeState(uint8_t* buf,
+                         uint32_t robot_id,
+                         const float* state) {
+         EncodeHeader(buf, MSG_STATE, robot_id, STATE_PAYLOAD_SIZE);
+         uint8_t* payload = buf + HEADER_SIZE;
+         for (size_t i = 0; i < STATE_SIZE; ++i) {
+            WriteFloat(payload + i * sizeof(float), state[i]);
+         }
+         return STATE_FRAME_SIZE;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeReward(uint8_t* buf,
+                          uint32_t robot_id,
+                          float reward,
+                          bool done) {
+         EncodeHeader(buf, MSG_REWARD, robot_id, REWARD_PAYLOAD_SIZE);
+         uint8_t* payload = buf + HEADER_SIZE;
+         WriteFloat(payload, reward);
+         payload[sizeof(float)] = done ? 1 : 0;
+         return REWARD_FRAME_SIZE;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeStep(uint8_t* buf,
+                        uint32_t robot_id,
+                        const float* state,
+                        float prev_reward,
+                        uint8_t flags) {
+         EncodeHeader(buf, MSG_STEP, robot_id, STEP_PAYLOAD_SIZE);
+         uint8_t* payload = buf + HEADER_SIZE;
+         for (size_t i = 0; i < STATE_SIZE; ++i) {
+            WriteFloat(payload + i * sizeof(float), state[i]);
+         }
+         WriteFloat(payload + STATE_PAYLOAD_SIZE, prev_reward);
+         payload[STATE_PAYLOAD_SIZE + sizeof(float)] = flags;
+         return STEP_FRAME_SIZE;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t BatchStepPayloadSize(uint32_t count) {
+         return sizeof(uint32_t) +
+                count * (sizeof(uint32_t) + STATE_PAYLOAD_SIZE + sizeof(float) + 1);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t BatchStepFrameSize(uint32_t count) {
+         return HEADER_SIZE + BatchStepPayloadSize(count);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeBatchStep(uint8_t* buf,
+                             uint32_t count,
+                             const uint32_t* robot_ids,
+                             const float* states,
+                             const float* prev_rewards,
+                             const uint8_t* flags) {
+         EncodeHeader(buf, MSG_BATCH_STEP, 0, BatchStepPayloadSize(count));
+         uint8_t* payload = buf + HEADER_SIZE;
+
+         WriteUInt32(payload, count);
+         payload += sizeof(uint32_t);
+
+         for (uint32_t i = 0; i < count; ++i) {
+            WriteUInt32(payload + i * sizeof(uint32_t), robot_ids[i]);
+         }
+         payload += count * sizeof(uint32_t);
+
+         for (size_t i = 0; i < count * STATE_SIZE; ++i) {
+            WriteFloat(payload + i * sizeof(float), states[i]);
+         }
+         payload += count * STATE_PAYLOAD_SIZE;
+
+         for (uint32_t i = 0; i < count; ++i) {
+            WriteFloat(payload + i * sizeof(float), prev_rewards[i]);
+         }
+         payload += count * sizeof(float);
+
+         memcpy(payload, flags, count);
+         return BatchStepFrameSize(count);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      uint8_t CompactGoalFlag(SCompactGoal& s_goal, const float* state, uint32_t un_generation) {
+         if (s_goal.Sent && s_goal.Generation == un_generation &&
+             s_goal.X == state[2] && s_goal.Y == state[3]) {
+            return 0;
+         }
+         s_goal.X = state[2];
+         s_goal.Y = state[3];
+         s_goal.Generation = un_generation;
+         s_goal.Sent = true;
+         return STEP_HAS_GOAL;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeCompactStep(uint8_t* buf,
+                               uint32_t robot_id,
+                               const float* state,
+                               float prev_reward,
+                               uint8_t flags) {
+         size_t payloadSize = COMPACT_STEP_PAYLOAD_SIZE + ((flags & STEP_HAS_GOAL) ? COMPACT_GOAL_SIZE : 0);
+         EncodeHeader(buf, MSG_COMPACT_STEP, robot_id, payloadSize);
+         uint8_t* payload = buf + HEADER_SIZE;
+
+         WriteFloat(payload, prev_reward);
+         payload[sizeof(float)] = flags;
+         payload += sizeof(float) + 1;
+
+         WritePosition(payload, state[0]);
+         WritePosition(payload + 2, state[1]);
+         payload += 2 * sizeof(int16_t);
+         if (flags & STEP_HAS_GOAL) {
+            WritePosition(payload, state[2]);
+            WritePosition(payload + 2, state[3]);
+            payload += COMPACT_GOAL_SIZE;
+         }
+
+         WriteFeatures(payload, payload + PROXIMITY_SIZE, state);
+         return HEADER_SIZE + payloadSize;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t CompactBatchStepFrameSize(uint32_t count, uint32_t goals) {
+         return HEADER_SIZE + sizeof(uint32_t) +
+                count * (sizeof(uint32_t) + sizeof(float) + 1 + COMPACT_STATE_SIZE) +
+                goals * COMPACT_GOAL_SIZE;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeCompactBatchStep(uint8_t* buf,
+                                    uint32_t count,
+                                    const uint32_t* robot_ids,
+                                    const float* states,
+                                    const float* prev_rewards,
+                                    const uint8_t* flags) {
+         uint32_t goals = 0;
+         for (uint32_t i = 0; i < count; ++i) {
+            goals += (flags[i] & STEP_HAS_GOAL) ? 1 : 0;
+         }
+         size_t frameSize = CompactBatchStepFrameSize(count, goals);
+         EncodeHeader(buf, MSG_COMPACT_BATCH_STEP, 0, frameSize - HEADER_SIZE);
+         uint8_t* payload = buf + HEADER_SIZE;
+
+         WriteUInt32(payload, count);
+         payload += sizeof(uint32_t);
+
+         for (uint32_t i = 0; i < count; ++i) {
+            WriteUInt32(payload + i * sizeof(uint32_t), robot_ids[i]);
+         }
+         payload += count * sizeof(uint32_t);
+
+         for (uint32_t i = 0; i < count; ++i) {
+            WriteFloat(payload + i * sizeof(float), prev_rewards[i]);
+         }
+         payload += count * sizeof(float);
+
+         memcpy(payload, flags, count);
+         payload += count;
+
+         for (uint32_t i = 0; i < count; ++i) {
+            WritePosition(payload + 4 * i, states[i * STATE_SIZE]);
+            WritePosition(payload + 4 * i + 2, states[i * STATE_SIZE + 1]);
+         }
+         payload += count * 2 * sizeof(int16_t);
+
+         const size_t unNeighbours = NEIGHBOUR_FEATURES * NEIGHBOURS;
+         uint8_t* neighbours = payload + count * PROXIMITY_SIZE;
+         for (uint32_t i = 0; i < count; ++i) {
+            WriteFeatures(payload + i * PROXIMITY_SIZE, neighbours + i * unNeighbours, states + i * STATE_SIZE);
+         }
+         payload = neighbours + count * unNeighbours;
+
+         for (uint32_t i = 0; i < count; ++i) {
+            if (flags[i] & STEP_HAS_GOAL) {
+               WritePosition(payload, states[i * STATE_SIZE + 2]);
+               WritePosition(payload + 2, states[i * STATE_SIZE + 3]);
+               payload += COMPACT_GOAL_SIZE;
+            }
+         }
+         return frameSize;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeTextStep(char* buf,
+                            size_t size,
+                            uint32_t robot_id,
+                            const float* state,
+                            float prev_reward,
+                            uint8_t flags,
+                            bool b_combined) {
+         size_t pos;
+         if (b_combined) {
+            pos = AppendType(buf, size, "STEP");
+            pos = AppendUInt(buf, size, pos, robot_id);
+            pos = AppendFloat(buf, size, pos, prev_reward);
+            pos = AppendUInt(buf, size, pos, flags);
+         }
+         else {
+            pos = AppendType(buf, size, "STATE");
+            pos = AppendUInt(buf, size, pos, robot_id);
+         }
+         for (size_t i = 0; i < STATE_SIZE; ++i) {
+            pos = AppendFloat(buf, size, pos, state[i]);
+         }
+         return pos;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      size_t EncodeTextReward(char* buf,
+                              size_t size,
+                              uint32_t robot_id,
+                              float reward,
+                              bool done) {
+         size_t pos = AppendType(buf, size, "REWARD");
+         pos = AppendUInt(buf, size, pos, robot_id);
+         pos = AppendFloat(buf, size, pos, reward);
+         return AppendUInt(buf, size, pos, done ? 1 : 0);
+      }
+
+      /****************************************/
+      /****************************************/
+
+      int ParseTextAction(const char* reply, size_t length) {
+         const char* bar = static_cast<const char*>(memchr(reply, '|', length));
+         int action = 0;
+         if (bar != NULL) {
+            ParseInt(bar + 1, reply + length, action);
+         }
+         return action;
+      }
+
+   }
+
+}
@@ -0,0 +1,307 @@
+#ifndef Q_SWARM_PROTOCOL_H
+#define Q_SWARM_PROTOCOL_H
+
+/*
+ * Q-Swarm Binary Wire Protocol
+ *
+ * Fixed-size frames exchanged between the controllers and the Python
+ * Q-Network server (see python/q_protocol.py for the server side).
+ *
+ * Every frame starts with a 12-byte little-endian header:
+ *
+ *    offset  size  field
+ *    0       2     magic ("QS")
+ *    2       1     protocol version
+ *    3       1     message type
+ *    4       4     robot id (uint32)
+ *    8       4     payload size in bytes (uint32)
+ *
+ * Payloads:
+ *    STATE   float32[28]   x, y, goal_x, goal_y, prox_0, ..., prox_23
+ *    REWARD  float32 + u8  reward, done
+ *    STEP    float32[28] + float32 + u8
+ *                          state, previous reward, STEP_* flags
+ *    BATCH_STEP            N STEPs in struct-of-arrays layout:
+ *                          u32 N, u32 robot_ids[N], float32 states[N][28],
+ *                          float32 prev_rewards[N], u8 flags[N]
+ *
+ * The server answers a STATE or STEP frame with a single action byte
+ * (0-3), a BATCH_STEP frame with N action bytes (in batch order) and a
+ * REWARD frame with a single ACK byte. The header robot id is unused
+ * (0) for BATCH_STEP frames.
+ *
+ * STEP merges the REWARD of the previous tick into the STATE of the
+ * current one, so each tick needs a single round trip. The server
+ * completes the previous transition with the state carried in the
+ * same frame as its next_state.
+ *
+ * Compact frames (compact_state="true") carry the same steps in about a
+ * quarter of the bytes, answered like STEP and BATCH_STEP:
+ *    COMPACT_STEP          float32 previous reward, u8 STEP_* flags,
+ *                          compact state
+ *    COMPACT_BATCH_STEP    u32 N, u32 robot_ids[N], float32 prev_rewards[N],
+ *                          u8 flags[N], int16 positions[N][2],
+ *                          u8 proximity[N][PROXIMITY_SIZE],
+ *                          int8 neighbours[N][3 * NEIGHBOURS],
+ *                          int16 goals[M][2] for the M robots with
+ *                          STEP_HAS_GOAL, in batch order
+ * where the compact state is int16 x, y, then int16 goal_x, goal_y if
+ * STEP_HAS_GOAL is set, u8 proximity[PROXIMITY_SIZE] and int8
+ * neighbours[3 * NEIGHBOURS]. Positions are fixed point millimetres
+ * relative to the arena (as in the float state, +-32.7 m), proximity
+ * values are scaled by 255 and neighbour features by 127. The goal is
+ * only sent when it changes: the server keeps the last goal of each
+ * robot of the connection, and a reconnection sends it again.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef Q_SWARM_NEIGHBOURS
+#define Q_SWARM_NEIGHBOURS 0
+#endif
+
+#ifndef Q_SWARM_PROXIMITY_SECTORS
+#define Q_SWARM_PROXIMITY_SECTORS 0
+#endif
+
+namespace argos {
+
+   namespace QSwarmProtocol {
+
+      /*
+       * Proximity values in a state vector: the 24 readings of the
+       * foot-bot, or their 8 sector maxima in Q_SWARM_PROXIMITY_SECTORS
+       * builds (the server reads the same setting from the
+       * Q_SWARM_PROXIMITY_SECTORS environment variable)
+       */
+      const size_t PROXIMITY_SIZE = Q_SWARM_PROXIMITY_SECTORS ? 8 : 24;
+
+      /*
+       * Neighbour features after the proximity readings: the
+       * Q_SWARM_NEIGHBOURS nearest robots of the same arena (build option,
+       * 0 by default; the server reads the same value from the
+       * Q_SWARM_NEIGHBOURS environment variable), each as dx, dy divided
+       * by the loop functions' neighbour_radius and 1 (zeros if there is
+       * no such neighbour within the radius)
+       */
+      const size_t NEIGHBOURS = Q_SWARM_NEIGHBOURS;
+      const size_t NEIGHBOUR_FEATURES = 3;
+      const size_t NEIGHBOUR_OFFSET = 4 + PROXIMITY_SIZE;
+
+      /* Number of floats in a state vector (4 position/goal + proximity + neighbours) */
+      const size_t STATE_SIZE = NEIGHBOUR_OFFSET + NEIGHBOUR_FEATURES * NEIGHBOURS;
+
+      /* Frame header constants */
+      const uint8_t MAGIC_0 = 'Q';
+      const uint8_t MAGIC_1 = 'S';
+      const uint8_t VERSION = 1;
+      const size_t HEADER_SIZE = 12;
+
+      /* Message types */
+      enum EMessageType {
+         MSG_STATE  = 1,
+         MSG_REWARD = 2,
+         MSG_STEP   = 3,
+         MSG_BATCH_STEP = 4,
+         /* 5 and 6 are the servers' parameter sync frames (python/q_protocol.py) */
+         MSG_COMPACT_STEP = 7,
+         MSG_COMPACT_BATCH_STEP = 8
+      };
+
+      /* STEP flags */
+      const uint8_t STEP_HAS_PREV  = 0x01;  /* previous reward field is valid */
+      const uint8_t STEP_PREV_DONE = 0x02;  /* previous step ended the episode */
+      const uint8_t STEP_HAS_GOAL  = 0x04;  /* compact frames: the goal is included */
+
+      /* Compact state quantization */
+      const float COMPACT_POSITION_SCALE = 1000.0f;
+      const float COMPACT_PROXIMITY_SCALE = 255.0f;
+      const float COMPACT_NEIGHBOUR_SCALE = 127.0f;
+
+      /* Bytes of a compact state without and with the goal */
+      const size_t COMPACT_STATE_SIZE = 2 * sizeof(int16_t) + PROXIMITY_SIZE + NEIGHBOUR_FEATURES * NEIGHBOURS;
+      const size_t COMPACT_GOAL_SIZE = 2 * sizeof(int16_t);
+
+      /* Payload sizes */
+      const size_t STATE_PAYLOAD_SIZE = STATE_SIZE * sizeof(float);
+      const size_t REWARD_PAYLOAD_SIZE = sizeof(float) + 1;
+      const size_t STEP_PAYLOAD_SIZE = STATE_PAYLOAD_SIZE + sizeof(float) + 1;
+
+      const size_t COMPACT_STEP_PAYLOAD_SIZE = sizeof(float) + 1 + COMPACT_STATE_SIZE;
+
+      /* Full frame sizes (compact: largest, with the goal) */
+      const size_t STATE_FRAME_SIZE = HEADER_SIZE + STATE_PAYLOAD_SIZE;
+      const size_t REWARD_FRAME_SIZE = HEADER_SIZE + REWARD_PAYLOAD_SIZE;
+      const size_t STEP_FRAME_SIZE = HEADER_SIZE + STEP_PAYLOAD_SIZE;
+      const size_t COMPACT_STEP_FRAME_SIZE = HEADER_SIZE + COMPACT_STEP_PAYLOAD_SIZE + COMPACT_GOAL_SIZE;
+
+      /* Size of the server reply (action id or ACK) */
+      const size_t REPLY_SIZE = 1;
+
+      /* Value of the reply byte sent for a REWARD frame */
+      const uint8_t ACK_BYTE = 0x06;
+
+      /*
+       * Decoded frame header
+       */
+      struct SFrameHeader {
+         uint8_t Version;
+         uint8_t Type;
+         uint32_t RobotId;
+         uint32_t PayloadSize;
+      };
+
+      /*
+       * Write a frame header into buf (at least HEADER_SIZE bytes)
+       */
+      void EncodeHeader(uint8_t* buf,
+                        uint8_t type,
+                        uint32_t robot_id,
+                        uint32_t payload_size);
+
+      /*
+       * Parse a frame header from buf (at least HEADER_SIZE bytes)
+       * Returns false on bad magic or unsupported version
+       */
+      bool DecodeHeader(const uint8_t* buf, SFrameHeader& header);
+
+      /*
+       * Encode a STATE frame into buf (at least STATE_FRAME_SIZE bytes)
+       * Returns the number of bytes written
+       */
+      size_t EncodeState(uint8_t* buf,
+                         uint32_t robot_id,
+                         const float* state);
+
+      /*
+       * Encode a REWARD frame into buf (at least REWARD_FRAME_SIZE bytes)
+       * Returns the number of bytes written
+       */
+      size_t EncodeReward(uint8_t* buf,
+                          uint32_t robot_id,
+                          float reward,
+                          bool done);
+
+      /*
+       * Encode a STEP frame into buf (at least STEP_FRAME_SIZE bytes)
+       * flags is a combination of STEP_HAS_PREV and STEP_PREV_DONE
+       * Returns the number of bytes written
+       */
+      size_t EncodeStep(uint8_t* buf,
+                        uint32_t robot_id,
+                        const float* state,
+                        float prev_reward,
+                        uint8_t flags);
+
+      /*
+       * Size of a BATCH_STEP frame (and of its payload) for count robots
+       */
+      size_t BatchStepPayloadSize(uint32_t count);
+      size_t BatchStepFrameSize(uint32_t count);
+
+      /*
+       * Encode a BATCH_STEP frame into buf (at least BatchStepFrameSize(count) bytes)
+       * states is a contiguous [count x STATE_SIZE] row-major buffer
+       * Returns the number of bytes written
+       */
+      size_t EncodeBatchStep(uint8_t* buf,
+                             uint32_t count,
+                             const uint32_t* robot_ids,
+                             const float* states,
+                             const float* prev_rewards,
+                             const uint8_t* flags);
+
+      /*
+       * Goal of a robot last sent over a connection in a compact frame
+       */
+      struct SCompactGoal {
+         float X;
+         float Y;
+         uint32_t Generation;              /* CQSwarmSocket::GetGeneration() when sent */
+         bool Sent;
+      };
+
+      /*
+       * STEP_HAS_GOAL if the goal of state must go with the robot's next
+       * compact frame on connection un_generation (it changed, or was
+       * not sent on this connection), 0 otherwise; s_goal then
+       * remembers it as sent
+       */
+      uint8_t CompactGoalFlag(SCompactGoal& s_goal, const float* state, uint32_t un_generation);
+
+      /*
+       * Encode a COMPACT_STEP frame into buf (at least COMPACT_STEP_FRAME_SIZE bytes)
+       * The goal is included if flags has STEP_HAS_GOAL
+       * Returns the number of bytes written
+       */
+      size_t EncodeCompactStep(uint8_t* buf,
+                               uint32_t robot_id,
+                               const float* state,
+                               float prev_reward,
+                               uint8_t flags);
+
+      /*
+       * Size of a COMPACT_BATCH_STEP frame for count robots, goals of
+       * which have STEP_HAS_GOAL
+       */
+      size_t CompactBatchStepFrameSize(uint32_t count, uint32_t goals);
+
+      /*
+       * Encode a COMPACT_BATCH_STEP frame into buf (at least
+       * CompactBatchStepFrameSize() bytes); same arguments as
+       * EncodeBatchStep(), the goals of the robots whose flags have
+       * STEP_HAS_GOAL are included
+       * Returns the number of bytes written
+       */
+      size_t EncodeCompactBatchStep(uint8_t* buf,
+                                    uint32_t count,
+                                    const uint32_t* robot_ids,
+                                    const float* states,
+                                    const float* prev_rewards,
+                                    const uint8_t* flags);
+
+      /*
+       * Text protocol (one line per message, the newline is not written):
+       *    STEP|robot_id|prev_reward|flags|state...   (b_combined)
+       *    STATE|robot_id|state...
+       *    REWARD|robot_id|reward|done
+       * Floats are formatted like std::ostream ("%g")
+       * Returns the message length, or size if it does not fit in buf
+       */
+      size_t EncodeTextStep(char* buf,
+                            size_t size,
+                            uint32_t robot_id,
+                            const float* state,
+                            float prev_reward,
+                            uint8_t flags,
+                            bool b_combined);
+
+      size_t EncodeTextReward(char* buf,
+                              size_t size,
+                              uint32_t robot_id,
+                              float reward,
+                              bool done);
+
+      /*
+       * Action of an "ACTION|action_id" reply of length bytes (0 if it has none)
+       */
+      int ParseTextAction(const char* reply, size_t length);
+
+      /*
+       * Little-endian helpers
+       */
+      void WriteUInt16(uint8_t* buf, uint16_t value);
+      uint16_t ReadUInt16(const uint8_t* buf);
+      void WriteUInt32(uint8_t* buf, uint32_t value);
+      uint32_t ReadUInt32(const uint8_t* buf);
+      void WriteFloat(uint8_t* buf, float value);
+      float ReadFloat(const uint8_t* buf);
+
+   }
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef Q_SWARM_RANDOM_H
+#define Q_SWARM_RANDOM_H
+
+/*
+ * Q-Swarm Random Streams
+ *
+ * One stream per controller, for fallback actions and local exploration,
+ * instead of the process-wide rand(): no shared state and no lock when
+ * ARGoS steps the controllers in several threads, and the same numbers
+ * for the same experiment seed whatever the thread schedule.
+ *
+ * The generator is counter-based: number n of a stream is a hash
+ * (SplitMix64 finalizer) of the stream's key and n. The key comes from
+ * the experiment's random_seed and the robot id, so every robot has its
+ * own stream, and the counter is the whole state: a checkpoint restores a
+ * stream by setting it back (QSwarmCheckpoint::SRecord::RandomDraws).
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stdint.h>
+
+namespace argos {
+
+   class CQSwarmRandom {
+
+   public:
+
+      CQSwarmRandom() : m_unKey(0), m_unCounter(0) {}
+
+      /* Stream un_stream (robot id) of seed un_seed, from its first number */
+      void Seed(uint64_t un_seed, uint64_t un_stream) {
+         m_unKey = Mix(Mix(un_seed) ^ (un_stream * GOLDEN_GAMMA + 1));
+         m_unCounter = 0;
+      }
+
+      /* Numbers drawn since Seed() */
+      uint64_t GetCounter() const {
+         return m_unCounter;
+      }
+
+      void SetCounter(uint64_t un_counter) {
+         m_unCounter = un_counter;
+      }
+
+      /* Next 64 random bits */
+      uint64_t Next() {
+         return Mix(m_unKey + (++m_unCounter) * GOLDEN_GAMMA);
+      }
+
+      /* Uniform in [0, un_bound) (multiply-shift; exact for powers of two) */
+      uint32_t Below(uint32_t un_bound) {
+         return static_cast<uint32_t>(((Next() >> 32) * un_bound) >> 32);
+      }
+
+      /* Uniform in [0, 1) */
+      float Uniform() {
+         return static_cast<float>(Next() >> 40) * (1.0f / 16777216.0f);
+      }
+
+   private:
+
+      static const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+
+      static uint64_t Mix(uint64_t un_value) {
+         un_value = (un_value ^ (un_value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+         un_value = (un_value ^ (un_value >> 27)) * 0x94d049bb133111ebULL;
+         return un_value ^ (un_value >> 31);
+      }
+
+      uint64_t m_unKey;
+      uint64_t m_unCounter;
+
+   };
+
+}
+
+#endif
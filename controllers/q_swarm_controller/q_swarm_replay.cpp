@@ -0,0 +1,319 @@
+/*
+ * Q-Swarm Native Replay Buffer Implementation
+ */
+
+#include "q_swarm_replay.h"
+
+#include <math.h>
+#include <string.h>
+#include <new>
+
+namespace argos {
+
+   const double CQSwarmReplayBuffer::MIN_PRIORITY = 1e-6;
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmReplayBuffer::CQSwarmReplayBuffer(size_t un_capacity,
+                                            size_t un_max_batch,
+                                            size_t un_state_size) :
+      m_unCapacity(un_capacity > 0 ? un_capacity : 1),
+      m_unMaxBatch(un_max_batch > 0 ? un_max_batch : 1),
+      m_unStateSize(un_state_size),
+      m_unSize(0),
+      m_unNext(0),
+      m_unRngState(0x9E3779B97F4A7C15ULL),
+      m_fAlpha(0.6f),
+      m_fPriorityEpsilon(1e-3f),
+      m_fMaxPriority(1.0),
+      m_vecStates(m_unCapacity * m_unStateSize),
+      m_vecActions(m_unCapacity),
+      m_vecRewards(m_unCapacity),
+      m_vecNextStates(m_unCapacity * m_unStateSize),
+      m_vecDones(m_unCapacity),
+      m_vecBatchStates(m_unMaxBatch * m_unStateSize),
+      m_vecBatchActions(m_unMaxBatch),
+      m_vecBatchRewards(m_unMaxBatch),
+      m_vecBatchNextStates(m_unMaxBatch * m_unStateSize),
+      m_vecBatchDones(m_unMaxBatch),
+      m_vecBatchWeights(m_unMaxBatch, 1.0f),
+      m_vecBatchIndices(m_unMaxBatch) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmReplayBuffer::EnablePriorities(float f_alpha, float f_epsilon) {
+      m_fAlpha = f_alpha;
+      m_fPriorityEpsilon = f_epsilon;
+      m_fMaxPriority = 1.0;
+      m_pcTree.reset(new CQSwarmSumTree(m_unCapacity));
+      for (size_t unRow = 0; unRow < m_unSize; ++unRow) {
+         m_pcTree->Set(unRow, m_fMaxPriority);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmReplayBuffer::Clear() {
+      m_unSize = 0;
+      m_unNext = 0;
+      if (m_pcTree) {
+         m_pcTree->Clear();
+         m_fMaxPriority = 1.0;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmReplayBuffer::Push(const float* state,
+                                  uint8_t action,
+                                  float reward,
+                                  const float* next_state,
+                                  bool done) {
+      size_t unRow = m_unNext;
+      memcpy(&m_vecStates[unRow * m_unStateSize], state, m_unStateSize * sizeof(float));
+      memcpy(&m_vecNextStates[unRow * m_unStateSize], next_state, m_unStateSize * sizeof(float));
+      m_vecActions[unRow] = action;
+      m_vecRewards[unRow] = reward;
+      m_vecDones[unRow] = done ? 1 : 0;
+      if (m_pcTree) {
+         m_pcTree->Set(unRow, m_fMaxPriority);
+      }
+
+      m_unNext = (unRow + 1 == m_unCapacity) ? 0 : unRow + 1;
+      if (m_unSize < m_unCapacity) {
+         ++m_unSize;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmReplayBuffer::PushBatch(size_t un_count,
+                                       const float* states,
+                                       const uint8_t* actions,
+                                       const float* rewards,
+                                       const float* next_states,
+                                       const uint8_t* dones) {
+      for (size_t i = 0; i < un_count; ++i) {
+         Push(states + i * m_unStateSize, actions[i], rewards[i],
+              next_states + i * m_unStateSize, dones[i] != 0);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmReplayBuffer::Sample(size_t un_batch, float f_beta) {
+      if (m_unSize == 0) {
+         return 0;
+      }
+      if (un_batch > m_unMaxBatch) {
+         un_batch = m_unMaxBatch;
+      }
+
+      // Uniform as well if no row has any priority left
+      double fTotal = m_pcTree ? m_pcTree->GetTotal() : 0.0;
+      if (!(fTotal > 0.0)) {
+         for (size_t i = 0; i < un_batch; ++i) {
+            // Uniform row in [0, size): high half of a 64x32-bit product
+            uint64_t unRandom = NextRandom() >> 32;
+            Gather(i, static_cast<size_t>((unRandom * m_unSize) >> 32));
+            m_vecBatchWeights[i] = 1.0f;
+         }
+         return un_batch;
+      }
+
+      // One draw per slice of the total priority
+      double fSlice = fTotal / static_cast<double>(un_batch);
+      double fMaxWeight = 0.0;
+      for (size_t i = 0; i < un_batch; ++i) {
+         double fUniform = static_cast<double>(NextRandom() >> 11) * (1.0 / 9007199254740992.0);
+         size_t unRow = m_pcTree->Find((static_cast<double>(i) + fUniform) * fSlice);
+         Gather(i, unRow);
+
+         // Find() never lands on an empty leaf, and stored priorities are
+         // at least MIN_PRIORITY, so the weight is finite
+         double fProbability = m_pcTree->Get(unRow) / fTotal;
+         double fWeight = fProbability > 0.0 ?
+            pow(static_cast<double>(m_unSize) * fProbability, -static_cast<double>(f_beta)) : 0.0;
+         m_vecBatchWeights[i] = static_cast<float>(fWeight);
+         if (fWeight > fMaxWeight) {
+            fMaxWeight = fWeight;
+         }
+      }
+      for (size_t i = 0; i < un_batch; ++i) {
+         m_vecBatchWeights[i] = fMaxWeight > 0.0 ?
+            static_cast<float>(m_vecBatchWeights[i] / fMaxWeight) : 1.0f;
+      }
+      return un_batch;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmReplayBuffer::UpdatePriorities(size_t un_count,
+                                              const int64_t* indices,
+                                              const float* td_errors) {
+      if (!m_pcTree) {
+         return;
+      }
+      for (size_t i = 0; i < un_count; ++i) {
+         if (indices[i] < 0 || static_cast<size_t>(indices[i]) >= m_unSize) {
+            continue;
+         }
+         double fPriority = pow(fabs(static_cast<double>(td_errors[i])) + m_fPriorityEpsilon,
+                               static_cast<double>(m_fAlpha));
+         // Also catches a NaN TD error
+         if (!(fPriority >= MIN_PRIORITY)) {
+            fPriority = MIN_PRIORITY;
+         }
+         m_pcTree->Set(static_cast<size_t>(indices[i]), fPriority);
+         if (fPriority > m_fMaxPriority) {
+            m_fMaxPriority = fPriority;
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmReplayBuffer::Gather(size_t un_entry, size_t un_row) {
+      size_t unRowBytes = m_unStateSize * sizeof(float);
+      memcpy(&m_vecBatchStates[un_entry * m_unStateSize], &m_vecStates[un_row * m_unStateSize], unRowBytes);
+      memcpy(&m_vecBatchNextStates[un_entry * m_unStateSize], &m_vecNextStates[un_row * m_unStateSize], unRowBytes);
+      m_vecBatchActions[un_entry] = m_vecActions[un_row];
+      m_vecBatchRewards[un_entry] = m_vecRewards[un_row];
+      m_vecBatchDones[un_entry] = static_cast<float>(m_vecDones[un_row]);
+      m_vecBatchIndices[un_entry] = static_cast<int64_t>(un_row);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmReplayBuffer::Seed(uint64_t un_seed) {
+      // xorshift must not start at zero
+      m_unRngState = un_seed ? un_seed : 0x9E3779B97F4A7C15ULL;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint64_t CQSwarmReplayBuffer::NextRandom() {
+      m_unRngState ^= m_unRngState >> 12;
+      m_unRngState ^= m_unRngState << 25;
+      m_unRngState ^= m_unRngState >> 27;
+      return m_unRngState * 0x2545F4914F6CDD1DULL;
+   }
+
+}
+
+/****************************************/
+/****************************************/
+
+using argos::CQSwarmReplayBuffer;
+
+extern "C" {
+
+   void* q_swarm_replay_create(size_t capacity, size_t max_batch, size_t state_size) {
+      // Allocation failures must not cross the C boundary
+      try {
+         return new CQSwarmReplayBuffer(capacity, max_batch, state_size);
+      }
+      catch (const std::bad_alloc&) {
+         return NULL;
+      }
+   }
+
+   void q_swarm_replay_destroy(void* buffer) {
+      delete static_cast<CQSwarmReplayBuffer*>(buffer);
+   }
+
+   void q_swarm_replay_push(void* buffer,
+                            const float* state,
+                            uint8_t action,
+                            float reward,
+                            const float* next_state,
+                            uint8_t done) {
+      static_cast<CQSwarmReplayBuffer*>(buffer)->Push(state, action, reward, next_state, done != 0);
+   }
+
+   void q_swarm_replay_push_batch(void* buffer,
+                                  size_t count,
+                                  const float* states,
+                                  const uint8_t* actions,
+                                  const float* rewards,
+                                  const float* next_states,
+                                  const uint8_t* dones) {
+      static_cast<CQSwarmReplayBuffer*>(buffer)->PushBatch(count, states, actions, rewards,
+                                                           next_states, dones);
+   }
+
+   int q_swarm_replay_enable_priorities(void* buffer, float alpha, float epsilon) {
+      try {
+         static_cast<CQSwarmReplayBuffer*>(buffer)->EnablePriorities(alpha, epsilon);
+         return 1;
+      }
+      catch (const std::bad_alloc&) {
+         return 0;
+      }
+   }
+
+   size_t q_swarm_replay_sample(void* buffer, size_t batch, float beta) {
+      return static_cast<CQSwarmReplayBuffer*>(buffer)->Sample(batch, beta);
+   }
+
+   void q_swarm_replay_update_priorities(void* buffer,
+                                         size_t count,
+                                         const int64_t* indices,
+                                         const float* td_errors) {
+      static_cast<CQSwarmReplayBuffer*>(buffer)->UpdatePriorities(count, indices, td_errors);
+   }
+
+   void q_swarm_replay_seed(void* buffer, uint64_t seed) {
+      static_cast<CQSwarmReplayBuffer*>(buffer)->Seed(seed);
+   }
+
+   void q_swarm_replay_clear(void* buffer) {
+      static_cast<CQSwarmReplayBuffer*>(buffer)->Clear();
+   }
+
+   size_t q_swarm_replay_size(const void* buffer) {
+      return static_cast<const CQSwarmReplayBuffer*>(buffer)->GetSize();
+   }
+
+   size_t q_swarm_replay_oldest(const void* buffer) {
+      return static_cast<const CQSwarmReplayBuffer*>(buffer)->GetOldest();
+   }
+
+   const void* q_swarm_replay_storage(const void* buffer, int which) {
+      const CQSwarmReplayBuffer* pcReplay = static_cast<const CQSwarmReplayBuffer*>(buffer);
+      switch (which) {
+         case 0: return pcReplay->GetStates();
+         case 1: return pcReplay->GetActions();
+         case 2: return pcReplay->GetRewards();
+         case 3: return pcReplay->GetNextStates();
+         case 4: return pcReplay->GetDones();
+         default: return NULL;
+      }
+   }
+
+   const void* q_swarm_replay_batch(const void* buffer, int which) {
+      const CQSwarmReplayBuffer* pcReplay = static_cast<const CQSwarmReplayBuffer*>(buffer);
+      switch (which) {
+         case 0: return pcReplay->GetBatchStates();
+         case 1: return pcReplay->GetBatchActions();
+         case 2: return pcReplay->GetBatchRewards();
+         case 3: return pcReplay->GetBatchNextStates();
+         case 4: return pcReplay->GetBatchDones();
+         case 5: return pcReplay->GetBatchWeights();
+         case 6: return pcReplay->GetBatchIndices();
+         default: return NULL;
+      }
+   }
+
+}
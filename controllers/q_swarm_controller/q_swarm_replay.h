@@ -0,0 +1,230 @@
+#ifndef Q_SWARM_REPLAY_H
+#define Q_SWARM_REPLAY_H
+
+/*
+ * Q-Swarm Native Replay Buffer
+ *
+ * Experience replay for the Q-Network trainer with preallocated
+ * struct-of-arrays storage:
+ *
+ *    states[capacity][STATE_SIZE]       float32
+ *    actions[capacity]                  u8
+ *    rewards[capacity]                  float32
+ *    next_states[capacity][STATE_SIZE]  float32
+ *    dones[capacity]                    u8
+ *
+ * Push() overwrites the oldest transition once the buffer is full (O(1),
+ * no allocation). Sample() draws batch indices uniformly (with
+ * replacement) and gathers the rows into batch arrays that are
+ * contiguous and already typed the way the trainer uses them (float32
+ * states, int64 actions, float32 dones), so python/q_replay.py wraps
+ * them as numpy arrays without copying. A batch stays valid until the
+ * next Sample().
+ *
+ * With EnablePriorities() sampling is prioritized (Schaul et al.): row i
+ * is drawn with probability p_i / sum(p), p_i = (|td_error_i| + eps)^alpha,
+ * through a CQSwarmSumTree (stratified: one draw per equal slice of the
+ * total priority). Priorities never go below MIN_PRIORITY, so a row with
+ * no TD error (eps = 0) keeps a finite weight. New rows get the highest
+ * priority seen so far, so they are replayed at least once. Each batch
+ * comes with its rows and with the importance-sampling weights
+ * (N * P(i))^-beta, divided by the largest weight of the batch;
+ * UpdatePriorities() stores the TD errors of a trained batch.
+ *
+ * Not thread-safe: one writer/sampler at a time.
+ *
+ * Python uses it through the C functions at the end of this header
+ * (ctypes, libq_swarm_replay). This header does not depend on ARGoS so
+ * it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "q_swarm_protocol.h"
+#include "q_swarm_sum_tree.h"
+
+namespace argos {
+
+   class CQSwarmReplayBuffer {
+
+   public:
+
+      /* Smallest priority stored by UpdatePriorities() */
+      static const double MIN_PRIORITY;
+
+      CQSwarmReplayBuffer(size_t un_capacity,
+                          size_t un_max_batch = 256,
+                          size_t un_state_size = QSwarmProtocol::STATE_SIZE);
+
+      /* Add one transition (overwrites the oldest one when full) */
+      void Push(const float* state,
+                uint8_t action,
+                float reward,
+                const float* next_state,
+                bool done);
+
+      /* Add un_count transitions given as arrays (states row-major) */
+      void PushBatch(size_t un_count,
+                     const float* states,
+                     const uint8_t* actions,
+                     const float* rewards,
+                     const float* next_states,
+                     const uint8_t* dones);
+
+      /*
+       * Switch to prioritized sampling (stored rows get priority 1)
+       */
+      void EnablePriorities(float f_alpha = 0.6f, float f_epsilon = 1e-3f);
+
+      bool IsPrioritized() const {
+         return m_pcTree.get() != NULL;
+      }
+
+      /*
+       * Gather un_batch random transitions into the batch arrays
+       * (f_beta: importance-sampling exponent, prioritized mode only)
+       * Returns the batch size (0 if the buffer is empty, at most the
+       * max_batch given to the constructor)
+       */
+      size_t Sample(size_t un_batch, float f_beta = 0.4f);
+
+      /*
+       * New priorities of un_count rows from their TD errors (rows as
+       * returned in the batch; ignored unless prioritized)
+       */
+      void UpdatePriorities(size_t un_count, const int64_t* indices, const float* td_errors);
+
+      /* Re-seed the sampling generator (deterministic runs) */
+      void Seed(uint64_t un_seed);
+
+      void Clear();
+
+      size_t GetSize() const {
+         return m_unSize;
+      }
+
+      size_t GetCapacity() const {
+         return m_unCapacity;
+      }
+
+      size_t GetStateSize() const {
+         return m_unStateSize;
+      }
+
+      /* Row of the oldest transition in the storage arrays */
+      size_t GetOldest() const {
+         return m_unSize < m_unCapacity ? 0 : m_unNext;
+      }
+
+      /* Storage (capacity rows) */
+      const float* GetStates() const { return &m_vecStates[0]; }
+      const uint8_t* GetActions() const { return &m_vecActions[0]; }
+      const float* GetRewards() const { return &m_vecRewards[0]; }
+      const float* GetNextStates() const { return &m_vecNextStates[0]; }
+      const uint8_t* GetDones() const { return &m_vecDones[0]; }
+
+      /* Last batch (rows of the last Sample()) */
+      const float* GetBatchStates() const { return &m_vecBatchStates[0]; }
+      const int64_t* GetBatchActions() const { return &m_vecBatchActions[0]; }
+      const float* GetBatchRewards() const { return &m_vecBatchRewards[0]; }
+      const float* GetBatchNextStates() const { return &m_vecBatchNextStates[0]; }
+      const float* GetBatchDones() const { return &m_vecBatchDones[0]; }
+      const float* GetBatchWeights() const { return &m_vecBatchWeights[0]; }
+      const int64_t* GetBatchIndices() const { return &m_vecBatchIndices[0]; }
+
+   private:
+
+      /* xorshift64* step */
+      uint64_t NextRandom();
+
+      /* Copy storage row un_row into batch entry un_entry */
+      void Gather(size_t un_entry, size_t un_row);
+
+      size_t m_unCapacity;
+      size_t m_unMaxBatch;
+      size_t m_unStateSize;
+
+      /* Transitions stored, row written by the next Push() */
+      size_t m_unSize;
+      size_t m_unNext;
+
+      uint64_t m_unRngState;
+
+      /* Prioritized mode: priorities (already raised to alpha), NULL if uniform */
+      std::unique_ptr<CQSwarmSumTree> m_pcTree;
+      float m_fAlpha;
+      float m_fPriorityEpsilon;
+      double m_fMaxPriority;
+
+      std::vector<float> m_vecStates;
+      std::vector<uint8_t> m_vecActions;
+      std::vector<float> m_vecRewards;
+      std::vector<float> m_vecNextStates;
+      std::vector<uint8_t> m_vecDones;
+
+      std::vector<float> m_vecBatchStates;
+      std::vector<int64_t> m_vecBatchActions;
+      std::vector<float> m_vecBatchRewards;
+      std::vector<float> m_vecBatchNextStates;
+      std::vector<float> m_vecBatchDones;
+      std::vector<float> m_vecBatchWeights;
+      std::vector<int64_t> m_vecBatchIndices;
+
+   };
+
+}
+
+/*
+ * C interface for python/q_replay.py (handles are CQSwarmReplayBuffer*)
+ */
+
+#if defined(_WIN32)
+#define Q_SWARM_REPLAY_API __declspec(dllexport)
+#else
+#define Q_SWARM_REPLAY_API __attribute__((visibility("default")))
+#endif
+
+extern "C" {
+
+   /* Returns NULL if the buffers cannot be allocated */
+   Q_SWARM_REPLAY_API void* q_swarm_replay_create(size_t capacity, size_t max_batch, size_t state_size);
+   Q_SWARM_REPLAY_API void q_swarm_replay_destroy(void* buffer);
+
+   Q_SWARM_REPLAY_API void q_swarm_replay_push(void* buffer,
+                                               const float* state,
+                                               uint8_t action,
+                                               float reward,
+                                               const float* next_state,
+                                               uint8_t done);
+   Q_SWARM_REPLAY_API void q_swarm_replay_push_batch(void* buffer,
+                                                     size_t count,
+                                                     const float* states,
+                                                     const uint8_t* actions,
+                                                     const float* rewards,
+                                                     const float* next_states,
+                                                     const uint8_t* dones);
+   /* Returns 0 if the tree cannot be allocated */
+   Q_SWARM_REPLAY_API int q_swarm_replay_enable_priorities(void* buffer, float alpha, float epsilon);
+   Q_SWARM_REPLAY_API size_t q_swarm_replay_sample(void* buffer, size_t batch, float beta);
+   Q_SWARM_REPLAY_API void q_swarm_replay_update_priorities(void* buffer,
+                                                            size_t count,
+                                                            const int64_t* indices,
+                                                            const float* td_errors);
+   Q_SWARM_REPLAY_API void q_swarm_replay_seed(void* buffer, uint64_t seed);
+   Q_SWARM_REPLAY_API void q_swarm_replay_clear(void* buffer);
+   Q_SWARM_REPLAY_API size_t q_swarm_replay_size(const void* buffer);
+   Q_SWARM_REPLAY_API size_t q_swarm_replay_oldest(const void* buffer);
+
+   /*
+    * Storage (which = 0 states, 1 actions, 2 rewards, 3 next_states,
+    * 4 dones) and last batch (same order, then 5 weights, 6 indices) arrays
+    */
+   Q_SWARM_REPLAY_API const void* q_swarm_replay_storage(const void* buffer, int which);
+   Q_SWARM_REPLAY_API const void* q_swarm_replay_batch(const void* buffer, int which);
+
+}
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Q-Swarm Scenarios Implementation
+ */
+
+#include "q_swarm_scenarios.h"
+#include "q_swarm_random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace argos {
+
+   const float CQSwarmScenarioCache::GOAL_MARGIN = 2.0f;
+   const float CQSwarmScenarioCache::WALL_GAP = 0.15f;
+   const float CQSwarmScenarioCache::GOAL_CLEARANCE = 1.0f;
+   const float CQSwarmScenarioCache::ROBOT_CLEARANCE = 0.3f;
+   const float CQSwarmScenarioCache::ROBOT_SPACING = 0.5f;
+   const float CQSwarmScenarioCache::MIN_GOAL_DISTANCE = 1.5f;
+
+   namespace {
+
+      /* Draws per obstacle or robot, and layouts per scenario, before giving up */
+      const int MAX_DRAWS = 256;
+      const int MAX_LAYOUTS = 16;
+
+      const float PI = 3.14159265358979f;
+
+      float Between(CQSwarmRandom& c_random, float f_min, float f_max) {
+         return f_min + (f_max - f_min) * c_random.Uniform();
+      }
+
+      /* Distance from a point to a square obstacle of half side f_half */
+      float DistanceToObstacle(float f_x, float f_y, const CQSwarmScenarioCache::SObstacle& s_obstacle,
+                               float f_half) {
+         float fDx = std::max(std::fabs(f_x - s_obstacle.X) - f_half, 0.0f);
+         float fDy = std::max(std::fabs(f_y - s_obstacle.Y) - f_half, 0.0f);
+         return std::sqrt(fDx * fDx + fDy * fDy);
+      }
+
+      bool TryLayout(const CQSwarmScenarioCache::SConfig& c_config,
+                     float f_difficulty,
+                     CQSwarmRandom& c_random,
+                     float& f_goal_x,
+                     float& f_goal_y,
+                     CQSwarmScenarioCache::SPose* starts,
+                     CQSwarmScenarioCache::SObstacle* obstacles) {
+         typedef CQSwarmScenarioCache C;
+         const float fSize = c_config.ArenaSize;
+         const float fHalf = c_config.ObstacleSize * 0.5f;
+
+         f_goal_x = Between(c_random, C::GOAL_MARGIN, fSize - C::GOAL_MARGIN);
+         f_goal_y = Between(c_random, C::GOAL_MARGIN, fSize - C::GOAL_MARGIN);
+
+         // Obstacles: no closer to the walls than WALL_GAP, and no further
+         // than the level allows (one obstacle deep along the walls at level 0)
+         float fMinCenter = fHalf + C::WALL_GAP;
+         float fMaxCenter = fSize - fMinCenter;
+         float fBand = fMinCenter + c_config.ObstacleSize + f_difficulty * fSize * 0.5f;
+         for (uint32_t i = 0; i < c_config.Obstacles; ++i) {
+            bool bPlaced = false;
+            for (int nDraw = 0; nDraw < MAX_DRAWS && !bPlaced; ++nDraw) {
+               C::SObstacle sObstacle;
+               sObstacle.X = Between(c_random, fMinCenter, fMaxCenter);
+               sObstacle.Y = Between(c_random, fMinCenter, fMaxCenter);
+               float fWall = std::min(std::min(sObstacle.X, fSize - sObstacle.X),
+                                      std::min(sObstacle.Y, fSize - sObstacle.Y));
+               if (fWall > fBand ||
+                   DistanceToObstacle(f_goal_x, f_goal_y, sObstacle, fHalf) < C::GOAL_CLEARANCE) {
+                  continue;
+               }
+               // Apart from the others, so that each one is its own body
+               bPlaced = true;
+               for (uint32_t j = 0; j < i && bPlaced; ++j) {
+                  bPlaced = std::max(std::fabs(sObstacle.X - obstacles[j].X),
+                                     std::fabs(sObstacle.Y - obstacles[j].Y)) >=
+                     c_config.ObstacleSize + C::WALL_GAP;
+               }
+               if (bPlaced) {
+                  obstacles[i] = sObstacle;
+               }
+            }
+            if (!bPlaced) {
+               return false;
+            }
+         }
+
+         // Robots: near the goal at level 0, anywhere at the last level
+         float fMaxGoalDistance = C::MIN_GOAL_DISTANCE + 2.0f + f_difficulty * fSize * 1.5f;
+         float fMinStart = C::ROBOT_CLEARANCE + 0.2f;
+         for (uint32_t i = 0; i < c_config.Robots; ++i) {
+            bool bPlaced = false;
+            for (int nDraw = 0; nDraw < MAX_DRAWS && !bPlaced; ++nDraw) {
+               C::SPose sPose;
+               sPose.X = Between(c_random, fMinStart, fSize - fMinStart);
+               sPose.Y = Between(c_random, fMinStart, fSize - fMinStart);
+               sPose.Yaw = Between(c_random, -PI, PI);
+               float fGoalDistance = std::sqrt((sPose.X - f_goal_x) * (sPose.X - f_goal_x) +
+                                               (sPose.Y - f_goal_y) * (sPose.Y - f_goal_y));
+               if (fGoalDistance < C::MIN_GOAL_DISTANCE || fGoalDistance > fMaxGoalDistance) {
+                  continue;
+               }
+               bPlaced = true;
+               for (uint32_t j = 0; j < c_config.Obstacles && bPlaced; ++j) {
+                  bPlaced = DistanceToObstacle(sPose.X, sPose.Y, obstacles[j], fHalf) >= C::ROBOT_CLEARANCE;
+               }
+               for (uint32_t j = 0; j < i && bPlaced; ++j) {
+                  float fDx = sPose.X - starts[j].X;
+                  float fDy = sPose.Y - starts[j].Y;
+                  bPlaced = fDx * fDx + fDy * fDy >= C::ROBOT_SPACING * C::ROBOT_SPACING;
+               }
+               if (bPlaced) {
+                  starts[i] = sPose;
+               }
+            }
+            if (!bPlaced) {
+               return false;
+            }
+         }
+         return true;
+      }
+
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmScenarioCache::CQSwarmScenarioCache() :
+      m_unPerLevel(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmScenarioCache::Build(const SConfig& c_config,
+                                    uint64_t un_seed,
+                                    size_t un_per_level,
+                                    std::string& str_error) {
+      m_unPerLevel = 0;
+      m_vecGoals.clear();
+      m_vecStarts.clear();
+      m_vecObstacles.clear();
+      if (c_config.Levels == 0 || un_per_level == 0 || c_config.ObstacleSize <= 0.0f ||
+          c_config.ArenaSize <= 2.0f * GOAL_MARGIN) {
+         str_error = "invalid scenario configuration";
+         return false;
+      }
+
+      size_t unScenarios = c_config.Levels * un_per_level;
+      m_vecGoals.resize(2 * unScenarios);
+      m_vecStarts.resize(c_config.Robots * unScenarios);
+      m_vecObstacles.resize(c_config.Obstacles * unScenarios);
+      for (uint32_t unLevel = 0; unLevel < c_config.Levels; ++unLevel) {
+         for (size_t i = 0; i < un_per_level; ++i) {
+            size_t unScenario = unLevel * un_per_level + i;
+            if (!Generate(c_config, un_seed, unLevel, i,
+                          m_vecGoals[2 * unScenario], m_vecGoals[2 * unScenario + 1],
+                          c_config.Robots ? &m_vecStarts[c_config.Robots * unScenario] : NULL,
+                          c_config.Obstacles ? &m_vecObstacles[c_config.Obstacles * unScenario] : NULL)) {
+               std::ostringstream cError;
+               cError << c_config.Obstacles << " obstacles of " << c_config.ObstacleSize << " m and "
+                      << c_config.Robots << " robots do not fit in a " << c_config.ArenaSize
+                      << " m arena at level " << unLevel;
+               str_error = cError.str();
+               m_vecGoals.clear();
+               m_vecStarts.clear();
+               m_vecObstacles.clear();
+               return false;
+            }
+         }
+      }
+      m_sConfig = c_config;
+      m_unPerLevel = un_per_level;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmScenarioCache::SScenario CQSwarmScenarioCache::Get(uint32_t un_level, uint64_t un_index) const {
+      size_t unLevel = std::min<size_t>(un_level, m_sConfig.Levels - 1);
+      size_t unScenario = unLevel * m_unPerLevel + static_cast<size_t>(un_index % m_unPerLevel);
+      SScenario sScenario;
+      sScenario.GoalX = m_vecGoals[2 * unScenario];
+      sScenario.GoalY = m_vecGoals[2 * unScenario + 1];
+      sScenario.Starts = m_sConfig.Robots ? &m_vecStarts[m_sConfig.Robots * unScenario] : NULL;
+      sScenario.Obstacles = m_sConfig.Obstacles ? &m_vecObstacles[m_sConfig.Obstacles * unScenario] : NULL;
+      return sScenario;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmScenarioCache::Generate(const SConfig& c_config,
+                                       uint64_t un_seed,
+                                       uint32_t un_level,
+                                       uint64_t un_index,
+                                       float& f_goal_x,
+                                       float& f_goal_y,
+                                       SPose* starts,
+                                       SObstacle* obstacles) {
+      // One stream per scenario; a failed layout draws the next from it
+      CQSwarmRandom cRandom;
+      cRandom.Seed(un_seed, (static_cast<uint64_t>(un_level) << 40) ^ un_index);
+      float fDifficulty = c_config.Levels > 1 ?
+         static_cast<float>(un_level) / static_cast<float>(c_config.Levels - 1) : 1.0f;
+      for (int nLayout = 0; nLayout < MAX_LAYOUTS; ++nLayout) {
+         if (TryLayout(c_config, fDifficulty, cRandom, f_goal_x, f_goal_y, starts, obstacles)) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+}
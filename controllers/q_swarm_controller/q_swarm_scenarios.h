@@ -0,0 +1,134 @@
+#ifndef Q_SWARM_SCENARIOS_H
+#define Q_SWARM_SCENARIOS_H
+
+/*
+ * Q-Swarm Scenarios
+ *
+ * Layouts of a sub-arena (goal, start pose of every robot, square
+ * obstacles) generated from a seed, so that one ARGoS process can run
+ * thousands of different scenarios back-to-back instead of one static
+ * .argos file per configuration. Scenario n of level l is a pure
+ * function of (seed, l, n): it is drawn from its own CQSwarmRandom
+ * stream, so every process and every run sees the same sequence, and a
+ * run resumed at episode k gets scenario k again.
+ *
+ * Levels make a curriculum: at level 0 the obstacles stand along the
+ * walls and the robots start close to the goal; with every level the
+ * obstacles may stand further into the arena and the robots start
+ * further away, up to the whole arena at the last level (a single level
+ * is the last one).
+ *
+ * Build() draws all layouts of all levels once, into flat arrays (one
+ * block of poses and one of obstacles per scenario): picking the next
+ * scenario at an episode boundary is an index computation.
+ *
+ * Coordinates are relative to the arena's origin, in [0, arena size].
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   class CQSwarmScenarioCache {
+
+   public:
+
+      struct SConfig {
+         float ArenaSize;                  /* side of the square arena, m */
+         uint32_t Robots;                  /* start poses per scenario */
+         uint32_t Obstacles;               /* obstacles per scenario */
+         float ObstacleSize;               /* side of the square obstacles, m */
+         uint32_t Levels;                  /* curriculum levels (at least 1) */
+
+         SConfig() : ArenaSize(20.0f), Robots(1), Obstacles(0), ObstacleSize(1.0f), Levels(1) {}
+      };
+
+      struct SPose {
+         float X;
+         float Y;
+         float Yaw;                        /* radians */
+      };
+
+      /* Center of a square obstacle of SConfig::ObstacleSize */
+      struct SObstacle {
+         float X;
+         float Y;
+      };
+
+      /* A cached layout (points into the cache) */
+      struct SScenario {
+         float GoalX;
+         float GoalY;
+         const SPose* Starts;              /* SConfig::Robots */
+         const SObstacle* Obstacles;       /* SConfig::Obstacles */
+      };
+
+      /* Distances kept by the generator, m */
+      static const float GOAL_MARGIN;      /* goal from the walls */
+      static const float WALL_GAP;         /* obstacles from the walls */
+      static const float GOAL_CLEARANCE;   /* obstacles from the goal */
+      static const float ROBOT_CLEARANCE;  /* robots from obstacles and walls */
+      static const float ROBOT_SPACING;    /* between two robots */
+      static const float MIN_GOAL_DISTANCE;/* robots from the goal */
+
+      CQSwarmScenarioCache();
+
+      /*
+       * Draw un_per_level scenarios of every level of c_config from un_seed
+       * Returns false (and sets str_error) if the layout does not fit the
+       * arena
+       */
+      bool Build(const SConfig& c_config,
+                 uint64_t un_seed,
+                 size_t un_per_level,
+                 std::string& str_error);
+
+      const SConfig& GetConfig() const {
+         return m_sConfig;
+      }
+
+      size_t GetPerLevel() const {
+         return m_unPerLevel;
+      }
+
+      bool IsEmpty() const {
+         return m_unPerLevel == 0;
+      }
+
+      /* Scenario un_index (modulo the scenarios per level) of level un_level */
+      SScenario Get(uint32_t un_level, uint64_t un_index) const;
+
+      /*
+       * Draw scenario un_index of level un_level into the goal, starts
+       * (c_config.Robots entries) and obstacles (c_config.Obstacles entries)
+       * Returns false if no layout was found that keeps all distances
+       */
+      static bool Generate(const SConfig& c_config,
+                           uint64_t un_seed,
+                           uint32_t un_level,
+                           uint64_t un_index,
+                           float& f_goal_x,
+                           float& f_goal_y,
+                           SPose* starts,
+                           SObstacle* obstacles);
+
+   private:
+
+      SConfig m_sConfig;
+      size_t m_unPerLevel;
+
+      /* [levels x per level] goals (x, y), starts and obstacles */
+      std::vector<float> m_vecGoals;
+      std::vector<SPose> m_vecStarts;
+      std::vector<SObstacle> m_vecObstacles;
+
+   };
+
+}
+
+#endif
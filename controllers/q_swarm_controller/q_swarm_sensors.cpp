@@ -0,0 +1,159 @@
+/*
+ * Q-Swarm Sensor Snapshot Implementation
+ */
+
+#include "q_swarm_sensors.h"
+
+#include <string.h>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+   #include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+   #include <arm_neon.h>
+#endif
+
+namespace argos {
+
+   namespace QSwarmSensors {
+
+      static_assert(READINGS % 4 == 0 && SECTOR_WIDTH == 3,
+                    "the vector code reads 4 readings at a time and sectors of 3");
+
+      /****************************************/
+      /****************************************/
+
+      void Clear(SSnapshot& s_snapshot) {
+         memset(&s_snapshot, 0, sizeof(s_snapshot));
+      }
+
+      /****************************************/
+      /****************************************/
+
+      void ProcessScalar(SSnapshot& s_snapshot) {
+         const float* p = s_snapshot.Proximity;
+         float fMax = p[0];
+         uint32_t unMask = 0;
+         for (size_t i = 0; i < READINGS; ++i) {
+            fMax = p[i] > fMax ? p[i] : fMax;
+            if (p[i] > COLLISION_READING) {
+               unMask |= 1u << i;
+            }
+         }
+         for (size_t s = 0; s < SECTORS; ++s) {
+            const float* q = p + s * SECTOR_WIDTH;
+            float fSector = q[0] > q[1] ? q[0] : q[1];
+            s_snapshot.Sectors[s] = fSector > q[2] ? fSector : q[2];
+         }
+         s_snapshot.Max = fMax;
+         s_snapshot.CloseMask = unMask;
+      }
+
+      /****************************************/
+      /****************************************/
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+      void Process(SSnapshot& s_snapshot) {
+         const float* p = s_snapshot.Proximity;
+         const __m128 cThreshold = _mm_set1_ps(COLLISION_READING);
+         __m128 cMax = _mm_load_ps(p);
+         uint32_t unMask = 0;
+         // Window maxima max(p[i], p[i+1], p[i+2]); sector s is window 3s
+         alignas(16) float fWindows[READINGS];
+         for (size_t i = 0; i < READINGS; i += 4) {
+            __m128 cValues = _mm_load_ps(p + i);
+            cMax = _mm_max_ps(cMax, cValues);
+            unMask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpgt_ps(cValues, cThreshold))) << i;
+            __m128 cWindow = _mm_max_ps(cValues, _mm_max_ps(_mm_loadu_ps(p + i + 1),
+                                                             _mm_loadu_ps(p + i + 2)));
+            _mm_store_ps(fWindows + i, cWindow);
+         }
+         // Horizontal maximum of the 4 lanes
+         cMax = _mm_max_ps(cMax, _mm_shuffle_ps(cMax, cMax, _MM_SHUFFLE(2, 3, 0, 1)));
+         cMax = _mm_max_ps(cMax, _mm_shuffle_ps(cMax, cMax, _MM_SHUFFLE(1, 0, 3, 2)));
+         s_snapshot.Max = _mm_cvtss_f32(cMax);
+         s_snapshot.CloseMask = unMask;
+         for (size_t s = 0; s < SECTORS; ++s) {
+            s_snapshot.Sectors[s] = fWindows[s * SECTOR_WIDTH];
+         }
+      }
+
+#elif defined(__ARM_NEON)
+
+      void Process(SSnapshot& s_snapshot) {
+         const float* p = s_snapshot.Proximity;
+         const float32x4_t cThreshold = vdupq_n_f32(COLLISION_READING);
+         const uint32x4_t cBits = { 1u, 2u, 4u, 8u };
+         float32x4_t cMax = vld1q_f32(p);
+         uint32_t unMask = 0;
+         float fWindows[READINGS];
+         for (size_t i = 0; i < READINGS; i += 4) {
+            float32x4_t cValues = vld1q_f32(p + i);
+            cMax = vmaxq_f32(cMax, cValues);
+            uint32x4_t cClose = vandq_u32(vcgtq_f32(cValues, cThreshold), cBits);
+            uint32x2_t cPairs = vorr_u32(vget_low_u32(cClose), vget_high_u32(cClose));
+            unMask |= (vget_lane_u32(cPairs, 0) | vget_lane_u32(cPairs, 1)) << i;
+            float32x4_t cWindow = vmaxq_f32(cValues, vmaxq_f32(vld1q_f32(p + i + 1),
+                                                               vld1q_f32(p + i + 2)));
+            vst1q_f32(fWindows + i, cWindow);
+         }
+         float32x2_t cPair = vpmax_f32(vget_low_f32(cMax), vget_high_f32(cMax));
+         cPair = vpmax_f32(cPair, cPair);
+         s_snapshot.Max = vget_lane_f32(cPair, 0);
+         s_snapshot.CloseMask = unMask;
+         for (size_t s = 0; s < SECTORS; ++s) {
+            s_snapshot.Sectors[s] = fWindows[s * SECTOR_WIDTH];
+         }
+      }
+
+#else
+
+      void Process(SSnapshot& s_snapshot) {
+         ProcessScalar(s_snapshot);
+      }
+
+#endif
+
+      /****************************************/
+      /****************************************/
+
+      void FillState(const SSnapshot& s_snapshot,
+                     float f_origin_x,
+                     float f_origin_y,
+                     float f_goal_x,
+                     float f_goal_y,
+                     float* state) {
+         state[0] = s_snapshot.X - f_origin_x;
+         state[1] = s_snapshot.Y - f_origin_y;
+         state[2] = f_goal_x - f_origin_x;
+         state[3] = f_goal_y - f_origin_y;
+         const float* pfProximity = Q_SWARM_PROXIMITY_SECTORS ? s_snapshot.Sectors : s_snapshot.Proximity;
+         memcpy(state + 4, pfProximity, QSwarmProtocol::PROXIMITY_SIZE * sizeof(float));
+      }
+
+      /****************************************/
+      /****************************************/
+
+      bool IsAtGoal(const SSnapshot& s_snapshot, float f_goal_x, float f_goal_y, float f_threshold) {
+         float fDx = s_snapshot.X - f_goal_x;
+         float fDy = s_snapshot.Y - f_goal_y;
+         return std::sqrt(fDx * fDx + fDy * fDy) < f_threshold;
+      }
+
+      /****************************************/
+      /****************************************/
+
+      bool IsColliding(const SSnapshot& s_snapshot,
+                       float f_previous_x,
+                       float f_previous_y,
+                       float f_threshold) {
+         float fDx = s_snapshot.X - f_previous_x;
+         float fDy = s_snapshot.Y - f_previous_y;
+         return std::sqrt(fDx * fDx + fDy * fDy) < f_threshold || s_snapshot.CloseMask != 0;
+      }
+
+   }
+
+}
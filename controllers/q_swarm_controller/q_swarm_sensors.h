@@ -0,0 +1,99 @@
+#ifndef Q_SWARM_SENSORS_H
+#define Q_SWARM_SENSORS_H
+
+/*
+ * Q-Swarm Sensor Snapshot
+ *
+ * The sensors of one tick, read once: ControlStep copies the 24 proximity
+ * readings and the position into an SSnapshot, Process() derives what the
+ * state, the reward and the collision check need (maximum reading,
+ * readings above the collision threshold, sector maxima), and all of them
+ * read the snapshot instead of going back to the sensors.
+ *
+ * Sectors: the readings go around the foot-bot, and sector s is the
+ * maximum of readings 3s .. 3s+2, the nearest obstacle in that eighth of
+ * the body. Builds with Q_SWARM_PROXIMITY_SECTORS put the 8 sectors in the
+ * state instead of the 24 readings (QSwarmProtocol::PROXIMITY_SIZE).
+ *
+ * FillState(), IsAtGoal() and IsColliding() are the state and the end of
+ * episode checks of QSwarmController on a snapshot, so that tools (the
+ * benchmarks) run the same code as the controller.
+ *
+ * Process() uses SSE2 on x86-64 and NEON on ARM (both baseline on these
+ * targets, no runtime dispatch) and a scalar loop elsewhere; all give the
+ * same result.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "q_swarm_protocol.h"
+
+namespace argos {
+
+   namespace QSwarmSensors {
+
+      /* Proximity readings of the foot-bot */
+      const size_t READINGS = 24;
+
+      /* Sectors of READINGS / SECTORS adjacent readings */
+      const size_t SECTORS = 8;
+      const size_t SECTOR_WIDTH = READINGS / SECTORS;
+
+      /* Readings above this are an obstacle touching the robot */
+      const float COLLISION_READING = 0.9f;
+
+      struct SSnapshot {
+         /* Proximity readings, zero past the sensor's count; padded for vector loads */
+         alignas(16) float Proximity[READINGS + 4];
+         alignas(16) float Sectors[SECTORS];
+
+         /* Largest reading, and bit i set if reading i > COLLISION_READING */
+         float Max;
+         uint32_t CloseMask;
+
+         /* Position from the positioning sensor */
+         float X;
+         float Y;
+      };
+
+      /* Zero readings and results */
+      void Clear(SSnapshot& s_snapshot);
+
+      /* Compute Max, CloseMask and Sectors from Proximity */
+      void Process(SSnapshot& s_snapshot);
+
+      /* Same result without vector instructions (reference and fallback) */
+      void ProcessScalar(SSnapshot& s_snapshot);
+
+      /*
+       * Position and goal relative to the arena origin, then the proximity
+       * readings (or sectors): the first QSwarmProtocol::NEIGHBOUR_OFFSET
+       * floats of state
+       */
+      void FillState(const SSnapshot& s_snapshot,
+                     float f_origin_x,
+                     float f_origin_y,
+                     float f_goal_x,
+                     float f_goal_y,
+                     float* state);
+
+      /* Closer to the goal than f_threshold */
+      bool IsAtGoal(const SSnapshot& s_snapshot, float f_goal_x, float f_goal_y, float f_threshold);
+
+      /*
+       * Moved less than f_threshold since (f_previous_x, f_previous_y)
+       * (stuck), or a reading above COLLISION_READING
+       */
+      bool IsColliding(const SSnapshot& s_snapshot,
+                       float f_previous_x,
+                       float f_previous_y,
+                       float f_threshold);
+
+   }
+
+}
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * Q-Swarm Shared-Memory Transport Implementation
+ */
+
+#include "q_swarm_shm_transport.h"
+#include <string.h>
+#include <sstream>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <time.h>
+    #ifdef __linux__
+        #include <linux/futex.h>
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+namespace argos {
+
+   static_assert(sizeof(QSwarmShm::SShmHeader) == QSwarmShm::HEADER_SIZE,
+                 "shm header layout must match python/q_shm.py");
+   static_assert(sizeof(QSwarmShm::SShmSlot) == QSwarmShm::SLOT_SIZE,
+                 "shm slot layout must match python/q_shm.py");
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmShmTransport::CQSwarmShmTransport(const std::string& str_name,
+                                            uint32_t slot,
+                                            int n_timeout_ms) :
+      m_strName(str_name),
+      m_unSlot(slot),
+      m_nTimeoutMs(n_timeout_ms),
+      m_bActive(false),
+      m_pMapping(NULL),
+      m_unMappingSize(0),
+      m_psSlot(NULL),
+      m_unSeq(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmShmTransport::~CQSwarmShmTransport() {
+      Close();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmShmTransport::Connect() {
+      #ifdef _WIN32
+         return false;
+      #else
+         // The server creates the segment; if it is not there yet,
+         // Maintain() keeps looking for it like for a listening socket
+         Close();
+         m_bActive = true;
+         m_strFatalError.clear();
+         m_cBackoff.Reset();
+         Maintain();
+         return true;
+      #endif
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmShmTransport::Maintain() {
+      if (m_psSlot != NULL) {
+         return true;
+      }
+      if (!m_bActive || !m_cBackoff.IsDue()) {
+         return false;
+      }
+      if (!MapSegment()) {
+         m_cBackoff.Failed();
+         return false;
+      }
+      m_cBackoff.Reset();
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmShmTransport::MapSegment() {
+      #ifdef _WIN32
+         return false;
+      #else
+         int fd = shm_open(m_strName.c_str(), O_RDWR, 0);
+         if (fd < 0) {
+            return false;
+         }
+
+         struct stat sStat;
+         if (fstat(fd, &sStat) != 0 ||
+             static_cast<size_t>(sStat.st_size) < QSwarmShm::HEADER_SIZE) {
+            close(fd);
+            return false;
+         }
+
+         size_t size = sStat.st_size;
+         void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+         close(fd);
+         if (mapping == MAP_FAILED) {
+            return false;
+         }
+
+         // Validate the layout written by the server
+         const QSwarmShm::SShmHeader* psHeader =
+            static_cast<const QSwarmShm::SShmHeader*>(mapping);
+         if (psHeader->Magic != QSwarmShm::MAGIC ||
+             psHeader->Version != QSwarmShm::VERSION ||
+             psHeader->SlotSize != QSwarmShm::SLOT_SIZE ||
+             size < QSwarmShm::HEADER_SIZE + psHeader->NumSlots * QSwarmShm::SLOT_SIZE) {
+            munmap(mapping, size);
+            return false;
+         }
+
+         // The server made fewer slots than there are robots: retrying cannot help
+         if (m_unSlot >= psHeader->NumSlots) {
+            std::ostringstream cError;
+            cError << "slot " << m_unSlot << " is beyond the " << psHeader->NumSlots
+                   << " slots of shared-memory segment " << m_strName;
+            m_strFatalError = cError.str();
+            m_bActive = false;
+            munmap(mapping, size);
+            return false;
+         }
+
+         m_pMapping = mapping;
+         m_unMappingSize = size;
+         m_psSlot = reinterpret_cast<QSwarmShm::SShmSlot*>(
+            static_cast<uint8_t*>(mapping) + QSwarmShm::HEADER_SIZE + m_unSlot * QSwarmShm::SLOT_SIZE);
+
+         // Continue the sequence of a previous run using this slot
+         m_unSeq = __atomic_load_n(&m_psSlot->RequestSeq, __ATOMIC_ACQUIRE);
+         return true;
+      #endif
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmShmTransport::RequestAction(uint32_t robot_id,
+                                           const float* state,
+                                           float prev_reward,
+                                           uint8_t flags,
+                                           int& action) {
+      if (m_psSlot == NULL) {
+         return false;
+      }
+
+      // Fill the slot directly; the server does not read it until RequestSeq changes
+      m_psSlot->RobotId = robot_id;
+      m_psSlot->Flags = flags;
+      m_psSlot->PrevReward = prev_reward;
+      memcpy(m_psSlot->State, state, sizeof(m_psSlot->State));
+
+      // Publish the request
+      uint32_t seq = ++m_unSeq;
+      __atomic_store_n(&m_psSlot->RequestSeq, seq, __ATOMIC_RELEASE);
+
+      if (!WaitForResponse(seq)) {
+         // The server may be gone: look for a new segment after the backoff delay
+         Unmap();
+         m_cBackoff.Failed();
+         return false;
+      }
+
+      action = m_psSlot->Action;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmShmTransport::WaitForResponse(uint32_t seq) {
+      #ifdef _WIN32
+         return false;
+      #else
+         // Short spin: on an idle server the answer is usually already there
+         for (int i = 0; i < 1000; ++i) {
+            if (__atomic_load_n(&m_psSlot->ResponseSeq, __ATOMIC_ACQUIRE) == seq) {
+               return true;
+            }
+         }
+
+         struct timespec sStart, sNow;
+         clock_gettime(CLOCK_MONOTONIC, &sStart);
+         while (true) {
+            uint32_t current = __atomic_load_n(&m_psSlot->ResponseSeq, __ATOMIC_ACQUIRE);
+            if (current == seq) {
+               return true;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &sNow);
+            long elapsedMs = (sNow.tv_sec - sStart.tv_sec) * 1000 +
+                             (sNow.tv_nsec - sStart.tv_nsec) / 1000000;
+            if (elapsedMs >= m_nTimeoutMs) {
+               return false;
+            }
+
+            // Sleep until the server wakes us (bounded, so a missed wake-up only costs 1 ms)
+            #ifdef __linux__
+               struct timespec sTimeout = { 0, 1000000 };
+               syscall(SYS_futex, &m_psSlot->ResponseSeq, FUTEX_WAIT, current, &sTimeout, NULL, 0);
+            #else
+               usleep(100);
+            #endif
+         }
+      #endif
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmShmTransport::Close() {
+      Unmap();
+      m_bActive = false;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmShmTransport::Unmap() {
+      #ifndef _WIN32
+         if (m_pMapping != NULL) {
+            munmap(m_pMapping, m_unMappingSize);
+         }
+      #endif
+      m_pMapping = NULL;
+      m_unMappingSize = 0;
+      m_psSlot = NULL;
+   }
+
+}
@@ -0,0 +1,146 @@
+#ifndef Q_SWARM_SHM_TRANSPORT_H
+#define Q_SWARM_SHM_TRANSPORT_H
+
+/*
+ * Q-Swarm Shared-Memory Transport
+ *
+ * The Q-Network server creates a POSIX shared memory segment
+ * (shm_open + mmap, see python/q_shm.py) holding one slot per robot.
+ * A controller writes its state, previous reward and flags straight
+ * into its slot and bumps RequestSeq. The server polls all slots, runs
+ * the network once over every pending request, writes the actions and
+ * sets ResponseSeq = RequestSeq, waking waiters through a futex on
+ * ResponseSeq. No socket traffic and no serialisation are involved.
+ *
+ * Segment layout:
+ *    SShmHeader                   64 bytes
+ *    SShmSlot[NumSlots]           SLOT_SIZE bytes each, indexed by robot id
+ *
+ * The segment is mapped in the background like a socket connection:
+ * Maintain() retries (with backoff) until the server has created it, and
+ * maps it again after a request timed out, in case the server restarted
+ * and created a new segment.
+ *
+ * Only available on POSIX systems (Connect() fails on Windows).
+ */
+
+#include "q_swarm_transport.h"
+#include "q_swarm_protocol.h"
+#include "q_swarm_backoff.h"
+
+#include <stddef.h>
+#include <string>
+
+namespace argos {
+
+   namespace QSwarmShm {
+
+      const uint32_t MAGIC = 0x4D485351;  /* "QSHM" little-endian */
+      const uint32_t VERSION = 1;
+      const size_t HEADER_SIZE = 64;
+      /* Slot fields and state, rounded up to 64-byte cache lines (192 for 28 floats) */
+      const size_t SLOT_SIZE = (5 * sizeof(uint32_t) + QSwarmProtocol::STATE_SIZE * sizeof(float) + 63) / 64 * 64;
+
+      struct SShmHeader {
+         uint32_t Magic;
+         uint32_t Version;
+         uint32_t NumSlots;
+         uint32_t SlotSize;
+         uint8_t Reserved[HEADER_SIZE - 4 * sizeof(uint32_t)];
+      };
+
+      struct SShmSlot {
+         /* Written by the controller once the request is complete */
+         uint32_t RequestSeq;
+         /* Written by the server once Action is valid (futex word) */
+         uint32_t ResponseSeq;
+         uint32_t RobotId;
+         uint8_t Flags;                    /* QSwarmProtocol::STEP_* */
+         uint8_t Action;
+         uint8_t Reserved0[2];
+         float PrevReward;
+         float State[QSwarmProtocol::STATE_SIZE];
+         uint8_t Reserved[SLOT_SIZE - 5 * sizeof(uint32_t) -
+                          QSwarmProtocol::STATE_SIZE * sizeof(float)];
+      };
+
+   }
+
+   class CQSwarmShmTransport : public CQSwarmTransport {
+
+   public:
+
+      /*
+       * str_name:     segment name, e.g. "/q_swarm"
+       * slot:         slot index (the robot id)
+       * n_timeout_ms: how long to wait for an action before giving up
+       */
+      CQSwarmShmTransport(const std::string& str_name,
+                          uint32_t slot,
+                          int n_timeout_ms = 5000);
+
+      virtual ~CQSwarmShmTransport();
+
+      virtual bool Connect();
+
+      virtual bool Maintain();
+
+      virtual bool IsConnected() const {
+         return m_psSlot != NULL;
+      }
+
+      virtual bool RequestAction(uint32_t robot_id,
+                                 const float* state,
+                                 float prev_reward,
+                                 uint8_t flags,
+                                 int& action);
+
+      /*
+       * Not supported: the slot always carries the previous reward
+       * with the next state
+       */
+      virtual bool SendReward(uint32_t /* robot_id */,
+                              float /* reward */,
+                              bool /* done */) {
+         return false;
+      }
+
+      virtual void Close();
+
+   private:
+
+      /*
+       * Map the segment and locate this robot's slot
+       */
+      bool MapSegment();
+
+      /*
+       * Release the mapping (Maintain() maps the segment again)
+       */
+      void Unmap();
+
+      /*
+       * Wait until the server has answered request seq
+       */
+      bool WaitForResponse(uint32_t seq);
+
+      std::string m_strName;
+      uint32_t m_unSlot;
+      int m_nTimeoutMs;
+
+      /* Between Connect() and Close(): keep mapping the segment */
+      bool m_bActive;
+      CQSwarmBackoff m_cBackoff;
+
+      void* m_pMapping;
+      size_t m_unMappingSize;
+      QSwarmShm::SShmSlot* m_psSlot;
+
+      /* Sequence number of the last request */
+      uint32_t m_unSeq;
+
+   };
+
+}
+
+#endif
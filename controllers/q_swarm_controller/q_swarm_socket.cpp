@@ -0,0 +1,398 @@
+/*
+ * Q-Swarm Socket Implementation
+ */
+
+#include "q_swarm_socket.h"
+#include <string.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <sys/socket.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <netdb.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <errno.h>
+#endif
+
+namespace argos {
+
+   namespace {
+
+      /* Receive buffer size (a text STEP message is about 400 bytes) */
+      const size_t RECEIVE_BUFFER_SIZE = 4096;
+
+      /* A closed peer must not raise SIGPIPE: the send just fails */
+      #ifdef MSG_NOSIGNAL
+         const int SEND_FLAGS = MSG_NOSIGNAL;
+      #else
+         const int SEND_FLAGS = 0;
+      #endif
+
+      void SetBlocking(int n_socket, bool b_blocking) {
+         #ifdef _WIN32
+            u_long nonBlocking = b_blocking ? 0 : 1;
+            ioctlsocket(n_socket, FIONBIO, &nonBlocking);
+         #else
+            int flags = fcntl(n_socket, F_GETFL, 0);
+            fcntl(n_socket, F_SETFL, b_blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+         #endif
+      }
+
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmSocket::CQSwarmSocket() :
+      m_nSocket(-1),
+      m_bConnected(false),
+      m_unGeneration(0),
+      m_bHasEndpoint(false),
+      m_unAddress(0),
+      m_unPort(0),
+      m_bConnecting(false),
+      m_vecBuffer(RECEIVE_BUFFER_SIZE),
+      m_unBufferStart(0),
+      m_unBufferEnd(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmSocket::~CQSwarmSocket() {
+      Close();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::Connect(const std::string& str_host,
+                               int n_port) {
+      Close();
+
+      #ifdef _WIN32
+         WSADATA wsaData;
+         if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            return false;
+         }
+      #endif
+
+      // Resolve once: names like "localhost" and dotted addresses both work
+      struct addrinfo sHints;
+      memset(&sHints, 0, sizeof(sHints));
+      sHints.ai_family = AF_INET;
+      sHints.ai_socktype = SOCK_STREAM;
+      struct addrinfo* psResult = NULL;
+      if (getaddrinfo(str_host.c_str(), NULL, &sHints, &psResult) != 0 || psResult == NULL) {
+         #ifdef _WIN32
+            WSACleanup();
+         #endif
+         return false;
+      }
+      m_unAddress = reinterpret_cast<struct sockaddr_in*>(psResult->ai_addr)->sin_addr.s_addr;
+      freeaddrinfo(psResult);
+
+      m_unPort = htons(static_cast<uint16_t>(n_port));
+      m_bHasEndpoint = true;
+      m_cBackoff.Reset();
+      StartAttempt();
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::Maintain() {
+      if (m_bConnected) {
+         return true;
+      }
+      if (!m_bHasEndpoint) {
+         return false;
+      }
+      if (m_bConnecting) {
+         return CheckAttempt();
+      }
+      if (m_cBackoff.IsDue()) {
+         return StartAttempt();
+      }
+      return false;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::StartAttempt() {
+      m_nSocket = socket(AF_INET, SOCK_STREAM, 0);
+      if (m_nSocket < 0) {
+         m_cBackoff.Failed();
+         return false;
+      }
+      SetBlocking(m_nSocket, false);
+
+      struct sockaddr_in serverAddr;
+      memset(&serverAddr, 0, sizeof(serverAddr));
+      serverAddr.sin_family = AF_INET;
+      serverAddr.sin_port = m_unPort;
+      serverAddr.sin_addr.s_addr = m_unAddress;
+
+      if (connect(m_nSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == 0) {
+         OnConnected();
+         return true;
+      }
+
+      #ifdef _WIN32
+         bool inProgress = (WSAGetLastError() == WSAEWOULDBLOCK);
+      #else
+         bool inProgress = (errno == EINPROGRESS || errno == EINTR);
+      #endif
+      if (!inProgress) {
+         Drop();
+         return false;
+      }
+      m_bConnecting = true;
+      return false;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::CheckAttempt() {
+      // Writable once connect() finished, successfully or not
+      #ifdef _WIN32
+         fd_set sWrite, sError;
+         FD_ZERO(&sWrite);
+         FD_ZERO(&sError);
+         FD_SET(m_nSocket, &sWrite);
+         FD_SET(m_nSocket, &sError);
+         struct timeval sTimeout = { 0, 0 };
+         int ready = select(0, NULL, &sWrite, &sError, &sTimeout);
+      #else
+         struct pollfd sPoll;
+         sPoll.fd = m_nSocket;
+         sPoll.events = POLLOUT;
+         sPoll.revents = 0;
+         int ready = poll(&sPoll, 1, 0);
+      #endif
+      if (ready == 0) {
+         return false;
+      }
+
+      int error = 0;
+      socklen_t length = sizeof(error);
+      if (ready < 0 ||
+          getsockopt(m_nSocket, SOL_SOCKET, SO_ERROR,
+                     reinterpret_cast<char*>(&error), &length) != 0 ||
+          error != 0) {
+         Drop();
+         return false;
+      }
+
+      OnConnected();
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmSocket::OnConnected() {
+      // Requests and replies themselves are blocking
+      SetBlocking(m_nSocket, true);
+
+      // Small request/reply messages: send immediately (no Nagle delay)
+      int noDelay = 1;
+      setsockopt(m_nSocket, IPPROTO_TCP, TCP_NODELAY,
+                 reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+      m_bConnecting = false;
+      m_bConnected = true;
+      ++m_unGeneration;
+      m_unBufferStart = 0;
+      m_unBufferEnd = 0;
+      m_cBackoff.Reset();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmSocket::Drop() {
+      CloseSocket();
+      m_cBackoff.Failed();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmSocket::CloseSocket() {
+      if (m_nSocket >= 0) {
+         #ifdef _WIN32
+            closesocket(m_nSocket);
+         #else
+            close(m_nSocket);
+         #endif
+         m_nSocket = -1;
+      }
+      m_bConnected = false;
+      m_bConnecting = false;
+      m_unBufferStart = 0;
+      m_unBufferEnd = 0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::SendBytes(const void* data, size_t size) {
+      if (m_nSocket < 0 || !m_bConnected) return false;
+
+      const char* bytes = static_cast<const char*>(data);
+      while (size > 0) {
+         int sent = send(m_nSocket, bytes, size, SEND_FLAGS);
+         if (sent <= 0) {
+            Drop();
+            return false;
+         }
+         bytes += sent;
+         size -= sent;
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::ReceiveBytes(void* data, size_t size) {
+      if (m_nSocket < 0 || !m_bConnected) return false;
+
+      // Bytes already buffered by ReceiveLine() come first
+      char* bytes = static_cast<char*>(data);
+      size_t buffered = m_unBufferEnd - m_unBufferStart;
+      if (buffered > 0) {
+         size_t count = (buffered < size) ? buffered : size;
+         memcpy(bytes, &m_vecBuffer[m_unBufferStart], count);
+         m_unBufferStart += count;
+         bytes += count;
+         size -= count;
+      }
+
+      while (size > 0) {
+         int received = recv(m_nSocket, bytes, size, 0);
+         if (received <= 0) {
+            Drop();
+            return false;
+         }
+         bytes += received;
+         size -= received;
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::ReceiveLine(char* line, size_t size, size_t& length) {
+      if (m_nSocket < 0 || !m_bConnected) return false;
+
+      length = 0;
+      while (true) {
+         // Look for the end of the message in the buffered bytes
+         const char* start = &m_vecBuffer[0] + m_unBufferStart;
+         size_t buffered = m_unBufferEnd - m_unBufferStart;
+         const char* newline = static_cast<const char*>(memchr(start, '\n', buffered));
+         size_t count = (newline != NULL) ? static_cast<size_t>(newline - start) : buffered;
+         if (length + count > size) {
+            // Out of sync with the server: start over on a new connection
+            Drop();
+            return false;
+         }
+         memcpy(line + length, start, count);
+         length += count;
+
+         if (newline != NULL) {
+            m_unBufferStart += count + 1;
+            return true;
+         }
+
+         // Partial message: wait for the rest
+         if (!FillBuffer()) {
+            return false;
+         }
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocket::FillBuffer() {
+      m_unBufferStart = 0;
+      m_unBufferEnd = 0;
+      int received = recv(m_nSocket, &m_vecBuffer[0], m_vecBuffer.size(), 0);
+      if (received <= 0) {
+         Drop();
+         return false;
+      }
+      m_unBufferEnd = received;
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int CQSwarmSocket::ReceiveAvailable(void* data, size_t size) {
+      if (m_nSocket < 0 || !m_bConnected) return -1;
+
+      size_t buffered = m_unBufferEnd - m_unBufferStart;
+      if (buffered > 0) {
+         size_t count = (buffered < size) ? buffered : size;
+         memcpy(data, &m_vecBuffer[m_unBufferStart], count);
+         m_unBufferStart += count;
+         return count;
+      }
+
+      #ifdef _WIN32
+         u_long available = 0;
+         if (ioctlsocket(m_nSocket, FIONREAD, &available) != 0) {
+            return -1;
+         }
+         if (available == 0) {
+            return 0;
+         }
+         if (available < size) {
+            size = available;
+         }
+         int received = recv(m_nSocket, static_cast<char*>(data), size, 0);
+      #else
+         int received = recv(m_nSocket, data, size, MSG_DONTWAIT);
+         if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return 0;
+         }
+      #endif
+
+      // 0 from recv() means the server closed the connection
+      if (received <= 0) {
+         Drop();
+         return -1;
+      }
+      return received;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmSocket::Close() {
+      CloseSocket();
+      if (m_bHasEndpoint) {
+         #ifdef _WIN32
+            WSACleanup();
+         #endif
+         m_bHasEndpoint = false;
+      }
+   }
+
+
+}
@@ -0,0 +1,143 @@
+#ifndef Q_SWARM_SOCKET_H
+#define Q_SWARM_SOCKET_H
+
+/*
+ * Q-Swarm Socket
+ *
+ * Thin blocking TCP client used to talk to the Python Q-Network server.
+ * Shared by the per-robot controller and the swarm loop functions.
+ *
+ * TCP may split or coalesce messages, so received bytes go through a
+ * persistent buffer: ReceiveLine() returns exactly one text message and
+ * keeps whatever follows it for the next read.
+ *
+ * Connections are made in the background: Connect() starts a
+ * non-blocking attempt and Maintain(), called from the control loop,
+ * completes it. Failed attempts and lost connections are retried with
+ * exponential backoff (CQSwarmBackoff), so nothing ever sleeps.
+ */
+
+#include "q_swarm_backoff.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   class CQSwarmSocket {
+
+   public:
+
+      CQSwarmSocket();
+
+      /* Closes the connection if still open */
+      ~CQSwarmSocket();
+
+      /*
+       * Connect to host:port in the background (see Maintain())
+       * Resolves the host and starts the first attempt without waiting
+       * Returns false if the host cannot be resolved
+       */
+      bool Connect(const std::string& str_host,
+                   int n_port);
+
+      /*
+       * Advance the connection without blocking: finish an attempt in
+       * progress or start the next one once the backoff delay is over
+       * Returns true while connected
+       */
+      bool Maintain();
+
+      /*
+       * Returns true while the connection is usable
+       */
+      bool IsConnected() const {
+         return m_bConnected;
+      }
+
+      /*
+       * Number of connections made so far: changes when the socket
+       * reconnects, i.e. when the server has forgotten what was sent
+       */
+      uint32_t GetGeneration() const {
+         return m_unGeneration;
+      }
+
+      /*
+       * Send all size bytes (loops over partial sends)
+       */
+      bool SendBytes(const void* data, size_t size);
+
+      /*
+       * Receive exactly size bytes
+       */
+      bool ReceiveBytes(void* data, size_t size);
+
+      /*
+       * Receive one newline-terminated message into line (at most size
+       * bytes, newline not included) and set length
+       * Returns false on error/close or if the message does not fit
+       */
+      bool ReceiveLine(char* line, size_t size, size_t& length);
+
+      /*
+       * Receive at most size bytes that already arrived, without waiting
+       * Returns the number of bytes received (0 if none), -1 on error/close
+       */
+      int ReceiveAvailable(void* data, size_t size);
+
+      /*
+       * Close the connection (no reconnection until the next Connect())
+       */
+      void Close();
+
+   private:
+
+      /* Not copyable: owns the socket descriptor */
+      CQSwarmSocket(const CQSwarmSocket&);
+      CQSwarmSocket& operator=(const CQSwarmSocket&);
+
+      /*
+       * recv() into the empty receive buffer
+       * Returns false on error/close
+       */
+      bool FillBuffer();
+
+      /* Start a non-blocking connect() (true if it completed at once) */
+      bool StartAttempt();
+
+      /* Check the attempt in progress (true once connected) */
+      bool CheckAttempt();
+
+      /* The socket is connected: back to blocking mode */
+      void OnConnected();
+
+      /* Close the socket after an error and schedule a reconnection */
+      void Drop();
+
+      /* Close the descriptor */
+      void CloseSocket();
+
+      int m_nSocket;
+      bool m_bConnected;
+      uint32_t m_unGeneration;
+
+      /* Server address (network byte order) and reconnection state */
+      bool m_bHasEndpoint;
+      uint32_t m_unAddress;
+      uint16_t m_unPort;
+      bool m_bConnecting;
+      CQSwarmBackoff m_cBackoff;
+
+      /* Received bytes not consumed yet: [m_unBufferStart, m_unBufferEnd) */
+      std::vector<char> m_vecBuffer;
+      size_t m_unBufferStart;
+      size_t m_unBufferEnd;
+
+   };
+
+}
+
+#endif
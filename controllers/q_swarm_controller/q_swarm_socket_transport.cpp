@@ -0,0 +1,213 @@
+/*
+ * Q-Swarm TCP Transport Implementation
+ */
+
+#include "q_swarm_socket_transport.h"
+#include "q_swarm_protocol.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace argos {
+
+   namespace {
+
+      /* Largest text message (a STEP with 28 floats is about 400 bytes) */
+      const size_t MESSAGE_BUFFER_SIZE = 4096;
+
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmSocketTransport::CQSwarmSocketTransport(const std::string& str_host,
+                                                  int n_port,
+                                                  bool binary,
+                                                  bool combined,
+                                                  bool compact) :
+      m_strHost(str_host),
+      m_nPort(n_port),
+      m_bBinary(binary),
+      m_bCombined(combined),
+      m_bCompact(compact && binary && combined),
+      m_unGoalRobot(0),
+      m_vecSendBuffer(MESSAGE_BUFFER_SIZE),
+      m_vecReceiveBuffer(MESSAGE_BUFFER_SIZE) {
+      memset(&m_sGoal, 0, sizeof(m_sGoal));
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocketTransport::Connect() {
+      return m_cSocket.Connect(m_strHost, m_nPort);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocketTransport::RequestAction(uint32_t robot_id,
+                                              const float* state,
+                                              float prev_reward,
+                                              uint8_t flags,
+                                              int& action) {
+      CQSwarmLatencyTimer cTimer(m_pcLatency);
+      if (m_bBinary) {
+         // Send STEP (or STATE) frame, receive a single action byte
+         uint8_t frame[QSwarmProtocol::STEP_FRAME_SIZE];
+         size_t frameSize;
+         if (m_bCombined) {
+            frameSize = EncodeStepFrame(frame, robot_id, state, prev_reward, flags);
+         }
+         else {
+            frameSize = QSwarmProtocol::EncodeState(frame, robot_id, state);
+         }
+         cTimer.Lap(CQSwarmLatencyStats::ENCODE);
+         if (!m_cSocket.SendBytes(frame, frameSize)) {
+            return false;
+         }
+         cTimer.Lap(CQSwarmLatencyStats::SEND);
+
+         uint8_t reply = 0;
+         if (!m_cSocket.ReceiveBytes(&reply, QSwarmProtocol::REPLY_SIZE)) {
+            return false;
+         }
+         cTimer.Lap(CQSwarmLatencyStats::WAIT);
+         action = reply;
+         return true;
+      }
+
+      // Build state message: "STATE|robot_id|x|y|goal_x|goal_y|prox0|...|prox23"
+      // or "STEP|robot_id|prev_reward|flags|x|y|goal_x|goal_y|prox0|...|prox23"
+      size_t pos = QSwarmProtocol::EncodeTextStep(&m_vecSendBuffer[0], m_vecSendBuffer.size(),
+                                                  robot_id, state, prev_reward, flags, m_bCombined);
+      cTimer.Lap(CQSwarmLatencyStats::ENCODE);
+
+      // Send state
+      if (!SendMessage(pos)) {
+         return false;
+      }
+      cTimer.Lap(CQSwarmLatencyStats::SEND);
+
+      // Receive action: "ACTION|action_id"
+      size_t length = 0;
+      if (!ReceiveMessage(length)) {
+         return false;
+      }
+      cTimer.Lap(CQSwarmLatencyStats::WAIT);
+
+      // Parse action
+      action = QSwarmProtocol::ParseTextAction(&m_vecReceiveBuffer[0], length);
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocketTransport::SendRequest(uint32_t robot_id,
+                                            const float* state,
+                                            float prev_reward,
+                                            uint8_t flags) {
+      if (!SupportsPipelining()) {
+         return false;
+      }
+
+      uint8_t frame[QSwarmProtocol::STEP_FRAME_SIZE];
+      size_t frameSize = EncodeStepFrame(frame, robot_id, state, prev_reward, flags);
+      return m_cSocket.SendBytes(frame, frameSize);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   int CQSwarmSocketTransport::PollActions(int& action) {
+      if (!SupportsPipelining()) {
+         return -1;
+      }
+
+      // One byte per answer: drain everything that arrived
+      int total = 0;
+      uint8_t replies[64];
+      while (true) {
+         int received = m_cSocket.ReceiveAvailable(replies, sizeof(replies));
+         if (received < 0) {
+            return -1;
+         }
+         if (received == 0) {
+            return total;
+         }
+         action = replies[received - 1];
+         total += received;
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocketTransport::SendReward(uint32_t robot_id,
+                                           float reward,
+                                           bool done) {
+      if (m_bBinary) {
+         uint8_t frame[QSwarmProtocol::REWARD_FRAME_SIZE];
+         size_t frameSize = QSwarmProtocol::EncodeReward(frame, robot_id, reward, done);
+         if (!m_cSocket.SendBytes(frame, frameSize)) {
+            return false;
+         }
+
+         // Wait for acknowledgment byte
+         uint8_t ack;
+         return m_cSocket.ReceiveBytes(&ack, QSwarmProtocol::REPLY_SIZE);
+      }
+
+      // Build reward message: "REWARD|robot_id|reward|done"
+      size_t pos = QSwarmProtocol::EncodeTextReward(&m_vecSendBuffer[0], m_vecSendBuffer.size(),
+                                                    robot_id, reward, done);
+
+      if (!SendMessage(pos)) {
+         return false;
+      }
+
+      // Wait for acknowledgment
+      size_t length = 0;
+      return ReceiveMessage(length);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocketTransport::SendMessage(size_t length) {
+      // Keep room for the newline delimiter
+      if (length + 1 >= m_vecSendBuffer.size()) {
+         return false;
+      }
+      m_vecSendBuffer[length] = '\n';
+      return m_cSocket.SendBytes(&m_vecSendBuffer[0], length + 1);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmSocketTransport::EncodeStepFrame(uint8_t* frame,
+                                                  uint32_t robot_id,
+                                                  const float* state,
+                                                  float prev_reward,
+                                                  uint8_t flags) {
+      if (!m_bCompact) {
+         return QSwarmProtocol::EncodeStep(frame, robot_id, state, prev_reward, flags);
+      }
+      if (robot_id != m_unGoalRobot) {
+         m_unGoalRobot = robot_id;
+         m_sGoal.Sent = false;
+      }
+      flags |= QSwarmProtocol::CompactGoalFlag(m_sGoal, state, m_cSocket.GetGeneration());
+      return QSwarmProtocol::EncodeCompactStep(frame, robot_id, state, prev_reward, flags);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmSocketTransport::ReceiveMessage(size_t& length) {
+      // Exactly one message, even if TCP split or merged them
+      return m_cSocket.ReceiveLine(&m_vecReceiveBuffer[0], m_vecReceiveBuffer.size(), length);
+   }
+
+}
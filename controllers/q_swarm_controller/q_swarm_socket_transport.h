@@ -0,0 +1,128 @@
+#ifndef Q_SWARM_SOCKET_TRANSPORT_H
+#define Q_SWARM_SOCKET_TRANSPORT_H
+
+/*
+ * Q-Swarm TCP Transport
+ *
+ * Talks to the Q-Network server over a TCP socket using either the text
+ * messages (STEP|..., STATE|..., REWARD|...) or the binary frames from
+ * q_swarm_protocol.h.
+ *
+ * Messages are built and parsed in buffers owned by the transport, so a
+ * request does not allocate.
+ *
+ * With compact frames (binary STEP only) the goal is sent with the first
+ * step of each connection and whenever it changes.
+ */
+
+#include "q_swarm_transport.h"
+#include "q_swarm_socket.h"
+#include "q_swarm_protocol.h"
+
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   class CQSwarmSocketTransport : public CQSwarmTransport {
+
+   public:
+
+      /*
+       * binary:   binary frames instead of text messages
+       * combined: STEP messages (reward travels with the next state)
+       *           instead of separate STATE and REWARD round trips
+       * compact:  COMPACT_STEP frames instead of STEP (binary and
+       *           combined only)
+       */
+      CQSwarmSocketTransport(const std::string& str_host,
+                             int n_port,
+                             bool binary,
+                             bool combined,
+                             bool compact = false);
+
+      virtual bool Connect();
+
+      virtual bool Maintain() {
+         return m_cSocket.Maintain();
+      }
+
+      virtual bool IsConnected() const {
+         return m_cSocket.IsConnected();
+      }
+
+      virtual bool RequestAction(uint32_t robot_id,
+                                 const float* state,
+                                 float prev_reward,
+                                 uint8_t flags,
+                                 int& action);
+
+      virtual bool SendReward(uint32_t robot_id,
+                              float reward,
+                              bool done);
+
+      /*
+       * Only with binary STEP frames: the answers are single bytes, and
+       * the server reads frames one after the other from the stream
+       */
+      virtual bool SupportsPipelining() const {
+         return m_bBinary && m_bCombined;
+      }
+
+      virtual bool SendRequest(uint32_t robot_id,
+                               const float* state,
+                               float prev_reward,
+                               uint8_t flags);
+
+      virtual int PollActions(int& action);
+
+      virtual void Close() {
+         m_cSocket.Close();
+      }
+
+   private:
+
+      /*
+       * Send the first length bytes of m_vecSendBuffer as a text message
+       * (adds the newline)
+       */
+      bool SendMessage(size_t length);
+
+      /*
+       * Receive one text message into m_vecReceiveBuffer (without the newline)
+       * Returns false on error
+       */
+      bool ReceiveMessage(size_t& length);
+
+      /*
+       * Encode the STEP (or COMPACT_STEP) frame of a request into frame
+       * (at least STEP_FRAME_SIZE bytes)
+       * Returns the number of bytes written
+       */
+      size_t EncodeStepFrame(uint8_t* frame,
+                             uint32_t robot_id,
+                             const float* state,
+                             float prev_reward,
+                             uint8_t flags);
+
+      CQSwarmSocket m_cSocket;
+
+      std::string m_strHost;
+      int m_nPort;
+      bool m_bBinary;
+      bool m_bCombined;
+      bool m_bCompact;
+
+      /* Goal the server has for m_unGoalRobot (compact frames) */
+      uint32_t m_unGoalRobot;
+      QSwarmProtocol::SCompactGoal m_sGoal;
+
+      /* Text message buffers (allocated once) */
+      std::vector<char> m_vecSendBuffer;
+      std::vector<char> m_vecReceiveBuffer;
+
+   };
+
+}
+
+#endif
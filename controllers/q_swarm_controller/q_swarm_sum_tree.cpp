@@ -0,0 +1,61 @@
+/*
+ * Q-Swarm Sum Tree Implementation
+ */
+
+#include "q_swarm_sum_tree.h"
+
+#include <algorithm>
+
+namespace argos {
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmSumTree::CQSwarmSumTree(size_t un_leaves) :
+      m_unLeaves(un_leaves > 0 ? un_leaves : 1),
+      m_unFirstLeaf(1) {
+      while (m_unFirstLeaf < m_unLeaves) {
+         m_unFirstLeaf *= 2;
+      }
+      m_vecNodes.assign(2 * m_unFirstLeaf, 0.0);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmSumTree::Set(size_t un_leaf, double f_priority) {
+      // Recompute the sums instead of adding a delta, so rounding errors
+      // do not accumulate
+      size_t unNode = m_unFirstLeaf + un_leaf;
+      m_vecNodes[unNode] = f_priority;
+      for (unNode /= 2; unNode >= 1; unNode /= 2) {
+         m_vecNodes[unNode] = m_vecNodes[2 * unNode] + m_vecNodes[2 * unNode + 1];
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   size_t CQSwarmSumTree::Find(double f_mass) const {
+      size_t unNode = 1;
+      while (unNode < m_unFirstLeaf) {
+         size_t unLeft = 2 * unNode;
+         if (f_mass < m_vecNodes[unLeft] || m_vecNodes[unLeft + 1] <= 0.0) {
+            unNode = unLeft;
+         }
+         else {
+            f_mass -= m_vecNodes[unLeft];
+            unNode = unLeft + 1;
+         }
+      }
+      return std::min(unNode - m_unFirstLeaf, m_unLeaves - 1);
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmSumTree::Clear() {
+      std::fill(m_vecNodes.begin(), m_vecNodes.end(), 0.0);
+   }
+
+}
@@ -0,0 +1,64 @@
+#ifndef Q_SWARM_SUM_TREE_H
+#define Q_SWARM_SUM_TREE_H
+
+/*
+ * Q-Swarm Sum Tree
+ *
+ * Index for prioritized replay: every leaf holds the priority of one
+ * replay row and every inner node the sum of its children, so setting a
+ * priority and finding the row at a given cumulative priority both take
+ * O(log n).
+ *
+ * The tree is one contiguous array in heap order (node i has children
+ * 2i and 2i + 1, the root is node 1, the leaves start at the number of
+ * leaves rounded up to a power of two). The upper levels, which every
+ * lookup visits, share a few cache lines. Sums are kept in double and
+ * recomputed from the children on every update, so they do not drift.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include <stddef.h>
+#include <vector>
+
+namespace argos {
+
+   class CQSwarmSumTree {
+
+   public:
+
+      CQSwarmSumTree(size_t un_leaves);
+
+      /* Set the priority of a leaf */
+      void Set(size_t un_leaf, double f_priority);
+
+      double Get(size_t un_leaf) const {
+         return m_vecNodes[m_unFirstLeaf + un_leaf];
+      }
+
+      /* Sum of all priorities */
+      double GetTotal() const {
+         return m_vecNodes[1];
+      }
+
+      /*
+       * Leaf where the cumulative priority reaches f_mass (0 <= f_mass <
+       * GetTotal()); never a leaf past the ones in use when the mass is
+       * rounded up to the total
+       */
+      size_t Find(double f_mass) const;
+
+      /* Set every priority to zero */
+      void Clear();
+
+   private:
+
+      size_t m_unLeaves;
+      size_t m_unFirstLeaf;
+      std::vector<double> m_vecNodes;
+
+   };
+
+}
+
+#endif
@@ -0,0 +1,1118 @@
+/*
+ * Q-Swarm Experiment Sweep
+ *
+ * Runs an experiment file over a grid of parameter values, several runs
+ * at a time, and collects the outcome of every run into one table:
+ *
+ *    q_swarm_sweep TEMPLATE [--set ATTR=v1,v2,...]... [--seeds 1-8|1,4,9]
+ *       [--jobs N] [--cores-per-job K] [--pin core|node|none]
+ *       [--out sweep] [--argos argos3] [--server CMD|none] [--base-port 5600]
+ *       [--shm] [--timeout S] [--visual] [--dry-run]
+ *
+ * Grid: every combination of the --set values, times every seed. ATTR is
+ * element.attribute (added to every such element if missing, e.g.
+ * params.velocity, loop_functions.arenas, system.threads) or a bare
+ * attribute name (replaces every occurrence, e.g. max_steps). --seeds sets
+ * experiment.random_seed; without it every combination runs once with the
+ * template's seed.
+ *
+ * Each run gets a directory OUT/run_NNNN with its experiment file, the logs
+ * of ARGoS and of its server (argos.log, server.log), its episode log
+ * (loop_functions.episode_log) and the server's models. Runs are started
+ * from the current directory, so the library paths of the template apply
+ * as they are (run the sweep from the repository root).
+ *
+ * Jobs: a work queue keeps --jobs runs going (default: the allowed cores
+ * divided by --cores-per-job) and starts the next run as soon as one ends.
+ * Job slot i owns its cores and a server of its own:
+ *    --pin core   K consecutive cores, in NUMA node order (default)
+ *    --pin node   every core of NUMA node i % nodes
+ *    --pin none   no affinity
+ * ARGoS and the server of the slot are both pinned to its cores. A server
+ * is started per run from the --server template (placeholders {port}
+ * {shm} {dir} {run} {seed}), by default
+ *    python3 python/q_server.py --port {port} --model-dir {dir}/models
+ * plus --shm {shm} with --shm, and the run's controllers and loop functions
+ * are pointed at it: port BASE_PORT + i, or shared-memory segment
+ * /q_swarm_sweep_<i> with transport="shm". --server none starts no server
+ * and leaves the template's endpoints alone (native inference).
+ *
+ * A run ends when ARGoS exits: at the experiment length, or with
+ * length="0" once every robot has run its max_episodes. --timeout stops
+ * runs that take longer.
+ *
+ * OUT/results.csv gets one row per run as the runs end:
+ *    run,<params>,seed,status,seconds,episodes,goal_rate,collision_rate,
+ *    timeout_rate,mean_reward,final_reward,mean_steps
+ * final_reward is the mean reward of the last 10% of the episodes. The
+ * rates, rewards and steps come from the episode log, and the table
+ * printed at the end averages them over the seeds of each combination.
+ *
+ * POSIX only (fork, sched_setaffinity): the simulations run on Linux.
+ */
+
+#include "q_swarm_episode_log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace argos;
+
+namespace {
+
+   /* One --set: attribute and its values */
+   struct SParameter {
+      std::string Element;              /* empty: every element */
+      std::string Attribute;
+      std::vector<std::string> Values;
+
+      std::string GetName() const {
+         return Element.empty() ? Attribute : Element + "." + Attribute;
+      }
+   };
+
+   struct SOptions {
+      std::string Template;
+      std::vector<SParameter> Parameters;
+      std::vector<std::string> Seeds;
+      size_t Jobs;
+      size_t CoresPerJob;
+      std::string Pin;
+      std::string Out;
+      std::string Argos;
+      std::string Server;
+      int BasePort;
+      bool Shm;
+      double Timeout;
+      bool Visual;
+      bool DryRun;
+
+      SOptions() :
+         Jobs(0),
+         CoresPerJob(1),
+         Pin("core"),
+         Out("sweep"),
+         Argos("argos3"),
+         BasePort(5600),
+         Shm(false),
+         Timeout(0.0),
+         Visual(false),
+         DryRun(false) {
+      }
+   };
+
+   /* Outcome of a run, from its episode log */
+   struct SMetrics {
+      size_t Episodes;
+      double GoalRate;
+      double CollisionRate;
+      double TimeoutRate;
+      double MeanReward;
+      double FinalReward;
+      double MeanSteps;
+
+      SMetrics() :
+         Episodes(0), GoalRate(0.0), CollisionRate(0.0), TimeoutRate(0.0),
+         MeanReward(0.0), FinalReward(0.0), MeanSteps(0.0) {
+      }
+   };
+
+   /* One point of the grid */
+   struct SRun {
+      size_t Index;
+      std::vector<std::string> Values;  /* one per parameter */
+      std::string Seed;                 /* empty: the template's */
+      std::string Dir;
+      std::string Status;
+      double Seconds;
+      bool HasLog;                      /* episode log read back */
+      SMetrics Metrics;
+
+      SRun() : Index(0), Seconds(0.0), HasLog(false) {}
+   };
+
+   /* A job slot: its cores and the run it is busy with */
+   struct SSlot {
+      std::vector<int> Cpus;
+      bool Busy;
+      size_t Run;
+      pid_t Argos;
+      pid_t Server;
+      std::chrono::steady_clock::time_point Start;
+
+      SSlot() : Busy(false), Run(0), Argos(-1), Server(-1) {}
+   };
+
+   /* Fraction of a run's episodes averaged into final_reward */
+   const double FINAL_FRACTION = 0.1;
+
+   /* How often the queue looks at its runs */
+   const int POLL_MS = 100;
+
+   /* Time a process gets to exit after SIGINT/SIGTERM before SIGKILL */
+   const int STOP_GRACE_MS = 10000;
+
+   volatile sig_atomic_t g_bInterrupted = 0;
+
+   void OnInterrupt(int) {
+      g_bInterrupted = 1;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void PrintUsage() {
+      fprintf(stderr,
+              "Usage: q_swarm_sweep TEMPLATE [--set ATTR=v1,v2,...]... [--seeds 1-8|1,4,9]\n"
+              "          [--jobs N] [--cores-per-job K] [--pin core|node|none]\n"
+              "          [--out sweep] [--argos argos3] [--server CMD|none] [--base-port 5600]\n"
+              "          [--shm] [--timeout S] [--visual] [--dry-run]\n");
+   }
+
+   /****************************************/
+   /****************************************/
+
+   std::vector<std::string> Split(const std::string& str_text, char c_separator) {
+      std::vector<std::string> vecParts;
+      std::istringstream cText(str_text);
+      std::string strPart;
+      while (std::getline(cText, strPart, c_separator)) {
+         vecParts.push_back(strPart);
+      }
+      return vecParts;
+   }
+
+   /*
+    * Parse a list of integers and ranges ("0-3,8,10-11")
+    * Returns false if it is malformed
+    */
+   bool ParseRanges(const std::string& str_text, std::vector<long>& vec_values) {
+      std::vector<std::string> vecParts = Split(str_text, ',');
+      for (size_t i = 0; i < vecParts.size(); ++i) {
+         const char* pcPart = vecParts[i].c_str();
+         char* pcEnd;
+         long nFirst = strtol(pcPart, &pcEnd, 10);
+         if (pcEnd == pcPart) {
+            return false;
+         }
+         long nLast = nFirst;
+         if (*pcEnd == '-') {
+            const char* pcSecond = pcEnd + 1;
+            nLast = strtol(pcSecond, &pcEnd, 10);
+            if (pcEnd == pcSecond || nLast < nFirst) {
+               return false;
+            }
+         }
+         if (*pcEnd != '\0' && *pcEnd != '\n') {
+            return false;
+         }
+         for (long n = nFirst; n <= nLast; ++n) {
+            vec_values.push_back(n);
+         }
+      }
+      return !vec_values.empty();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool ParseOptions(int argc, char** argv, SOptions& s_options) {
+      for (int i = 1; i < argc; ++i) {
+         std::string strArg = argv[i];
+         bool bValue = (i + 1 < argc);
+         if (strArg == "--set" && bValue) {
+            std::string strSet = argv[++i];
+            size_t unEquals = strSet.find('=');
+            if (unEquals == std::string::npos || unEquals == 0 || unEquals + 1 == strSet.size()) {
+               fprintf(stderr, "--set needs ATTR=v1,v2,...: '%s'\n", strSet.c_str());
+               return false;
+            }
+            SParameter sParameter;
+            std::string strName = strSet.substr(0, unEquals);
+            size_t unDot = strName.rfind('.');
+            if (unDot != std::string::npos) {
+               sParameter.Element = strName.substr(0, unDot);
+            }
+            sParameter.Attribute = strName.substr(unDot == std::string::npos ? 0 : unDot + 1);
+            sParameter.Values = Split(strSet.substr(unEquals + 1), ',');
+            if (sParameter.Attribute.empty() || sParameter.Values.empty()) {
+               fprintf(stderr, "--set needs ATTR=v1,v2,...: '%s'\n", strSet.c_str());
+               return false;
+            }
+            s_options.Parameters.push_back(sParameter);
+         }
+         else if (strArg == "--seeds" && bValue) {
+            std::vector<long> vecSeeds;
+            if (!ParseRanges(argv[++i], vecSeeds)) {
+               fprintf(stderr, "--seeds needs a list such as 1-8 or 1,4,9\n");
+               return false;
+            }
+            for (size_t k = 0; k < vecSeeds.size(); ++k) {
+               std::ostringstream cSeed;
+               cSeed << vecSeeds[k];
+               s_options.Seeds.push_back(cSeed.str());
+            }
+         }
+         else if (strArg == "--jobs" && bValue) {
+            s_options.Jobs = strtoul(argv[++i], NULL, 10);
+         }
+         else if (strArg == "--cores-per-job" && bValue) {
+            s_options.CoresPerJob = strtoul(argv[++i], NULL, 10);
+         }
+         else if (strArg == "--pin" && bValue) {
+            s_options.Pin = argv[++i];
+         }
+         else if (strArg == "--out" && bValue) {
+            s_options.Out = argv[++i];
+         }
+         else if (strArg == "--argos" && bValue) {
+            s_options.Argos = argv[++i];
+         }
+         else if (strArg == "--server" && bValue) {
+            s_options.Server = argv[++i];
+         }
+         else if (strArg == "--base-port" && bValue) {
+            s_options.BasePort = atoi(argv[++i]);
+         }
+         else if (strArg == "--shm") {
+            s_options.Shm = true;
+         }
+         else if (strArg == "--timeout" && bValue) {
+            s_options.Timeout = atof(argv[++i]);
+         }
+         else if (strArg == "--visual") {
+            s_options.Visual = true;
+         }
+         else if (strArg == "--dry-run") {
+            s_options.DryRun = true;
+         }
+         else if (!strArg.empty() && strArg[0] != '-' && s_options.Template.empty()) {
+            s_options.Template = strArg;
+         }
+         else {
+            return false;
+         }
+      }
+
+      if (s_options.Pin != "core" && s_options.Pin != "node" && s_options.Pin != "none") {
+         fprintf(stderr, "Unknown pinning '%s'\n", s_options.Pin.c_str());
+         return false;
+      }
+      if (s_options.CoresPerJob == 0) {
+         s_options.CoresPerJob = 1;
+      }
+      if (s_options.Server.empty()) {
+         s_options.Server = "python3 python/q_server.py --port {port} --model-dir {dir}/models";
+         if (s_options.Shm) {
+            s_options.Server += " --shm {shm}";
+         }
+      }
+      return !s_options.Template.empty();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /* A start or empty-element tag of the experiment file */
+   struct STag {
+      size_t Begin;                     /* '<' */
+      size_t NameEnd;
+      size_t End;                       /* one past '>' */
+      std::string Name;
+      bool Closing;
+      bool SelfClosing;
+   };
+
+   /*
+    * Find the next tag at or after un_pos, skipping comments and
+    * declarations
+    * Returns false at the end of the file
+    */
+   bool NextTag(const std::string& str_xml, size_t& un_pos, STag& s_tag) {
+      while (true) {
+         size_t unBegin = str_xml.find('<', un_pos);
+         if (unBegin == std::string::npos || unBegin + 1 >= str_xml.size()) {
+            return false;
+         }
+         if (str_xml.compare(unBegin, 4, "<!--") == 0) {
+            size_t unEnd = str_xml.find("-->", unBegin + 4);
+            un_pos = (unEnd == std::string::npos) ? str_xml.size() : unEnd + 3;
+            continue;
+         }
+         if (str_xml[unBegin + 1] == '?' || str_xml[unBegin + 1] == '!') {
+            size_t unEnd = str_xml.find('>', unBegin);
+            un_pos = (unEnd == std::string::npos) ? str_xml.size() : unEnd + 1;
+            continue;
+         }
+         s_tag.Begin = unBegin;
+         s_tag.Closing = (str_xml[unBegin + 1] == '/');
+         size_t unName = unBegin + 1 + (s_tag.Closing ? 1 : 0);
+         s_tag.NameEnd = str_xml.find_first_of(" \t\r\n/>", unName);
+         if (s_tag.NameEnd == std::string::npos) {
+            return false;
+         }
+         s_tag.Name = str_xml.substr(unName, s_tag.NameEnd - unName);
+
+         // '>' outside of the attribute values
+         char cQuote = 0;
+         size_t p = s_tag.NameEnd;
+         for (; p < str_xml.size(); ++p) {
+            char c = str_xml[p];
+            if (cQuote != 0) {
+               cQuote = (c == cQuote) ? 0 : cQuote;
+            }
+            else if (c == '"' || c == '\'') {
+               cQuote = c;
+            }
+            else if (c == '>') {
+               break;
+            }
+         }
+         if (p == str_xml.size()) {
+            return false;
+         }
+         s_tag.End = p + 1;
+         s_tag.SelfClosing = (str_xml[p - 1] == '/');
+         un_pos = s_tag.End;
+         return true;
+      }
+   }
+
+   std::string EscapeXml(const std::string& str_value) {
+      std::string strEscaped;
+      for (size_t i = 0; i < str_value.size(); ++i) {
+         char c = str_value[i];
+         if (c == '&') strEscaped += "&amp;";
+         else if (c == '<') strEscaped += "&lt;";
+         else if (c == '"') strEscaped += "&quot;";
+         else strEscaped += c;
+      }
+      return strEscaped;
+   }
+
+   /*
+    * Set attribute str_attribute to str_value in every element named
+    * str_element (every element if empty), adding it where it is missing
+    * if b_insert
+    * Returns the number of elements changed
+    */
+   size_t SetAttribute(std::string& str_xml,
+                       const std::string& str_element,
+                       const std::string& str_attribute,
+                       const std::string& str_value,
+                       bool b_insert) {
+      std::string strValue = EscapeXml(str_value);
+      size_t unChanged = 0;
+      size_t unPos = 0;
+      STag sTag;
+      while (NextTag(str_xml, unPos, sTag)) {
+         if (sTag.Closing || (!str_element.empty() && sTag.Name != str_element)) {
+            continue;
+         }
+         size_t unLast = sTag.End - (sTag.SelfClosing ? 2 : 1);
+         size_t p = sTag.NameEnd;
+         bool bFound = false;
+         while (p < unLast) {
+            // name = "value"
+            p = str_xml.find_first_not_of(" \t\r\n", p);
+            if (p == std::string::npos || p >= unLast) {
+               break;
+            }
+            size_t unNameEnd = str_xml.find_first_of(" \t\r\n=", p);
+            size_t unEquals = str_xml.find('=', p);
+            if (unNameEnd == std::string::npos || unEquals == std::string::npos || unEquals >= unLast) {
+               break;
+            }
+            size_t unQuote = str_xml.find_first_of("\"'", unEquals);
+            if (unQuote == std::string::npos || unQuote >= unLast) {
+               break;
+            }
+            size_t unClose = str_xml.find(str_xml[unQuote], unQuote + 1);
+            if (unClose == std::string::npos || unClose >= unLast) {
+               break;
+            }
+            if (str_xml.compare(p, unNameEnd - p, str_attribute) == 0 &&
+                unNameEnd - p == str_attribute.size()) {
+               str_xml.replace(unQuote + 1, unClose - unQuote - 1, strValue);
+               unPos = sTag.End + strValue.size() - (unClose - unQuote - 1);
+               bFound = true;
+               break;
+            }
+            p = unClose + 1;
+         }
+         if (bFound) {
+            ++unChanged;
+         }
+         else if (b_insert) {
+            // After the last attribute, before "/>" or ">"
+            size_t unInsert = str_xml.find_last_not_of(" \t\r\n", unLast - 1) + 1;
+            std::string strAttribute = " " + str_attribute + "=\"" + strValue + "\"";
+            str_xml.insert(unInsert, strAttribute);
+            unPos = sTag.End + strAttribute.size();
+            ++unChanged;
+         }
+      }
+      return unChanged;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /* Cores this process may run on */
+   std::vector<int> GetAllowedCpus() {
+      std::vector<int> vecCpus;
+      cpu_set_t sSet;
+      CPU_ZERO(&sSet);
+      if (sched_getaffinity(0, sizeof(sSet), &sSet) == 0) {
+         for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &sSet)) {
+               vecCpus.push_back(i);
+            }
+         }
+      }
+      if (vecCpus.empty()) {
+         long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+         for (long i = 0; i < (nCpus > 0 ? nCpus : 1); ++i) {
+            vecCpus.push_back(static_cast<int>(i));
+         }
+      }
+      return vecCpus;
+   }
+
+   /*
+    * The allowed cores by NUMA node (sysfs), nodes in ascending order
+    * A single node with every core if the topology is not available
+    */
+   std::vector<std::vector<int> > GetNodes(const std::vector<int>& vec_allowed) {
+      std::map<long, std::vector<int> > mapNodes;
+      std::set<int> setAllowed(vec_allowed.begin(), vec_allowed.end());
+      std::set<int> setPlaced;
+      DIR* pcDir = opendir("/sys/devices/system/node");
+      if (pcDir != NULL) {
+         struct dirent* psEntry;
+         while ((psEntry = readdir(pcDir)) != NULL) {
+            const char* pcName = psEntry->d_name;
+            char* pcEnd;
+            if (strncmp(pcName, "node", 4) != 0) {
+               continue;
+            }
+            long nNode = strtol(pcName + 4, &pcEnd, 10);
+            if (pcEnd == pcName + 4 || *pcEnd != '\0') {
+               continue;
+            }
+            std::ifstream cList(std::string("/sys/devices/system/node/") + pcName + "/cpulist");
+            std::string strList;
+            std::vector<long> vecCpus;
+            if (!std::getline(cList, strList) || !ParseRanges(strList, vecCpus)) {
+               continue;
+            }
+            for (size_t i = 0; i < vecCpus.size(); ++i) {
+               int nCpu = static_cast<int>(vecCpus[i]);
+               if (setAllowed.count(nCpu) > 0 && setPlaced.insert(nCpu).second) {
+                  mapNodes[nNode].push_back(nCpu);
+               }
+            }
+         }
+         closedir(pcDir);
+      }
+
+      std::vector<std::vector<int> > vecNodes;
+      for (std::map<long, std::vector<int> >::iterator it = mapNodes.begin(); it != mapNodes.end(); ++it) {
+         vecNodes.push_back(it->second);
+      }
+      // Cores of no node (no sysfs, offline nodes) form one more
+      std::vector<int> vecRest;
+      for (size_t i = 0; i < vec_allowed.size(); ++i) {
+         if (setPlaced.count(vec_allowed[i]) == 0) {
+            vecRest.push_back(vec_allowed[i]);
+         }
+      }
+      if (!vecRest.empty()) {
+         vecNodes.push_back(vecRest);
+      }
+      return vecNodes;
+   }
+
+   std::string FormatCpus(const std::vector<int>& vec_cpus) {
+      if (vec_cpus.empty()) {
+         return "any";
+      }
+      std::ostringstream cText;
+      for (size_t i = 0; i < vec_cpus.size(); ++i) {
+         size_t j = i;
+         while (j + 1 < vec_cpus.size() && vec_cpus[j + 1] == vec_cpus[j] + 1) {
+            ++j;
+         }
+         cText << (i > 0 ? "," : "") << vec_cpus[i];
+         if (j > i) {
+            cText << "-" << vec_cpus[j];
+         }
+         i = j;
+      }
+      return cText.str();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /* mkdir -p */
+   bool MakeDirs(const std::string& str_path) {
+      for (size_t p = 1; p <= str_path.size(); ++p) {
+         if (p == str_path.size() || str_path[p] == '/') {
+            std::string strDir = str_path.substr(0, p);
+            if (mkdir(strDir.c_str(), 0755) != 0 && errno != EEXIST) {
+               return false;
+            }
+         }
+      }
+      return true;
+   }
+
+   std::string Replace(std::string str_text, const std::string& str_key, const std::string& str_value) {
+      for (size_t p = str_text.find(str_key); p != std::string::npos;
+           p = str_text.find(str_key, p + str_value.size())) {
+         str_text.replace(p, str_key.size(), str_value);
+      }
+      return str_text;
+   }
+
+   std::string GetShmName(size_t un_slot) {
+      std::ostringstream cName;
+      cName << "/q_swarm_sweep_" << un_slot;
+      return cName.str();
+   }
+
+   /*
+    * Experiment file of a run on job slot un_slot
+    * Returns false (with the reason) if a parameter matches nothing
+    */
+   bool MakeConfig(const std::string& str_template,
+                   const SOptions& s_options,
+                   const SRun& s_run,
+                   size_t un_slot,
+                   std::string& str_config,
+                   std::string& str_error) {
+      str_config = str_template;
+      for (size_t i = 0; i < s_options.Parameters.size(); ++i) {
+         const SParameter& sParameter = s_options.Parameters[i];
+         if (SetAttribute(str_config, sParameter.Element, sParameter.Attribute, s_run.Values[i],
+                          !sParameter.Element.empty()) == 0) {
+            str_error = sParameter.Element.empty() ?
+               "no attribute '" + sParameter.Attribute + "' in the template" :
+               "no element '" + sParameter.Element + "' in the template";
+            return false;
+         }
+      }
+      if (!s_run.Seed.empty() &&
+          SetAttribute(str_config, "experiment", "random_seed", s_run.Seed, true) == 0) {
+         str_error = "no element 'experiment' in the template";
+         return false;
+      }
+
+      // The run's own server and episode log
+      if (s_options.Server != "none") {
+         std::ostringstream cPort;
+         cPort << s_options.BasePort + static_cast<int>(un_slot);
+         SetAttribute(str_config, "params", "port", cPort.str(), true);
+         SetAttribute(str_config, "loop_functions", "port", cPort.str(), true);
+         if (s_options.Shm) {
+            SetAttribute(str_config, "params", "transport", "shm", true);
+            SetAttribute(str_config, "params", "shm_name", GetShmName(un_slot), true);
+         }
+      }
+      SetAttribute(str_config, "loop_functions", "episode_log", s_run.Dir + "/episodes.qse", true);
+      return true;
+   }
+
+   std::string MakeServerCommand(const SOptions& s_options, const SRun& s_run, size_t un_slot) {
+      std::ostringstream cPort;
+      cPort << s_options.BasePort + static_cast<int>(un_slot);
+      std::ostringstream cRun;
+      cRun << s_run.Index;
+      std::string strCommand = s_options.Server;
+      strCommand = Replace(strCommand, "{port}", cPort.str());
+      strCommand = Replace(strCommand, "{shm}", GetShmName(un_slot));
+      strCommand = Replace(strCommand, "{dir}", s_run.Dir);
+      strCommand = Replace(strCommand, "{run}", cRun.str());
+      strCommand = Replace(strCommand, "{seed}", s_run.Seed);
+      return strCommand;
+   }
+
+   std::vector<std::string> MakeArgosCommand(const SOptions& s_options, const SRun& s_run) {
+      std::vector<std::string> vecArgs;
+      vecArgs.push_back(s_options.Argos);
+      vecArgs.push_back("-c");
+      vecArgs.push_back(s_run.Dir + "/experiment.argos");
+      if (!s_options.Visual) {
+         vecArgs.push_back("-z");
+      }
+      return vecArgs;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   /*
+    * Start vec_args pinned to vec_cpus (any core if empty), output to
+    * str_log
+    * Returns the child, or -1 if fork failed
+    */
+   pid_t Spawn(const std::vector<std::string>& vec_args,
+               const std::vector<int>& vec_cpus,
+               const std::string& str_log) {
+      pid_t nPid = fork();
+      if (nPid != 0) {
+         return nPid;
+      }
+
+      // Child: only async-signal-safe work from here on
+      signal(SIGINT, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      if (!vec_cpus.empty()) {
+         cpu_set_t sSet;
+         CPU_ZERO(&sSet);
+         for (size_t i = 0; i < vec_cpus.size(); ++i) {
+            CPU_SET(vec_cpus[i], &sSet);
+         }
+         sched_setaffinity(0, sizeof(sSet), &sSet);
+      }
+      int nNull = open("/dev/null", O_RDONLY);
+      int nLog = open(str_log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (nNull >= 0) {
+         dup2(nNull, STDIN_FILENO);
+      }
+      if (nLog >= 0) {
+         dup2(nLog, STDOUT_FILENO);
+         dup2(nLog, STDERR_FILENO);
+      }
+      std::vector<char*> vecArgv;
+      for (size_t i = 0; i < vec_args.size(); ++i) {
+         vecArgv.push_back(const_cast<char*>(vec_args[i].c_str()));
+      }
+      vecArgv.push_back(NULL);
+      execvp(vecArgv[0], &vecArgv[0]);
+      fprintf(stderr, "Cannot run %s: %s\n", vecArgv[0], strerror(errno));
+      _exit(127);
+   }
+
+   /*
+    * Signal n_pid, give it STOP_GRACE_MS to exit, then kill it
+    * Returns its wait status
+    */
+   int Stop(pid_t n_pid, int n_signal) {
+      int nStatus = 0;
+      kill(n_pid, n_signal);
+      for (int nWaited = 0; nWaited < STOP_GRACE_MS; nWaited += POLL_MS) {
+         if (waitpid(n_pid, &nStatus, WNOHANG) == n_pid) {
+            return nStatus;
+         }
+         std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MS));
+      }
+      kill(n_pid, SIGKILL);
+      waitpid(n_pid, &nStatus, 0);
+      return nStatus;
+   }
+
+   std::string DescribeExit(int n_status) {
+      std::ostringstream cStatus;
+      if (WIFEXITED(n_status)) {
+         if (WEXITSTATUS(n_status) == 0) {
+            return "ok";
+         }
+         cStatus << "exit " << WEXITSTATUS(n_status);
+      }
+      else if (WIFSIGNALED(n_status)) {
+         cStatus << "signal " << WTERMSIG(n_status);
+      }
+      else {
+         cStatus << "unknown";
+      }
+      return cStatus.str();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   SMetrics ComputeMetrics(const std::vector<QSwarmEpisodeLog::SRecord>& vec_records) {
+      SMetrics sMetrics;
+      sMetrics.Episodes = vec_records.size();
+      if (vec_records.empty()) {
+         return sMetrics;
+      }
+      size_t unFinal = static_cast<size_t>(vec_records.size() * FINAL_FRACTION);
+      unFinal = std::max<size_t>(unFinal, 1);
+      size_t unFinalStart = vec_records.size() - unFinal;
+      for (size_t i = 0; i < vec_records.size(); ++i) {
+         const QSwarmEpisodeLog::SRecord& sRecord = vec_records[i];
+         sMetrics.GoalRate += (sRecord.Outcome == QSwarmEpisodeLog::OUTCOME_GOAL);
+         sMetrics.CollisionRate += (sRecord.Outcome == QSwarmEpisodeLog::OUTCOME_COLLISION);
+         sMetrics.TimeoutRate += (sRecord.Outcome == QSwarmEpisodeLog::OUTCOME_TIMEOUT);
+         sMetrics.MeanReward += sRecord.Reward;
+         sMetrics.MeanSteps += sRecord.Steps;
+         if (i >= unFinalStart) {
+            sMetrics.FinalReward += sRecord.Reward;
+         }
+      }
+      double fEpisodes = static_cast<double>(vec_records.size());
+      sMetrics.GoalRate /= fEpisodes;
+      sMetrics.CollisionRate /= fEpisodes;
+      sMetrics.TimeoutRate /= fEpisodes;
+      sMetrics.MeanReward /= fEpisodes;
+      sMetrics.MeanSteps /= fEpisodes;
+      sMetrics.FinalReward /= static_cast<double>(unFinal);
+      return sMetrics;
+   }
+
+   void WriteHeader(FILE* pc_file, const SOptions& s_options) {
+      fprintf(pc_file, "run");
+      for (size_t i = 0; i < s_options.Parameters.size(); ++i) {
+         fprintf(pc_file, ",%s", s_options.Parameters[i].GetName().c_str());
+      }
+      fprintf(pc_file, ",seed,status,seconds,episodes,goal_rate,collision_rate,"
+              "timeout_rate,mean_reward,final_reward,mean_steps\n");
+      fflush(pc_file);
+   }
+
+   void WriteRow(FILE* pc_file, const SRun& s_run) {
+      const SMetrics& sMetrics = s_run.Metrics;
+      fprintf(pc_file, "%zu", s_run.Index);
+      for (size_t i = 0; i < s_run.Values.size(); ++i) {
+         fprintf(pc_file, ",%s", s_run.Values[i].c_str());
+      }
+      fprintf(pc_file, ",%s,%s,%.1f,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f\n",
+              s_run.Seed.c_str(), s_run.Status.c_str(), s_run.Seconds, sMetrics.Episodes,
+              sMetrics.GoalRate, sMetrics.CollisionRate, sMetrics.TimeoutRate,
+              sMetrics.MeanReward, sMetrics.FinalReward, sMetrics.MeanSteps);
+      fflush(pc_file);
+   }
+
+   /* Mean over the seeds of every combination, in grid order */
+   void PrintTable(const SOptions& s_options, const std::vector<SRun>& vec_runs) {
+      std::vector<size_t> vecWidths;
+      for (size_t i = 0; i < s_options.Parameters.size(); ++i) {
+         size_t unWidth = s_options.Parameters[i].GetName().size();
+         for (size_t k = 0; k < s_options.Parameters[i].Values.size(); ++k) {
+            unWidth = std::max(unWidth, s_options.Parameters[i].Values[k].size());
+         }
+         vecWidths.push_back(unWidth);
+      }
+
+      printf("\n");
+      for (size_t i = 0; i < vecWidths.size(); ++i) {
+         printf("%-*s  ", static_cast<int>(vecWidths[i]), s_options.Parameters[i].GetName().c_str());
+      }
+      printf("%6s %9s %10s %10s %10s %12s %12s %10s\n",
+             "runs", "episodes", "goal", "collision", "timeout", "mean reward", "final reward", "steps");
+
+      size_t unSeeds = std::max<size_t>(s_options.Seeds.size(), 1);
+      for (size_t unFirst = 0; unFirst < vec_runs.size(); unFirst += unSeeds) {
+         SMetrics sMean;
+         size_t unRuns = 0;
+         for (size_t k = unFirst; k < unFirst + unSeeds && k < vec_runs.size(); ++k) {
+            const SRun& sRun = vec_runs[k];
+            if (!sRun.HasLog || sRun.Metrics.Episodes == 0) {
+               continue;
+            }
+            ++unRuns;
+            sMean.Episodes += sRun.Metrics.Episodes;
+            sMean.GoalRate += sRun.Metrics.GoalRate;
+            sMean.CollisionRate += sRun.Metrics.CollisionRate;
+            sMean.TimeoutRate += sRun.Metrics.TimeoutRate;
+            sMean.MeanReward += sRun.Metrics.MeanReward;
+            sMean.FinalReward += sRun.Metrics.FinalReward;
+            sMean.MeanSteps += sRun.Metrics.MeanSteps;
+         }
+         for (size_t i = 0; i < vecWidths.size(); ++i) {
+            printf("%-*s  ", static_cast<int>(vecWidths[i]), vec_runs[unFirst].Values[i].c_str());
+         }
+         if (unRuns == 0) {
+            printf("%6d %9s\n", 0, "-");
+            continue;
+         }
+         double fRuns = static_cast<double>(unRuns);
+         printf("%6zu %9zu %9.1f%% %9.1f%% %9.1f%% %12.2f %12.2f %10.1f\n",
+                unRuns, sMean.Episodes / unRuns,
+                100.0 * sMean.GoalRate / fRuns, 100.0 * sMean.CollisionRate / fRuns,
+                100.0 * sMean.TimeoutRate / fRuns, sMean.MeanReward / fRuns,
+                sMean.FinalReward / fRuns, sMean.MeanSteps / fRuns);
+      }
+   }
+
+}
+
+/****************************************/
+/****************************************/
+
+int main(int argc, char** argv) {
+   SOptions sOptions;
+   if (!ParseOptions(argc, argv, sOptions)) {
+      PrintUsage();
+      return 2;
+   }
+
+   std::ifstream cTemplate(sOptions.Template.c_str());
+   if (!cTemplate) {
+      fprintf(stderr, "Cannot read %s\n", sOptions.Template.c_str());
+      return 1;
+   }
+   std::ostringstream cTemplateText;
+   cTemplateText << cTemplate.rdbuf();
+   std::string strTemplate = cTemplateText.str();
+
+   // The grid: parameters in --set order, seeds innermost
+   std::vector<SRun> vecRuns;
+   std::vector<size_t> vecDigits(sOptions.Parameters.size(), 0);
+   std::vector<std::string> vecSeeds = sOptions.Seeds;
+   if (vecSeeds.empty()) {
+      vecSeeds.push_back("");
+   }
+   while (true) {
+      for (size_t s = 0; s < vecSeeds.size(); ++s) {
+         SRun sRun;
+         sRun.Index = vecRuns.size();
+         for (size_t i = 0; i < vecDigits.size(); ++i) {
+            sRun.Values.push_back(sOptions.Parameters[i].Values[vecDigits[i]]);
+         }
+         sRun.Seed = vecSeeds[s];
+         char pcDir[32];
+         snprintf(pcDir, sizeof(pcDir), "/run_%04zu", sRun.Index);
+         sRun.Dir = sOptions.Out + pcDir;
+         vecRuns.push_back(sRun);
+      }
+      size_t i = vecDigits.size();
+      while (i > 0 && ++vecDigits[i - 1] == sOptions.Parameters[i - 1].Values.size()) {
+         vecDigits[i - 1] = 0;
+         --i;
+      }
+      if (i == 0) {
+         break;
+      }
+   }
+
+   // Job slots and their cores
+   std::vector<int> vecAllowed = GetAllowedCpus();
+   std::vector<std::vector<int> > vecNodes = GetNodes(vecAllowed);
+   std::vector<int> vecOrdered;
+   for (size_t n = 0; n < vecNodes.size(); ++n) {
+      vecOrdered.insert(vecOrdered.end(), vecNodes[n].begin(), vecNodes[n].end());
+   }
+   size_t unJobs = sOptions.Jobs;
+   if (unJobs == 0) {
+      unJobs = std::max<size_t>(vecOrdered.size() / sOptions.CoresPerJob, 1);
+   }
+   unJobs = std::min(unJobs, vecRuns.size());
+   std::vector<SSlot> vecSlots(unJobs);
+   for (size_t i = 0; i < unJobs; ++i) {
+      if (sOptions.Pin == "core") {
+         for (size_t k = 0; k < sOptions.CoresPerJob; ++k) {
+            vecSlots[i].Cpus.push_back(vecOrdered[(i * sOptions.CoresPerJob + k) % vecOrdered.size()]);
+         }
+         std::vector<int>& vecCpus = vecSlots[i].Cpus;
+         std::sort(vecCpus.begin(), vecCpus.end());
+         vecCpus.erase(std::unique(vecCpus.begin(), vecCpus.end()), vecCpus.end());
+      }
+      else if (sOptions.Pin == "node") {
+         vecSlots[i].Cpus = vecNodes[i % vecNodes.size()];
+      }
+   }
+   if (unJobs * sOptions.CoresPerJob > vecOrdered.size() && sOptions.Pin == "core") {
+      fprintf(stderr, "Warning: %zu jobs of %zu cores on %zu cores, slots share cores\n",
+              unJobs, sOptions.CoresPerJob, vecOrdered.size());
+   }
+
+   // Every parameter must hit the template before anything starts
+   std::string strConfig;
+   std::string strError;
+   if (!MakeConfig(strTemplate, sOptions, vecRuns[0], 0, strConfig, strError)) {
+      fprintf(stderr, "%s: %s\n", sOptions.Template.c_str(), strError.c_str());
+      return 1;
+   }
+   if (!MakeDirs(sOptions.Out)) {
+      fprintf(stderr, "Cannot create %s: %s\n", sOptions.Out.c_str(), strerror(errno));
+      return 1;
+   }
+
+   printf("%zu runs, %zu jobs, %zu cores in %zu NUMA node(s), pinning: %s\n",
+          vecRuns.size(), unJobs, vecOrdered.size(), vecNodes.size(), sOptions.Pin.c_str());
+   for (size_t i = 0; i < unJobs; ++i) {
+      printf("   slot %zu: cores %s", i, FormatCpus(vecSlots[i].Cpus).c_str());
+      if (sOptions.Server != "none") {
+         if (sOptions.Shm) {
+            printf(", shm %s", GetShmName(i).c_str());
+         }
+         printf(", port %d", sOptions.BasePort + static_cast<int>(i));
+      }
+      printf("\n");
+   }
+
+   if (sOptions.DryRun) {
+      for (size_t r = 0; r < vecRuns.size(); ++r) {
+         SRun& sRun = vecRuns[r];
+         size_t unSlot = r % unJobs;
+         if (!MakeDirs(sRun.Dir) ||
+             !MakeConfig(strTemplate, sOptions, sRun, unSlot, strConfig, strError)) {
+            fprintf(stderr, "%s: cannot prepare\n", sRun.Dir.c_str());
+            return 1;
+         }
+         std::ofstream(std::string(sRun.Dir + "/experiment.argos").c_str()) << strConfig;
+         std::vector<std::string> vecArgs = MakeArgosCommand(sOptions, sRun);
+         printf("run %zu (slot %zu):", sRun.Index, unSlot);
+         for (size_t i = 0; i < vecArgs.size(); ++i) {
+            printf(" %s", vecArgs[i].c_str());
+         }
+         if (sOptions.Server != "none") {
+            printf("\n   server: %s", MakeServerCommand(sOptions, sRun, unSlot).c_str());
+         }
+         printf("\n");
+      }
+      return 0;
+   }
+
+   std::string strResults = sOptions.Out + "/results.csv";
+   FILE* pcResults = fopen(strResults.c_str(), "w");
+   if (pcResults == NULL) {
+      fprintf(stderr, "Cannot create %s: %s\n", strResults.c_str(), strerror(errno));
+      return 1;
+   }
+   WriteHeader(pcResults, sOptions);
+
+   struct sigaction sAction;
+   memset(&sAction, 0, sizeof(sAction));
+   sAction.sa_handler = OnInterrupt;
+   sigaction(SIGINT, &sAction, NULL);
+   sigaction(SIGTERM, &sAction, NULL);
+
+   // Work queue: fill free slots, reap finished runs
+   size_t unNext = 0;
+   size_t unDone = 0;
+   size_t unFailed = 0;
+   std::chrono::steady_clock::time_point cSweepStart = std::chrono::steady_clock::now();
+   while (unDone < vecRuns.size()) {
+      for (size_t i = 0; i < unJobs && unNext < vecRuns.size() && !g_bInterrupted; ++i) {
+         SSlot& sSlot = vecSlots[i];
+         if (sSlot.Busy) {
+            continue;
+         }
+         SRun& sRun = vecRuns[unNext++];
+         sSlot.Busy = true;
+         sSlot.Run = sRun.Index;
+         sSlot.Start = std::chrono::steady_clock::now();
+         sSlot.Server = -1;
+         sSlot.Argos = -1;
+         if (!MakeDirs(sRun.Dir) ||
+             !MakeConfig(strTemplate, sOptions, sRun, i, strConfig, strError) ||
+             !(std::ofstream(std::string(sRun.Dir + "/experiment.argos").c_str()) << strConfig)) {
+            sRun.Status = "config failed";
+            continue;
+         }
+         // The controllers reconnect until the server listens
+         if (sOptions.Server != "none") {
+            std::vector<std::string> vecShell;
+            vecShell.push_back("/bin/sh");
+            vecShell.push_back("-c");
+            vecShell.push_back("exec " + MakeServerCommand(sOptions, sRun, i));
+            sSlot.Server = Spawn(vecShell, sSlot.Cpus, sRun.Dir + "/server.log");
+         }
+         sSlot.Argos = Spawn(MakeArgosCommand(sOptions, sRun), sSlot.Cpus, sRun.Dir + "/argos.log");
+         if (sSlot.Argos < 0) {
+            sRun.Status = "spawn failed";
+         }
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MS));
+
+      for (size_t i = 0; i < unJobs; ++i) {
+         SSlot& sSlot = vecSlots[i];
+         if (!sSlot.Busy) {
+            continue;
+         }
+         SRun& sRun = vecRuns[sSlot.Run];
+         double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sSlot.Start).count();
+         int nStatus = 0;
+         bool bEnded = sSlot.Argos < 0;
+         if (!bEnded && waitpid(sSlot.Argos, &nStatus, WNOHANG) == sSlot.Argos) {
+            sRun.Status = DescribeExit(nStatus);
+            bEnded = true;
+         }
+         else if (!bEnded && sSlot.Server > 0 && waitpid(sSlot.Server, &nStatus, WNOHANG) == sSlot.Server) {
+            sSlot.Server = -1;
+            Stop(sSlot.Argos, SIGTERM);
+            sRun.Status = "server " + DescribeExit(nStatus);
+            bEnded = true;
+         }
+         else if (!bEnded && sOptions.Timeout > 0.0 && fSeconds > sOptions.Timeout) {
+            Stop(sSlot.Argos, SIGTERM);
+            sRun.Status = "timeout";
+            bEnded = true;
+         }
+         else if (!bEnded && g_bInterrupted) {
+            Stop(sSlot.Argos, SIGTERM);
+            sRun.Status = "interrupted";
+            bEnded = true;
+         }
+         if (!bEnded) {
+            continue;
+         }
+
+         // SIGINT lets the server save its models
+         if (sSlot.Server > 0) {
+            Stop(sSlot.Server, SIGINT);
+         }
+         sSlot.Busy = false;
+         sRun.Seconds = fSeconds;
+         std::vector<QSwarmEpisodeLog::SRecord> vecRecords;
+         if (CQSwarmEpisodeLog::Read(sRun.Dir + "/episodes.qse", vecRecords, strError)) {
+            sRun.Metrics = ComputeMetrics(vecRecords);
+            sRun.HasLog = true;
+         }
+         else if (sRun.Status == "ok") {
+            // A clean exit without results is a failed run, not a zero-goal one
+            sRun.Status = "no log: " + strError;
+         }
+         unFailed += (sRun.Status != "ok");
+         ++unDone;
+         WriteRow(pcResults, sRun);
+         printf("[%zu/%zu] run %zu: %s, %.1f s, %zu episodes, goal %.1f%%\n",
+                unDone, vecRuns.size(), sRun.Index, sRun.Status.c_str(), sRun.Seconds,
+                sRun.Metrics.Episodes, 100.0 * sRun.Metrics.GoalRate);
+         fflush(stdout);
+      }
+
+      // Runs never started count as done once the running ones are stopped
+      if (g_bInterrupted && unNext < vecRuns.size()) {
+         bool bIdle = true;
+         for (size_t i = 0; i < unJobs; ++i) {
+            bIdle = bIdle && !vecSlots[i].Busy;
+         }
+         if (bIdle) {
+            break;
+         }
+      }
+   }
+   fclose(pcResults);
+
+   PrintTable(sOptions, vecRuns);
+   double fSweep = std::chrono::duration<double>(std::chrono::steady_clock::now() - cSweepStart).count();
+   printf("\n%zu of %zu runs done in %.1f s, %zu failed: %s\n",
+          unDone, vecRuns.size(), fSweep, unFailed, strResults.c_str());
+   return g_bInterrupted ? 130 : (unFailed > 0 ? 1 : 0);
+}
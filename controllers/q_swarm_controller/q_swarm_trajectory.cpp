@@ -0,0 +1,262 @@
+/*
+ * Q-Swarm Trajectory Log Implementation
+ */
+
+#include "q_swarm_trajectory.h"
+
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+#ifndef _WIN32
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+#endif
+
+namespace argos {
+
+   static_assert(sizeof(QSwarmTrajectory::SHeader) == QSwarmTrajectory::HEADER_SIZE,
+                 "trajectory header layout");
+   static_assert(QSwarmTrajectory::RECORD_SIZE == 20 + 4 * QSwarmProtocol::STATE_SIZE,
+                 "trajectory records must not be padded");
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmTrajectoryWriter& CQSwarmTrajectoryWriter::GetInstance() {
+      static CQSwarmTrajectoryWriter cInstance;
+      return cInstance;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmTrajectoryWriter::CQSwarmTrajectoryWriter() :
+      m_pFile(NULL),
+      m_unUsers(0),
+      m_unRecords(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmTrajectoryWriter::~CQSwarmTrajectoryWriter() {
+      if (m_pFile != NULL) {
+         WriteBuffer();
+         fclose(m_pFile);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmTrajectoryWriter::Register(const std::string& str_path, std::string& str_error) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      if (m_pFile != NULL) {
+         if (str_path != m_strPath) {
+            str_error = "already recording to " + m_strPath;
+            return false;
+         }
+         ++m_unUsers;
+         return true;
+      }
+
+      m_pFile = fopen(str_path.c_str(), "wb");
+      if (m_pFile == NULL) {
+         str_error = "cannot create " + str_path;
+         return false;
+      }
+      // Records are buffered here; stdio would allocate its own buffer later
+      setvbuf(m_pFile, NULL, _IONBF, 0);
+
+      QSwarmTrajectory::SHeader sHeader;
+      memset(&sHeader, 0, sizeof(sHeader));
+      sHeader.Magic = QSwarmTrajectory::MAGIC;
+      sHeader.Version = QSwarmTrajectory::VERSION;
+      sHeader.StateSize = QSwarmProtocol::STATE_SIZE;
+      sHeader.RecordSize = QSwarmTrajectory::RECORD_SIZE;
+      if (fwrite(&sHeader, sizeof(sHeader), 1, m_pFile) != 1) {
+         str_error = "cannot write " + str_path;
+         fclose(m_pFile);
+         m_pFile = NULL;
+         return false;
+      }
+
+      m_strPath = str_path;
+      m_unUsers = 1;
+      m_unRecords = 0;
+      m_vecBuffer.clear();
+      m_vecBuffer.reserve(QSwarmTrajectory::BUFFER_RECORDS);
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmTrajectoryWriter::Unregister() {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      if (m_unUsers == 0 || --m_unUsers > 0) {
+         return;
+      }
+      WriteBuffer();
+      fclose(m_pFile);
+      m_pFile = NULL;
+      m_strPath.clear();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmTrajectoryWriter::Append(const QSwarmTrajectory::SRecord& s_record) {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      if (m_pFile == NULL) {
+         return;
+      }
+      m_vecBuffer.push_back(s_record);
+      ++m_unRecords;
+      if (m_vecBuffer.size() == QSwarmTrajectory::BUFFER_RECORDS) {
+         WriteBuffer();
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmTrajectoryWriter::Flush() {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      WriteBuffer();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   uint64_t CQSwarmTrajectoryWriter::GetRecordCount() {
+      std::lock_guard<std::mutex> cLock(m_cMutex);
+      return m_unRecords;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmTrajectoryWriter::WriteBuffer() {
+      if (m_pFile == NULL || m_vecBuffer.empty()) {
+         return;
+      }
+      // A short write (disk full) loses the block; the log stays readable
+      fwrite(&m_vecBuffer[0], QSwarmTrajectory::RECORD_SIZE, m_vecBuffer.size(), m_pFile);
+      m_vecBuffer.clear();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmTrajectoryReader::CQSwarmTrajectoryReader() :
+      m_pMapping(NULL),
+      m_unMappingSize(0),
+      m_psRecords(NULL),
+      m_unRecords(0) {
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmTrajectoryReader::~CQSwarmTrajectoryReader() {
+      Close();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool CQSwarmTrajectoryReader::Open(const std::string& str_path, std::string& str_error) {
+      Close();
+
+      const uint8_t* data = NULL;
+      size_t unSize = 0;
+#ifndef _WIN32
+      int nFd = open(str_path.c_str(), O_RDONLY);
+      if (nFd < 0) {
+         str_error = "cannot open " + str_path;
+         return false;
+      }
+      struct stat sStat;
+      if (fstat(nFd, &sStat) != 0 || sStat.st_size < static_cast<off_t>(QSwarmTrajectory::HEADER_SIZE)) {
+         close(nFd);
+         str_error = "not a trajectory log";
+         return false;
+      }
+      unSize = sStat.st_size;
+      void* pMapping = mmap(NULL, unSize, PROT_READ, MAP_PRIVATE, nFd, 0);
+      close(nFd);
+      if (pMapping == MAP_FAILED) {
+         str_error = "cannot map " + str_path;
+         return false;
+      }
+      m_pMapping = pMapping;
+      m_unMappingSize = unSize;
+      data = static_cast<const uint8_t*>(pMapping);
+#else
+      // No mmap: read the records into a private copy
+      std::ifstream cFile(str_path.c_str(), std::ios::binary);
+      if (!cFile) {
+         str_error = "cannot open " + str_path;
+         return false;
+      }
+      std::vector<uint8_t> vecData((std::istreambuf_iterator<char>(cFile)),
+                                   std::istreambuf_iterator<char>());
+      if (vecData.size() < QSwarmTrajectory::HEADER_SIZE) {
+         str_error = "not a trajectory log";
+         return false;
+      }
+      unSize = vecData.size();
+      size_t unRecords = (unSize - QSwarmTrajectory::HEADER_SIZE) / QSwarmTrajectory::RECORD_SIZE;
+      m_vecOwned.resize(unRecords);
+      if (unRecords > 0) {
+         memcpy(&m_vecOwned[0], &vecData[QSwarmTrajectory::HEADER_SIZE],
+                unRecords * QSwarmTrajectory::RECORD_SIZE);
+      }
+      data = &vecData[0];
+#endif
+
+      QSwarmTrajectory::SHeader sHeader;
+      memcpy(&sHeader, data, sizeof(sHeader));
+      if (sHeader.Magic != QSwarmTrajectory::MAGIC || sHeader.Version != QSwarmTrajectory::VERSION) {
+         str_error = "not a trajectory log";
+         Close();
+         return false;
+      }
+      if (sHeader.StateSize != QSwarmProtocol::STATE_SIZE ||
+          sHeader.RecordSize != QSwarmTrajectory::RECORD_SIZE) {
+         str_error = "trajectory log of another state layout";
+         Close();
+         return false;
+      }
+
+      // A partly written last record is left out
+      m_unRecords = (unSize - QSwarmTrajectory::HEADER_SIZE) / QSwarmTrajectory::RECORD_SIZE;
+#ifndef _WIN32
+      m_psRecords = reinterpret_cast<const QSwarmTrajectory::SRecord*>(data + QSwarmTrajectory::HEADER_SIZE);
+#else
+      m_psRecords = m_vecOwned.empty() ? NULL : &m_vecOwned[0];
+#endif
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void CQSwarmTrajectoryReader::Close() {
+#ifndef _WIN32
+      if (m_pMapping != NULL) {
+         munmap(m_pMapping, m_unMappingSize);
+      }
+#endif
+      m_pMapping = NULL;
+      m_unMappingSize = 0;
+      m_vecOwned.clear();
+      m_psRecords = NULL;
+      m_unRecords = 0;
+   }
+
+}
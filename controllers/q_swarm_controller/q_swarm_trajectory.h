@@ -0,0 +1,167 @@
+#ifndef Q_SWARM_TRAJECTORY_H
+#define Q_SWARM_TRAJECTORY_H
+
+/*
+ * Q-Swarm Trajectory Log
+ *
+ * Recorded inputs for reproducible benchmarks: with record_file set, every
+ * controller appends one fixed-size record per step (state, action taken,
+ * reward and episode end) to a binary log shared by all robots of the
+ * ARGoS process. q_swarm_trajectory_bench replays a log against the
+ * transports and the native policy.
+ *
+ * File layout (host byte order, little-endian on all supported targets):
+ *    SHeader                64 bytes ("QSTR", version, state size, record size)
+ *    SRecord[...]           RECORD_SIZE bytes each, in the order the steps ran
+ *
+ * The log is append-only and has no trailer, so a run that crashed leaves
+ * a valid log (a partly written last record is ignored). Records are
+ * 4-byte aligned in the file and CQSwarmTrajectoryReader maps the file
+ * and reads them in place.
+ *
+ * The writer buffers records and writes them in blocks of BUFFER_RECORDS
+ * (under a mutex, controllers may step in several threads); its buffer is
+ * allocated when the log is opened, so appending does not allocate.
+ *
+ * This header does not depend on ARGoS so it can be reused by tools.
+ */
+
+#include "q_swarm_protocol.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace argos {
+
+   namespace QSwarmTrajectory {
+
+      const uint32_t MAGIC = 0x52545351;  /* "QSTR" little-endian */
+      const uint32_t VERSION = 1;
+      const size_t HEADER_SIZE = 64;
+
+      /* SRecord::Flags */
+      const uint8_t RECORD_DONE = 0x01;     /* goal or collision: terminal transition */
+      const uint8_t RECORD_TIMEOUT = 0x02;  /* max_steps reached: episode cut, not terminal */
+
+      struct SHeader {
+         uint32_t Magic;
+         uint32_t Version;
+         uint32_t StateSize;
+         uint32_t RecordSize;
+         uint8_t Reserved[HEADER_SIZE - 4 * sizeof(uint32_t)];
+      };
+
+      struct SRecord {
+         uint32_t RobotId;
+         uint32_t Episode;
+         uint32_t Step;                    /* step in the episode, from 1 */
+         uint8_t Action;
+         uint8_t Flags;                    /* RECORD_* */
+         uint8_t Reserved[2];
+         float Reward;
+         float State[QSwarmProtocol::STATE_SIZE];
+      };
+
+      const size_t RECORD_SIZE = sizeof(SRecord);
+
+      /* Records written per block */
+      const size_t BUFFER_RECORDS = 4096;
+
+   }
+
+   /*
+    * Process-wide writer of the trajectory log
+    */
+   class CQSwarmTrajectoryWriter {
+
+   public:
+
+      static CQSwarmTrajectoryWriter& GetInstance();
+
+      /*
+       * Add a robot; the first one creates str_path (a previous file is
+       * replaced). Returns false if the file cannot be created, or if
+       * another log is already open (the robot is then not recording)
+       */
+      bool Register(const std::string& str_path, std::string& str_error);
+
+      /*
+       * Remove a robot; the last one writes the buffered records and
+       * closes the file
+       */
+      void Unregister();
+
+      /* Add one record (written with the next full block) */
+      void Append(const QSwarmTrajectory::SRecord& s_record);
+
+      /* Write the buffered records */
+      void Flush();
+
+      uint64_t GetRecordCount();
+
+   private:
+
+      CQSwarmTrajectoryWriter();
+
+      ~CQSwarmTrajectoryWriter();
+
+      /* Write the buffer (m_cMutex held) */
+      void WriteBuffer();
+
+      std::mutex m_cMutex;
+      FILE* m_pFile;
+      std::string m_strPath;
+      size_t m_unUsers;
+      uint64_t m_unRecords;
+      std::vector<QSwarmTrajectory::SRecord> m_vecBuffer;
+
+   };
+
+   /*
+    * Read-only view of a trajectory log (mapped where mmap is available)
+    */
+   class CQSwarmTrajectoryReader {
+
+   public:
+
+      CQSwarmTrajectoryReader();
+
+      ~CQSwarmTrajectoryReader();
+
+      /*
+       * Map str_path and check its header
+       * Returns false if it is not a trajectory log of this build's state size
+       */
+      bool Open(const std::string& str_path, std::string& str_error);
+
+      void Close();
+
+      /* Complete records in the file */
+      size_t GetSize() const {
+         return m_unRecords;
+      }
+
+      const QSwarmTrajectory::SRecord& Get(size_t un_index) const {
+         return m_psRecords[un_index];
+      }
+
+   private:
+
+      CQSwarmTrajectoryReader(const CQSwarmTrajectoryReader&);
+      CQSwarmTrajectoryReader& operator=(const CQSwarmTrajectoryReader&);
+
+      void* m_pMapping;
+      size_t m_unMappingSize;
+      std::vector<QSwarmTrajectory::SRecord> m_vecOwned;
+      const QSwarmTrajectory::SRecord* m_psRecords;
+      size_t m_unRecords;
+
+   };
+
+}
+
+#endif
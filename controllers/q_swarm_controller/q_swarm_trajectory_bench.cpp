@@ -0,0 +1,391 @@
+/*
+ * Q-Swarm Trajectory Benchmark
+ *
+ * Replays a trajectory log (record_file on the controllers, see
+ * q_swarm_trajectory.h) against the ways a controller obtains its actions
+ * and reports throughput and tail latency for each:
+ *    text     TCP, text STEP messages
+ *    binary   TCP, binary STEP frames
+ *    compact  TCP, binary COMPACT_STEP frames (compact_state="true")
+ *    shm      shared memory slots (server started with --shm NAME)
+ *    native   in-process forward pass of an exported policy file
+ *
+ * Usage:
+ *    q_swarm_trajectory_bench LOG [--modes text,binary,compact,shm,native]
+ *       [--host 127.0.0.1] [--port 5555] [--shm-name /q_swarm]
+ *       [--policy models/q_network_latest.bin] [--limit N] [--csv FILE]
+ *
+ * Every record becomes one request with the recorded state. The reward of
+ * the robot's previous record travels with it (combined step), so the
+ * server sees the transitions of the recorded run. Each robot gets its own
+ * transport, as in the simulation, and requests go one at a time in log
+ * order: the latency is one round trip and the throughput the sequential
+ * request rate of one simulator thread. Connection setup is not timed.
+ *
+ * Native mode also counts the actions that match the recorded ones (all
+ * of them when the log was recorded with the same policy file and
+ * inference="native").
+ *
+ * --csv appends one row per mode:
+ *    mode,requests,failed,seconds,requests_per_s,p50_us,p99_us,p999_us,max_us,matching_actions
+ */
+
+#include "q_swarm_trajectory.h"
+#include "q_swarm_latency.h"
+#include "q_swarm_policy.h"
+#include "q_swarm_socket_transport.h"
+#include "q_swarm_shm_transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace argos;
+
+namespace {
+
+   struct SOptions {
+      std::string Log;
+      std::vector<std::string> Modes;
+      std::string Host;
+      int Port;
+      std::string ShmName;
+      std::string Policy;
+      size_t Limit;
+      std::string Csv;
+
+      SOptions() :
+         Host("127.0.0.1"),
+         Port(5555),
+         ShmName("/q_swarm"),
+         Policy("models/q_network_latest.bin"),
+         Limit(0) {
+      }
+   };
+
+   struct SResult {
+      std::string Mode;
+      bool Available;
+      std::string Error;
+      size_t Requests;
+      size_t Failed;
+      size_t Matches;
+      uint64_t Nanoseconds;
+      CQSwarmLatencyHistogram Latency;
+
+      SResult() : Available(false), Requests(0), Failed(0), Matches(0), Nanoseconds(0) {}
+   };
+
+   /* Transport of one replayed robot, and its previous record */
+   struct SRobot {
+      std::unique_ptr<CQSwarmTransport> Transport;
+      bool HasPrev;
+      float PrevReward;
+      bool PrevDone;
+
+      SRobot() : HasPrev(false), PrevReward(0.0f), PrevDone(false) {}
+   };
+
+   /* How long a transport may take to connect */
+   const int CONNECT_TIMEOUT_MS = 5000;
+
+   /****************************************/
+   /****************************************/
+
+   void PrintUsage() {
+      fprintf(stderr,
+              "Usage: q_swarm_trajectory_bench LOG [--modes text,binary,compact,shm,native]\n"
+              "          [--host 127.0.0.1] [--port 5555] [--shm-name /q_swarm]\n"
+              "          [--policy models/q_network_latest.bin] [--limit N] [--csv FILE]\n");
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool ParseOptions(int argc, char** argv, SOptions& s_options) {
+      std::string strModes = "text,binary,compact,shm,native";
+      for (int i = 1; i < argc; ++i) {
+         std::string strArg = argv[i];
+         bool bValue = (i + 1 < argc);
+         if (strArg == "--modes" && bValue) {
+            strModes = argv[++i];
+         }
+         else if (strArg == "--host" && bValue) {
+            s_options.Host = argv[++i];
+         }
+         else if (strArg == "--port" && bValue) {
+            s_options.Port = atoi(argv[++i]);
+         }
+         else if (strArg == "--shm-name" && bValue) {
+            s_options.ShmName = argv[++i];
+         }
+         else if (strArg == "--policy" && bValue) {
+            s_options.Policy = argv[++i];
+         }
+         else if (strArg == "--limit" && bValue) {
+            s_options.Limit = strtoul(argv[++i], NULL, 10);
+         }
+         else if (strArg == "--csv" && bValue) {
+            s_options.Csv = argv[++i];
+         }
+         else if (!strArg.empty() && strArg[0] != '-' && s_options.Log.empty()) {
+            s_options.Log = strArg;
+         }
+         else {
+            return false;
+         }
+      }
+
+      std::istringstream cModes(strModes);
+      std::string strMode;
+      while (std::getline(cModes, strMode, ',')) {
+         if (strMode != "text" && strMode != "binary" && strMode != "compact" &&
+             strMode != "shm" && strMode != "native") {
+            fprintf(stderr, "Unknown mode '%s'\n", strMode.c_str());
+            return false;
+         }
+         s_options.Modes.push_back(strMode);
+      }
+      return !s_options.Log.empty() && !s_options.Modes.empty();
+   }
+
+   /****************************************/
+   /****************************************/
+
+   CQSwarmTransport* MakeTransport(const std::string& str_mode,
+                                   uint32_t un_robot,
+                                   const SOptions& s_options) {
+      if (str_mode == "shm") {
+         return new CQSwarmShmTransport(s_options.ShmName, un_robot);
+      }
+      return new CQSwarmSocketTransport(s_options.Host, s_options.Port, str_mode != "text", true,
+                                        str_mode == "compact");
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool WaitConnected(CQSwarmTransport& c_transport) {
+      if (!c_transport.Connect()) {
+         return false;
+      }
+      std::chrono::steady_clock::time_point cDeadline =
+         std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+      while (!c_transport.Maintain()) {
+         if (!c_transport.GetFatalError().empty() || std::chrono::steady_clock::now() > cDeadline) {
+            return false;
+         }
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void RunTransport(const CQSwarmTrajectoryReader& c_log,
+                     size_t un_records,
+                     const SOptions& s_options,
+                     SResult& s_result) {
+      std::map<uint32_t, SRobot> mapRobots;
+      for (size_t i = 0; i < un_records; ++i) {
+         const QSwarmTrajectory::SRecord& sRecord = c_log.Get(i);
+         SRobot& sRobot = mapRobots[sRecord.RobotId];
+         if (!sRobot.Transport) {
+            sRobot.Transport.reset(MakeTransport(s_result.Mode, sRecord.RobotId, s_options));
+            if (!WaitConnected(*sRobot.Transport)) {
+               std::ostringstream cError;
+               cError << "no server for robot " << sRecord.RobotId;
+               if (!sRobot.Transport->GetFatalError().empty()) {
+                  cError << " (" << sRobot.Transport->GetFatalError() << ")";
+               }
+               s_result.Error = cError.str();
+               return;
+            }
+         }
+
+         uint8_t flags = 0;
+         if (sRobot.HasPrev) {
+            flags |= QSwarmProtocol::STEP_HAS_PREV;
+            if (sRobot.PrevDone) {
+               flags |= QSwarmProtocol::STEP_PREV_DONE;
+            }
+         }
+
+         int action = 0;
+         uint64_t unStart = CQSwarmLatencyStats::Now();
+         bool bOk = sRobot.Transport->RequestAction(sRecord.RobotId, sRecord.State,
+                                                    sRobot.PrevReward, flags, action);
+         uint64_t unTime = CQSwarmLatencyStats::Now() - unStart;
+         if (!bOk) {
+            // A dropped connection reconnects like in the simulation
+            ++s_result.Failed;
+            if (!WaitConnected(*sRobot.Transport)) {
+               s_result.Error = "connection lost";
+               return;
+            }
+            continue;
+         }
+         ++s_result.Requests;
+         s_result.Nanoseconds += unTime;
+         s_result.Latency.Record(unTime);
+         if (action == sRecord.Action) {
+            ++s_result.Matches;
+         }
+
+         sRobot.HasPrev = true;
+         sRobot.PrevReward = sRecord.Reward;
+         sRobot.PrevDone = (sRecord.Flags & QSwarmTrajectory::RECORD_DONE) != 0;
+      }
+
+      for (std::map<uint32_t, SRobot>::iterator it = mapRobots.begin(); it != mapRobots.end(); ++it) {
+         it->second.Transport->Close();
+      }
+      s_result.Available = true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void RunNative(const CQSwarmTrajectoryReader& c_log,
+                  size_t un_records,
+                  const SOptions& s_options,
+                  SResult& s_result) {
+      CQSwarmPolicy cPolicy;
+      if (!cPolicy.Load(s_options.Policy, s_result.Error)) {
+         return;
+      }
+      if (cPolicy.GetInputSize() != QSwarmProtocol::STATE_SIZE) {
+         s_result.Error = "policy input size does not match the state";
+         return;
+      }
+      s_result.Mode += " (" + std::string(cPolicy.GetKernelName()) + ")";
+
+      for (size_t i = 0; i < un_records; ++i) {
+         const QSwarmTrajectory::SRecord& sRecord = c_log.Get(i);
+         uint64_t unStart = CQSwarmLatencyStats::Now();
+         int action = cPolicy.SelectAction(sRecord.State);
+         uint64_t unTime = CQSwarmLatencyStats::Now() - unStart;
+         ++s_result.Requests;
+         s_result.Nanoseconds += unTime;
+         s_result.Latency.Record(unTime);
+         if (action == sRecord.Action) {
+            ++s_result.Matches;
+         }
+      }
+      s_result.Available = true;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   double Microseconds(uint64_t un_ns) {
+      return static_cast<double>(un_ns) / 1000.0;
+   }
+
+   double RequestsPerSecond(const SResult& s_result) {
+      return s_result.Nanoseconds > 0 ? s_result.Requests * 1e9 / s_result.Nanoseconds : 0.0;
+   }
+
+   /****************************************/
+   /****************************************/
+
+   void PrintResult(const SResult& s_result) {
+      if (!s_result.Available) {
+         printf("%-16s unavailable: %s\n", s_result.Mode.c_str(), s_result.Error.c_str());
+         return;
+      }
+      const CQSwarmLatencyHistogram& cLatency = s_result.Latency;
+      printf("%-16s %10zu %12.0f %10.2f %10.2f %10.2f %10.2f %8.1f%%\n",
+             s_result.Mode.c_str(), s_result.Requests, RequestsPerSecond(s_result),
+             Microseconds(cLatency.GetPercentile(0.5)), Microseconds(cLatency.GetPercentile(0.99)),
+             Microseconds(cLatency.GetPercentile(0.999)), Microseconds(cLatency.GetMax()),
+             s_result.Requests > 0 ? 100.0 * s_result.Matches / s_result.Requests : 0.0);
+      if (s_result.Failed > 0) {
+         printf("%-16s %zu failed requests\n", "", s_result.Failed);
+      }
+   }
+
+   /****************************************/
+   /****************************************/
+
+   bool WriteCsv(const std::string& str_path, const std::vector<SResult>& vec_results) {
+      std::ifstream cExisting(str_path.c_str());
+      bool bHeader = !cExisting.good() || cExisting.peek() == std::ifstream::traits_type::eof();
+      cExisting.close();
+
+      std::ofstream cFile(str_path.c_str(), std::ios::app);
+      if (!cFile) {
+         return false;
+      }
+      if (bHeader) {
+         cFile << "mode,requests,failed,seconds,requests_per_s,p50_us,p99_us,p999_us,max_us,matching_actions\n";
+      }
+      for (size_t i = 0; i < vec_results.size(); ++i) {
+         const SResult& sResult = vec_results[i];
+         if (!sResult.Available) {
+            continue;
+         }
+         const CQSwarmLatencyHistogram& cLatency = sResult.Latency;
+         cFile << sResult.Mode << "," << sResult.Requests << "," << sResult.Failed << ","
+               << sResult.Nanoseconds / 1e9 << "," << RequestsPerSecond(sResult) << ","
+               << Microseconds(cLatency.GetPercentile(0.5)) << ","
+               << Microseconds(cLatency.GetPercentile(0.99)) << ","
+               << Microseconds(cLatency.GetPercentile(0.999)) << ","
+               << Microseconds(cLatency.GetMax()) << "," << sResult.Matches << "\n";
+      }
+      return static_cast<bool>(cFile);
+   }
+
+}
+
+/****************************************/
+/****************************************/
+
+int main(int argc, char** argv) {
+   SOptions sOptions;
+   if (!ParseOptions(argc, argv, sOptions)) {
+      PrintUsage();
+      return 2;
+   }
+
+   CQSwarmTrajectoryReader cLog;
+   std::string strError;
+   if (!cLog.Open(sOptions.Log, strError)) {
+      fprintf(stderr, "Cannot read %s: %s\n", sOptions.Log.c_str(), strError.c_str());
+      return 1;
+   }
+   size_t unRecords = cLog.GetSize();
+   if (sOptions.Limit > 0 && sOptions.Limit < unRecords) {
+      unRecords = sOptions.Limit;
+   }
+   printf("%s: %zu records\n\n", sOptions.Log.c_str(), unRecords);
+   printf("%-16s %10s %12s %10s %10s %10s %10s %9s\n",
+          "mode", "requests", "requests/s", "p50 us", "p99 us", "p99.9 us", "max us", "matching");
+
+   std::vector<SResult> vecResults(sOptions.Modes.size());
+   for (size_t i = 0; i < sOptions.Modes.size(); ++i) {
+      SResult& sResult = vecResults[i];
+      sResult.Mode = sOptions.Modes[i];
+      if (sResult.Mode == "native") {
+         RunNative(cLog, unRecords, sOptions, sResult);
+      }
+      else {
+         RunTransport(cLog, unRecords, sOptions, sResult);
+      }
+      PrintResult(sResult);
+   }
+
+   if (!sOptions.Csv.empty() && !WriteCsv(sOptions.Csv, vecResults)) {
+      fprintf(stderr, "Cannot write %s\n", sOptions.Csv.c_str());
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef Q_SWARM_TRANSPORT_H
+#define Q_SWARM_TRANSPORT_H
+
+/*
+ * Q-Swarm Transport Interface
+ *
+ * How a controller exchanges states, rewards and actions with the
+ * Q-Network server. Implementations:
+ *    CQSwarmSocketTransport  TCP, text or binary frames
+ *    CQSwarmShmTransport     POSIX shared memory slots
+ */
+
+#include <stdint.h>
+#include <string>
+
+#include "q_swarm_latency.h"
+
+namespace argos {
+
+   class CQSwarmTransport {
+
+   public:
+
+      CQSwarmTransport() :
+         m_pcLatency(NULL) {
+      }
+
+      virtual ~CQSwarmTransport() {}
+
+      /*
+       * Start connecting to the server without waiting for it
+       * (Maintain() finishes the connection and reconnects after a failure)
+       * Returns false only if the server address is invalid
+       */
+      virtual bool Connect() = 0;
+
+      /*
+       * Advance the connection in the background: check a connection in
+       * progress, or start a new attempt once the backoff delay expired
+       * Never blocks. Returns true while the connection is usable
+       */
+      virtual bool Maintain() {
+         return IsConnected();
+      }
+
+      /*
+       * Returns true while the connection is usable
+       */
+      virtual bool IsConnected() const = 0;
+
+      /*
+       * Send the state of the current tick and wait for the action
+       * state points to QSwarmProtocol::STATE_SIZE floats
+       * prev_reward/flags carry the previous tick's reward (STEP_* flags)
+       * when the transport runs in combined step mode
+       * Returns false if no action could be obtained
+       */
+      virtual bool RequestAction(uint32_t robot_id,
+                                 const float* state,
+                                 float prev_reward,
+                                 uint8_t flags,
+                                 int& action) = 0;
+
+      /*
+       * Send a reward as a separate message (split step mode only)
+       */
+      virtual bool SendReward(uint32_t robot_id,
+                              float reward,
+                              bool done) = 0;
+
+      /*
+       * Pipelined mode: requests are sent without waiting for the answer
+       * and the actions are collected later with PollActions(), so the
+       * simulator thread never waits for the server
+       * Returns true if the transport supports it
+       */
+      virtual bool SupportsPipelining() const {
+         return false;
+      }
+
+      /*
+       * Send the state of the current tick (same fields as RequestAction)
+       * without waiting for the action
+       */
+      virtual bool SendRequest(uint32_t,
+                               const float*,
+                               float,
+                               uint8_t) {
+         return false;
+      }
+
+      /*
+       * Collect the actions that arrived since the last call, without
+       * blocking. Answers come in request order; action is set to the
+       * most recent one
+       * Returns the number of actions received, -1 on error
+       */
+      virtual int PollActions(int&) {
+         return -1;
+      }
+
+      /*
+       * Close the connection
+       */
+      virtual void Close() = 0;
+
+      /*
+       * Record the ENCODE/SEND/WAIT phases of requests into pc_latency
+       * (NULL: not timed). Transports that cannot tell the phases apart
+       * only get the controller's ACTION time
+       */
+      void SetLatencyStats(CQSwarmLatencyStats* pc_latency) {
+         m_pcLatency = pc_latency;
+      }
+
+      /*
+       * Why Maintain() stopped trying to connect (a configuration that
+       * can never match the server), empty while it keeps trying
+       */
+      const std::string& GetFatalError() const {
+         return m_strFatalError;
+      }
+
+   protected:
+
+      CQSwarmLatencyStats* m_pcLatency;
+
+      /* Set by implementations that give up for good */
+      std::string m_strFatalError;
+
+   };
+
+}
+
+#endif
@@ -0,0 +1,213 @@
+"""
+Policy Export
+
+Writes the Q-Network weights as a flat binary file that the C++
+controller loads for inference="native" (see
+controllers/q_swarm_controller/q_swarm_policy.h).
+
+Format: version 3 "packed" (see q_swarm_policy_registry.h), little-endian:
+    header (64 bytes): "QSNN" | version u32 (3) | num_layers u32 | block_width u32 (8)
+    layer table (32 bytes per layer):
+        inputs u32 | outputs u32 | blocks u32 | type u32 (0 float32, 1 int8) |
+        weights_offset u32 | scales_offset u32 | biases_offset u32 | reserved u32
+    sections (64-byte aligned):
+        weights [blocks][inputs][8] (output j is lane j % 8 of block j // 8)
+        scales  float32 [blocks * 8] (int8 layers, weight ~ scale * q)
+        biases  float32 [blocks * 8]
+    Padding outputs are zero.
+
+The weights are stored exactly as the C++ kernels read them, so the
+controllers map the file read-only and every ARGoS process on a node
+shares one copy. The file is replaced atomically, so running
+controllers can reload it between episodes.
+
+The int8 file (one symmetric scale per output) is about 4x smaller.
+Before using it, check that it picks the same actions as the float
+model on recorded states:
+
+    python export_policy.py --int8 --states ../models/recorded_states.npy
+
+Usage:
+    python export_policy.py [--model ../models/q_network_latest.pth]
+                            [--output ../models/q_network_latest.bin]
+                            [--int8] [--states FILE.npy] [--min-agreement 0.99]
+"""
+
+import argparse
+import os
+import struct
+import sys
+import numpy as np
+
+MAGIC = b'QSNN'
+VERSION_PACKED = 3
+BLOCK_WIDTH = 8
+ALIGNMENT = 64
+HEADER_SIZE = 64
+LAYER_ENTRY = struct.Struct('<IIIIIIII')
+
+LAYER_FLOAT = 0
+LAYER_INT8 = 1
+
+# Layers of q_network.DQN, in forward order
+LAYERS = ['fc1', 'fc2', 'fc3', 'fc4']
+
+
+def _to_numpy(tensor):
+    """Tensor (or array) as a float32 numpy array"""
+    if hasattr(tensor, 'detach'):
+        tensor = tensor.detach().cpu().numpy()
+    return np.asarray(tensor, dtype='<f4')
+
+
+def extract_layers(state_dict):
+    """[(weight[outputs][inputs], bias[outputs])] of a DQN state dict"""
+    return [(_to_numpy(state_dict[f'{name}.weight']), _to_numpy(state_dict[f'{name}.bias']))
+            for name in LAYERS]
+
+
+def quantize(weight):
+    """
+    Symmetric per-output-channel int8 quantization
+
+    Returns:
+        (scales[outputs], int8 weights[outputs][inputs]) with
+        weight ~ scales[:, None] * q
+    """
+    max_abs = np.abs(weight).max(axis=1)
+    scales = np.where(max_abs > 0, max_abs / 127.0, 1.0).astype('<f4')
+    q = np.clip(np.rint(weight / scales[:, None]), -127, 127).astype(np.int8)
+    return scales, q
+
+
+def dequantize_layers(layers):
+    """Float layers as the C++ int8 kernels see them"""
+    result = []
+    for weight, bias in layers:
+        scales, q = quantize(weight)
+        result.append((scales[:, None] * q.astype('<f4'), bias))
+    return result
+
+
+def forward(layers, states):
+    """Q-values of a batch of states (ReLU on every layer but the last)"""
+    x = np.asarray(states, dtype='<f4')
+    for index, (weight, bias) in enumerate(layers):
+        x = x @ weight.T + bias
+        if index < len(layers) - 1:
+            x = np.maximum(x, 0.0)
+    return x
+
+
+def check_agreement(state_dict, states):
+    """Fraction of states where the int8 model picks the float model's action"""
+    layers = extract_layers(state_dict)
+    float_actions = forward(layers, states).argmax(axis=1)
+    int8_actions = forward(dequantize_layers(layers), states).argmax(axis=1)
+    return float(np.mean(float_actions == int8_actions))
+
+
+def _align(offset):
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def _pack_weights(weight, blocks):
+    """[outputs][inputs] -> [blocks][inputs][BLOCK_WIDTH], zero padded"""
+    outputs, inputs = weight.shape
+    padded = np.zeros((blocks * BLOCK_WIDTH, inputs), dtype=weight.dtype)
+    padded[:outputs] = weight
+    return np.ascontiguousarray(padded.reshape(blocks, BLOCK_WIDTH, inputs).transpose(0, 2, 1))
+
+
+def _pad_vector(vector, blocks):
+    padded = np.zeros(blocks * BLOCK_WIDTH, dtype='<f4')
+    padded[:len(vector)] = vector
+    return padded
+
+
+def export_state_dict(state_dict, filepath, int8=False):
+    """Write the layers of a DQN state dict to a packed weights file"""
+    # (offset, bytes) sections and one table entry per layer
+    sections = []
+    entries = []
+    layers = extract_layers(state_dict)
+    offset = _align(HEADER_SIZE + LAYER_ENTRY.size * len(layers))
+    for weight, bias in layers:
+        outputs, inputs = weight.shape
+        blocks = (outputs + BLOCK_WIDTH - 1) // BLOCK_WIDTH
+
+        if int8:
+            scales, q = quantize(weight)
+            parts = [_pack_weights(q, blocks), _pad_vector(scales, blocks), _pad_vector(bias, blocks)]
+        else:
+            parts = [_pack_weights(weight, blocks), _pad_vector(bias, blocks)]
+
+        offsets = []
+        for part in parts:
+            sections.append((offset, part.tobytes()))
+            offsets.append(offset)
+            offset = _align(offset + part.nbytes)
+
+        weights_offset, biases_offset = offsets[0], offsets[-1]
+        scales_offset = offsets[1] if int8 else 0
+        entries.append(LAYER_ENTRY.pack(inputs, outputs, blocks, LAYER_INT8 if int8 else LAYER_FLOAT,
+                                        weights_offset, scales_offset, biases_offset, 0))
+
+    image = bytearray(offset)
+    image[:16] = struct.pack('<4sIII', MAGIC, VERSION_PACKED, len(layers), BLOCK_WIDTH)
+    table = b''.join(entries)
+    image[HEADER_SIZE:HEADER_SIZE + len(table)] = table
+    for section_offset, data in sections:
+        image[section_offset:section_offset + len(data)] = data
+
+    # Write to a temporary file first so readers never see a partial file;
+    # controllers still using the old file keep their mapping of it
+    tmp_path = filepath + '.tmp'
+    with open(tmp_path, 'wb') as f:
+        f.write(image)
+    os.replace(tmp_path, filepath)
+
+
+def export_policy(q_network, filepath, int8=False):
+    """Write a DQN module's weights to a flat weights file"""
+    export_state_dict(q_network.state_dict(), filepath, int8)
+
+
+def main():
+    import torch
+
+    parser = argparse.ArgumentParser(description="Export Q-Network weights for native inference")
+    parser.add_argument('--model', default="../models/q_network_latest.pth",
+                        help="checkpoint saved by QNetworkAgent.save_model")
+    parser.add_argument('--output', default=None,
+                        help="flat weights file for the C++ controller "
+                             "(default: ../models/q_network_latest.bin, or _int8.bin with --int8)")
+    parser.add_argument('--int8', action='store_true',
+                        help="write int8 weights with per-output scales")
+    parser.add_argument('--states', default=None,
+                        help="recorded states (.npy, [N x 28]) for the int8 accuracy check")
+    parser.add_argument('--min-agreement', type=float, default=0.99,
+                        help="minimum argmax agreement with the float model (default: 0.99)")
+    args = parser.parse_args()
+
+    output = args.output
+    if output is None:
+        output = "../models/q_network_latest_int8.bin" if args.int8 else "../models/q_network_latest.bin"
+
+    checkpoint = torch.load(args.model, map_location='cpu')
+    state_dict = checkpoint['q_network_state_dict']
+
+    if args.int8 and args.states is not None:
+        states = np.load(args.states)
+        agreement = check_agreement(state_dict, states)
+        print(f"int8 argmax agreement: {agreement * 100:.2f}% over {len(states)} states")
+        if agreement < args.min_agreement:
+            print(f"Agreement below {args.min_agreement * 100:.2f}%, not exporting")
+            sys.exit(1)
+
+    export_state_dict(state_dict, output, args.int8)
+    print(f"Policy exported to {output}")
+
+
+if __name__ == "__main__":
+    main()
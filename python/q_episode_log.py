@@ -0,0 +1,139 @@
+"""
+Episode Log Reader
+
+Reads the episode log the loop functions write (episode_log attribute,
+controllers/q_swarm_controller/q_swarm_episode_log.h): a 64-byte header
+and one 32-byte record per finished episode, rotated to path.1, path.2,
+... when it reaches its size limit.
+
+read_log() loads a log with its rotated files, oldest first.
+EpisodeLogTail follows a log that is being written: each poll() returns
+only the records appended since the previous one and follows rotations,
+so a dashboard never re-reads history.
+"""
+
+import os
+import struct
+from collections import namedtuple
+
+MAGIC = 0x50455351  # "QSEP"
+VERSION = 1
+HEADER = struct.Struct('<III52x')
+RECORD = struct.Struct('<QIIIfBxHI')
+
+OUTCOME_NONE = 0
+OUTCOME_GOAL = 1
+OUTCOME_COLLISION = 2
+OUTCOME_TIMEOUT = 3
+OUTCOME_NAMES = {OUTCOME_NONE: 'none', OUTCOME_GOAL: 'goal',
+                 OUTCOME_COLLISION: 'collision', OUTCOME_TIMEOUT: 'timeout'}
+
+# time: end of the episode in ms since the Unix epoch
+EpisodeRecord = namedtuple('EpisodeRecord',
+                           'time robot_id episode steps reward outcome arena')
+
+
+def check_header(data):
+    """Raise ValueError unless data starts with an episode log header"""
+    if len(data) < HEADER.size:
+        raise ValueError("not an episode log")
+    magic, version, record_size = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not an episode log")
+    if record_size != RECORD.size:
+        raise ValueError(f"record size {record_size}, expected {RECORD.size}")
+
+
+def parse_records(data):
+    """Complete records in data (a partly written last one is left out)"""
+    count = len(data) // RECORD.size
+    return [EpisodeRecord(*fields[:-1])
+            for fields in RECORD.iter_unpack(memoryview(data)[:count * RECORD.size])]
+
+
+def rotated_paths(path):
+    """path.N, ..., path.1 that exist, oldest first"""
+    paths = []
+    index = 1
+    while os.path.exists(f"{path}.{index}"):
+        paths.append(f"{path}.{index}")
+        index += 1
+    return paths[::-1]
+
+
+def read_log(path, rotated=True):
+    """All records of a log (and of its rotated files), oldest first"""
+    records = []
+    for file_path in (rotated_paths(path) if rotated else []) + [path]:
+        if not os.path.exists(file_path):
+            continue
+        with open(file_path, 'rb') as f:
+            data = f.read()
+        check_header(data)
+        records.extend(parse_records(data[HEADER.size:]))
+    return records
+
+
+class EpisodeLogTail:
+    """
+    Incremental reader of a log being written
+
+    from_start=False skips the records already in the file. A rotation
+    is noticed when path names a new file: the old one (still open) is
+    read to its end first, so no record is lost or read twice.
+    """
+
+    def __init__(self, path, from_start=True):
+        self.path = path
+        self.file = None
+        self.pending = b''
+        self.from_start = from_start
+
+    def _open(self):
+        try:
+            f = open(self.path, 'rb')
+        except OSError:
+            return False
+        header = f.read(HEADER.size)
+        if len(header) < HEADER.size:
+            # Created but the header is not written yet
+            f.close()
+            return False
+        check_header(header)
+        if not self.from_start:
+            size = os.fstat(f.fileno()).st_size - HEADER.size
+            f.seek(HEADER.size + size - size % RECORD.size)
+        self.file = f
+        self.pending = b''
+        # Files that appear later are read from their start
+        self.from_start = True
+        return True
+
+    def _rotated(self):
+        try:
+            return os.stat(self.path).st_ino != os.fstat(self.file.fileno()).st_ino
+        except OSError:
+            return False
+
+    def _read(self):
+        data = self.pending + self.file.read()
+        count = len(data) // RECORD.size
+        self.pending = data[count * RECORD.size:]
+        return parse_records(data[:count * RECORD.size])
+
+    def poll(self):
+        """Records appended since the last call"""
+        records = []
+        if self.file is not None and self._rotated():
+            records.extend(self._read())
+            self.file.close()
+            self.file = None
+        if self.file is None and not self._open():
+            return records
+        records.extend(self._read())
+        return records
+
+    def close(self):
+        if self.file is not None:
+            self.file.close()
+            self.file = None
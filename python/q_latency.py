@@ -0,0 +1,141 @@
+"""
+Latency Histograms
+
+Server side of controllers/q_swarm_controller/q_swarm_latency.h: the same
+HDR-style buckets (one per nanosecond below 16 ns, then 16 linear buckets
+per power of two, so within 6.25%) and the same CSV / JSON lines output,
+so the server's phases can be lined up with the controllers'.
+
+Each histogram is written by one thread only (the event loop or the
+shared-memory thread each have their own phases), so recording takes no
+lock.
+"""
+
+import json
+import math
+import time
+
+SUB_BUCKETS = 16
+MAX_MAGNITUDE = 40
+BUCKETS = SUB_BUCKETS * (MAX_MAGNITUDE - 3)
+
+CSV_HEADER = "episodes,phase,count,mean_us,p50_us,p99_us,p999_us,max_us\n"
+
+
+def bucket_of(ns):
+    if ns < SUB_BUCKETS:
+        return ns
+    magnitude = ns.bit_length() - 1
+    if magnitude >= MAX_MAGNITUDE:
+        return BUCKETS - 1
+    return SUB_BUCKETS * (magnitude - 3) + (ns >> (magnitude - 4)) - SUB_BUCKETS
+
+
+def upper_bound(bucket):
+    """Largest value that falls in a bucket"""
+    if bucket < SUB_BUCKETS:
+        return bucket
+    magnitude = bucket // SUB_BUCKETS + 3
+    return ((SUB_BUCKETS + bucket % SUB_BUCKETS + 1) << (magnitude - 4)) - 1
+
+
+class LatencyHistogram:
+    """Durations in nanoseconds"""
+
+    def __init__(self):
+        self.counts = [0] * BUCKETS
+        self.count = 0
+        self.total = 0
+        self.max = 0
+
+    def record(self, ns):
+        ns = max(int(ns), 0)
+        self.counts[bucket_of(ns)] += 1
+        self.count += 1
+        self.total += ns
+        if ns > self.max:
+            self.max = ns
+
+    def percentile(self, quantile):
+        """Upper bound of the bucket holding the quantile (at most the maximum)"""
+        if self.count == 0:
+            return 0
+        rank = max(1, math.ceil(quantile * self.count))
+        seen = 0
+        for bucket, count in enumerate(self.counts):
+            seen += count
+            if seen >= rank:
+                return min(upper_bound(bucket), self.max)
+        return self.max
+
+    def mean(self):
+        return self.total / self.count if self.count else 0.0
+
+    def merge(self, other):
+        """Add the values of another histogram"""
+        for bucket, count in enumerate(other.counts):
+            if count:
+                self.counts[bucket] += count
+        self.count += other.count
+        self.total += other.total
+        self.max = max(self.max, other.max)
+
+    def clear(self):
+        self.__init__()
+
+
+class LatencyStats:
+    """Named phases, timed with time.perf_counter_ns() (monotonic)"""
+
+    def __init__(self, phases):
+        self.phases = {name: LatencyHistogram() for name in phases}
+
+    @staticmethod
+    def now():
+        return time.perf_counter_ns()
+
+    def record_since(self, phase, start):
+        """Record the time since start (a now() value); returns now()"""
+        now = time.perf_counter_ns()
+        self.phases[phase].record(now - start)
+        return now
+
+    def merge(self, other):
+        for name, histogram in other.phases.items():
+            self.phases.setdefault(name, LatencyHistogram()).merge(histogram)
+
+    def clear(self):
+        for histogram in self.phases.values():
+            histogram.clear()
+
+    def summary(self):
+        """{phase: {count, mean_us, p50_us, p99_us, p999_us, max_us}} of recorded phases"""
+        summary = {}
+        for name, histogram in self.phases.items():
+            if histogram.count == 0:
+                continue
+            summary[name] = {
+                'count': histogram.count,
+                'mean_us': histogram.mean() / 1000.0,
+                'p50_us': histogram.percentile(0.5) / 1000.0,
+                'p99_us': histogram.percentile(0.99) / 1000.0,
+                'p999_us': histogram.percentile(0.999) / 1000.0,
+                'max_us': histogram.max / 1000.0,
+            }
+        return summary
+
+    def write(self, path, episodes, truncate=False):
+        """
+        Append the recorded phases to path (CSV, or JSON lines for a .json
+        path), in the format of CQSwarmLatencyStats::Write()
+        """
+        summary = self.summary()
+        with open(path, 'w' if truncate else 'a') as f:
+            if path.endswith('.json'):
+                f.write(json.dumps({'episodes': episodes, 'phases': summary}) + "\n")
+                return
+            if truncate:
+                f.write(CSV_HEADER)
+            for name, row in summary.items():
+                f.write(f"{episodes},{name},{row['count']},{row['mean_us']:g},{row['p50_us']:g},"
+                        f"{row['p99_us']:g},{row['p999_us']:g},{row['max_us']:g}\n")
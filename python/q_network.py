@@ -4,7 +4,8 @@ Deep Q-Network Implementation
 This module implements a Deep Q-Learning network using PyTorch.
 It includes:
 - Neural network architecture
-- Experience replay buffer
+- Experience replay buffer (native C++ storage when libq_swarm_replay
+  is built, see q_replay.py)
 - Training logic
 - Model saving/loading
 """
@@ -54,6 +55,7 @@ class ReplayBuffer:
     """
     
     def __init__(self, capacity=10000):
+        self.capacity = capacity
         self.buffer = deque(maxlen=capacity)
     
     def push(self, state, action, reward, next_state, done):
@@ -62,10 +64,30 @@ class ReplayBuffer:
     def sample(self, batch_size):
         return random.sample(self.buffer, batch_size)
     
+    def sample_batch(self, batch_size):
+        """(states, actions, rewards, next_states, dones) arrays of a random batch"""
+        states, actions, rewards, next_states, dones = zip(*self.sample(batch_size))
+        return np.array(states), actions, rewards, np.array(next_states), dones
+    
+    def __iter__(self):
+        return iter(self.buffer)
+    
     def __len__(self):
         return len(self.buffer)
 
 
+def make_replay_buffer(capacity=10000, alpha=None):
+    """
+    Native replay buffer if libq_swarm_replay is built, else ReplayBuffer
+    (alpha: priority exponent for prioritized replay, native buffer only)
+    """
+    try:
+        from q_replay import NativeReplayBuffer
+        return NativeReplayBuffer(capacity, alpha=alpha)
+    except OSError:
+        return ReplayBuffer(capacity)
+
+
 class QNetworkAgent:
     """
     Q-Learning Agent
@@ -75,7 +97,8 @@ class QNetworkAgent:
     """
     
     def __init__(self, state_size=28, action_size=4, learning_rate=0.001,
-                 gamma=0.99, epsilon=1.0, epsilon_min=0.01, epsilon_decay=0.995):
+                 gamma=0.99, epsilon=1.0, epsilon_min=0.01, epsilon_decay=0.995,
+                 prioritized=False, priority_alpha=0.6, beta_start=0.4, beta_steps=100000):
         
         self.state_size = state_size
         self.action_size = action_size
@@ -101,8 +124,18 @@ class QNetworkAgent:
         # Loss function
         self.criterion = nn.MSELoss()
         
-        # Replay buffer
-        self.replay_buffer = ReplayBuffer(capacity=10000)
+        # Replay buffer (prioritized: sampled by TD error, the importance-sampling
+        # exponent beta grows from beta_start to 1 over beta_steps updates)
+        self.priority_alpha = priority_alpha
+        self.beta_start = beta_start
+        self.beta_steps = beta_steps
+        self.replay_buffer = make_replay_buffer(capacity=10000,
+                                                alpha=priority_alpha if prioritized else None)
+        self.prioritized = prioritized and hasattr(self.replay_buffer, 'update_priorities')
+        if prioritized and not self.prioritized:
+            print("Prioritized replay needs libq_swarm_replay, sampling uniformly")
+        print(f"Replay buffer: {type(self.replay_buffer).__name__}"
+              f"{' (prioritized)' if self.prioritized else ''}")
         
         # Batch size for training
         self.batch_size = 64
@@ -149,6 +182,36 @@ class QNetworkAgent:
         
         return action
     
+    def select_actions(self, states, robot_ids):
+        """
+        Select actions for a batch of robots with one forward pass
+        
+        Args:
+            states: [N x state_size] array of states
+            robot_ids: N robot ids, one per row
+            
+        Returns:
+            actions: numpy array of N selected actions (0-3)
+        """
+        states = np.array(states, dtype=np.float32)
+        
+        # Exploit: best action for every row in one forward pass
+        state_tensor = torch.from_numpy(states).to(self.device)
+        with torch.no_grad():
+            q_values = self.q_network(state_tensor)
+        actions = q_values.argmax(dim=1).cpu().numpy()
+        
+        # Explore: replace with random actions at rate epsilon
+        explore = np.random.rand(len(actions)) < self.epsilon
+        actions[explore] = np.random.randint(0, self.action_size, int(explore.sum()))
+        
+        # Store current state/action per robot
+        for i, robot_id in enumerate(robot_ids):
+            self.current_states[robot_id] = states[i]
+            self.current_actions[robot_id] = int(actions[i])
+        
+        return actions
+    
     def store_transition(self, robot_id, reward, next_state, done):
         """
         Store transition in replay buffer
@@ -177,17 +240,19 @@ class QNetworkAgent:
             return None
         
         # Sample batch from replay buffer
-        batch = self.replay_buffer.sample(self.batch_size)
-        
-        # Unpack batch
-        states, actions, rewards, next_states, dones = zip(*batch)
+        if self.prioritized:
+            beta = min(1.0, self.beta_start + (1.0 - self.beta_start) * self.update_counter / self.beta_steps)
+            (states, actions, rewards, next_states, dones,
+             weights, indices) = self.replay_buffer.sample_prioritized(self.batch_size, beta)
+        else:
+            states, actions, rewards, next_states, dones = self.replay_buffer.sample_batch(self.batch_size)
         
-        # Convert to tensors
-        states = torch.FloatTensor(np.array(states)).to(self.device)
-        actions = torch.LongTensor(actions).to(self.device)
-        rewards = torch.FloatTensor(rewards).to(self.device)
-        next_states = torch.FloatTensor(np.array(next_states)).to(self.device)
-        dones = torch.FloatTensor(dones).to(self.device)
+        # Convert to tensors (wraps float32/int64 arrays without copying on the CPU)
+        states = torch.as_tensor(states, dtype=torch.float32, device=self.device)
+        actions = torch.as_tensor(actions, dtype=torch.int64, device=self.device)
+        rewards = torch.as_tensor(rewards, dtype=torch.float32, device=self.device)
+        next_states = torch.as_tensor(next_states, dtype=torch.float32, device=self.device)
+        dones = torch.as_tensor(dones, dtype=torch.float32, device=self.device)
         
         # Current Q-values
         current_q_values = self.q_network(states).gather(1, actions.unsqueeze(1))
@@ -197,8 +262,15 @@ class QNetworkAgent:
             next_q_values = self.target_network(next_states).max(1)[0]
             target_q_values = rewards + (1 - dones) * self.gamma * next_q_values
         
-        # Compute loss
-        loss = self.criterion(current_q_values.squeeze(), target_q_values)
+        # Compute loss (importance-weighted when prioritized, and the TD
+        # errors become the new priorities of the batch)
+        if self.prioritized:
+            td_errors = target_q_values - current_q_values.squeeze(1)
+            weights = torch.as_tensor(weights, dtype=torch.float32, device=self.device)
+            loss = (weights * td_errors.pow(2)).mean()
+            self.replay_buffer.update_priorities(indices, td_errors.detach().abs().cpu().numpy())
+        else:
+            loss = self.criterion(current_q_values.squeeze(), target_q_values)
         
         # Optimize
         self.optimizer.zero_grad()
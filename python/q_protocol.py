@@ -0,0 +1,452 @@
+"""
+Binary Wire Protocol
+
+Mirror of controllers/q_swarm_controller/q_swarm_protocol.h.
+
+Every frame starts with a 12-byte little-endian header:
+    magic "QS" | version (u8) | type (u8) | robot_id (u32) | payload_size (u32)
+
+Payloads:
+- STATE:  float32[28]  (x, y, goal_x, goal_y, prox0, ..., prox23, then
+          3 floats per neighbour with Q_SWARM_NEIGHBOURS, see STATE_SIZE)
+- REWARD: float32 reward + u8 done
+- STEP:   float32[28] state + float32 previous reward + u8 flags
+- BATCH_STEP: N STEPs, struct-of-arrays:
+          u32 N | u32 robot_ids[N] | float32 states[N][28] |
+          float32 prev_rewards[N] | u8 flags[N]
+- COMPACT_STEP, COMPACT_BATCH_STEP: STEP and BATCH_STEP with quantized
+          states, the goal only when it changes (see q_swarm_protocol.h and
+          decode_compact_step())
+
+Server to server (parameter sync, see q_server.py --learner):
+- TRANSITIONS: replica -> learner, experience of the replica's robots:
+          u32 N | float32 states[N][28] | u8 actions[N] | float32 rewards[N] |
+          float32 next_states[N][28] | u8 dones[N]
+- WEIGHTS: learner -> replicas, the Q-network parameters:
+          u32 version | float32 epsilon | float32 parameters[...] (the
+          tensors of q_network.state_dict(), flattened, in key order)
+
+Replies:
+- STATE      -> 1 byte action id
+- STEP       -> 1 byte action id (COMPACT_STEP too)
+- BATCH_STEP -> N action bytes, in batch order (COMPACT_BATCH_STEP too)
+- REWARD     -> 1 byte ACK
+
+STEP carries the reward of the previous tick together with the current
+state, so one round trip per tick is enough.
+
+TCP may split a frame across several reads or merge several frames into
+one; FrameReader (binary) and LineReader (text) reassemble the stream.
+
+Robots are sharded across several servers with shard_of(), the same hash
+as ShardOf() in q_swarm_endpoints.h.
+"""
+
+import os
+import struct
+import numpy as np
+
+# State layout: position and goal, proximity readings, then dx, dy, present
+# of the NEIGHBOURS nearest robots (the controllers' Q_SWARM_NEIGHBOURS build
+# option, given to the server in the environment variable of the same name).
+# Controllers built with Q_SWARM_PROXIMITY_SECTORS send 8 sector maxima
+# instead of the 24 readings
+PROXIMITY_SECTORS = os.environ.get('Q_SWARM_PROXIMITY_SECTORS', '0') not in ('', '0')
+PROXIMITY_SIZE = 8 if PROXIMITY_SECTORS else 24
+NEIGHBOURS = int(os.environ.get('Q_SWARM_NEIGHBOURS', '0'))
+NEIGHBOUR_FEATURES = 3
+STATE_SIZE = 4 + PROXIMITY_SIZE + NEIGHBOUR_FEATURES * NEIGHBOURS
+
+MAGIC = b'QS'
+VERSION = 1
+
+MSG_STATE = 1
+MSG_REWARD = 2
+MSG_STEP = 3
+MSG_BATCH_STEP = 4
+MSG_TRANSITIONS = 5
+MSG_WEIGHTS = 6
+MSG_COMPACT_STEP = 7
+MSG_COMPACT_BATCH_STEP = 8
+
+STEP_HAS_PREV = 0x01   # previous reward field is valid
+STEP_PREV_DONE = 0x02  # previous step ended the episode
+STEP_HAS_GOAL = 0x04   # compact frames: the goal is included
+
+# Compact states (compact_state="true"): int16 millimetres relative to the
+# arena, u8 proximity * 255, int8 neighbour features * 127
+COMPACT_POSITION_SCALE = 1000.0
+COMPACT_PROXIMITY_SCALE = 255.0
+COMPACT_NEIGHBOUR_SCALE = 127.0
+COMPACT_STEP_HEAD = struct.Struct('<fBhh')
+COMPACT_GOAL = struct.Struct('<hh')
+COMPACT_FEATURES = struct.Struct('<%dB%db' % (PROXIMITY_SIZE, NEIGHBOUR_FEATURES * NEIGHBOURS))
+
+HEADER = struct.Struct('<2sBBII')
+STATE_PAYLOAD = struct.Struct('<%df' % STATE_SIZE)
+REWARD_PAYLOAD = struct.Struct('<fB')
+STEP_PAYLOAD = struct.Struct('<%dffB' % STATE_SIZE)
+
+ACK_BYTE = b'\x06'
+
+# Sanity limits: anything larger means the stream is out of sync
+MAX_PAYLOAD_SIZE = 1 << 24
+MAX_LINE_SIZE = 1 << 16
+
+
+def is_binary(first_byte):
+    """Return True if a connection's first byte starts a binary frame"""
+    return first_byte[:1] == MAGIC[:1]
+
+
+def decode_header(data, offset=0):
+    """
+    Parse a frame header (at offset in data)
+
+    Returns:
+        (msg_type, robot_id, payload_size)
+
+    Raises:
+        ValueError on bad magic or unsupported version
+    """
+    magic, version, msg_type, robot_id, payload_size = HEADER.unpack_from(data, offset)
+    if magic != MAGIC:
+        raise ValueError(f"Bad frame magic: {magic!r}")
+    if version != VERSION:
+        raise ValueError(f"Unsupported protocol version: {version}")
+    return msg_type, robot_id, payload_size
+
+
+def encode_state(robot_id, state):
+    """Encode a STATE frame (used by tests and tools)"""
+    return (HEADER.pack(MAGIC, VERSION, MSG_STATE, robot_id, STATE_PAYLOAD.size) +
+            STATE_PAYLOAD.pack(*state))
+
+
+def encode_reward(robot_id, reward, done):
+    """Encode a REWARD frame (used by tests and tools)"""
+    return (HEADER.pack(MAGIC, VERSION, MSG_REWARD, robot_id, REWARD_PAYLOAD.size) +
+            REWARD_PAYLOAD.pack(reward, 1 if done else 0))
+
+
+def encode_step(robot_id, state, prev_reward, flags):
+    """Encode a STEP frame (used by tests and tools)"""
+    return (HEADER.pack(MAGIC, VERSION, MSG_STEP, robot_id, STEP_PAYLOAD.size) +
+            STEP_PAYLOAD.pack(*state, prev_reward, flags))
+
+
+def decode_state(payload):
+    """Decode a STATE payload into a list of STATE_SIZE floats"""
+    return list(STATE_PAYLOAD.unpack(payload))
+
+
+def decode_reward(payload):
+    """Decode a REWARD payload into (reward, done)"""
+    reward, done = REWARD_PAYLOAD.unpack(payload)
+    return reward, done == 1
+
+
+def decode_step(payload):
+    """Decode a STEP payload into (state, prev_reward, flags)"""
+    values = STEP_PAYLOAD.unpack(payload)
+    return list(values[:STATE_SIZE]), values[STATE_SIZE], values[STATE_SIZE + 1]
+
+
+def encode_batch_step(robot_ids, states, prev_rewards, flags):
+    """Encode a BATCH_STEP frame (used by tests and tools)"""
+    count = len(robot_ids)
+    payload = (struct.pack('<I', count) +
+               np.asarray(robot_ids, dtype='<u4').tobytes() +
+               np.asarray(states, dtype='<f4').reshape(count, STATE_SIZE).tobytes() +
+               np.asarray(prev_rewards, dtype='<f4').tobytes() +
+               np.asarray(flags, dtype='u1').tobytes())
+    return HEADER.pack(MAGIC, VERSION, MSG_BATCH_STEP, 0, len(payload)) + payload
+
+
+def decode_batch_step(payload):
+    """
+    Decode a BATCH_STEP payload without copying
+
+    Returns:
+        (robot_ids [N], states [N x 28], prev_rewards [N], flags [N]) as numpy arrays
+    """
+    count, = struct.unpack_from('<I', payload, 0)
+    offset = 4
+    robot_ids = np.frombuffer(payload, dtype='<u4', count=count, offset=offset)
+    offset += 4 * count
+    states = np.frombuffer(payload, dtype='<f4', count=count * STATE_SIZE, offset=offset)
+    offset += 4 * count * STATE_SIZE
+    prev_rewards = np.frombuffer(payload, dtype='<f4', count=count, offset=offset)
+    offset += 4 * count
+    flags = np.frombuffer(payload, dtype='u1', count=count, offset=offset)
+    return robot_ids, states.reshape(count, STATE_SIZE), prev_rewards, flags
+
+
+def _quantize_features(states):
+    """u8 proximity and int8 neighbour features of [N x STATE_SIZE] states"""
+    states = np.asarray(states, dtype=np.float32).reshape(-1, STATE_SIZE)
+    proximity = np.clip(np.rint(states[:, 4:4 + PROXIMITY_SIZE] * COMPACT_PROXIMITY_SCALE), 0, 255)
+    neighbours = np.clip(np.rint(states[:, 4 + PROXIMITY_SIZE:] * COMPACT_NEIGHBOUR_SCALE), -127, 127)
+    return proximity.astype('u1'), neighbours.astype('i1')
+
+
+def _quantize_positions(values):
+    values = np.asarray(values, dtype=np.float32) * COMPACT_POSITION_SCALE
+    return np.clip(np.rint(values), -32768, 32767).astype('<i2')
+
+
+def _quantize(value, scale, low, high):
+    return min(max(int(round(value * scale)), low), high)
+
+
+def encode_compact_step(robot_id, state, prev_reward, flags):
+    """
+    Encode a COMPACT_STEP frame (used by tests and tools)
+    The goal is included if flags has STEP_HAS_GOAL
+    """
+    position = [_quantize(v, COMPACT_POSITION_SCALE, -32768, 32767) for v in state[:4]]
+    payload = COMPACT_STEP_HEAD.pack(prev_reward, flags, position[0], position[1])
+    if flags & STEP_HAS_GOAL:
+        payload += COMPACT_GOAL.pack(position[2], position[3])
+    payload += COMPACT_FEATURES.pack(
+        *[_quantize(v, COMPACT_PROXIMITY_SCALE, 0, 255) for v in state[4:4 + PROXIMITY_SIZE]],
+        *[_quantize(v, COMPACT_NEIGHBOUR_SCALE, -127, 127) for v in state[4 + PROXIMITY_SIZE:]])
+    return HEADER.pack(MAGIC, VERSION, MSG_COMPACT_STEP, robot_id, len(payload)) + payload
+
+
+def decode_compact_step(payload, robot_id, goals):
+    """
+    Decode a COMPACT_STEP payload into (state, prev_reward, flags) like
+    decode_step()
+    goals maps the robot ids of the connection to their last goal: it is
+    updated if the frame carries one, and used otherwise
+
+    Raises:
+        ValueError if the frame has no goal and none is known for the robot
+    """
+    prev_reward, flags, x, y = COMPACT_STEP_HEAD.unpack_from(payload, 0)
+    offset = COMPACT_STEP_HEAD.size
+    if flags & STEP_HAS_GOAL:
+        goals[robot_id] = [v / COMPACT_POSITION_SCALE for v in COMPACT_GOAL.unpack_from(payload, offset)]
+        offset += COMPACT_GOAL.size
+    elif robot_id not in goals:
+        raise ValueError(f"Compact step of robot {robot_id} without a goal")
+    if len(payload) != offset + COMPACT_FEATURES.size:
+        raise ValueError(f"Compact step of {len(payload)} bytes does not match the state layout")
+    features = COMPACT_FEATURES.unpack_from(payload, offset)
+    state = ([x / COMPACT_POSITION_SCALE, y / COMPACT_POSITION_SCALE] + goals[robot_id] +
+             [v / COMPACT_PROXIMITY_SCALE for v in features[:PROXIMITY_SIZE]] +
+             [v / COMPACT_NEIGHBOUR_SCALE for v in features[PROXIMITY_SIZE:]])
+    return state, prev_reward, flags
+
+
+def encode_compact_batch_step(robot_ids, states, prev_rewards, flags):
+    """Encode a COMPACT_BATCH_STEP frame (used by tests and tools)"""
+    count = len(robot_ids)
+    states = np.asarray(states, dtype=np.float32).reshape(count, STATE_SIZE)
+    flags = np.asarray(flags, dtype='u1')
+    proximity, neighbours = _quantize_features(states)
+    payload = (struct.pack('<I', count) +
+               np.asarray(robot_ids, dtype='<u4').tobytes() +
+               np.asarray(prev_rewards, dtype='<f4').tobytes() +
+               flags.tobytes() +
+               _quantize_positions(states[:, 0:2]).tobytes() +
+               proximity.tobytes() + neighbours.tobytes() +
+               _quantize_positions(states[(flags & STEP_HAS_GOAL) != 0, 2:4]).tobytes())
+    return HEADER.pack(MAGIC, VERSION, MSG_COMPACT_BATCH_STEP, 0, len(payload)) + payload
+
+
+def decode_compact_batch_step(payload, goals):
+    """
+    Decode a COMPACT_BATCH_STEP payload like decode_batch_step()
+    (float32 states), updating and using goals as decode_compact_step()
+
+    Raises:
+        ValueError if a robot has no goal
+    """
+    count, = struct.unpack_from('<I', payload, 0)
+    offset = 4
+    robot_ids = np.frombuffer(payload, dtype='<u4', count=count, offset=offset)
+    offset += 4 * count
+    prev_rewards = np.frombuffer(payload, dtype='<f4', count=count, offset=offset)
+    offset += 4 * count
+    flags = np.frombuffer(payload, dtype='u1', count=count, offset=offset)
+    offset += count
+    positions = np.frombuffer(payload, dtype='<i2', count=2 * count, offset=offset)
+    offset += 4 * count
+    proximity = np.frombuffer(payload, dtype='u1', count=count * PROXIMITY_SIZE, offset=offset)
+    offset += count * PROXIMITY_SIZE
+    features = NEIGHBOUR_FEATURES * NEIGHBOURS
+    neighbours = np.frombuffer(payload, dtype='i1', count=count * features, offset=offset)
+    offset += count * features
+    has_goal = (flags & STEP_HAS_GOAL) != 0
+    new_goals = np.frombuffer(payload, dtype='<i2', count=2 * int(has_goal.sum()), offset=offset)
+
+    states = np.empty((count, STATE_SIZE), dtype=np.float32)
+    states[:, 0:2] = positions.reshape(count, 2) / COMPACT_POSITION_SCALE
+    states[:, 4:4 + PROXIMITY_SIZE] = proximity.reshape(count, PROXIMITY_SIZE) / COMPACT_PROXIMITY_SCALE
+    states[:, 4 + PROXIMITY_SIZE:] = neighbours.reshape(count, features) / COMPACT_NEIGHBOUR_SCALE
+    new_goals = new_goals.reshape(-1, 2) / COMPACT_POSITION_SCALE
+    for robot_id, goal in zip(robot_ids[has_goal].tolist(), new_goals.tolist()):
+        goals[robot_id] = goal
+    for i, robot_id in enumerate(robot_ids.tolist()):
+        goal = goals.get(robot_id)
+        if goal is None:
+            raise ValueError(f"Compact step of robot {robot_id} without a goal")
+        states[i, 2:4] = goal
+    return robot_ids, states, prev_rewards, flags
+
+
+def encode_transitions(states, actions, rewards, next_states, dones):
+    """Encode a TRANSITIONS frame (no reply)"""
+    count = len(actions)
+    payload = (struct.pack('<I', count) +
+               np.asarray(states, dtype='<f4').reshape(count, STATE_SIZE).tobytes() +
+               np.asarray(actions, dtype='u1').tobytes() +
+               np.asarray(rewards, dtype='<f4').tobytes() +
+               np.asarray(next_states, dtype='<f4').reshape(count, STATE_SIZE).tobytes() +
+               np.asarray(dones, dtype='u1').tobytes())
+    return HEADER.pack(MAGIC, VERSION, MSG_TRANSITIONS, 0, len(payload)) + payload
+
+
+def decode_transitions(payload):
+    """
+    Decode a TRANSITIONS payload
+
+    Returns:
+        (states [N x 28], actions [N], rewards [N], next_states [N x 28], dones [N])
+    """
+    count, = struct.unpack_from('<I', payload, 0)
+    offset = 4
+    states = np.frombuffer(payload, dtype='<f4', count=count * STATE_SIZE, offset=offset)
+    offset += 4 * count * STATE_SIZE
+    actions = np.frombuffer(payload, dtype='u1', count=count, offset=offset)
+    offset += count
+    rewards = np.frombuffer(payload, dtype='<f4', count=count, offset=offset)
+    offset += 4 * count
+    next_states = np.frombuffer(payload, dtype='<f4', count=count * STATE_SIZE, offset=offset)
+    offset += 4 * count * STATE_SIZE
+    dones = np.frombuffer(payload, dtype='u1', count=count, offset=offset)
+    return (states.reshape(count, STATE_SIZE), actions, rewards,
+            next_states.reshape(count, STATE_SIZE), dones)
+
+
+def encode_weights(version, epsilon, parameters):
+    """Encode a WEIGHTS frame from a list of float32 arrays (no reply)"""
+    payload = (struct.pack('<If', version, epsilon) +
+               b''.join(np.ascontiguousarray(p, dtype='<f4').tobytes() for p in parameters))
+    return HEADER.pack(MAGIC, VERSION, MSG_WEIGHTS, 0, len(payload)) + payload
+
+
+def decode_weights(payload):
+    """
+    Decode a WEIGHTS payload
+
+    Returns:
+        (version, epsilon, flat float32 parameters)
+    """
+    version, epsilon = struct.unpack_from('<If', payload, 0)
+    return version, epsilon, np.frombuffer(payload, dtype='<f4', offset=8)
+
+
+def shard_of(robot_id, shards):
+    """Index of the server (0 to shards - 1) serving robot_id"""
+    if shards <= 1:
+        return 0
+    # MurmurHash3 fmix32
+    h = robot_id & 0xFFFFFFFF
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & 0xFFFFFFFF
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h % shards
+
+
+def encode_action(action):
+    """Encode the 1-byte action reply"""
+    return bytes((action,))
+
+
+def recv_exact(sock, size):
+    """Receive exactly size bytes, or None if the connection closed"""
+    chunks = []
+    remaining = size
+    while remaining > 0:
+        chunk = sock.recv(remaining)
+        if not chunk:
+            return None
+        chunks.append(chunk)
+        remaining -= len(chunk)
+    return b''.join(chunks)
+
+
+class FrameReader:
+    """
+    Incremental decoder for a stream of binary frames
+
+    Feed bytes as they arrive; complete frames are returned in order and
+    an incomplete one stays buffered until the rest arrives.
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        """
+        Add received bytes
+
+        Returns:
+            list of (msg_type, robot_id, payload) for the frames completed
+
+        Raises:
+            ValueError if the stream is not a valid frame sequence
+        """
+        self.buffer += data
+        frames = []
+        offset = 0
+        while len(self.buffer) - offset >= HEADER.size:
+            msg_type, robot_id, payload_size = decode_header(self.buffer, offset)
+            if payload_size > MAX_PAYLOAD_SIZE:
+                raise ValueError(f"Frame payload too large: {payload_size}")
+            end = offset + HEADER.size + payload_size
+            if len(self.buffer) < end:
+                break
+            frames.append((msg_type, robot_id, bytes(self.buffer[offset + HEADER.size:end])))
+            offset = end
+        del self.buffer[:offset]
+        return frames
+
+
+class LineReader:
+    """
+    Incremental decoder for newline-terminated text messages
+
+    Feed bytes as they arrive; complete messages are returned (decoded,
+    stripped, empty lines skipped) and a partial one stays buffered.
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        """
+        Add received bytes
+
+        Returns:
+            list of the messages completed
+
+        Raises:
+            ValueError if a message exceeds MAX_LINE_SIZE
+        """
+        self.buffer += data
+        lines = self.buffer.split(b'\n')
+        self.buffer = lines.pop()
+        if len(self.buffer) > MAX_LINE_SIZE:
+            raise ValueError(f"Text message too long: {len(self.buffer)} bytes")
+        messages = []
+        for line in lines:
+            message = line.decode('utf-8').strip()
+            if message:
+                messages.append(message)
+        return messages
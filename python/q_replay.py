@@ -0,0 +1,204 @@
+"""
+Native Replay Buffer
+
+Python side of controllers/q_swarm_controller/q_swarm_replay.h: a replay
+buffer with preallocated struct-of-arrays storage in C++ (libq_swarm_replay,
+built with the controllers), used through ctypes.
+
+sample_batch() returns numpy arrays that point into the C++ batch arrays
+(no copy, already float32/int64), so torch.as_tensor() wraps them without
+copying either. They are overwritten by the next sample_batch() call.
+
+With alpha set, sampling is prioritized (sum tree, see q_swarm_replay.h):
+sample_prioritized() also returns the importance-sampling weights and the
+rows of the batch, and update_priorities() takes the batch's TD errors.
+
+The library is looked up in $Q_SWARM_REPLAY_LIB, then next to the
+controller build. QNetworkAgent falls back to the deque-based
+q_network.ReplayBuffer when it is not built.
+"""
+
+import ctypes
+import os
+import sys
+import numpy as np
+import q_protocol
+
+_LIBRARY_NAMES = {'win32': 'q_swarm_replay.dll', 'darwin': 'libq_swarm_replay.dylib'}
+
+_STATES, _ACTIONS, _REWARDS, _NEXT_STATES, _DONES, _WEIGHTS, _INDICES = range(7)
+
+_library = None
+
+
+def _library_path():
+    path = os.environ.get('Q_SWARM_REPLAY_LIB')
+    if path:
+        return path
+    name = _LIBRARY_NAMES.get(sys.platform, 'libq_swarm_replay.so')
+    here = os.path.dirname(os.path.abspath(__file__))
+    return os.path.join(here, '..', 'controllers', 'q_swarm_controller', 'build', name)
+
+
+def load_library():
+    """Load libq_swarm_replay (raises OSError if it is not built)"""
+    global _library
+    if _library is not None:
+        return _library
+
+    lib = ctypes.CDLL(_library_path())
+    handle, size = ctypes.c_void_p, ctypes.c_size_t
+    floats = ctypes.POINTER(ctypes.c_float)
+    bytes_ = ctypes.POINTER(ctypes.c_uint8)
+
+    lib.q_swarm_replay_create.restype = handle
+    lib.q_swarm_replay_create.argtypes = [size, size, size]
+    lib.q_swarm_replay_destroy.argtypes = [handle]
+    lib.q_swarm_replay_push.argtypes = [handle, floats, ctypes.c_uint8, ctypes.c_float,
+                                        floats, ctypes.c_uint8]
+    lib.q_swarm_replay_push_batch.argtypes = [handle, size, floats, bytes_, floats, floats, bytes_]
+    lib.q_swarm_replay_enable_priorities.restype = ctypes.c_int
+    lib.q_swarm_replay_enable_priorities.argtypes = [handle, ctypes.c_float, ctypes.c_float]
+    lib.q_swarm_replay_sample.restype = size
+    lib.q_swarm_replay_sample.argtypes = [handle, size, ctypes.c_float]
+    lib.q_swarm_replay_update_priorities.argtypes = [handle, size, ctypes.POINTER(ctypes.c_int64), floats]
+    lib.q_swarm_replay_seed.argtypes = [handle, ctypes.c_uint64]
+    lib.q_swarm_replay_clear.argtypes = [handle]
+    lib.q_swarm_replay_size.restype = size
+    lib.q_swarm_replay_size.argtypes = [handle]
+    lib.q_swarm_replay_oldest.restype = size
+    lib.q_swarm_replay_oldest.argtypes = [handle]
+    lib.q_swarm_replay_storage.restype = handle
+    lib.q_swarm_replay_storage.argtypes = [handle, ctypes.c_int]
+    lib.q_swarm_replay_batch.restype = handle
+    lib.q_swarm_replay_batch.argtypes = [handle, ctypes.c_int]
+
+    _library = lib
+    return lib
+
+
+def _view(address, ctype, shape):
+    """numpy array over C memory (no copy)"""
+    return np.ctypeslib.as_array(ctypes.cast(address, ctypes.POINTER(ctype)), shape=shape)
+
+
+class NativeReplayBuffer:
+    """
+    Replay buffer in C++ storage (same interface as q_network.ReplayBuffer)
+    """
+
+    def __init__(self, capacity=10000, max_batch=256, state_size=q_protocol.STATE_SIZE,
+                 alpha=None, priority_epsilon=1e-3):
+        self.lib = load_library()
+        self.capacity = capacity
+        self.max_batch = max_batch
+        self.state_size = state_size
+        self.handle = self.lib.q_swarm_replay_create(capacity, max_batch, state_size)
+        if not self.handle:
+            raise MemoryError(f"cannot allocate a replay buffer of {capacity} transitions")
+        self.prioritized = alpha is not None
+        if self.prioritized and not self.lib.q_swarm_replay_enable_priorities(self.handle, alpha,
+                                                                               priority_epsilon):
+            raise MemoryError(f"cannot allocate the priorities of {capacity} transitions")
+
+        # Fixed arrays, so the views are made once
+        storage = self.lib.q_swarm_replay_storage
+        batch = self.lib.q_swarm_replay_batch
+        self.storage = (
+            _view(storage(self.handle, _STATES), ctypes.c_float, (capacity, state_size)),
+            _view(storage(self.handle, _ACTIONS), ctypes.c_uint8, (capacity,)),
+            _view(storage(self.handle, _REWARDS), ctypes.c_float, (capacity,)),
+            _view(storage(self.handle, _NEXT_STATES), ctypes.c_float, (capacity, state_size)),
+            _view(storage(self.handle, _DONES), ctypes.c_uint8, (capacity,)),
+        )
+        self.batch = (
+            _view(batch(self.handle, _STATES), ctypes.c_float, (max_batch, state_size)),
+            _view(batch(self.handle, _ACTIONS), ctypes.c_int64, (max_batch,)),
+            _view(batch(self.handle, _REWARDS), ctypes.c_float, (max_batch,)),
+            _view(batch(self.handle, _NEXT_STATES), ctypes.c_float, (max_batch, state_size)),
+            _view(batch(self.handle, _DONES), ctypes.c_float, (max_batch,)),
+            _view(batch(self.handle, _WEIGHTS), ctypes.c_float, (max_batch,)),
+            _view(batch(self.handle, _INDICES), ctypes.c_int64, (max_batch,)),
+        )
+
+    def __del__(self):
+        if getattr(self, 'handle', None):
+            self.lib.q_swarm_replay_destroy(self.handle)
+            self.handle = None
+
+    def push(self, state, action, reward, next_state, done):
+        state = np.ascontiguousarray(state, dtype=np.float32)
+        next_state = np.ascontiguousarray(next_state, dtype=np.float32)
+        floats = ctypes.POINTER(ctypes.c_float)
+        self.lib.q_swarm_replay_push(self.handle, state.ctypes.data_as(floats), int(action),
+                                     float(reward), next_state.ctypes.data_as(floats), int(bool(done)))
+
+    def push_batch(self, states, actions, rewards, next_states, dones):
+        """Add N transitions given as arrays"""
+        states = np.ascontiguousarray(states, dtype=np.float32)
+        actions = np.ascontiguousarray(actions, dtype=np.uint8)
+        rewards = np.ascontiguousarray(rewards, dtype=np.float32)
+        next_states = np.ascontiguousarray(next_states, dtype=np.float32)
+        dones = np.ascontiguousarray(dones, dtype=np.uint8)
+        floats = ctypes.POINTER(ctypes.c_float)
+        bytes_ = ctypes.POINTER(ctypes.c_uint8)
+        self.lib.q_swarm_replay_push_batch(self.handle, len(actions),
+                                           states.ctypes.data_as(floats), actions.ctypes.data_as(bytes_),
+                                           rewards.ctypes.data_as(floats), next_states.ctypes.data_as(floats),
+                                           dones.ctypes.data_as(bytes_))
+
+    def sample_batch(self, batch_size):
+        """
+        (states, actions, rewards, next_states, dones) of batch_size random
+        transitions, as views of the C++ batch arrays (valid until the next call)
+        """
+        count = self.lib.q_swarm_replay_sample(self.handle, batch_size, 0.0)
+        return tuple(array[:count] for array in self.batch[:5])
+    
+    def sample_prioritized(self, batch_size, beta=0.4):
+        """
+        (states, actions, rewards, next_states, dones, weights, indices):
+        sample_batch() plus the importance-sampling weights (exponent beta)
+        and the rows to pass to update_priorities()
+        """
+        count = self.lib.q_swarm_replay_sample(self.handle, batch_size, beta)
+        return tuple(array[:count] for array in self.batch)
+    
+    def update_priorities(self, indices, td_errors):
+        """Store the TD errors of a trained batch as its new priorities"""
+        indices = np.ascontiguousarray(indices, dtype=np.int64)
+        td_errors = np.ascontiguousarray(td_errors, dtype=np.float32)
+        self.lib.q_swarm_replay_update_priorities(
+            self.handle, len(indices), indices.ctypes.data_as(ctypes.POINTER(ctypes.c_int64)),
+            td_errors.ctypes.data_as(ctypes.POINTER(ctypes.c_float)))
+
+    def sample(self, batch_size):
+        """List of (state, action, reward, next_state, done) tuples (copies)"""
+        transitions = []
+        while len(transitions) < batch_size:
+            states, actions, rewards, next_states, dones = (
+                array.copy() for array in self.sample_batch(min(batch_size - len(transitions), self.max_batch)))
+            if len(actions) == 0:
+                break
+            transitions.extend(zip(states, actions.tolist(), rewards.tolist(), next_states,
+                                   dones.astype(bool).tolist()))
+        return transitions
+
+    def seed(self, seed):
+        self.lib.q_swarm_replay_seed(self.handle, seed)
+
+    def clear(self):
+        self.lib.q_swarm_replay_clear(self.handle)
+
+    def __iter__(self):
+        """Stored transitions, oldest first"""
+        size = len(self)
+        oldest = self.lib.q_swarm_replay_oldest(self.handle)
+        states, actions, rewards, next_states, dones = self.storage
+        for i in range(size):
+            row = (oldest + i) % self.capacity
+            yield (states[row].copy(), int(actions[row]), float(rewards[row]),
+                   next_states[row].copy(), bool(dones[row]))
+
+    def __len__(self):
+        return self.lib.q_swarm_replay_size(self.handle)
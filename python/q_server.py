@@ -5,61 +5,218 @@ This script runs a socket server that communicates with the ARGoS
 C++ controllers. It receives states, selects actions using the Q-Network,
 and performs learning updates based on rewards.
 
-Protocol:
+Protocol (text):
+- Receive: "STEP|robot_id|prev_reward|flags|x|y|goal_x|goal_y|prox0|...|prox23"
+- Send: "ACTION|action_id"
+
+Legacy split round trips (combined_step="false" on the controller):
 - Receive: "STATE|robot_id|x|y|goal_x|goal_y|prox0|...|prox23"
 - Send: "ACTION|action_id"
 - Receive: "REWARD|robot_id|reward|done"
 - Send: "ACK"
+
+Protocol (binary, see q_protocol.py):
+- Receive: STEP frame (header + float32[28] + float32 prev_reward + u8 flags;
+  more state floats with Q_SWARM_NEIGHBOURS, see q_protocol.STATE_SIZE)
+- Send: 1 byte action id
+- Receive: BATCH_STEP frame (all robots of a swarm, sent by the loop functions)
+- Send: N action bytes, one per robot in batch order
+- STATE/REWARD frames mirror the legacy text messages
+
+A reward that does not end the episode is held until the robot's next
+state arrives, which is then stored as the transition's next_state.
+
+The protocol is detected per connection from the first byte received.
+All connections are served by one selector-based event loop; messages
+split or merged by TCP are reassembled (q_protocol.FrameReader/LineReader).
+Pooled controllers (transport="pool") send the STEP frames of many robots
+over one connection; frames of distinct robots that arrive together are
+answered with one forward pass.
+
+Shared memory (--shm NAME, controllers with transport="shm"): see q_shm.py.
+The event loop scans the slots on every pass (it only blocks briefly
+while the segment is in use) and answers all pending slots together with
+one forward pass, so the agent is only ever touched from one thread.
+
+Several servers (controllers with servers="host:port,..." shard the robots
+across them): one learner trains, the others run with --learner HOST:PORT
+as inference replicas. A replica answers its robots with its copy of the
+network, forwards their transitions to the learner (TRANSITIONS frames)
+and does not train; the learner trains on the transitions of every
+replica and broadcasts its weights (WEIGHTS frames) every --sync-interval
+seconds. A replica keeps serving with its last weights while the learner
+is unreachable.
+
+Asynchronous training (--async-training): a trainer process (q_trainer.py)
+trains on a replay buffer in shared memory and publishes new weights every
+--publish-interval seconds; this process only selects actions, so action
+latency does not depend on training.
+
+Latency (--latency FILE.csv or FILE.json): the server times its own
+phases (handling of received data, action selection, training steps and
+shared-memory batches) in the histograms of q_latency.py and, once per
+round of episodes (as many episodes as robots), appends p50/p99/p99.9 per
+phase to FILE, in the format of the controllers' latency_file.
+
+Episode history: the server keeps the last EPISODE_HISTORY episode rewards
+for its statistics. The complete record of a run, written while it runs,
+is the loop functions' episode_log (q_episode_log.py, visualize.py follow).
 """
 
+import argparse
+import collections
+import multiprocessing
+import selectors
 import socket
-import threading
 import time
 import numpy as np
 import os
-from q_network import QNetworkAgent
+from collections import defaultdict
+import q_protocol
+from q_network import QNetworkAgent, make_replay_buffer
+from q_trainer import (SharedReplayBuffer, SharedWeights, run_trainer,
+                       flatten_parameters, load_parameters)
+from export_policy import export_policy, check_agreement
+from q_latency import LatencyStats
+
+
+class ClientConnection:
+    """State of one controller connection in the event loop"""
+    
+    def __init__(self, sock, address):
+        self.sock = sock
+        self.address = address
+        self.binary = False
+        self.reader = None          # chosen from the first byte received
+        self.outgoing = bytearray() # replies not sent yet
+        self.events = selectors.EVENT_READ
+        self.replica = False        # learner side: sends TRANSITIONS
+        self.goals = {}             # robot_id -> goal of its compact frames
+
+
+class ForwardingBuffer:
+    """
+    Replay buffer of an inference replica: transitions are queued for the
+    learner instead of being trained on (always empty, so train() is a no-op)
+    """
+    
+    def __init__(self, capacity=10000):
+        self.queue = collections.deque(maxlen=capacity)
+    
+    def push(self, state, action, reward, next_state, done):
+        self.queue.append((state, action, reward, next_state, done))
+    
+    def take(self):
+        """Remove and return the queued transitions"""
+        transitions = list(self.queue)
+        self.queue.clear()
+        return transitions
+    
+    def __len__(self):
+        return 0
 
 
 class QServer:
-    def __init__(self, host='localhost', port=5555):
+    # Replica: forward transitions once this many are queued (or every second)
+    TRANSITION_BATCH = 256
+    
+    # Timed phases (--latency)
+    LATENCY_PHASES = ('request', 'select', 'train', 'shm_request')
+    
+    # Empty slot scans before the event loop sleeps SHM_IDLE_SLEEP seconds per pass
+    SHM_SPIN_POLLS = 1000
+    SHM_IDLE_SLEEP = 0.0001
+    
+    # Episode rewards kept in memory (the full history is the loop
+    # functions' episode_log)
+    EPISODE_HISTORY = 10000
+    
+    def __init__(self, host='localhost', port=5555, shm_name=None, shm_slots=1024,
+                 learner=None, sync_interval=5.0, async_training=False, publish_interval=1.0,
+                 prioritized=False, latency_file=None, model_dir="../models"):
         self.host = host
         self.port = port
         self.server_socket = None
         
+        # Optional shared-memory transport
+        self.shm_name = shm_name
+        self.shm_slots = shm_slots
+        
         # Initialize Q-Network agent
         self.agent = QNetworkAgent(
-            state_size=28,  # 4 (position + goal) + 24 (proximity sensors)
+            state_size=q_protocol.STATE_SIZE,  # 4 (position + goal) + proximity + neighbours
             action_size=4,   # forward, left, right, stop
             learning_rate=0.001,
             gamma=0.99,
             epsilon=1.0,
             epsilon_min=0.01,
-            epsilon_decay=0.995
+            epsilon_decay=0.995,
+            prioritized=prioritized
         )
         
-        # Episode tracking
+        # Episode tracking (per robot, created on first contact)
         self.episode_count = 0
-        self.episode_rewards = {i: 0.0 for i in range(4)}  # 4 robots
-        self.episode_steps = {i: 0 for i in range(4)}
+        self.episode_rewards = defaultdict(float)
+        self.episode_steps = defaultdict(int)
+        
+        # Rewards waiting for the next state to complete their transition
+        self.pending_rewards = {}
         
         # Training statistics
         self.total_steps = 0
         self.training_interval = 10  # Train every N steps
         
         # Model save directory
-        self.model_dir = "../models"
+        self.model_dir = model_dir
         os.makedirs(self.model_dir, exist_ok=True)
         
         # Load existing model if available
         model_path = os.path.join(self.model_dir, "q_network_latest.pth")
         self.agent.load_model(model_path)
         
+        # Parameter sync: learner address (replica) or connected replicas (learner)
+        self.learner = learner
+        self.sync_interval = sync_interval
+        self.learner_link = None
+        self.next_link_attempt = 0.0
+        self.last_forward = time.time()
+        self.replicas = set()
+        self.weights_version = 0
+        self.synced_updates = self.agent.update_counter
+        self.last_sync = time.time()
+        if self.learner is not None:
+            self.agent.replay_buffer = ForwardingBuffer()
+        
+        # Asynchronous training: trainer process and its shared segments
+        self.async_training = async_training and self.learner is None
+        if self.async_training and self.agent.prioritized:
+            print("[WARN] The trainer process samples its shared buffer uniformly")
+        self.publish_interval = publish_interval
+        self.trainer = None
+        self.shared_weights = None
+        self.trainer_version = 0
+        
+        # Latency histograms
+        self.latency_file = latency_file
+        self.latency = LatencyStats(self.LATENCY_PHASES) if latency_file else None
+        self.latency_episodes = 0
+        self.latency_truncate = True
+        
+        # Shared-memory segment, scanned by the event loop
+        self.shm_segment = None
+        self.shm_idle_polls = 0
+        
     def start(self):
         """Start the server"""
         self.server_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         self.server_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
         self.server_socket.bind((self.host, self.port))
-        self.server_socket.listen(5)
+        self.server_socket.listen(128)
+        self.server_socket.setblocking(False)
+        
+        # One thread serves every robot connection
+        self.selector = selectors.DefaultSelector()
+        self.selector.register(self.server_socket, selectors.EVENT_READ)
         
         print("=" * 50)
         print("=== Q-Learning Server Started ===")
@@ -67,48 +224,361 @@ class QServer:
         print("=" * 50)
         print("Waiting for ARGoS to connect...\n")
         
+        if self.async_training:
+            self.start_trainer()
+        
+        if self.shm_name:
+            import q_shm
+            self.shm_segment = q_shm.ShmSegment(self.shm_name, self.shm_slots)
+            print(f"[INFO] Shared memory segment {self.shm_name} ({self.shm_slots} slots)")
+        
+        # Parameter sync and trainer weights need the loop to wake up periodically
+        timeout = min(self.sync_interval, self.publish_interval, 1.0)
+        
         try:
             while True:
-                client_socket, address = self.server_socket.accept()
-                print(f"[INFO] Connection from {address}")
-                
-                # Handle client in a new thread
-                client_thread = threading.Thread(
-                    target=self.handle_client,
-                    args=(client_socket,)
-                )
-                client_thread.start()
+                # The slots have no file descriptor: do not block while they are in use
+                wait = timeout if self.shm_segment is None else 0
+                for key, events in self.selector.select(wait):
+                    if key.fileobj is self.server_socket:
+                        self.accept_client()
+                    else:
+                        self.service_client(key.data, events)
+                if self.shm_segment is not None:
+                    self.serve_shm()
+                self.poll_trainer()
+                self.sync_parameters()
+                self.write_latency()
         
         except KeyboardInterrupt:
             print("\n[INFO] Server shutting down...")
+            self.stop_trainer()
             self.save_final_model()
         
         finally:
-            if self.server_socket:
-                self.server_socket.close()
+            self.stop_trainer()
+            for key in list(self.selector.get_map().values()):
+                key.fileobj.close()
+            self.selector.close()
+            if self.shm_segment is not None:
+                self.shm_segment.close()
+    
+    def start_trainer(self):
+        """Move the replay buffer to shared memory and start the trainer process"""
+        base = f"q_swarm_{os.getpid()}"
+        capacity = self.agent.replay_buffer.capacity
+        num_parameters = len(flatten_parameters(self.agent.q_network))
+        
+        replay = SharedReplayBuffer(base + "_replay", capacity, create=True)
+        for transition in self.agent.replay_buffer:
+            replay.push(*transition)
+        self.agent.replay_buffer = replay
+        self.shared_weights = SharedWeights(base + "_weights", num_parameters, create=True)
+        
+        # spawn: the trainer must not inherit this process's sockets or CUDA state
+        context = multiprocessing.get_context('spawn')
+        self.trainer = context.Process(
+            target=run_trainer, name="q_trainer", daemon=True,
+            args=(replay.name, self.shared_weights.name, capacity, num_parameters,
+                  os.path.join(self.model_dir, "q_network_latest.pth"),
+                  self.training_interval, self.publish_interval))
+        self.trainer.start()
+        print(f"[INFO] Trainer process started (pid {self.trainer.pid})")
+    
+    def poll_trainer(self):
+        """Load the weights the trainer published since the last call"""
+        if self.shared_weights is None:
+            return
+        published = self.shared_weights.read(self.trainer_version)
+        if published is None:
+            return
+        self.trainer_version, updates, epsilon, parameters = published
+        load_parameters(self.agent.q_network, parameters)
+        load_parameters(self.agent.target_network, parameters)
+        self.agent.update_counter = updates
+        self.agent.epsilon = epsilon
     
-    def handle_client(self, client_socket):
-        """Handle communication with a single robot controller"""
+    def stop_trainer(self):
+        """Stop the trainer and keep its last weights"""
+        if self.trainer is None:
+            return
+        self.agent.replay_buffer.stop()
+        self.trainer.join(timeout=10.0)
+        if self.trainer.is_alive():
+            self.trainer.terminate()
+        self.poll_trainer()
+        self.trainer = None
+        
+        # Back to a local buffer (the checkpoint code samples it)
+        shared = self.agent.replay_buffer
+        self.agent.replay_buffer = make_replay_buffer(
+            capacity=shared.capacity,
+            alpha=self.agent.priority_alpha if self.agent.prioritized else None)
+        for row in shared.rows[:len(shared)].copy():
+            self.agent.replay_buffer.push(row['state'].copy(), int(row['action']), float(row['reward']),
+                                          row['next_state'].copy(), bool(row['done']))
+        shared.close(unlink=True)
+        self.shared_weights.close(unlink=True)
+        self.shared_weights = None
+    
+    def accept_client(self):
+        """Accept a controller connection and add it to the event loop"""
         try:
-            while True:
-                # Receive message
-                data = client_socket.recv(4096).decode('utf-8').strip()
-                
-                if not data:
-                    break
-                
-                # Parse and handle message
-                response = self.process_message(data)
-                
-                # Send response
+            client_socket, address = self.server_socket.accept()
+        except BlockingIOError:
+            return
+        print(f"[INFO] Connection from {address}")
+        client_socket.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        client_socket.setblocking(False)
+        client = ClientConnection(client_socket, address)
+        self.selector.register(client_socket, selectors.EVENT_READ, client)
+    
+    def service_client(self, client, events):
+        """Read what a connection sent, answer complete messages, flush replies"""
+        if events & selectors.EVENT_READ:
+            try:
+                data = client.sock.recv(65536)
+            except BlockingIOError:
+                data = None
+            except OSError:
+                data = b''
+            
+            if data == b'':
+                self.close_client(client)
+                return
+            
+            if data:
+                try:
+                    start = LatencyStats.now() if self.latency else 0
+                    for reply in self.handle_data(client, data):
+                        client.outgoing += reply
+                    if self.latency:
+                        self.latency.record_since('request', start)
+                except Exception as e:
+                    print(f"[ERROR] Client handler error: {e}")
+                    self.close_client(client)
+                    return
+        
+        self.flush_client(client)
+    
+    def handle_data(self, client, data):
+        """
+        Feed received bytes to the connection's reader and handle every
+        complete message (the protocol is detected from the first byte)
+        Returns: list of encoded replies, in message order
+        """
+        if client.reader is None:
+            client.binary = q_protocol.is_binary(data)
+            client.reader = q_protocol.FrameReader() if client.binary else q_protocol.LineReader()
+        
+        replies = []
+        if client.binary:
+            sync_types = (q_protocol.MSG_TRANSITIONS, q_protocol.MSG_WEIGHTS)
+            # Consecutive STEP frames of different robots (a pooled connection
+            # carries many robots) are answered with one forward pass
+            steps = []
+            for msg_type, robot_id, payload in client.reader.feed(data):
+                if msg_type in (q_protocol.MSG_STEP, q_protocol.MSG_COMPACT_STEP):
+                    if any(step[0] == robot_id for step in steps):
+                        replies.append(self.process_steps(steps))
+                        steps = []
+                    if msg_type == q_protocol.MSG_STEP:
+                        step = q_protocol.decode_step(payload)
+                    else:
+                        step = q_protocol.decode_compact_step(payload, robot_id, client.goals)
+                    steps.append((robot_id,) + step)
+                    continue
+                if steps:
+                    replies.append(self.process_steps(steps))
+                    steps = []
+                if msg_type in sync_types:
+                    self.process_sync_frame(client, msg_type, payload)
+                    continue
+                if msg_type == q_protocol.MSG_COMPACT_BATCH_STEP:
+                    batch = q_protocol.decode_compact_batch_step(payload, client.goals)
+                    replies.append(self.on_batch_step(*batch).astype(np.uint8).tobytes())
+                    continue
+                reply = self.process_frame(msg_type, robot_id, payload)
+                if reply is None:
+                    raise ValueError(f"Unknown binary message type: {msg_type}")
+                replies.append(reply)
+            if steps:
+                replies.append(self.process_steps(steps))
+        else:
+            for message in client.reader.feed(data):
+                response = self.process_message(message)
                 if response:
-                    client_socket.send((response + "\n").encode('utf-8'))
+                    replies.append((response + "\n").encode('utf-8'))
+        return replies
+    
+    def flush_client(self, client):
+        """Send pending replies; wait for writability if the socket is full"""
+        if client.outgoing:
+            try:
+                sent = client.sock.send(client.outgoing)
+            except BlockingIOError:
+                sent = 0
+            except OSError:
+                self.close_client(client)
+                return
+            del client.outgoing[:sent]
         
-        except Exception as e:
-            print(f"[ERROR] Client handler error: {e}")
+        events = selectors.EVENT_READ
+        if client.outgoing:
+            events |= selectors.EVENT_WRITE
+        if events != client.events:
+            client.events = events
+            self.selector.modify(client.sock, events, client)
+    
+    def close_client(self, client):
+        """Remove a connection from the event loop"""
+        print(f"[INFO] Connection from {client.address} closed")
+        self.selector.unregister(client.sock)
+        client.sock.close()
+        self.replicas.discard(client)
+        if client is self.learner_link:
+            self.learner_link = None
+            self.next_link_attempt = time.time() + self.sync_interval
+    
+    def process_sync_frame(self, client, msg_type, payload):
+        """Handle a parameter sync frame (no reply)"""
+        if msg_type == q_protocol.MSG_TRANSITIONS:
+            # Learner: experience collected by a replica's robots
+            if not client.replica:
+                print(f"[SYNC] Replica {client.address} connected")
+                client.replica = True
+                self.replicas.add(client)
+            states, actions, rewards, next_states, dones = q_protocol.decode_transitions(payload)
+            for i in range(len(actions)):
+                self.agent.replay_buffer.push(states[i], int(actions[i]), float(rewards[i]),
+                                              next_states[i], bool(dones[i]))
+            self.count_steps(len(actions))
         
-        finally:
-            client_socket.close()
+        elif client is self.learner_link:
+            self.on_weights(payload)
+    
+    def sync_parameters(self):
+        """Forward transitions (replica) or broadcast weights (learner) when due"""
+        now = time.time()
+        if self.learner is not None:
+            if self.learner_link is None and now >= self.next_link_attempt:
+                self.connect_learner()
+            
+            queue = self.agent.replay_buffer.queue
+            due = len(queue) >= self.TRANSITION_BATCH or (queue and now - self.last_forward >= 1.0)
+            if self.learner_link is not None and due:
+                transitions = self.agent.replay_buffer.take()
+                states, actions, rewards, next_states, dones = zip(*transitions)
+                self.learner_link.outgoing += q_protocol.encode_transitions(
+                    states, actions, rewards, next_states, dones)
+                self.flush_client(self.learner_link)
+                self.last_forward = now
+        
+        elif self.replicas and now - self.last_sync >= self.sync_interval:
+            self.last_sync = now
+            if self.agent.update_counter == self.synced_updates:
+                return
+            self.synced_updates = self.agent.update_counter
+            self.weights_version += 1
+            frame = q_protocol.encode_weights(self.weights_version, self.agent.epsilon,
+                                              [flatten_parameters(self.agent.q_network)])
+            for replica in list(self.replicas):
+                replica.outgoing += frame
+                self.flush_client(replica)
+    
+    def connect_learner(self):
+        """Replica: open the connection to the learner (retried every sync_interval)"""
+        try:
+            sock = socket.create_connection(self.learner, timeout=1.0)
+        except OSError as e:
+            print(f"[SYNC] Learner {self.learner[0]}:{self.learner[1]} unreachable ({e}), "
+                  f"serving with the current weights")
+            self.next_link_attempt = time.time() + self.sync_interval
+            return
+        print(f"[SYNC] Connected to learner {self.learner[0]}:{self.learner[1]}")
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sock.setblocking(False)
+        link = ClientConnection(sock, self.learner)
+        link.binary = True
+        link.reader = q_protocol.FrameReader()
+        self.selector.register(sock, selectors.EVENT_READ, link)
+        self.learner_link = link
+    
+    def on_weights(self, payload):
+        """Replica: load the weights broadcast by the learner"""
+        version, epsilon, flat = q_protocol.decode_weights(payload)
+        load_parameters(self.agent.q_network, flat)
+        self.agent.epsilon = epsilon
+        print(f"[SYNC] Weights version {version} loaded (epsilon {epsilon:.4f})")
+    
+    def process_frame(self, msg_type, robot_id, payload):
+        """
+        Handle one binary frame
+        Returns: reply bytes, or None for an unknown message type
+        """
+        if msg_type == q_protocol.MSG_BATCH_STEP:
+            robot_ids, states, prev_rewards, flags = q_protocol.decode_batch_step(payload)
+            actions = self.on_batch_step(robot_ids, states, prev_rewards, flags)
+            return actions.astype(np.uint8).tobytes()
+        
+        elif msg_type == q_protocol.MSG_STEP:
+            state, prev_reward, flags = q_protocol.decode_step(payload)
+            return q_protocol.encode_action(self.on_step(robot_id, state, prev_reward, flags))
+        
+        elif msg_type == q_protocol.MSG_STATE:
+            return q_protocol.encode_action(self.on_state(robot_id, q_protocol.decode_state(payload)))
+        
+        elif msg_type == q_protocol.MSG_REWARD:
+            reward, done = q_protocol.decode_reward(payload)
+            self.on_reward(robot_id, reward, done)
+            return q_protocol.ACK_BYTE
+        
+        return None
+    
+    def process_steps(self, steps):
+        """
+        Handle decoded STEP frames of distinct robots received together
+        steps: list of (robot_id, state, prev_reward, flags)
+        Returns: one action byte per frame, in frame order
+        """
+        if len(steps) == 1:
+            robot_id, state, prev_reward, flags = steps[0]
+            return q_protocol.encode_action(self.on_step(robot_id, state, prev_reward, flags))
+        
+        robot_ids = []
+        states = np.empty((len(steps), q_protocol.STATE_SIZE), dtype=np.float32)
+        prev_rewards = np.empty(len(steps), dtype=np.float32)
+        flags = np.empty(len(steps), dtype=np.uint8)
+        for i, (robot_id, state, prev_rewards[i], flags[i]) in enumerate(steps):
+            states[i] = state
+            robot_ids.append(robot_id)
+        actions = self.on_batch_step(robot_ids, states, prev_rewards, flags)
+        return actions.astype(np.uint8).tobytes()
+    
+    def serve_shm(self):
+        """Answer the shared-memory slots that are ready (one scan per loop pass)"""
+        try:
+            ready, seqs = self.shm_segment.poll()
+            if len(ready) == 0:
+                # Spin briefly, then back off so an idle server does not burn a core
+                self.shm_idle_polls += 1
+                if self.shm_idle_polls > self.SHM_SPIN_POLLS:
+                    time.sleep(self.SHM_IDLE_SLEEP)
+                return
+            self.shm_idle_polls = 0
+            
+            start = LatencyStats.now() if self.latency else 0
+            slots = self.shm_segment.slots[ready]
+            actions = self.on_batch_step(slots['robot_id'], slots['state'],
+                                         slots['prev_reward'], slots['flags'])
+            self.shm_segment.respond(ready, seqs, actions)
+            if self.latency:
+                self.latency.record_since('shm_request', start)
+        
+        except Exception as e:
+            print(f"[ERROR] Shared memory server error: {e}")
+            self.shm_segment.close()
+            self.shm_segment = None
     
     def process_message(self, message):
         """Process incoming message and return response"""
@@ -119,7 +589,10 @@ class QServer:
         
         msg_type = parts[0]
         
-        if msg_type == "STATE":
+        if msg_type == "STEP":
+            return self.handle_step(parts)
+        
+        elif msg_type == "STATE":
             return self.handle_state(parts)
         
         elif msg_type == "REWARD":
@@ -129,6 +602,40 @@ class QServer:
             print(f"[WARNING] Unknown message type: {msg_type}")
             return None
     
+    def handle_step(self, parts):
+        """
+        Handle STEP message
+        Format: STEP|robot_id|prev_reward|flags|x|y|goal_x|goal_y|prox0|...|prox23
+        Returns: ACTION|action_id
+        """
+        try:
+            robot_id = int(parts[1])
+            prev_reward = float(parts[2])
+            flags = int(parts[3])
+            state_values = [float(x) for x in parts[4:]]
+            
+            # Verify state size
+            if len(state_values) != q_protocol.STATE_SIZE:
+                print(f"[WARNING] Invalid state size: {len(state_values)} "
+                      f"(expected {q_protocol.STATE_SIZE})")
+                return "ACTION|0"  # Default: move forward
+            
+            return f"ACTION|{self.on_step(robot_id, state_values, prev_reward, flags)}"
+        
+        except Exception as e:
+            print(f"[ERROR] Error handling step: {e}")
+            return "ACTION|0"
+    
+    def on_step(self, robot_id, state_values, prev_reward, flags):
+        """
+        Record the previous reward (if any), then select an action
+        Returns: action id
+        """
+        if flags & q_protocol.STEP_HAS_PREV:
+            self.on_reward(robot_id, prev_reward,
+                           bool(flags & q_protocol.STEP_PREV_DONE))
+        return self.on_state(robot_id, state_values)
+    
     def handle_state(self, parts):
         """
         Handle STATE message
@@ -140,32 +647,99 @@ class QServer:
             state_values = [float(x) for x in parts[2:]]
             
             # Verify state size
-            if len(state_values) != 28:
-                print(f"[WARNING] Invalid state size: {len(state_values)} (expected 28)")
+            if len(state_values) != q_protocol.STATE_SIZE:
+                print(f"[WARNING] Invalid state size: {len(state_values)} "
+                      f"(expected {q_protocol.STATE_SIZE})")
                 return "ACTION|0"  # Default: move forward
             
+            return f"ACTION|{self.on_state(robot_id, state_values)}"
+        
+        except Exception as e:
+            print(f"[ERROR] Error handling state: {e}")
+            return "ACTION|0"
+    
+    def on_state(self, robot_id, state_values):
+        """
+        Select an action for a decoded state and train periodically
+        Returns: action id
+        """
+        try:
+            self.complete_pending(robot_id, state_values)
+            
             # Select action using Q-Network
+            start = LatencyStats.now() if self.latency else 0
             action = self.agent.select_action(state_values, robot_id)
+            if self.latency:
+                self.latency.record_since('select', start)
             
-            # Increment step counter
-            self.total_steps += 1
-            self.episode_steps[robot_id] += 1
+            self.advance_steps([robot_id])
+            return action
+        
+        except Exception as e:
+            print(f"[ERROR] Error handling state: {e}")
+            return 0
+    
+    def on_batch_step(self, robot_ids, states, prev_rewards, flags):
+        """
+        Handle a whole swarm tick: record rewards, then select all
+        actions with a single forward pass
+        Returns: numpy array of action ids, in batch order
+        """
+        try:
+            robot_ids = [int(robot_id) for robot_id in robot_ids]
+            for i, robot_id in enumerate(robot_ids):
+                if flags[i] & q_protocol.STEP_HAS_PREV:
+                    self.on_reward(robot_id, float(prev_rewards[i]),
+                                   bool(flags[i] & q_protocol.STEP_PREV_DONE))
+                self.complete_pending(robot_id, states[i])
             
-            # Train periodically
-            if self.total_steps % self.training_interval == 0:
-                loss = self.agent.train()
-                if loss is not None and self.total_steps % 100 == 0:
-                    stats = self.agent.get_statistics()
-                    print(f"[TRAIN] Step {self.total_steps} | "
-                          f"Loss: {loss:.4f} | "
-                          f"Epsilon: {stats['epsilon']:.4f} | "
-                          f"Buffer: {stats['buffer_size']}")
+            start = LatencyStats.now() if self.latency else 0
+            actions = self.agent.select_actions(states, robot_ids)
+            if self.latency:
+                self.latency.record_since('select', start)
             
-            return f"ACTION|{action}"
+            self.advance_steps(robot_ids)
+            return actions
         
         except Exception as e:
-            print(f"[ERROR] Error handling state: {e}")
-            return "ACTION|0"
+            print(f"[ERROR] Error handling batch: {e}")
+            return np.zeros(len(robot_ids), dtype=np.uint8)
+    
+    def complete_pending(self, robot_id, state_values):
+        """Complete the previous transition with this state as next_state"""
+        if robot_id in self.pending_rewards:
+            reward = self.pending_rewards.pop(robot_id)
+            self.agent.store_transition(robot_id, reward, state_values, False)
+    
+    def advance_steps(self, robot_ids):
+        """Count one step per robot and train every training_interval steps"""
+        for robot_id in robot_ids:
+            self.episode_steps[robot_id] += 1
+        self.count_steps(len(robot_ids))
+    
+    def count_steps(self, count):
+        """Count transitions (local or from replicas) and train when due"""
+        previous_steps = self.total_steps
+        self.total_steps += count
+        if self.trainer is not None:
+            return  # the trainer process trains on the shared buffer
+        
+        # Train periodically (once per interval crossed, so batches keep the same ratio)
+        intervals = (self.total_steps // self.training_interval -
+                     previous_steps // self.training_interval)
+        latency = self.latency
+        for _ in range(intervals):
+            start = LatencyStats.now() if latency else 0
+            loss = self.agent.train()
+            if latency:
+                latency.record_since('train', start)
+        
+        if intervals and loss is not None and self.total_steps // 100 != previous_steps // 100:
+            stats = self.agent.get_statistics()
+            print(f"[TRAIN] Step {self.total_steps} | "
+                  f"Loss: {loss:.4f} | "
+                  f"Epsilon: {stats['epsilon']:.4f} | "
+                  f"Buffer: {stats['buffer_size']}")
     
     def handle_reward(self, parts):
         """
@@ -178,11 +752,25 @@ class QServer:
             reward = float(parts[2])
             done = int(parts[3]) == 1
             
-            # Get next state (will be provided in next STATE message)
-            # For now, use current state as placeholder
-            if robot_id in self.agent.current_states:
-                next_state = self.agent.current_states[robot_id]
-                self.agent.store_transition(robot_id, reward, next_state, done)
+            self.on_reward(robot_id, reward, done)
+            return "ACK"
+        
+        except Exception as e:
+            print(f"[ERROR] Error handling reward: {e}")
+            return "ACK"
+    
+    def on_reward(self, robot_id, reward, done):
+        """Record a decoded reward and handle episode completion"""
+        try:
+            if done:
+                # Terminal transition: next_state is masked out of the
+                # target, so the last state is a valid stand-in
+                if robot_id in self.agent.current_states:
+                    next_state = self.agent.current_states[robot_id]
+                    self.agent.store_transition(robot_id, reward, next_state, done)
+            else:
+                # Stored once the next state arrives
+                self.pending_rewards[robot_id] = reward
             
             # Update episode reward
             self.episode_rewards[robot_id] += reward
@@ -193,8 +781,11 @@ class QServer:
                       f"Steps: {self.episode_steps[robot_id]} | "
                       f"Reward: {self.episode_rewards[robot_id]:.2f}")
                 
-                # Store episode reward
-                self.agent.episode_rewards.append(self.episode_rewards[robot_id])
+                # Store episode reward (recent ones only, trimmed in blocks)
+                history = self.agent.episode_rewards
+                history.append(self.episode_rewards[robot_id])
+                if len(history) > 2 * self.EPISODE_HISTORY:
+                    del history[:-self.EPISODE_HISTORY]
                 
                 # Reset episode tracking for this robot
                 self.episode_rewards[robot_id] = 0.0
@@ -202,20 +793,34 @@ class QServer:
                 
                 # Increment episode count
                 self.episode_count += 1
+                self.latency_episodes += 1
                 
-                # Save model periodically
-                if self.episode_count % 25 == 0:
+                # Save model periodically (the learner's copy is the model)
+                if self.episode_count % 25 == 0 and self.learner is None:
                     self.save_model()
                 
                 # Print statistics every 100 episodes
                 if self.episode_count % 100 == 0:
                     self.print_statistics()
-            
-            return "ACK"
         
         except Exception as e:
             print(f"[ERROR] Error handling reward: {e}")
-            return "ACK"
+    
+    def write_latency(self):
+        """
+        Append the latency histograms to the latency file once a round of
+        episodes ended, then start new ones
+        """
+        if self.latency is None or self.latency_episodes < max(len(self.episode_rewards), 1):
+            return
+        self.latency_episodes = 0
+        
+        try:
+            self.latency.write(self.latency_file, self.episode_count, truncate=self.latency_truncate)
+            self.latency_truncate = False
+        except OSError as e:
+            print(f"[ERROR] Latency histograms not written: {e}")
+        self.latency.clear()
     
     def save_model(self):
         """Save the current model"""
@@ -225,9 +830,37 @@ class QServer:
         # Also save as latest
         latest_path = os.path.join(self.model_dir, "q_network_latest.pth")
         self.agent.save_model(latest_path)
+        
+        # Flat weights for controllers running inference="native"
+        export_policy(self.agent.q_network, os.path.join(self.model_dir, "q_network_latest.bin"))
+        self.export_int8_policy()
+    
+    def export_int8_policy(self, max_states=4096, min_agreement=0.99):
+        """
+        Record states from the replay buffer and export the int8 policy
+        if it picks the same actions as the float model on them
+        """
+        replay_buffer = self.agent.replay_buffer
+        if len(replay_buffer) == 0:
+            return
+        
+        transitions = replay_buffer.sample(min(max_states, len(replay_buffer)))
+        states = np.array([transition[0] for transition in transitions], dtype=np.float32)
+        np.save(os.path.join(self.model_dir, "recorded_states.npy"), states)
+        
+        agreement = check_agreement(self.agent.q_network.state_dict(), states)
+        int8_path = os.path.join(self.model_dir, "q_network_latest_int8.bin")
+        if agreement >= min_agreement:
+            export_policy(self.agent.q_network, int8_path, int8=True)
+            print(f"[INFO] int8 policy exported ({agreement * 100:.2f}% argmax agreement)")
+        else:
+            print(f"[WARN] int8 policy not exported: {agreement * 100:.2f}% argmax agreement")
     
     def save_final_model(self):
         """Save the final model and statistics"""
+        if self.learner is not None:
+            return
+        
         final_path = os.path.join(self.model_dir, "q_network_final.pth")
         self.agent.save_model(final_path)
         
@@ -235,11 +868,14 @@ class QServer:
         self.save_training_curve()
     
     def save_training_curve(self):
-        """Save training curve data"""
+        """
+        Save the recent episode rewards (at most 2 * EPISODE_HISTORY) for
+        visualize.py; every episode of a run is in the episode log
+        """
         import json
         
         curve_data = {
-            'episode_rewards': self.agent.episode_rewards,
+            'episode_rewards': list(self.agent.episode_rewards),
             'total_episodes': self.episode_count,
             'final_epsilon': self.agent.epsilon
         }
@@ -261,13 +897,48 @@ class QServer:
         print(f"Epsilon: {stats['epsilon']:.4f}")
         print(f"Buffer Size: {stats['buffer_size']}")
         print(f"Avg Reward (last 100): {stats['avg_reward_last_100']:.2f}")
-        print(f"Total Episodes: {stats['total_episodes']}")
+        print(f"Total Episodes: {self.episode_count}")
         print("=" * 60 + "\n")
 
 
 def main():
+    parser = argparse.ArgumentParser(description="Q-Network server for ARGoS")
+    parser.add_argument('--host', default='localhost',
+                        help="address to listen on (default: localhost; 0.0.0.0 for other nodes)")
+    parser.add_argument('--port', type=int, default=5555,
+                        help="TCP port (default: 5555)")
+    parser.add_argument('--shm', metavar='NAME', default=None,
+                        help="also serve the shared-memory transport on segment NAME (e.g. /q_swarm)")
+    parser.add_argument('--shm-slots', type=int, default=1024,
+                        help="robot slots in the shared-memory segment (default: 1024)")
+    parser.add_argument('--learner', metavar='HOST:PORT', default=None,
+                        help="run as an inference replica of the learner server at HOST:PORT")
+    parser.add_argument('--sync-interval', type=float, default=5.0,
+                        help="seconds between weight broadcasts to replicas (default: 5)")
+    parser.add_argument('--async-training', action='store_true',
+                        help="train in a separate process; this one only selects actions")
+    parser.add_argument('--prioritized', action='store_true',
+                        help="prioritized experience replay (needs libq_swarm_replay)")
+    parser.add_argument('--publish-interval', type=float, default=1.0,
+                        help="seconds between weight updates from the trainer process (default: 1)")
+    parser.add_argument('--latency', metavar='FILE', default=None,
+                        help="append per-phase latency percentiles to FILE (.csv or .json) every round of episodes")
+    parser.add_argument('--model-dir', metavar='DIR', default='../models',
+                        help="where models and training data are loaded and saved (default: ../models)")
+    args = parser.parse_args()
+    
+    learner = None
+    if args.learner:
+        learner_host, _, learner_port = args.learner.rpartition(':')
+        learner = (learner_host or 'localhost', int(learner_port))
+    
     # Create and start server
-    server = QServer(host='localhost', port=5555)
+    server = QServer(host=args.host, port=args.port,
+                     shm_name=args.shm, shm_slots=args.shm_slots,
+                     learner=learner, sync_interval=args.sync_interval,
+                     async_training=args.async_training, publish_interval=args.publish_interval,
+                     prioritized=args.prioritized, latency_file=args.latency,
+                     model_dir=args.model_dir)
     server.start()
 
 
@@ -0,0 +1,117 @@
+"""
+Shared-Memory Transport
+
+Server side of controllers/q_swarm_controller/q_swarm_shm_transport.h.
+
+The server creates a POSIX shared memory segment with one slot per robot:
+    header (64 bytes): magic u32 | version u32 | num_slots u32 | slot_size u32
+    slots (SLOT_SIZE bytes each, 192 for 28 floats, indexed by robot id):
+        request_seq u32 | response_seq u32 | robot_id u32 |
+        flags u8 | action u8 | 2 bytes padding |
+        prev_reward f32 | state f32[STATE_SIZE] | padding
+
+A controller fills its slot and increments request_seq. The server polls
+all slots, answers every pending request in one batch by writing action
+and then response_seq = request_seq, and wakes waiting controllers
+through a futex on response_seq (Linux). Controllers wait with a short
+timeout, so a missing wake-up only adds latency.
+"""
+
+import ctypes
+import platform
+import sys
+import numpy as np
+from multiprocessing import shared_memory
+import q_protocol
+
+MAGIC = 0x4D485351  # "QSHM"
+VERSION = 1
+HEADER_SIZE = 64
+# Fields and state rounded up to 64-byte cache lines (192 for 28 floats)
+SLOT_SIZE = (20 + 4 * q_protocol.STATE_SIZE + 63) // 64 * 64
+
+SLOT_DTYPE = np.dtype({
+    'names': ['request_seq', 'response_seq', 'robot_id', 'flags', 'action',
+              'prev_reward', 'state'],
+    'formats': ['<u4', '<u4', '<u4', 'u1', 'u1', '<f4', ('<f4', (q_protocol.STATE_SIZE,))],
+    'offsets': [0, 4, 8, 12, 13, 16, 20],
+    'itemsize': SLOT_SIZE,
+})
+
+RESPONSE_SEQ_OFFSET = 4
+
+FUTEX_WAKE = 1
+SYS_FUTEX = {'x86_64': 202, 'aarch64': 98, 'armv7l': 240, 'i686': 240}
+
+
+def make_futex_waker():
+    """Return a function waking all futex waiters at an address, or None"""
+    if not sys.platform.startswith('linux'):
+        return None
+    number = SYS_FUTEX.get(platform.machine())
+    if number is None:
+        return None
+
+    syscall = ctypes.CDLL(None, use_errno=True).syscall
+
+    def wake(address):
+        syscall(number, ctypes.c_void_p(address), FUTEX_WAKE, 0x7fffffff, None, None, 0)
+
+    return wake
+
+
+class ShmSegment:
+    """Server-owned shared memory segment holding one slot per robot"""
+
+    def __init__(self, name='/q_swarm', num_slots=1024):
+        # SharedMemory adds the leading '/' itself
+        self.name = name.lstrip('/')
+        self.num_slots = num_slots
+        size = HEADER_SIZE + num_slots * SLOT_SIZE
+
+        try:
+            self.shm = shared_memory.SharedMemory(name=self.name, create=True, size=size)
+        except FileExistsError:
+            # Left over from a server that did not shut down cleanly
+            stale = shared_memory.SharedMemory(name=self.name)
+            stale.close()
+            stale.unlink()
+            self.shm = shared_memory.SharedMemory(name=self.name, create=True, size=size)
+
+        self.slots = np.ndarray((num_slots,), dtype=SLOT_DTYPE,
+                                buffer=self.shm.buf, offset=HEADER_SIZE)
+        self.slots[:] = np.zeros(1, dtype=SLOT_DTYPE)
+
+        # Publish the header last: controllers check the magic
+        header = np.ndarray((4,), dtype='<u4', buffer=self.shm.buf)
+        header[1:] = (VERSION, num_slots, SLOT_SIZE)
+        header[0] = MAGIC
+        del header
+
+        self.response_base = self.slots.ctypes.data + RESPONSE_SEQ_OFFSET
+        self.wake = make_futex_waker()
+
+    def poll(self):
+        """
+        Find slots with a pending request
+
+        Returns:
+            (slot indices, their request sequence numbers)
+        """
+        request_seq = self.slots['request_seq'].copy()
+        ready = np.nonzero(request_seq != self.slots['response_seq'])[0]
+        return ready, request_seq[ready]
+
+    def respond(self, ready, seqs, actions):
+        """Write the actions, then release the waiting controllers"""
+        self.slots['action'][ready] = actions
+        self.slots['response_seq'][ready] = seqs
+        if self.wake is not None:
+            for index in ready:
+                self.wake(self.response_base + int(index) * SLOT_SIZE)
+
+    def close(self):
+        """Unmap and remove the segment"""
+        del self.slots
+        self.shm.close()
+        self.shm.unlink()
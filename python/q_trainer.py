@@ -0,0 +1,245 @@
+"""
+Asynchronous Trainer
+
+With --async-training, q_server.py only selects actions and records
+transitions; a separate trainer process samples the replay buffer and
+runs the backward passes on its own core (or the GPU). Robots waiting
+for an action therefore never wait for a training step.
+
+The two processes share two POSIX shared memory segments:
+
+    replay (one writer: the server, one reader: the trainer):
+        header (64 bytes): written u64 | stop u64
+        rows (TRANSITION_DTYPE, capacity of them): ring buffer,
+            transition i is row i % capacity
+    weights (one writer: the trainer, one reader: the server):
+        header (64 bytes): seq u64 | version u64 | updates u64 | epsilon f64
+        parameters: float32, q_network.state_dict() flattened in key order
+
+The server writes a row before incrementing written, and the trainer
+never samples the oldest rows of a full ring (the next ones to be
+overwritten). The weights are published under a sequence lock: seq is
+odd while the trainer writes them, and the server retries a copy
+during which seq changed.
+
+The trainer keeps the synchronous server's replay ratio (one batch per
+training_interval transitions) and publishes new weights every
+publish_interval seconds. When it cannot keep up it trains at its own
+pace instead of queueing work.
+"""
+
+import time
+import numpy as np
+from multiprocessing import shared_memory
+import q_protocol
+
+HEADER_SIZE = 64
+
+TRANSITION_DTYPE = np.dtype([
+    ('state', '<f4', (q_protocol.STATE_SIZE,)),
+    ('action', 'u1'),
+    ('done', 'u1'),
+    ('reward', '<f4'),
+    ('next_state', '<f4', (q_protocol.STATE_SIZE,)),
+])
+
+# Rows next to the write position the trainer does not sample
+OVERWRITE_MARGIN = 256
+
+# Batches the trainer catches up on at once before dropping the backlog
+MAX_BACKLOG = 64
+
+
+def _open_segment(name, size, create):
+    """Create (replacing a stale one) or attach a shared memory segment"""
+    if not create:
+        return shared_memory.SharedMemory(name=name)
+    try:
+        return shared_memory.SharedMemory(name=name, create=True, size=size)
+    except FileExistsError:
+        stale = shared_memory.SharedMemory(name=name)
+        stale.close()
+        stale.unlink()
+        return shared_memory.SharedMemory(name=name, create=True, size=size)
+
+
+class SharedReplayBuffer:
+    """
+    Replay buffer in shared memory (same interface as q_network.ReplayBuffer)
+    """
+
+    def __init__(self, name, capacity=10000, create=False):
+        self.name = name
+        self.capacity = capacity
+        self.shm = _open_segment(name, HEADER_SIZE + capacity * TRANSITION_DTYPE.itemsize, create)
+        self.header = np.ndarray((2,), dtype='<u8', buffer=self.shm.buf)
+        self.rows = np.ndarray((capacity,), dtype=TRANSITION_DTYPE,
+                               buffer=self.shm.buf, offset=HEADER_SIZE)
+        if create:
+            self.header[:] = 0
+
+    @property
+    def written(self):
+        return int(self.header[0])
+
+    @property
+    def stopped(self):
+        return bool(self.header[1])
+
+    def stop(self):
+        self.header[1] = 1
+
+    def push(self, state, action, reward, next_state, done):
+        written = int(self.header[0])
+        row = self.rows[written % self.capacity]
+        row['state'] = state
+        row['action'] = action
+        row['done'] = done
+        row['reward'] = reward
+        row['next_state'] = next_state
+        self.header[0] = written + 1
+
+    def sample_batch(self, batch_size):
+        """(states, actions, rewards, next_states, dones) arrays of batch_size random rows"""
+        written = self.written
+        size = min(written, self.capacity)
+        if size == self.capacity:
+            size -= OVERWRITE_MARGIN
+        indices = (written - 1 - np.random.randint(0, size, batch_size)) % self.capacity
+        rows = self.rows[indices]
+        return (np.ascontiguousarray(rows['state']), rows['action'].astype(np.int64),
+                np.ascontiguousarray(rows['reward']), np.ascontiguousarray(rows['next_state']),
+                rows['done'].astype(np.float32))
+
+    def sample(self, batch_size):
+        return list(zip(*self.sample_batch(batch_size)))
+
+    def __len__(self):
+        return min(self.written, self.capacity)
+
+    def close(self, unlink=False):
+        self.header = self.rows = None
+        self.shm.close()
+        if unlink:
+            self.shm.unlink()
+
+
+class SharedWeights:
+    """Latest Q-Network parameters published by the trainer"""
+
+    def __init__(self, name, num_parameters, create=False):
+        self.name = name
+        self.shm = _open_segment(name, HEADER_SIZE + 4 * num_parameters, create)
+        self.header = np.ndarray((3,), dtype='<u8', buffer=self.shm.buf)
+        self.epsilon = np.ndarray((1,), dtype='<f8', buffer=self.shm.buf, offset=24)
+        self.parameters = np.ndarray((num_parameters,), dtype='<f4',
+                                     buffer=self.shm.buf, offset=HEADER_SIZE)
+        if create:
+            self.header[:] = 0
+
+    def publish(self, version, updates, epsilon, parameters):
+        self.header[0] += 1
+        self.header[1] = version
+        self.header[2] = updates
+        self.epsilon[0] = epsilon
+        self.parameters[:] = parameters
+        self.header[0] += 1
+
+    def read(self, last_version):
+        """(version, updates, epsilon, parameters) if newer than last_version, else None"""
+        while True:
+            seq = int(self.header[0])
+            if int(self.header[1]) == last_version and seq % 2 == 0:
+                return None
+            if seq % 2:
+                time.sleep(0.0001)
+                continue
+            version = int(self.header[1])
+            updates = int(self.header[2])
+            epsilon = float(self.epsilon[0])
+            parameters = self.parameters.copy()
+            if int(self.header[0]) == seq:
+                return version, updates, epsilon, parameters
+
+    def close(self, unlink=False):
+        self.header = self.epsilon = self.parameters = None
+        self.shm.close()
+        if unlink:
+            self.shm.unlink()
+
+
+def flatten_parameters(network):
+    """Parameters of a network as one float32 array, state_dict() key order"""
+    return np.concatenate([tensor.detach().cpu().numpy().ravel().astype('<f4')
+                           for tensor in network.state_dict().values()])
+
+
+def load_parameters(network, flat):
+    """Load a flatten_parameters() array into a network"""
+    import torch
+
+    state_dict = network.state_dict()
+    if len(flat) != sum(tensor.numel() for tensor in state_dict.values()):
+        raise ValueError(f"{len(flat)} parameters do not match the network")
+
+    offset = 0
+    weights = {}
+    for key, tensor in state_dict.items():
+        count = tensor.numel()
+        weights[key] = torch.from_numpy(np.array(flat[offset:offset + count])).reshape(tensor.shape)
+        offset += count
+    network.load_state_dict(weights)
+
+
+def run_trainer(replay_name, weights_name, capacity, num_parameters, model_path,
+                training_interval=10, publish_interval=1.0):
+    """Trainer process: train on the shared replay buffer until the server stops it"""
+    import torch
+    from q_network import QNetworkAgent
+
+    # One core for the backward passes, the others stay with the server
+    torch.set_num_threads(1)
+
+    agent = QNetworkAgent(state_size=q_protocol.STATE_SIZE, action_size=4)
+    agent.load_model(model_path)
+    agent.replay_buffer = SharedReplayBuffer(replay_name, capacity)
+    weights = SharedWeights(weights_name, num_parameters)
+
+    counted = agent.replay_buffer.written
+    version = 0
+    published_updates = agent.update_counter
+    next_publish = time.time() + publish_interval
+    loss = None
+
+    try:
+        while not agent.replay_buffer.stopped:
+            written = agent.replay_buffer.written
+            intervals = written // training_interval - counted // training_interval
+            counted = written
+
+            for _ in range(min(intervals, MAX_BACKLOG)):
+                loss = agent.train()
+                if loss is not None and agent.update_counter % 100 == 0:
+                    print(f"[TRAIN] Update {agent.update_counter} | "
+                          f"Loss: {loss:.4f} | "
+                          f"Epsilon: {agent.epsilon:.4f} | "
+                          f"Buffer: {len(agent.replay_buffer)}")
+
+            now = time.time()
+            if now >= next_publish and agent.update_counter != published_updates:
+                version += 1
+                published_updates = agent.update_counter
+                weights.publish(version, published_updates, agent.epsilon,
+                                flatten_parameters(agent.q_network))
+                next_publish = now + publish_interval
+
+            if intervals == 0:
+                time.sleep(0.001)
+
+        # Last weights for the server's final checkpoint
+        weights.publish(version + 1, agent.update_counter, agent.epsilon,
+                        flatten_parameters(agent.q_network))
+
+    finally:
+        agent.replay_buffer.close()
+        weights.close()
@@ -121,10 +121,16 @@ def test_file_structure():
     required_files = [
         "q_network.py",
         "q_server.py",
+        "q_protocol.py",
+        "q_trainer.py",
+        "q_replay.py",
+        "q_latency.py",
+        "q_episode_log.py",
         "visualize.py",
         "requirements.txt",
         "../controllers/q_swarm_controller/q_swarm_controller.h",
         "../controllers/q_swarm_controller/q_swarm_controller.cpp",
+        "../controllers/q_swarm_controller/q_swarm_loop_functions.cpp",
         "../controllers/q_swarm_controller/CMakeLists.txt",
         "../experiments/q_swarm_experiment.argos",
     ]
@@ -190,6 +196,703 @@ def test_argos_installation():
     print("")
 
 
+def test_protocol():
+    """Test binary frame encoding/decoding"""
+    print("=" * 60)
+    print("TEST 6: Testing Binary Protocol")
+    print("=" * 60)
+    
+    try:
+        import q_protocol
+        
+        state = [float(i) * 0.5 for i in range(q_protocol.STATE_SIZE)]
+        frame = q_protocol.encode_state(3, state)
+        header = frame[:q_protocol.HEADER.size]
+        msg_type, robot_id, payload_size = q_protocol.decode_header(header)
+        payload = frame[q_protocol.HEADER.size:]
+        
+        assert msg_type == q_protocol.MSG_STATE
+        assert robot_id == 3
+        assert payload_size == len(payload) == 4 * q_protocol.STATE_SIZE
+        assert q_protocol.decode_state(payload) == state
+        print(f"✓ STATE frame round trip ({len(frame)} bytes)")
+        
+        frame = q_protocol.encode_reward(3, -5.0, True)
+        msg_type, robot_id, payload_size = q_protocol.decode_header(frame[:q_protocol.HEADER.size])
+        assert msg_type == q_protocol.MSG_REWARD
+        assert q_protocol.decode_reward(frame[q_protocol.HEADER.size:]) == (-5.0, True)
+        print(f"✓ REWARD frame round trip ({len(frame)} bytes)")
+        
+        flags = q_protocol.STEP_HAS_PREV | q_protocol.STEP_PREV_DONE
+        frame = q_protocol.encode_step(3, state, 10.0, flags)
+        msg_type, robot_id, payload_size = q_protocol.decode_header(frame[:q_protocol.HEADER.size])
+        assert msg_type == q_protocol.MSG_STEP
+        assert q_protocol.decode_step(frame[q_protocol.HEADER.size:]) == (state, 10.0, flags)
+        print(f"✓ STEP frame round trip ({len(frame)} bytes)")
+        
+        states = [[float(r)] * q_protocol.STATE_SIZE for r in range(5)]
+        frame = q_protocol.encode_batch_step([0, 1, 2, 3, 4], states, [-0.1] * 5, [1] * 5)
+        msg_type, robot_id, payload_size = q_protocol.decode_header(frame[:q_protocol.HEADER.size])
+        robot_ids, batch, prev_rewards, flags = q_protocol.decode_batch_step(frame[q_protocol.HEADER.size:])
+        assert msg_type == q_protocol.MSG_BATCH_STEP
+        assert list(robot_ids) == [0, 1, 2, 3, 4] and batch.shape == (5, q_protocol.STATE_SIZE)
+        assert batch[4][0] == 4.0 and list(flags) == [1] * 5
+        print(f"✓ BATCH_STEP frame round trip ({len(frame)} bytes for 5 robots)")
+
+        # Compact frames: quantized, the goal only in the first frame
+        compact = [3.25, 4.5, 18.0, 17.5] + [0.2] * (q_protocol.STATE_SIZE - 4)
+        goals = {}
+        first = q_protocol.encode_compact_step(3, compact, 10.0, flags | q_protocol.STEP_HAS_GOAL)
+        later = q_protocol.encode_compact_step(3, compact, 10.0, flags)
+        for frame in (first, later):
+            msg_type, robot_id, payload_size = q_protocol.decode_header(frame[:q_protocol.HEADER.size])
+            decoded, prev_reward, decoded_flags = q_protocol.decode_compact_step(
+                frame[q_protocol.HEADER.size:], robot_id, goals)
+            assert msg_type == q_protocol.MSG_COMPACT_STEP and prev_reward == 10.0
+            assert decoded_flags & flags == flags
+            assert max(abs(a - b) for a, b in zip(decoded, compact)) < 0.002
+        assert len(later) < len(first) < len(q_protocol.encode_step(3, compact, 10.0, flags)) // 2
+        try:
+            q_protocol.decode_compact_step(later[q_protocol.HEADER.size:], 4, goals)
+            assert False, "a compact step without a known goal must be rejected"
+        except ValueError:
+            pass
+        frame = q_protocol.encode_compact_batch_step([3, 4], [compact, compact], [-0.1] * 2,
+                                                     [0, q_protocol.STEP_HAS_GOAL])
+        robot_ids, batch, prev_rewards, _ = q_protocol.decode_compact_batch_step(
+            frame[q_protocol.HEADER.size:], goals)
+        assert list(robot_ids) == [3, 4] and abs(batch[1][3] - 17.5) < 0.001
+        print(f"✓ Compact STEP frames round trip ({len(first)}/{len(later)} bytes with/without goal)")
+
+        frame = q_protocol.encode_transitions(states[:2], [1, 3], [-0.1, 10.0], states[1:3], [False, True])
+        msg_type, robot_id, payload_size = q_protocol.decode_header(frame[:q_protocol.HEADER.size])
+        batch, actions, rewards, next_batch, dones = q_protocol.decode_transitions(frame[q_protocol.HEADER.size:])
+        assert msg_type == q_protocol.MSG_TRANSITIONS
+        assert list(actions) == [1, 3] and list(dones) == [0, 1] and rewards[1] == 10.0
+        assert batch[1][0] == 1.0 and next_batch[1][0] == 2.0
+        print(f"✓ TRANSITIONS frame round trip ({len(frame)} bytes for 2 transitions)")
+        
+        frame = q_protocol.encode_weights(7, 0.5, [[1.0, 2.0], [3.0]])
+        version, epsilon, flat = q_protocol.decode_weights(frame[q_protocol.HEADER.size:])
+        assert (version, epsilon) == (7, 0.5) and list(flat) == [1.0, 2.0, 3.0]
+        print(f"✓ WEIGHTS frame round trip ({len(frame)} bytes)")
+        
+        # Must match ShardOf() in q_swarm_endpoints.cpp
+        assert [q_protocol.shard_of(r, 3) for r in range(12)] == [0, 1, 1, 1, 2, 1, 1, 1, 2, 0, 1, 1]
+        print("✓ Robot shards match the controller")
+        
+        assert q_protocol.is_binary(frame) and not q_protocol.is_binary(b"STATE|0")
+        print("✓ Text/binary detection works")
+        
+        # Frames split and merged by TCP come out whole and in order
+        reader = q_protocol.FrameReader()
+        stream = q_protocol.encode_step(1, state, 0.0, 0) + q_protocol.encode_reward(2, 1.0, False)
+        frames = reader.feed(stream[:20]) + reader.feed(stream[20:] + frame[:7])
+        assert [(f[0], f[1]) for f in frames] == [(q_protocol.MSG_STEP, 1), (q_protocol.MSG_REWARD, 2)]
+        frames = reader.feed(frame[7:])
+        assert len(frames) == 1 and frames[0][0] == q_protocol.MSG_BATCH_STEP
+        lines = q_protocol.LineReader()
+        assert lines.feed(b"STATE|1|0.5\nREWARD|1|") == ["STATE|1|0.5"]
+        assert lines.feed(b"-5|1\n") == ["REWARD|1|-5|1"]
+        print("✓ Stream readers reassemble split and merged messages")
+        
+    except Exception as e:
+        print(f"✗ Protocol test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
+def test_policy_export():
+    """Test float and int8 policy export for native inference"""
+    print("=" * 60)
+    print("TEST 7: Testing Policy Export")
+    print("=" * 60)
+    
+    try:
+        import struct
+        import tempfile
+        import numpy as np
+        import export_policy
+        
+        rng = np.random.default_rng(0)
+        dims = [28, 128, 128, 128, 4]
+        state_dict = {}
+        for name, inputs, outputs in zip(export_policy.LAYERS, dims[:-1], dims[1:]):
+            state_dict[f'{name}.weight'] = rng.normal(0, 0.2, (outputs, inputs)).astype(np.float32)
+            state_dict[f'{name}.bias'] = rng.normal(0, 0.1, outputs).astype(np.float32)
+        
+        with tempfile.TemporaryDirectory() as tmp:
+            sizes = {}
+            for int8 in (False, True):
+                path = os.path.join(tmp, f'policy_{int8}.bin')
+                export_policy.export_state_dict(state_dict, path, int8)
+                with open(path, 'rb') as f:
+                    data = f.read()
+                magic, version, num_layers, block_width = struct.unpack_from('<4sIII', data)
+                assert magic == b'QSNN' and version == export_policy.VERSION_PACKED
+                assert num_layers == 4 and block_width == export_policy.BLOCK_WIDTH
+                entry = export_policy.LAYER_ENTRY.unpack_from(data, export_policy.HEADER_SIZE)
+                inputs, outputs, blocks, layer_type, weights_offset = entry[:5]
+                assert (inputs, outputs, blocks) == (28, 128, 16)
+                assert layer_type == (export_policy.LAYER_INT8 if int8 else export_policy.LAYER_FLOAT)
+                assert weights_offset % export_policy.ALIGNMENT == 0
+                # Output 9, input 3 is lane 1 of block 1
+                dtype = np.int8 if int8 else np.float32
+                packed = np.frombuffer(data, dtype=dtype, count=blocks * 8 * inputs, offset=weights_offset)
+                expected = export_policy.quantize(state_dict['fc1.weight'])[1] if int8 else state_dict['fc1.weight']
+                assert packed[(1 * inputs + 3) * 8 + 1] == expected[9, 3]
+                sizes[int8] = len(data)
+        print(f"✓ float32 policy {sizes[False]} bytes, int8 policy {sizes[True]} bytes")
+        
+        states = rng.random((1000, dims[0]), dtype=np.float32)
+        agreement = export_policy.check_agreement(state_dict, states)
+        assert agreement >= 0.95
+        print(f"✓ int8 argmax agreement {agreement * 100:.1f}%")
+        
+    except Exception as e:
+        print(f"✗ Policy export test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
+def test_shared_training():
+    """Test the shared replay buffer and weights of the trainer process"""
+    print("=" * 60)
+    print("TEST 8: Testing Shared Replay Buffer")
+    print("=" * 60)
+    
+    try:
+        import numpy as np
+        import q_trainer
+        
+        name = f"q_swarm_test_{os.getpid()}"
+        writer = q_trainer.SharedReplayBuffer(name + "_replay", capacity=1000, create=True)
+        reader = q_trainer.SharedReplayBuffer(name + "_replay", capacity=1000)
+        try:
+            for i in range(1500):
+                state = np.full(28, i, dtype=np.float32)
+                writer.push(state, i % 4, float(i), state + 1, i % 2 == 0)
+            assert len(reader) == 1000 and reader.written == 1500
+            
+            states, actions, rewards, next_states, dones = reader.sample_batch(64)
+            assert states.shape == (64, 28) and len(actions) == 64
+            # Only recent rows, never the ones about to be overwritten
+            assert rewards.min() >= 500 + q_trainer.OVERWRITE_MARGIN
+            assert np.all(next_states[:, 0] == states[:, 0] + 1)
+            assert np.all(actions == rewards.astype(np.int64) % 4)
+            print("✓ Ring buffer shared between writer and reader")
+            
+            writer.stop()
+            assert reader.stopped
+        finally:
+            reader.close()
+            writer.close(unlink=True)
+        
+        published = q_trainer.SharedWeights(name + "_weights", 10, create=True)
+        seen = q_trainer.SharedWeights(name + "_weights", 10)
+        try:
+            assert seen.read(0) is None
+            published.publish(1, 42, 0.5, np.arange(10, dtype=np.float32))
+            version, updates, epsilon, parameters = seen.read(0)
+            assert (version, updates, epsilon) == (1, 42, 0.5) and parameters[9] == 9.0
+            assert seen.read(1) is None
+            print("✓ Weights published and read back")
+        finally:
+            seen.close()
+            published.close(unlink=True)
+        
+    except Exception as e:
+        print(f"✗ Shared replay buffer test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
+def test_native_replay():
+    """Test the C++ replay buffer (libq_swarm_replay)"""
+    print("=" * 60)
+    print("TEST 9: Testing Native Replay Buffer")
+    print("=" * 60)
+    
+    try:
+        import numpy as np
+        import q_replay
+        
+        try:
+            buffer = q_replay.NativeReplayBuffer(capacity=100, max_batch=64)
+        except OSError:
+            print("⚠ libq_swarm_replay not built, the Python replay buffer is used")
+            print("")
+            return True
+        
+        for i in range(150):
+            state = np.full(28, i, dtype=np.float32)
+            buffer.push(state, i % 4, float(i), state + 1, i % 2 == 0)
+        assert len(buffer) == 100
+        assert [transition[2] for transition in buffer][:2] == [50.0, 51.0]
+        
+        states, actions, rewards, next_states, dones = buffer.sample_batch(64)
+        assert states.shape == (64, 28) and states.dtype == np.float32 and actions.dtype == np.int64
+        assert rewards.min() >= 50 and np.all(next_states[:, 0] == states[:, 0] + 1)
+        assert np.all(actions == rewards.astype(np.int64) % 4)
+        assert np.all(dones == (rewards.astype(np.int64) % 2 == 0))
+        assert len(buffer.sample(200)) == 200
+        print("✓ Push, wrap-around and batch sampling")
+        
+        prioritized = q_replay.NativeReplayBuffer(capacity=1000, max_batch=64, alpha=1.0, priority_epsilon=0.0)
+        for i in range(1000):
+            state = np.full(28, i, dtype=np.float32)
+            prioritized.push(state, 0, float(i), state, False)
+        td_errors = np.ones(1000, dtype=np.float32)
+        td_errors[7] = 64.0
+        prioritized.update_priorities(np.arange(1000), td_errors)
+        hits = 0
+        for _ in range(200):
+            batch = prioritized.sample_prioritized(64, beta=1.0)
+            weights, indices = batch[5], batch[6]
+            assert np.all(batch[2] == indices)
+            hits += int(np.sum(indices == 7))
+            if np.any(indices == 7):
+                # Sampled 64x more often, so weighted 64x less
+                assert abs(weights[indices == 7][0] * 64.0 - weights.max()) < 1e-3
+        frequency = hits / (200 * 64)
+        assert abs(frequency - 64.0 / 1063.0) < 0.02
+        print(f"✓ Prioritized sampling ({frequency * 100:.1f}% of draws for the high-error row)")
+        
+        # Rows with no TD error and eps = 0: finite weights, still sampled
+        td_errors = np.zeros(1000, dtype=np.float32)
+        td_errors[:10] = 1.0
+        prioritized.update_priorities(np.arange(1000), td_errors)
+        weights, indices = prioritized.sample_prioritized(64, beta=1.0)[5:7]
+        assert np.all(np.isfinite(weights)) and weights.max() == 1.0 and weights.min() > 0.0
+        prioritized.update_priorities(np.arange(1000), np.zeros(1000, dtype=np.float32))
+        weights = prioritized.sample_prioritized(64, beta=1.0)[5]
+        assert np.all(weights == 1.0)
+        print("✓ Zero priorities sampled with finite weights")
+        
+    except Exception as e:
+        print(f"✗ Native replay buffer test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
+def test_latency():
+    """Test the latency histograms shared by the server and the controllers"""
+    print("=" * 60)
+    print("TEST 10: Testing Latency Histograms")
+    print("=" * 60)
+    
+    try:
+        import json
+        import tempfile
+        import q_latency
+        
+        histogram = q_latency.LatencyHistogram()
+        for ns in range(100000):
+            histogram.record(ns)
+        # Buckets are within 1/16 of their values
+        for quantile in (0.5, 0.99, 0.999):
+            exact = quantile * 100000
+            assert exact <= histogram.percentile(quantile) <= exact * (1 + 1.0 / 16)
+        assert histogram.percentile(1.0) == histogram.max == 99999
+        assert q_latency.bucket_of(1 << 50) == q_latency.BUCKETS - 1
+        print(f"✓ Percentiles (p99 {histogram.percentile(0.99)} ns of 99000)")
+        
+        stats = q_latency.LatencyStats(('request', 'train'))
+        other = q_latency.LatencyStats(('request', 'train'))
+        stats.phases['request'].record(2000)
+        other.phases['request'].record(4000)
+        stats.merge(other)
+        summary = stats.summary()
+        assert list(summary) == ['request'] and summary['request']['count'] == 2
+        
+        directory = tempfile.mkdtemp()
+        csv_path = os.path.join(directory, "latency.csv")
+        json_path = os.path.join(directory, "latency.json")
+        for episodes, truncate in ((4, True), (8, False)):
+            stats.write(csv_path, episodes, truncate)
+            stats.write(json_path, episodes, truncate)
+        with open(csv_path) as f:
+            lines = f.read().splitlines()
+        assert lines[0] == q_latency.CSV_HEADER.strip() and lines[2].startswith("8,request,2,3,")
+        with open(json_path) as f:
+            rows = [json.loads(line) for line in f]
+        assert [row['episodes'] for row in rows] == [4, 8]
+        assert rows[1]['phases']['request']['max_us'] == 4.0
+        print("✓ Merge, CSV and JSON lines output")
+        
+    except Exception as e:
+        print(f"✗ Latency histogram test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
+def test_episode_log():
+    """Test reading and tailing the loop functions' episode log"""
+    print("=" * 60)
+    print("TEST 11: Testing Episode Log")
+    print("=" * 60)
+    
+    try:
+        import tempfile
+        import q_episode_log
+        
+        assert q_episode_log.HEADER.size == 64 and q_episode_log.RECORD.size == 32
+        
+        def record(i):
+            return q_episode_log.RECORD.pack(1700000000000 + i, i % 3, i, 100 + i, i * 0.5,
+                                             q_episode_log.OUTCOME_GOAL, 0, 0)
+        
+        header = q_episode_log.HEADER.pack(q_episode_log.MAGIC, q_episode_log.VERSION,
+                                           q_episode_log.RECORD.size)
+        directory = tempfile.mkdtemp()
+        path = os.path.join(directory, "episodes.qse")
+        with open(path, 'wb') as f:
+            f.write(header + record(0) + record(1))
+        
+        tail = q_episode_log.EpisodeLogTail(path)
+        assert [r.episode for r in tail.poll()] == [0, 1]
+        assert tail.poll() == []
+        
+        # Records appended in pieces are returned once complete
+        with open(path, 'ab') as f:
+            f.write(record(2)[:10])
+            f.flush()
+            assert tail.poll() == []
+            f.write(record(2)[10:])
+        assert [r.steps for r in tail.poll()] == [102]
+        
+        # Rotation: the rest of the old file, then the new one
+        with open(path, 'ab') as f:
+            f.write(record(3))
+        os.rename(path, path + ".1")
+        with open(path, 'wb') as f:
+            f.write(header + record(4))
+        assert [r.episode for r in tail.poll()] == [3, 4]
+        tail.close()
+        print("✓ Tail returns new records only and follows rotation")
+        
+        records = q_episode_log.read_log(path)
+        assert [r.episode for r in records] == [0, 1, 2, 3, 4]
+        assert records[1].reward == 0.5 and records[1].robot_id == 1
+        print(f"✓ Rotated files read oldest first ({len(records)} episodes)")
+        
+    except Exception as e:
+        print(f"✗ Episode log test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
+def test_policy_reload():
+    """Test that a batch policy is reloaded only at an episode boundary"""
+    print("=" * 60)
+    print("TEST 12: Testing Policy Reload at Episode Boundaries")
+    print("=" * 60)
+    
+    try:
+        import random
+        import shutil
+        import struct
+        import subprocess
+        import tempfile
+        
+        compiler = shutil.which("c++") or shutil.which("g++")
+        if compiler is None:
+            print("⚠ No C++ compiler, skipped")
+            print("")
+            return True
+        
+        # Ticks of the loop functions' batch (StepBatch): "<episode counters> ; <batch size>"
+        # per tick in, "<reloaded> <weights changed> <q0>" out
+        driver = r"""
+#include "q_swarm_policy.h"
+#include <iostream>
+#include <sstream>
+using namespace argos;
+int main(int argc, char** argv) {
+   CQSwarmPolicy cPolicy;
+   std::string strError;
+   if (argc < 2 || !cPolicy.Load(argv[1], strError)) {
+      std::cerr << strError << std::endl;
+      return 1;
+   }
+   std::vector<float> vecState(cPolicy.GetInputSize(), 0.5f);
+   std::vector<float> vecQ(cPolicy.GetOutputSize());
+   CQSwarmEpisodeBoundaries cBoundaries;
+   std::string strLine;
+   for (bool bFirst = true; std::getline(std::cin, strLine); bFirst = false) {
+      std::istringstream cLine(strLine);
+      std::vector<int> vecEpisodes;
+      for (int nEpisode; cLine >> nEpisode; ) {
+         vecEpisodes.push_back(nEpisode);
+      }
+      cLine.clear();
+      char cSeparator;
+      size_t unBatch = 0;
+      cLine >> cSeparator >> unBatch;
+      if (bFirst) {
+         cBoundaries.Resize(vecEpisodes.size());
+      }
+      for (size_t i = 0; i < vecEpisodes.size(); ++i) {
+         cBoundaries.Update(i, vecEpisodes[i]);
+      }
+      // Robots that reset this tick are not in the batch
+      bool bReloaded = false;
+      bool bChanged = false;
+      if (unBatch > 0 && cBoundaries.IsReloadDue()) {
+         if (!cPolicy.Reload(bChanged, strError)) {
+            std::cerr << strError << std::endl;
+            return 1;
+         }
+         cBoundaries.Reloaded();
+         bReloaded = true;
+      }
+      cPolicy.Forward(&vecState[0], &vecQ[0]);
+      std::cout << bReloaded << " " << bChanged << " " << vecQ[0] << std::endl;
+   }
+   return 0;
+}
+"""
+        source_dir = os.path.abspath("../controllers/q_swarm_controller")
+        rng = random.Random(0)
+        dims = [28, 128, 128, 128, 4]
+        
+        def write_policy(path):
+            # Version 1 (float32) weights file, see q_swarm_policy.h
+            data = b'QSNN' + struct.pack('<II', 1, len(dims) - 1)
+            for inputs, outputs in zip(dims[:-1], dims[1:]):
+                values = [rng.gauss(0, 0.2) for _ in range(outputs * (inputs + 1))]
+                data += struct.pack('<II', inputs, outputs) + struct.pack(f'<{len(values)}f', *values)
+            with open(path, 'wb') as f:
+                f.write(data)
+        
+        with tempfile.TemporaryDirectory() as tmp:
+            binary = os.path.join(tmp, "reload_driver")
+            with open(binary + ".cpp", 'w') as f:
+                f.write(driver)
+            sources = [os.path.join(source_dir, name) for name in
+                       ("q_swarm_policy.cpp", "q_swarm_policy_registry.cpp", "q_swarm_kernels.cpp",
+                        "q_swarm_protocol.cpp")]
+            subprocess.run([compiler, "-std=c++11", "-O1", "-pthread", "-I", source_dir,
+                            "-o", binary, binary + ".cpp"] + sources, check=True)
+            
+            path = os.path.join(tmp, "policy.bin")
+            write_policy(path)
+            process = subprocess.Popen([binary, path], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                       text=True)
+            
+            def tick(episodes, batch=None):
+                batch = len(episodes) if batch is None else batch
+                process.stdin.write(" ".join(str(e) for e in episodes) + f" ; {batch}\n")
+                process.stdin.flush()
+                reloaded, changed, q0 = process.stdout.readline().split()
+                return reloaded == "1", changed == "1", float(q0)
+            
+            try:
+                # Robot 0 has finished its episodes (never in the batch),
+                # robots 1 and 2 are mid-episode
+                _, _, q_old = tick([5, 2, 3], 2)
+                replacement = os.path.join(tmp, "policy.tmp")
+                write_policy(replacement)
+                os.replace(replacement, path)
+                for _ in range(3):
+                    reloaded, changed, q0 = tick([5, 2, 3], 2)
+                    assert not reloaded and not changed and q0 == q_old
+                print("✓ Replaced file not picked up while no robot starts an episode")
+                
+                reloaded, changed, q_new = tick([5, 3, 3], 1)
+                assert reloaded and changed and q_new != q_old
+                reloaded, changed, _ = tick([5, 3, 3], 2)
+                assert not reloaded and not changed
+                print("✓ Replaced file picked up when robot 1 starts its next episode")
+                
+                # Robots 1 and 2 reset on the same tick: empty batch, then
+                # the boundary is honoured on the next tick
+                write_policy(replacement)
+                os.replace(replacement, path)
+                reloaded, changed, q0 = tick([5, 4, 4], 0)
+                assert not reloaded and q0 == q_new
+                reloaded, changed, q0 = tick([5, 4, 4], 2)
+                assert reloaded and changed and q0 != q_new
+                print("✓ Boundary of a tick where every robot reset is kept for the next batch")
+            finally:
+                process.stdin.close()
+                process.wait()
+        
+    except Exception as e:
+        print(f"✗ Policy reload test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
+def test_kernel_agreement():
+    """Test that the SIMD inference kernels agree with the scalar one"""
+    print("=" * 60)
+    print("TEST 13: Testing SIMD Kernel Agreement")
+    print("=" * 60)
+    
+    try:
+        import platform
+        import random
+        import shutil
+        import struct
+        import subprocess
+        import tempfile
+        
+        compiler = shutil.which("c++") or shutil.which("g++")
+        if compiler is None:
+            print("⚠ No C++ compiler, skipped")
+            print("")
+            return True
+        
+        # Q-values and greedy actions of every kernel against the scalar one:
+        # "<kernel> <largest error> <argmax mismatches>" per available kernel
+        driver = r"""
+#include "q_swarm_policy.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+using namespace argos;
+int main(int argc, char** argv) {
+   CQSwarmPolicy cPolicy;
+   std::string strError;
+   if (argc < 4 || !cPolicy.Load(argv[1], strError)) {
+      std::cerr << strError << std::endl;
+      return 1;
+   }
+   size_t unInputs = cPolicy.GetInputSize();
+   size_t unOutputs = cPolicy.GetOutputSize();
+   size_t unCount = std::atoi(argv[2]);
+   float fTolerance = static_cast<float>(std::atof(argv[3]));
+   std::vector<float> vecInputs(unCount * unInputs);
+   srand(1);
+   for (size_t i = 0; i < vecInputs.size(); ++i) {
+      vecInputs[i] = static_cast<float>(rand()) / RAND_MAX * 2.0f - 1.0f;
+   }
+
+   // Reference: one input at a time through the scalar kernel
+   cPolicy.SetKernel("scalar");
+   std::vector<float> vecReference(unCount * unOutputs);
+   for (size_t i = 0; i < unCount; ++i) {
+      cPolicy.Forward(&vecInputs[i * unInputs], &vecReference[i * unOutputs]);
+   }
+
+   const char* pcKernels[] = { "scalar", "sse", "avx2", "neon" };
+   for (size_t k = 0; k < sizeof(pcKernels) / sizeof(pcKernels[0]); ++k) {
+      if (QSwarmKernels::FindKernel(pcKernels[k]) == NULL) {
+         continue;
+      }
+      cPolicy.SetKernel(pcKernels[k]);
+      std::vector<float> vecQ(unCount * unOutputs);
+      std::vector<int> vecActions(unCount);
+      cPolicy.ForwardBatch(&vecInputs[0], unCount, &vecQ[0]);
+      cPolicy.SelectActions(&vecInputs[0], unCount, &vecActions[0]);
+      float fError = 0.0f;
+      size_t unMismatches = 0;
+      for (size_t i = 0; i < unCount; ++i) {
+         const float* pfReference = &vecReference[i * unOutputs];
+         for (size_t j = 0; j < unOutputs; ++j) {
+            fError = std::max(fError, std::fabs(vecQ[i * unOutputs + j] - pfReference[j]) /
+                                      std::max(1.0f, std::fabs(pfReference[j])));
+         }
+         // Only a clear winner must be the same (near ties may round apart)
+         size_t unBest = std::max_element(pfReference, pfReference + unOutputs) - pfReference;
+         bool bClear = true;
+         for (size_t j = 0; j < unOutputs; ++j) {
+            if (j != unBest && pfReference[unBest] - pfReference[j] <= fTolerance) {
+               bClear = false;
+            }
+         }
+         if (bClear && vecActions[i] != static_cast<int>(unBest)) {
+            ++unMismatches;
+         }
+      }
+      std::cout << pcKernels[k] << " " << fError << " " << unMismatches << std::endl;
+   }
+   return 0;
+}
+"""
+        source_dir = os.path.abspath("../controllers/q_swarm_controller")
+        rng = random.Random(0)
+        # Widths that are not multiples of the kernels' block width (8)
+        dims = [28, 37, 130, 19, 5]
+        tolerance = 1e-4
+        
+        def write_policy(path, version):
+            # Version 1 (float32) or 2 (int8, per-output scale) weights file,
+            # see q_swarm_policy.h
+            data = b'QSNN' + struct.pack('<II', version, len(dims) - 1)
+            for inputs, outputs in zip(dims[:-1], dims[1:]):
+                data += struct.pack('<II', inputs, outputs)
+                if version == 1:
+                    weights = [rng.gauss(0, 0.2) for _ in range(outputs * inputs)]
+                    data += struct.pack(f'<{len(weights)}f', *weights)
+                else:
+                    scales = [rng.uniform(0.001, 0.005) for _ in range(outputs)]
+                    weights = [rng.randint(-127, 127) for _ in range(outputs * inputs)]
+                    data += struct.pack(f'<{outputs}f', *scales)
+                    data += struct.pack(f'<{len(weights)}b', *weights)
+                biases = [rng.gauss(0, 0.1) for _ in range(outputs)]
+                data += struct.pack(f'<{outputs}f', *biases)
+            with open(path, 'wb') as f:
+                f.write(data)
+        
+        with tempfile.TemporaryDirectory() as tmp:
+            binary = os.path.join(tmp, "kernel_driver")
+            with open(binary + ".cpp", 'w') as f:
+                f.write(driver)
+            sources = [os.path.join(source_dir, name) for name in
+                       ("q_swarm_policy.cpp", "q_swarm_policy_registry.cpp", "q_swarm_kernels.cpp",
+                        "q_swarm_protocol.cpp")]
+            flags = ["-std=c++11", "-O1", "-pthread", "-I", source_dir]
+            # The AVX2 kernel is built with its own flags, as in CMakeLists.txt
+            if platform.machine().lower() in ("x86_64", "amd64"):
+                avx2_object = os.path.join(tmp, "q_swarm_kernels_avx2.o")
+                subprocess.run([compiler] + flags + ["-mavx2", "-mfma", "-c", "-o", avx2_object,
+                                os.path.join(source_dir, "q_swarm_kernels_avx2.cpp")], check=True)
+                sources.append(avx2_object)
+                flags.append("-DQ_SWARM_HAVE_AVX2")
+            subprocess.run([compiler] + flags + ["-o", binary, binary + ".cpp"] + sources,
+                           check=True)
+            
+            for version, label in ((1, "float32"), (2, "int8")):
+                path = os.path.join(tmp, f"policy_v{version}.bin")
+                write_policy(path, version)
+                result = subprocess.run([binary, path, "64", str(tolerance)],
+                                        capture_output=True, text=True, check=True)
+                kernels = []
+                for line in result.stdout.split("\n"):
+                    if not line:
+                        continue
+                    name, error, mismatches = line.split()
+                    assert float(error) <= tolerance, f"{name} {label} Q-values off by {error}"
+                    assert int(mismatches) == 0, f"{name} {label} picks other actions"
+                    kernels.append(name)
+                assert "scalar" in kernels
+                print(f"✓ {label} weights: {', '.join(kernels)} agree with scalar")
+        
+    except Exception as e:
+        print(f"✗ Kernel agreement test failed: {e}")
+        return False
+    
+    print("")
+    return True
+
+
 def run_all_tests():
     """Run all tests"""
     print("\n" + "=" * 60)
@@ -203,6 +906,14 @@ def run_all_tests():
     results.append(("Socket Server", test_socket_server()))
     results.append(("File Structure", test_file_structure()))
     results.append(("ARGoS Installation", test_argos_installation()))
+    results.append(("Binary Protocol", test_protocol()))
+    results.append(("Policy Export", test_policy_export()))
+    results.append(("Shared Replay Buffer", test_shared_training()))
+    results.append(("Native Replay Buffer", test_native_replay()))
+    results.append(("Latency Histograms", test_latency()))
+    results.append(("Episode Log", test_episode_log()))
+    results.append(("Policy Reload", test_policy_reload()))
+    results.append(("SIMD Kernel Agreement", test_kernel_agreement()))
     
     # Summary
     print("=" * 60)
@@ -9,9 +9,29 @@ import json
 import matplotlib.pyplot as plt
 import numpy as np
 import os
+import time
 
+import q_episode_log
 
-def plot_training_curve(data_file="../models/training_data.json"):
+EPISODE_LOG = "../models/episodes.qse"
+
+
+def load_training_data(data_file):
+    """
+    Training data of the server's JSON file, or of an episode log
+    (episode_log on the loop functions, with its rotated files)
+    """
+    if data_file.endswith('.json'):
+        with open(data_file, 'r') as f:
+            return json.load(f)
+    records = q_episode_log.read_log(data_file)
+    return {
+        'episode_rewards': [record.reward for record in records],
+        'outcomes': [record.outcome for record in records],
+    }
+
+
+def plot_training_curve(data_file=EPISODE_LOG):
     """Plot the training reward curve"""
     
     if not os.path.exists(data_file):
@@ -19,8 +39,7 @@ def plot_training_curve(data_file="../models/training_data.json"):
         return
     
     # Load training data
-    with open(data_file, 'r') as f:
-        data = json.load(f)
+    data = load_training_data(data_file)
     
     episode_rewards = data['episode_rewards']
     
@@ -62,23 +81,32 @@ def plot_training_curve(data_file="../models/training_data.json"):
     plt.show()
 
 
-def analyze_statistics(data_file="../models/training_data.json"):
+def analyze_statistics(data_file=EPISODE_LOG):
     """Print detailed statistics about training"""
     
     if not os.path.exists(data_file):
         print(f"Error: {data_file} not found. Run training first.")
         return
     
-    with open(data_file, 'r') as f:
-        data = json.load(f)
+    data = load_training_data(data_file)
     
     rewards = np.array(data['episode_rewards'])
+    if len(rewards) == 0:
+        print(f"No episodes in {data_file} yet.")
+        return
     
     print("\n" + "=" * 60)
     print("TRAINING ANALYSIS")
     print("=" * 60)
     print(f"Total Episodes: {len(rewards)}")
-    print(f"Final Epsilon: {data['final_epsilon']:.4f}")
+    if 'final_epsilon' in data:
+        print(f"Final Epsilon: {data['final_epsilon']:.4f}")
+    if 'outcomes' in data:
+        for outcome in (q_episode_log.OUTCOME_GOAL, q_episode_log.OUTCOME_COLLISION,
+                        q_episode_log.OUTCOME_TIMEOUT):
+            count = data['outcomes'].count(outcome)
+            print(f"  {q_episode_log.OUTCOME_NAMES[outcome].capitalize()}: "
+                  f"{count} ({100.0 * count / len(rewards):.1f}%)")
     print(f"\nReward Statistics:")
     print(f"  Mean: {np.mean(rewards):.2f}")
     print(f"  Std Dev: {np.std(rewards):.2f}")
@@ -128,10 +156,7 @@ def compare_training_runs(*data_files):
             print(f"Warning: {data_file} not found, skipping...")
             continue
         
-        with open(data_file, 'r') as f:
-            data = json.load(f)
-        
-        rewards = data['episode_rewards']
+        rewards = load_training_data(data_file)['episode_rewards']
         
         # Calculate moving average
         window_size = 50
@@ -156,6 +181,56 @@ def compare_training_runs(*data_files):
     plt.show()
 
 
+def follow_training(log_file=EPISODE_LOG, interval=1.0, window_size=50):
+    """
+    Live training curve of a running experiment: only the episodes
+    appended to the episode log since the last refresh are read
+    """
+    tail = q_episode_log.EpisodeLogTail(log_file)
+    rewards = []
+    goals = []
+    
+    plt.ion()
+    figure, (reward_axis, goal_axis) = plt.subplots(1, 2, figsize=(12, 6))
+    print(f"Following {log_file} (Ctrl+C to stop)")
+    try:
+        while plt.fignum_exists(figure.number):
+            records = tail.poll()
+            if records:
+                rewards.extend(record.reward for record in records)
+                goals.extend(record.outcome == q_episode_log.OUTCOME_GOAL for record in records)
+                
+                # Moving averages from cumulative sums (whole history, no re-read)
+                window = min(window_size, len(rewards))
+                reward_sums = np.cumsum(rewards)
+                goal_sums = np.cumsum(goals)
+                reward_avg = (reward_sums[window - 1:] - np.concatenate(([0], reward_sums[:-window]))) / window
+                goal_avg = (goal_sums[window - 1:] - np.concatenate(([0], goal_sums[:-window]))) / window
+                episodes = np.arange(window - 1, len(rewards))
+                
+                reward_axis.clear()
+                reward_axis.plot(rewards, alpha=0.3, label='Episode Reward')
+                reward_axis.plot(episodes, reward_avg, linewidth=2,
+                                 label=f'Moving Average ({window} episodes)')
+                reward_axis.set_xlabel('Episode')
+                reward_axis.set_ylabel('Total Reward')
+                reward_axis.set_title(f'Training Progress ({len(rewards)} episodes)')
+                reward_axis.legend()
+                reward_axis.grid(True, alpha=0.3)
+                
+                goal_axis.clear()
+                goal_axis.plot(episodes, 100.0 * goal_avg, linewidth=2)
+                goal_axis.set_xlabel('Episode')
+                goal_axis.set_ylabel('Goals (%)')
+                goal_axis.set_title(f'Goal Rate ({window} episodes)')
+                goal_axis.grid(True, alpha=0.3)
+            plt.pause(interval)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        tail.close()
+
+
 if __name__ == "__main__":
     import sys
     
@@ -163,9 +238,11 @@ if __name__ == "__main__":
     
     if len(sys.argv) > 1:
         if sys.argv[1] == "plot":
-            plot_training_curve()
+            plot_training_curve(*sys.argv[2:3])
         elif sys.argv[1] == "stats":
-            analyze_statistics()
+            analyze_statistics(*sys.argv[2:3])
+        elif sys.argv[1] == "follow":
+            follow_training(*sys.argv[2:3])
         elif sys.argv[1] == "test":
             test_trained_model()
         elif sys.argv[1] == "compare":
@@ -174,12 +251,14 @@ if __name__ == "__main__":
             else:
                 print("Usage: python visualize.py compare <file1> <file2> ...")
         else:
-            print("Unknown command. Use: plot, stats, test, or compare")
+            print("Unknown command. Use: plot, stats, follow, test, or compare")
     else:
         print("Usage:")
-        print("  python visualize.py plot     - Plot training curve")
-        print("  python visualize.py stats    - Show statistics")
-        print("  python visualize.py test     - Test trained model")
+        print("  python visualize.py plot [file]   - Plot training curve")
+        print("  python visualize.py stats [file]  - Show statistics")
+        print("  python visualize.py follow [log]  - Live training curve of a running experiment")
+        print("  python visualize.py test          - Test trained model")
         print("  python visualize.py compare <files...> - Compare multiple runs")
+        print(f"\nFiles are episode logs (default {EPISODE_LOG}) or the server's training_data.json")
         print("\nRunning default: plot")
         plot_training_curve()